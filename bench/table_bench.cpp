@@ -0,0 +1,559 @@
+// Micro-benchmarks of the conversion, serialization, write and catalog
+// paths, over synthetic tables. Besides the Google Benchmark flags it takes
+//   --rows=N[,N...]     table sizes (default 1024,16384,131072)
+//   --columns=N[,N...]  schema widths including the id column (default 8)
+//   --fanout=N[,N...]   children per tree node, 0 for a flat table (default 0,16)
+// and runs every table benchmark once per combination.
+
+#include "arrow_ipc.h"
+#include "data_store.h"
+#include "metrics.h"
+#include "procedural_table.h"
+#include "proto_convert.h"
+#include "rest_json.h"
+#include "snapshot.h"
+#include "text_search.h"
+#include "wal.h"
+
+#include <benchmark/benchmark.h>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+namespace {
+
+struct Shape {
+    std::size_t rows;
+    std::size_t columns;
+    std::size_t fanout;
+
+    std::string name() const {
+        return "rows:" + std::to_string(rows) + "/columns:" + std::to_string(columns) +
+               "/fanout:" + std::to_string(fanout);
+    }
+};
+
+constexpr ColumnType kTypes[] = {ColumnType::String, ColumnType::Number, ColumnType::Currency, ColumnType::Bool};
+
+// Column 0 is the string primary key; the others cycle through the types,
+// starting with Number so that "c1" always carries a roll-up.
+ColumnType columnType(std::size_t c) {
+    return kTypes[c % 4];
+}
+
+ColumnDef columnDef(std::string id, ColumnType type) {
+    return {id, id, type, 120, false, false, true, false};
+}
+
+CellValue sampleValue(ColumnType type, std::uint32_t n) {
+    switch (type) {
+    case ColumnType::String:
+        return "item " + std::to_string(n % 512);
+    case ColumnType::Number:
+        return static_cast<int>(n % 1000);
+    case ColumnType::Currency:
+        return static_cast<double>(n % 100000) / 100.0;
+    case ColumnType::Bool:
+        return (n & 1) != 0;
+    }
+    return nullptr;
+}
+
+std::string rowId(std::size_t i) { return "r" + std::to_string(i); }
+
+// Rows are appended parents first; with a fan-out of f, row i hangs under
+// row (i - 1) / f, so the tree is log_f(rows) deep.
+Table makeTable(const Shape& shape) {
+    Table table;
+    table.id = "bench";
+    table.name = "Bench";
+    table.primary_key = "id";
+    table.parent_key = shape.fanout ? "parent" : "";
+
+    std::vector<ColumnDef> schema{{"id", "ID", ColumnType::String, 120, true, true, false, true}};
+    for (std::size_t c = 1; c < shape.columns; ++c) {
+        schema.push_back(columnDef("c" + std::to_string(c), columnType(c)));
+    }
+    table.setSchema(schema);
+
+    std::mt19937 random(42);
+    std::vector<std::pair<std::string, CellValue>> cells;
+    for (std::size_t i = 0; i < shape.rows; ++i) {
+        const std::string id = rowId(i);
+        cells.clear();
+        cells.emplace_back("id", id);
+        for (std::size_t c = 1; c < shape.columns; ++c) {
+            cells.emplace_back(schema[c].id, sampleValue(schema[c].type, random()));
+        }
+        std::optional<std::string> parent;
+        if (shape.fanout && i > 0) parent = rowId((i - 1) / shape.fanout);
+        table.appendRow(id, parent, cells);
+    }
+    return table;
+}
+
+// Tables are built once per shape and shared by the benchmarks.
+std::shared_ptr<const Table> sharedTable(const Shape& shape) {
+    static std::mutex mutex;
+    static std::map<std::tuple<std::size_t, std::size_t, std::size_t>, std::shared_ptr<const Table>> tables;
+    std::lock_guard lock(mutex);
+    auto& table = tables[{shape.rows, shape.columns, shape.fanout}];
+    if (!table) table = std::make_shared<Table>(makeTable(shape));
+    return table;
+}
+
+class TempDirectory {
+public:
+    TempDirectory() {
+        std::string pattern = (std::filesystem::temp_directory_path() / "table_bench.XXXXXX").string();
+        if (!::mkdtemp(pattern.data())) {
+            std::cerr << "Cannot create a temporary directory" << std::endl;
+            std::exit(1);
+        }
+        path_ = pattern;
+    }
+    ~TempDirectory() {
+        std::error_code ignored;
+        std::filesystem::remove_all(path_, ignored);
+    }
+
+    TempDirectory(const TempDirectory&) = delete;
+    TempDirectory& operator=(const TempDirectory&) = delete;
+
+    const std::string& path() const { return path_; }
+
+private:
+    std::string path_;
+};
+
+void setRowCounters(benchmark::State& state, std::size_t rows, std::size_t bytes) {
+    state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations() * rows));
+    state.SetBytesProcessed(static_cast<std::int64_t>(state.iterations() * bytes));
+}
+
+// Single values; the argument indexes kTypes.
+
+void BM_ToProtoValue(benchmark::State& state) {
+    const ColumnType type = kTypes[state.range(0)];
+    const CellValue value = sampleValue(type, 12345);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(toProtoValue(value));
+    }
+    state.SetLabel(toString(type));
+}
+BENCHMARK(BM_ToProtoValue)->DenseRange(0, 3);
+
+void BM_ParseProtoValueForColumn(benchmark::State& state) {
+    const ColumnType type = kTypes[state.range(0)];
+    const ColumnDef column = columnDef("c", type);
+    const tables::Value proto = toProtoValue(sampleValue(type, 12345));
+    std::string error;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(parseProtoValueForColumn(proto, column, error));
+    }
+    state.SetLabel(toString(type));
+}
+BENCHMARK(BM_ParseProtoValueForColumn)->DenseRange(0, 3);
+
+// Includes reading the body, as the cell update route does.
+void BM_ParseJsonValueForColumn(benchmark::State& state) {
+    static const char* const kBodies[] = {
+        R"({"value":"item 345"})",
+        R"({"value":345})",
+        R"({"value":123.45})",
+        R"({"value":true})",
+    };
+    const ColumnType type = kTypes[state.range(0)];
+    const ColumnDef column = columnDef("c", type);
+    const std::string body = kBodies[state.range(0)];
+    std::string error;
+    for (auto _ : state) {
+        const auto json = crow::json::load(body);
+        benchmark::DoNotOptimize(parseJsonValueForColumn(json["value"], column, error));
+    }
+    state.SetLabel(toString(type));
+}
+BENCHMARK(BM_ParseJsonValueForColumn)->DenseRange(0, 3);
+
+// Whole tables.
+
+void BM_FillProtoSchema(benchmark::State& state, Shape shape) {
+    const auto table = sharedTable(shape);
+    for (auto _ : state) {
+        tables::TableSchema schema;
+        fillProtoSchema(*table, &schema);
+        benchmark::DoNotOptimize(schema);
+    }
+}
+
+void BM_BuildRowsJson(benchmark::State& state, Shape shape) {
+    const auto table = sharedTable(shape);
+    std::size_t bytes = 0;
+    for (auto _ : state) {
+        const std::string json = buildRowsJson(*table);
+        bytes = json.size();
+        benchmark::DoNotOptimize(json.data());
+    }
+    setRowCounters(state, shape.rows, bytes);
+}
+
+// The /data body for an Arrow client, against BM_BuildRowsJson for a JSON
+// one.
+void BM_ArrowStream(benchmark::State& state, Shape shape) {
+    const auto table = sharedTable(shape);
+    std::size_t bytes = 0;
+    for (auto _ : state) {
+        const std::string arrow = encodeArrow(table, ArrowFormat::Stream);
+        bytes = arrow.size();
+        benchmark::DoNotOptimize(arrow.data());
+    }
+    setRowCounters(state, shape.rows, bytes);
+}
+
+// The body GetData sends when the response cache misses.
+void BM_GetDataResponse(benchmark::State& state, Shape shape) {
+    const auto table = sharedTable(shape);
+    std::size_t bytes = 0;
+    for (auto _ : state) {
+        const std::string wire = serializeDataResponse(*table);
+        bytes = wire.size();
+        benchmark::DoNotOptimize(wire.data());
+    }
+    setRowCounters(state, shape.rows, bytes);
+}
+
+void BM_GetColumnarDataResponse(benchmark::State& state, Shape shape) {
+    const auto table = sharedTable(shape);
+    std::size_t bytes = 0;
+    for (auto _ : state) {
+        const std::string wire = serializeColumnarData(*table, 0, shape.rows);
+        bytes = wire.size();
+        benchmark::DoNotOptimize(wire.data());
+    }
+    setRowCounters(state, shape.rows, bytes);
+}
+
+// Substring searches of every String column (the row ids and "item n"
+// values), ranked and limited as the Search RPC runs them.
+void searchTable(benchmark::State& state, const Table& table, std::size_t rows) {
+    static constexpr std::string_view kQueries[] = {"item 42", "r1234", "m 7", "R99"};
+    std::size_t i = 0;
+    std::size_t matches = 0;
+    for (auto _ : state) {
+        SearchSpec spec;
+        spec.text = kQueries[i++ % std::size(kQueries)];
+        const SearchResult result = runSearch(table, spec);
+        matches += result.match_count;
+        benchmark::DoNotOptimize(result.hits.data());
+    }
+    setRowCounters(state, rows, 0);
+    state.counters["matches"] = benchmark::Counter(static_cast<double>(matches), benchmark::Counter::kAvgIterations);
+}
+
+void BM_Search(benchmark::State& state, Shape shape) {
+    Table table = *sharedTable(shape);
+    table.buildTextIndexes();
+    searchTable(state, table, shape.rows);
+}
+
+// The same searches without text indexes: every row is a candidate.
+void BM_SearchScan(benchmark::State& state, Shape shape) {
+    searchTable(state, *sharedTable(shape), shape.rows);
+}
+
+// One chunk of a 100M-row procedural table, as GetData and /data
+// materialize it; the argument is the fan-out.
+void BM_ProceduralRows(benchmark::State& state) {
+    const ProceduralSpec spec{100'000'000, static_cast<std::uint32_t>(state.range(0)), 1};
+    const Table header = makeSyntheticTable(spec);
+    std::mt19937_64 rng(1);
+    std::uniform_int_distribution<std::size_t> first(0, spec.rows - ProceduralTable::kChunkRows);
+    for (auto _ : state) {
+        const std::size_t begin = first(rng);
+        const auto rows = header.procedural->rows(header, begin, begin + ProceduralTable::kChunkRows);
+        benchmark::DoNotOptimize(rows.get());
+    }
+    setRowCounters(state, ProceduralTable::kChunkRows, 0);
+}
+BENCHMARK(BM_ProceduralRows)->Arg(0)->Arg(16);
+
+// Edits a Number column at random rows, so every update also walks the
+// roll-ups of the row's ancestors and publishes a new table version.
+void BM_UpdateCell(benchmark::State& state, Shape shape) {
+    if (shape.columns < 2) {
+        state.SkipWithError("needs a Number column");
+        return;
+    }
+    DataStore db;
+    std::string error;
+    if (!db.putTable(*sharedTable(shape), error)) {
+        state.SkipWithError(error.c_str());
+        return;
+    }
+    std::vector<std::string> ids;
+    for (std::size_t i = 0; i < shape.rows; ++i) ids.push_back(rowId(i));
+
+    std::mt19937 random(7);
+    for (auto _ : state) {
+        const std::string& id = ids[random() % ids.size()];
+        if (!db.updateCell("bench", id, "c1", static_cast<int>(random() % 1000), error)) {
+            state.SkipWithError(error.c_str());
+            break;
+        }
+    }
+    state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations()));
+}
+
+void BM_SnapshotWrite(benchmark::State& state, Shape shape) {
+    const TempDirectory directory;
+    const std::string path = directory.path() + "/snapshot";
+    const std::vector<std::shared_ptr<const Table>> tables{sharedTable(shape)};
+    std::string error;
+    for (auto _ : state) {
+        if (!writeSnapshot(path, tables, 0, error)) {
+            state.SkipWithError(error.c_str());
+            break;
+        }
+    }
+    std::error_code ignored;
+    setRowCounters(state, shape.rows, static_cast<std::size_t>(std::filesystem::file_size(path, ignored)));
+}
+
+// The restart path: map the snapshot and rebuild the tables from it.
+void BM_SnapshotLoad(benchmark::State& state, Shape shape) {
+    const TempDirectory directory;
+    const std::string path = directory.path() + "/snapshot";
+    std::string error;
+    if (!writeSnapshot(path, {sharedTable(shape)}, 0, error)) {
+        state.SkipWithError(error.c_str());
+        return;
+    }
+    for (auto _ : state) {
+        auto snapshot = loadSnapshot(path, error);
+        if (!snapshot) {
+            state.SkipWithError(error.c_str());
+            break;
+        }
+        benchmark::DoNotOptimize(snapshot->tables.data());
+    }
+    std::error_code ignored;
+    setRowCounters(state, shape.rows, static_cast<std::size_t>(std::filesystem::file_size(path, ignored)));
+}
+
+// One single-cell batch per append, acknowledged as UpdateCell would be.
+// With several threads the appends share group commits. The argument is
+// the SyncPolicy.
+void BM_WalAppend(benchmark::State& state) {
+    static std::unique_ptr<TempDirectory> directory;
+    static std::unique_ptr<WriteAheadLog> log;
+    const auto sync = static_cast<SyncPolicy>(state.range(0));
+    if (state.thread_index() == 0) {
+        directory = std::make_unique<TempDirectory>();
+        std::string error;
+        log = WriteAheadLog::open(directory->path(), 1, sync, std::chrono::milliseconds(100), error);
+        if (!log) state.SkipWithError(error.c_str());
+    }
+
+    const std::vector<CellEdit> edits{{rowId(state.thread_index()), "c1", 42}};
+    std::uint64_t version = 0;
+    for (auto _ : state) {
+        if (!log->waitDurable(log->append("bench", ++version, edits))) {
+            state.SkipWithError("write-ahead log failed");
+            break;
+        }
+    }
+    state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations()));
+    state.SetLabel(sync == SyncPolicy::Always ? "always" : sync == SyncPolicy::Interval ? "interval" : "never");
+
+    if (state.thread_index() == 0) {
+        log.reset();
+        directory.reset();
+    }
+}
+BENCHMARK(BM_WalAppend)
+    ->Arg(static_cast<int>(SyncPolicy::Always))
+    ->Arg(static_cast<int>(SyncPolicy::Interval))
+    ->Arg(static_cast<int>(SyncPolicy::Never))
+    ->Threads(1)
+    ->Threads(8)
+    ->UseRealTime();
+
+// The table catalog, with range(0) small tables besides the two built in.
+
+std::string tenantId(std::size_t i) { return "tenant-" + std::to_string(i) + "/orders"; }
+
+DataStore& catalogStore(std::size_t tables) {
+    static std::mutex mutex;
+    static std::map<std::size_t, std::unique_ptr<DataStore>> stores;
+    std::lock_guard lock(mutex);
+    auto& db = stores[tables];
+    if (!db) {
+        db = std::make_unique<DataStore>();
+        std::string error;
+        for (std::size_t i = 0; i < tables; ++i) {
+            Table table = makeTable({4, 4, 0});
+            table.id = tenantId(i);
+            db->createTable(std::move(table), error);
+        }
+    }
+    return *db;
+}
+
+// What every request pays to find its table.
+void BM_CatalogRead(benchmark::State& state) {
+    const std::size_t tables = static_cast<std::size_t>(state.range(0));
+    DataStore& db = catalogStore(tables);
+    std::vector<std::string> ids;
+    for (std::size_t i = 0; i < 1024; ++i) ids.push_back(tenantId((i * 7919 + state.thread_index()) % tables));
+    std::size_t i = 0;
+    for (auto _ : state) {
+        auto table = db.read(ids[++i % ids.size()]);
+        benchmark::DoNotOptimize(table.get());
+    }
+    state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations()));
+}
+BENCHMARK(BM_CatalogRead)->Arg(100)->Arg(10000)->Threads(1)->Threads(8)->UseRealTime();
+
+void BM_CatalogList(benchmark::State& state) {
+    DataStore& db = catalogStore(static_cast<std::size_t>(state.range(0)));
+    std::size_t listed = 0;
+    for (auto _ : state) {
+        listed = db.listTables().size();
+    }
+    setRowCounters(state, listed, 0);
+}
+BENCHMARK(BM_CatalogList)->Arg(100)->Arg(10000)->UseRealTime();
+
+// Creating and dropping one table among range(0): each copies one shard of
+// the catalog.
+void BM_CatalogCreateDrop(benchmark::State& state) {
+    DataStore& db = catalogStore(static_cast<std::size_t>(state.range(0)));
+    const Table source = makeTable({4, 4, 0});
+    std::string error;
+    for (auto _ : state) {
+        Table table = source;
+        table.id = "scratch";
+        db.createTable(std::move(table), error);
+        db.dropTable("scratch", error);
+    }
+    state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations()));
+}
+BENCHMARK(BM_CatalogCreateDrop)->Arg(100)->Arg(10000)->UseRealTime();
+
+// What instrumentation adds to one request: the clock reads and finish()
+// of the gRPC interceptor or the HTTP middleware, plus a row count.
+void BM_MetricsRequest(benchmark::State& state) {
+    static Metrics metrics;
+    static RequestMetrics& entry = metrics.addRpc("GetData", true);
+    std::uint64_t i = 0;
+    for (auto _ : state) {
+        const auto started = std::chrono::steady_clock::now();
+        entry.rows->observe(++i % 5000);
+        entry.finish(0, std::chrono::steady_clock::now() - started, 4096 + i);
+    }
+    state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations()));
+}
+BENCHMARK(BM_MetricsRequest)->Threads(1)->Threads(8)->UseRealTime();
+
+void BM_MetricsUpdateResult(benchmark::State& state) {
+    static Metrics metrics;
+    std::uint64_t i = 0;
+    for (auto _ : state) {
+        metrics.recordUpdate(++i % 4 ? std::string_view() : std::string_view("Row not found"));
+    }
+    state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations()));
+}
+BENCHMARK(BM_MetricsUpdateResult)->Threads(1)->Threads(8)->UseRealTime();
+
+bool parseSizes(std::string_view text, std::vector<std::size_t>& out) {
+    out.clear();
+    while (!text.empty()) {
+        const std::size_t comma = text.find(',');
+        const std::string part(text.substr(0, comma));
+        char* end = nullptr;
+        const unsigned long long value = std::strtoull(part.c_str(), &end, 10);
+        if (part.empty() || *end != '\0') return false;
+        out.push_back(static_cast<std::size_t>(value));
+        if (comma == std::string_view::npos) break;
+        text.remove_prefix(comma + 1);
+    }
+    return !out.empty();
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    std::vector<std::size_t> rows{1024, 16384, 131072};
+    std::vector<std::size_t> columns{8};
+    std::vector<std::size_t> fanouts{0, 16};
+
+    // Take our flags out before Google Benchmark sees the rest.
+    int kept = 1;
+    for (int i = 1; i < argc; ++i) {
+        const std::string_view arg = argv[i];
+        bool ok = true;
+        if (arg.starts_with("--rows=")) {
+            ok = parseSizes(arg.substr(7), rows);
+        } else if (arg.starts_with("--columns=")) {
+            ok = parseSizes(arg.substr(10), columns);
+        } else if (arg.starts_with("--fanout=")) {
+            ok = parseSizes(arg.substr(9), fanouts);
+        } else {
+            argv[kept++] = argv[i];
+            continue;
+        }
+        if (!ok) {
+            std::cerr << "Invalid " << arg << std::endl;
+            return 1;
+        }
+    }
+    argc = kept;
+
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) return 1;
+
+    for (std::size_t width : columns) {
+        const Shape shape{0, width, 0};
+        benchmark::RegisterBenchmark(("BM_FillProtoSchema/columns:" + std::to_string(width)).c_str(),
+                                     BM_FillProtoSchema, shape);
+    }
+    for (std::size_t n : rows) {
+        for (std::size_t width : columns) {
+            for (std::size_t fanout : fanouts) {
+                const Shape shape{n, width, fanout};
+                const std::string suffix = "/" + shape.name();
+                benchmark::RegisterBenchmark(("BM_BuildRowsJson" + suffix).c_str(), BM_BuildRowsJson, shape);
+                benchmark::RegisterBenchmark(("BM_ArrowStream" + suffix).c_str(), BM_ArrowStream, shape);
+                benchmark::RegisterBenchmark(("BM_GetDataResponse" + suffix).c_str(), BM_GetDataResponse, shape);
+                benchmark::RegisterBenchmark(("BM_GetColumnarDataResponse" + suffix).c_str(),
+                                             BM_GetColumnarDataResponse, shape);
+                benchmark::RegisterBenchmark(("BM_UpdateCell" + suffix).c_str(), BM_UpdateCell, shape);
+                benchmark::RegisterBenchmark(("BM_Search" + suffix).c_str(), BM_Search, shape);
+                benchmark::RegisterBenchmark(("BM_SearchScan" + suffix).c_str(), BM_SearchScan, shape);
+                benchmark::RegisterBenchmark(("BM_SnapshotWrite" + suffix).c_str(), BM_SnapshotWrite, shape)
+                    ->UseRealTime();
+                benchmark::RegisterBenchmark(("BM_SnapshotLoad" + suffix).c_str(), BM_SnapshotLoad, shape)
+                    ->UseRealTime();
+            }
+        }
+    }
+
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
@@ -3,6 +3,7 @@ set -euo pipefail
 
 # Simple build helper for the gRPC + Crow server.
 # Run from repo root: ./build.sh
+# Extra arguments go to the configure step, e.g. ./build.sh -DBUILD_BENCHMARKS=ON
 
 ROOT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
 cd "$ROOT_DIR"
@@ -14,5 +15,5 @@ conan profile detect --force >/dev/null
 conan install . --output-folder=build --build=missing
 
 # Configure and build via generated preset
-cmake --preset conan-release
+cmake --preset conan-release "$@"
 cmake --build --preset conan-release
@@ -0,0 +1,421 @@
+#include "arrow_ipc.h"
+
+#include "binary_io.h"
+#include "procedural_table.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <initializer_list>
+#include <numeric>
+#include <span>
+#include <string_view>
+#include <utility>
+
+// Arrow buffers and flatbuffers are little-endian; both are copied from
+// memory as they are.
+static_assert(std::endian::native == std::endian::little);
+
+namespace {
+
+constexpr std::uint32_t kContinuation = 0xFFFFFFFF;
+constexpr std::string_view kFileMagic("ARROW1\0\0", 8);  // padded to 8 bytes at the start of a file
+
+// Values from Arrow's Schema.fbs and Message.fbs.
+constexpr std::int16_t kMetadataV5 = 4;
+constexpr std::int16_t kPrecisionDouble = 2;
+enum class MessageHeader : std::uint8_t { Schema = 1, RecordBatch = 3 };
+enum class ArrowType : std::uint8_t { FloatingPoint = 3, Bool = 6, LargeUtf8 = 20 };
+
+// Writes a flatbuffer front to back: each table is preceded by its vtable
+// and followed by the objects it refers to, so every offset points forward
+// as the format requires. Positions are relative to the buffer start, which
+// the IPC framing keeps 8-byte aligned.
+class FlatBuilder {
+public:
+    // An inline table field: a scalar of 1, 2, 4 or 8 bytes, or a 4-byte
+    // offset that the object written for it fills in.
+    struct Field {
+        std::uint16_t slot;
+        std::uint8_t size;
+        std::uint64_t value = 0;
+    };
+
+    FlatBuilder() { putPod(bytes_, std::uint32_t{0}); }
+
+    static constexpr std::size_t kRoot = 0;
+
+    // The finished buffer, padded to 8 bytes.
+    std::string& finish() {
+        pad(8);
+        return bytes_;
+    }
+
+    // Writes a table for the offset at from. Returns the position of each
+    // field, in the order given.
+    std::vector<std::size_t> table(std::size_t from, std::initializer_list<Field> fields) {
+        std::uint16_t slots = 0;
+        for (const Field& field : fields) slots = std::max<std::uint16_t>(slots, field.slot + 1);
+
+        // Widest first, each aligned to its size, after the vtable offset.
+        std::vector<std::size_t> order(fields.size());
+        std::iota(order.begin(), order.end(), std::size_t{0});
+        std::stable_sort(order.begin(), order.end(),
+                         [&](std::size_t a, std::size_t b) { return fields.begin()[a].size > fields.begin()[b].size; });
+        std::vector<std::uint16_t> layout(fields.size());
+        std::size_t size = sizeof(std::int32_t);
+        for (std::size_t i : order) {
+            size += BinaryReader::padding(size, fields.begin()[i].size);
+            layout[i] = static_cast<std::uint16_t>(size);
+            size += fields.begin()[i].size;
+        }
+
+        pad(alignof(std::uint16_t));
+        const std::size_t vtable = bytes_.size();
+        putPod(bytes_, static_cast<std::uint16_t>(2 * (2 + slots)));
+        putPod(bytes_, static_cast<std::uint16_t>(size));
+        std::vector<std::uint16_t> entries(slots, 0);
+        for (std::size_t i = 0; i < fields.size(); ++i) entries[fields.begin()[i].slot] = layout[i];
+        for (std::uint16_t entry : entries) putPod(bytes_, entry);
+
+        pad(8);
+        const std::size_t table = bytes_.size();
+        link(from);
+        putPod(bytes_, static_cast<std::int32_t>(table - vtable));
+        bytes_.resize(table + size, '\0');
+        std::vector<std::size_t> positions;
+        positions.reserve(fields.size());
+        for (std::size_t i = 0; i < fields.size(); ++i) {
+            std::memcpy(bytes_.data() + table + layout[i], &fields.begin()[i].value, fields.begin()[i].size);
+            positions.push_back(table + layout[i]);
+        }
+        return positions;
+    }
+
+    void string(std::size_t from, std::string_view text) {
+        pad(alignof(std::uint32_t));
+        link(from);
+        putPod(bytes_, static_cast<std::uint32_t>(text.size()));
+        bytes_.append(text);
+        bytes_.push_back('\0');
+    }
+
+    // A vector of count offsets to objects written after it. Returns the
+    // position of the first; element i is 4 i bytes further.
+    std::size_t offsets(std::size_t from, std::size_t count) {
+        pad(alignof(std::uint32_t));
+        link(from);
+        putPod(bytes_, static_cast<std::uint32_t>(count));
+        const std::size_t first = bytes_.size();
+        bytes_.resize(first + count * sizeof(std::uint32_t), '\0');
+        return first;
+    }
+
+    // A vector of structs whose largest member is 8 bytes: the elements
+    // start on an 8-byte boundary, right after the length.
+    template <typename T>
+    void structs(std::size_t from, std::span<const T> values) {
+        static_assert(alignof(T) == 8 && std::has_unique_object_representations_v<T>);
+        pad(8);
+        bytes_.append(sizeof(std::uint32_t), '\0');
+        link(from);
+        putPod(bytes_, static_cast<std::uint32_t>(values.size()));
+        bytes_.append(reinterpret_cast<const char*>(values.data()), values.size_bytes());
+    }
+
+private:
+    void pad(std::size_t alignment) { bytes_.append(BinaryReader::padding(bytes_.size(), alignment), '\0'); }
+
+    // Points the offset at from to the end of the buffer.
+    void link(std::size_t from) {
+        const auto offset = static_cast<std::uint32_t>(bytes_.size() - from);
+        std::memcpy(bytes_.data() + from, &offset, sizeof offset);
+    }
+
+    std::string bytes_;
+};
+
+using KeyValues = std::initializer_list<std::pair<std::string_view, std::string_view>>;
+
+void writeKeyValues(FlatBuilder& builder, std::size_t from, KeyValues pairs) {
+    const std::size_t first = builder.offsets(from, pairs.size());
+    for (std::size_t i = 0; i < pairs.size(); ++i) {
+        const auto pair = builder.table(first + 4 * i, {{0, 4}, {1, 4}});
+        builder.string(pair[0], pairs.begin()[i].first);
+        builder.string(pair[1], pairs.begin()[i].second);
+    }
+}
+
+void writeField(FlatBuilder& builder, std::size_t from, std::string_view name, bool nullable, ArrowType type,
+                KeyValues metadata) {
+    // Slots: name, nullable, type_type, type, dictionary, children, custom_metadata.
+    const auto field = builder.table(from, {{0, 4}, {1, 1, nullable}, {2, 1, static_cast<std::uint8_t>(type)}, {3, 4},
+                                            {5, 4}, {6, 4}});
+    builder.string(field[0], name);
+    if (type == ArrowType::FloatingPoint) {
+        builder.table(field[3], {{0, 2, static_cast<std::uint64_t>(kPrecisionDouble)}});
+    } else {
+        builder.table(field[3], {});
+    }
+    builder.offsets(field[4], 0);  // readers require the children vector, even an empty one
+    writeKeyValues(builder, field[5], metadata);
+}
+
+ArrowType arrowType(ColumnType type) {
+    switch (type) {
+    case ColumnType::String:
+        return ArrowType::LargeUtf8;
+    case ColumnType::Number:
+    case ColumnType::Currency:
+        return ArrowType::FloatingPoint;
+    case ColumnType::Bool:
+        return ArrowType::Bool;
+    }
+    return ArrowType::LargeUtf8;
+}
+
+void writeSchema(FlatBuilder& builder, std::size_t from, const Table& table) {
+    // Slots: endianness (little), fields, custom_metadata.
+    const auto schema = builder.table(from, {{0, 2, 0}, {1, 4}, {2, 4}});
+    const std::size_t fields = builder.offsets(schema[1], table.schema.size() + 2);
+    writeField(builder, fields, "row_id", false, ArrowType::LargeUtf8, {});
+    writeField(builder, fields + 4, "parent_id", true, ArrowType::LargeUtf8, {});
+    for (std::size_t c = 0; c < table.schema.size(); ++c) {
+        const ColumnDef& column = table.schema[c];
+        const std::string type = toString(column.type);
+        writeField(builder, fields + 4 * (c + 2), column.id, true, arrowType(column.type),
+                   {{"column_type", type}, {"title", column.title}});
+    }
+    const std::string version = std::to_string(table.version);
+    writeKeyValues(builder, schema[2],
+                   {{"table_id", table.id},
+                    {"name", table.name},
+                    {"version", version},
+                    {"primary_key", table.primary_key},
+                    {"parent_key", table.parent_key}});
+}
+
+// Appends an encapsulated message: the continuation marker, the metadata
+// size, the Message flatbuffer padded to 8 bytes and the body. Returns the
+// size of everything before the body.
+template <typename WriteHeader>
+std::size_t appendMessage(std::string& out, MessageHeader type, std::string_view body, WriteHeader&& write_header) {
+    FlatBuilder builder;
+    // Slots: version, header_type, header, bodyLength.
+    const auto message = builder.table(FlatBuilder::kRoot, {{0, 2, static_cast<std::uint64_t>(kMetadataV5)},
+                                                            {1, 1, static_cast<std::uint8_t>(type)},
+                                                            {2, 4},
+                                                            {3, 8, body.size()}});
+    write_header(builder, message[2]);
+    const std::string& metadata = builder.finish();
+    putPod(out, kContinuation);
+    putPod(out, static_cast<std::int32_t>(metadata.size()));
+    out += metadata;
+    out.append(body);
+    return 2 * sizeof(std::uint32_t) + metadata.size();
+}
+
+// Calls visit(segment, offset, count) for each segment's share of rows
+// [first, first + count). first is a multiple of 64, so each share but the
+// last starts and ends on a bitmap word.
+template <typename Visit>
+void forEachSlice(const Column& column, std::size_t first, std::size_t count, Visit&& visit) {
+    const std::size_t end = first + count;
+    for (std::size_t row = first; row < end;) {
+        const ColumnSegment& segment = column.segment(row / kSegmentRows);
+        const std::size_t offset = row % kSegmentRows;
+        const std::size_t rows = std::min(end - row, segment.size() - offset);
+        visit(segment, offset, rows);
+        row += rows;
+    }
+}
+
+// Calls visit(word) for the bitmap words of rows [offset, offset + count),
+// with the bits past the last row cleared.
+template <typename Visit>
+void forEachWord(std::span<const std::uint64_t> words, std::size_t offset, std::size_t count, Visit&& visit) {
+    const std::size_t first = offset / 64;
+    const std::size_t last = (offset + count + 63) / 64;
+    for (std::size_t i = first; i < last; ++i) {
+        std::uint64_t word = words[i];
+        if (i + 1 == last && (offset + count) % 64 != 0) word &= (std::uint64_t{1} << ((offset + count) % 64)) - 1;
+        visit(word);
+    }
+}
+
+}  // namespace
+
+ArrowWriter::ArrowWriter(std::shared_ptr<const Table> table, ArrowFormat format, std::size_t batch_rows)
+    : table_(std::move(table)),
+      format_(format),
+      batch_rows_(std::max<std::size_t>(64, (batch_rows + 63) / 64 * 64)),
+      rows_(table_->procedural ? table_->procedural->rowCount() : table_->rowCount()) {}
+
+void ArrowWriter::next(std::string& out) {
+    const std::size_t before = out.size();
+    switch (state_) {
+    case State::Schema:
+        if (format_ == ArrowFormat::File) out += kFileMagic;
+        appendMessage(out, MessageHeader::Schema, {},
+                      [&](FlatBuilder& builder, std::size_t from) { writeSchema(builder, from, *table_); });
+        state_ = State::Batches;
+        if (rows_ == 0) writeEnd(out);
+        break;
+    case State::Batches:
+        writeBatch(out);
+        if (next_row_ == rows_) writeEnd(out);
+        break;
+    case State::Done:
+        break;
+    }
+    written_ += out.size() - before;
+}
+
+void ArrowWriter::writeBatch(std::string& out) {
+    const std::size_t begin = next_row_;
+    const std::size_t count = std::min(rows_ - begin, batch_rows_);
+
+    // A procedural table's rows exist for this batch only, from slot 0.
+    std::shared_ptr<const Table> chunk;
+    const Table* source = table_.get();
+    std::size_t first = begin;
+    if (table_->procedural) {
+        chunk = table_->procedural->rows(*table_, begin, begin + count);
+        source = chunk.get();
+        first = 0;
+    }
+
+    body_.clear();
+    nodes_.clear();
+    buffers_.clear();
+    appendStrings(source->row_ids, first, count);
+    appendStrings(source->parent_ids, first, count);
+    for (const Column& column : source->columns) {
+        switch (column.type()) {
+        case ColumnType::String:
+            appendStrings(column, first, count);
+            break;
+        case ColumnType::Number:
+        case ColumnType::Currency:
+            appendNumbers(column, first, count);
+            break;
+        case ColumnType::Bool:
+            appendBools(column, first, count);
+            break;
+        }
+    }
+    body_.append(BinaryReader::padding(body_.size(), 8), '\0');
+
+    // Batches start their piece, so the message starts after every byte
+    // written so far.
+    const std::size_t offset = written_;
+    const std::size_t metadata =
+        appendMessage(out, MessageHeader::RecordBatch, body_, [&](FlatBuilder& builder, std::size_t from) {
+            // Slots: length, nodes, buffers.
+            const auto batch = builder.table(from, {{0, 8, count}, {1, 4}, {2, 4}});
+            builder.structs<FieldNode>(batch[1], nodes_);
+            builder.structs<Buffer>(batch[2], buffers_);
+        });
+    blocks_.push_back({static_cast<std::int64_t>(offset), static_cast<std::int32_t>(metadata), 0,
+                       static_cast<std::int64_t>(body_.size())});
+    next_row_ = begin + count;
+}
+
+void ArrowWriter::writeEnd(std::string& out) {
+    putPod(out, kContinuation);
+    putPod(out, std::int32_t{0});
+    if (format_ == ArrowFormat::File) {
+        FlatBuilder builder;
+        // Slots: version, schema, dictionaries, recordBatches.
+        const auto footer = builder.table(FlatBuilder::kRoot, {{0, 2, static_cast<std::uint64_t>(kMetadataV5)},
+                                                               {1, 4},
+                                                               {2, 4},
+                                                               {3, 4}});
+        writeSchema(builder, footer[1], *table_);
+        builder.structs<Block>(footer[2], {});
+        builder.structs<Block>(footer[3], blocks_);
+        const std::string& bytes = builder.finish();
+        out += bytes;
+        putPod(out, static_cast<std::int32_t>(bytes.size()));
+        out += kFileMagic.substr(0, 6);
+    }
+    state_ = State::Done;
+}
+
+std::size_t ArrowWriter::beginBuffer() {
+    body_.append(BinaryReader::padding(body_.size(), 8), '\0');
+    return body_.size();
+}
+
+void ArrowWriter::endBuffer(std::size_t start) {
+    buffers_.push_back({static_cast<std::int64_t>(start), static_cast<std::int64_t>(body_.size() - start)});
+}
+
+// Arrow's validity bitmap is the complement of the null bitmap. It may be
+// left out when nothing is null, so the nulls are counted first.
+std::int64_t ArrowWriter::appendValidity(const Column& column, std::size_t first, std::size_t count) {
+    std::int64_t nulls = 0;
+    forEachSlice(column, first, count, [&](const ColumnSegment& segment, std::size_t offset, std::size_t rows) {
+        forEachWord(segment.nullWords(), offset, rows, [&](std::uint64_t word) { nulls += std::popcount(word); });
+    });
+    const std::size_t start = beginBuffer();
+    if (nulls != 0) {
+        forEachSlice(column, first, count, [&](const ColumnSegment& segment, std::size_t offset, std::size_t rows) {
+            const std::size_t end = offset + rows;
+            forEachWord(segment.nullWords(), offset, rows, [&](std::uint64_t word) {
+                // The bits past the last row stay clear.
+                const std::size_t bits = std::min<std::size_t>(64, end - offset);
+                putPod(body_, ~word & (bits == 64 ? ~std::uint64_t{0} : (std::uint64_t{1} << bits) - 1));
+                offset += 64;
+            });
+        });
+    }
+    endBuffer(start);
+    nodes_.push_back({static_cast<std::int64_t>(count), nulls});
+    return nulls;
+}
+
+void ArrowWriter::appendStrings(const Column& column, std::size_t first, std::size_t count) {
+    appendValidity(column, first, count);
+
+    const std::size_t offsets = beginBuffer();
+    body_.resize(offsets + (count + 1) * sizeof(std::int64_t), '\0');
+    endBuffer(offsets);
+
+    const std::size_t data = beginBuffer();
+    std::size_t row = 0;
+    forEachSlice(column, first, count, [&](const ColumnSegment& segment, std::size_t offset, std::size_t rows) {
+        for (std::size_t i = offset; i < offset + rows; ++i) {
+            if (!segment.isNull(i)) body_.append(segment.dictionaryEntry(segment.code(i)));
+            const auto end = static_cast<std::int64_t>(body_.size() - data);
+            std::memcpy(body_.data() + offsets + ++row * sizeof(std::int64_t), &end, sizeof end);
+        }
+    });
+    endBuffer(data);
+}
+
+void ArrowWriter::appendNumbers(const Column& column, std::size_t first, std::size_t count) {
+    appendValidity(column, first, count);
+    // Null rows keep whatever stale value the segment holds.
+    const std::size_t start = beginBuffer();
+    forEachSlice(column, first, count, [&](const ColumnSegment& segment, std::size_t offset, std::size_t rows) {
+        body_.append(reinterpret_cast<const char*>(segment.numbers().data() + offset), rows * sizeof(double));
+    });
+    endBuffer(start);
+}
+
+void ArrowWriter::appendBools(const Column& column, std::size_t first, std::size_t count) {
+    appendValidity(column, first, count);
+    const std::size_t start = beginBuffer();
+    forEachSlice(column, first, count, [&](const ColumnSegment& segment, std::size_t offset, std::size_t rows) {
+        forEachWord(segment.boolWords(), offset, rows, [&](std::uint64_t word) { putPod(body_, word); });
+    });
+    endBuffer(start);
+}
+
+std::string encodeArrow(std::shared_ptr<const Table> table, ArrowFormat format) {
+    ArrowWriter writer(std::move(table), format);
+    std::string out;
+    while (!writer.done()) writer.next(out);
+    return out;
+}
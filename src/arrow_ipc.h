@@ -0,0 +1,96 @@
+#pragma once
+
+#include "data_store.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Apache Arrow IPC output (format version 5), written without the Arrow
+// library: the flatbuffer metadata is encoded by hand and the buffers are
+// copied from the column store.
+enum class ArrowFormat {
+    Stream,  // application/vnd.apache.arrow.stream
+    File,    // application/vnd.apache.arrow.file: the stream between magic numbers, plus a footer
+};
+
+// Encodes one table version as Arrow IPC, one record batch at a time.
+//
+// The schema has a "row_id" field, a "parent_id" field (null for root
+// rows) and then one field per column, named by column id:
+//   String          -> LargeUtf8
+//   Number/Currency -> Float64, the stored form of both
+//   Bool            -> Bool
+// Every field but row_id is nullable. Each column field carries its
+// ColumnType and title as field metadata, and the schema carries the
+// table id, name, version, primary key and parent key.
+//
+// A batch is built a column segment at a time: numbers and bitmaps are
+// copied word by word, strings straight from the segment dictionaries, so
+// no cell allocates. Only the batch being written is held in memory; the
+// buffers of a procedural table's batch are materialized for it alone.
+class ArrowWriter {
+public:
+    static constexpr std::size_t kDefaultBatchRows = 16 * kSegmentRows;
+
+    // batch_rows is rounded up to a multiple of 64, so that every batch
+    // starts on a bitmap word.
+    ArrowWriter(std::shared_ptr<const Table> table, ArrowFormat format, std::size_t batch_rows = kDefaultBatchRows);
+
+    bool done() const { return state_ == State::Done; }
+    std::size_t rowCount() const { return rows_; }
+    std::size_t rowsWritten() const { return next_row_; }
+
+    // Appends the next piece to out: first the schema message (after the
+    // file magic), then one record batch per call. The end-of-stream marker,
+    // and a file's footer, follow the last batch in the same piece. The
+    // pieces concatenated in order are the whole stream or file.
+    void next(std::string& out);
+
+private:
+    enum class State { Schema, Batches, Done };
+
+    struct FieldNode {
+        std::int64_t length;
+        std::int64_t null_count;
+    };
+    struct Buffer {
+        std::int64_t offset;
+        std::int64_t length;
+    };
+    struct Block {
+        std::int64_t offset;
+        std::int32_t metadata_length;
+        std::int32_t padding = 0;
+        std::int64_t body_length;
+    };
+
+    void writeBatch(std::string& out);
+    void writeEnd(std::string& out);
+
+    std::size_t beginBuffer();
+    void endBuffer(std::size_t start);
+    std::int64_t appendValidity(const Column& column, std::size_t first, std::size_t count);
+    void appendStrings(const Column& column, std::size_t first, std::size_t count);
+    void appendNumbers(const Column& column, std::size_t first, std::size_t count);
+    void appendBools(const Column& column, std::size_t first, std::size_t count);
+
+    std::shared_ptr<const Table> table_;
+    ArrowFormat format_;
+    std::size_t batch_rows_;
+    std::size_t rows_;
+    State state_ = State::Schema;
+    std::size_t next_row_ = 0;
+    std::size_t written_ = 0;   // bytes of every piece so far
+    std::vector<Block> blocks_;  // of the record batches, for a file's footer
+
+    // Reused from batch to batch.
+    std::string body_;
+    std::vector<FieldNode> nodes_;
+    std::vector<Buffer> buffers_;
+};
+
+// Every piece of a table's stream or file.
+std::string encodeArrow(std::shared_ptr<const Table> table, ArrowFormat format);
@@ -0,0 +1,195 @@
+#pragma once
+
+#include "data_store.h"
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <variant>
+
+#include <unistd.h>
+
+// Encoding shared by the write-ahead log and snapshots: fixed-width fields in
+// native byte order, strings as a u32 length followed by the bytes. Files are
+// only read back by a build for the same architecture.
+
+template <typename T>
+void putPod(std::string& out, const T& value) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+inline void putString(std::string& out, std::string_view text) {
+    putPod(out, static_cast<std::uint32_t>(text.size()));
+    out.append(text);
+}
+
+// Cell values are a type tag followed by the value.
+enum class ValueTag : std::uint8_t { Null, String, Int, Double, Bool };
+
+enum ColumnFlag : std::uint8_t {
+    kTree = 1,
+    kPinned = 2,
+    kEditable = 4,
+    kPrimary = 8,
+};
+
+// Column definitions are strings id, title; u8 type; i32 width; u8 flags.
+inline void putColumnDef(std::string& out, const ColumnDef& def) {
+    putString(out, def.id);
+    putString(out, def.title);
+    putPod(out, static_cast<std::uint8_t>(def.type));
+    putPod(out, static_cast<std::int32_t>(def.width));
+    putPod(out, static_cast<std::uint8_t>((def.is_tree ? kTree : 0) | (def.is_pinned ? kPinned : 0) |
+                                          (def.is_editable ? kEditable : 0) | (def.is_primary ? kPrimary : 0)));
+}
+
+inline void putCellValue(std::string& out, const CellValue& value) {
+    if (const auto* text = std::get_if<std::string>(&value)) {
+        putPod(out, ValueTag::String);
+        putString(out, *text);
+    } else if (const auto* number = std::get_if<int>(&value)) {
+        putPod(out, ValueTag::Int);
+        putPod(out, *number);
+    } else if (const auto* number = std::get_if<double>(&value)) {
+        putPod(out, ValueTag::Double);
+        putPod(out, *number);
+    } else if (const auto* flag = std::get_if<bool>(&value)) {
+        putPod(out, ValueTag::Bool);
+        putPod(out, static_cast<std::uint8_t>(*flag));
+    } else {
+        putPod(out, ValueTag::Null);
+    }
+}
+
+// Bounds-checked cursor over encoded bytes. Every read fails once the input
+// is exhausted, so a truncated buffer is detected by the first read past it.
+class BinaryReader {
+public:
+    explicit BinaryReader(std::string_view bytes)
+        : bytes_(bytes) {}
+
+    std::size_t position() const { return position_; }
+    std::size_t remaining() const { return bytes_.size() - position_; }
+
+    template <typename T>
+    bool read(T& value) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        if (remaining() < sizeof(T)) return false;
+        std::memcpy(&value, bytes_.data() + position_, sizeof(T));
+        position_ += sizeof(T);
+        return true;
+    }
+
+    bool readString(std::string_view& text) {
+        std::uint32_t size = 0;
+        if (!read(size) || remaining() < size) return false;
+        text = bytes_.substr(position_, size);
+        position_ += size;
+        return true;
+    }
+
+    bool readString(std::string& text) {
+        std::string_view view;
+        if (!readString(view)) return false;
+        text.assign(view);
+        return true;
+    }
+
+    // A u64 element count, padding up to alignof(T) and the elements. The
+    // span points into the input, whose start must be suitably aligned.
+    template <typename T>
+    bool readArray(std::span<const T>& values) {
+        std::uint64_t count = 0;
+        if (!read(count) || !skip(padding(position_, alignof(T)))) return false;
+        if (count > remaining() / sizeof(T)) return false;
+        values = {reinterpret_cast<const T*>(bytes_.data() + position_), static_cast<std::size_t>(count)};
+        position_ += count * sizeof(T);
+        return true;
+    }
+
+    bool readCellValue(CellValue& value) {
+        ValueTag tag{};
+        if (!read(tag)) return false;
+        switch (tag) {
+        case ValueTag::Null:
+            value = nullptr;
+            return true;
+        case ValueTag::String: {
+            std::string text;
+            if (!readString(text)) return false;
+            value = std::move(text);
+            return true;
+        }
+        case ValueTag::Int: {
+            int number = 0;
+            if (!read(number)) return false;
+            value = number;
+            return true;
+        }
+        case ValueTag::Double: {
+            double number = 0.0;
+            if (!read(number)) return false;
+            value = number;
+            return true;
+        }
+        case ValueTag::Bool: {
+            std::uint8_t flag = 0;
+            if (!read(flag) || flag > 1) return false;
+            value = flag != 0;
+            return true;
+        }
+        }
+        return false;
+    }
+
+    bool readColumnDef(ColumnDef& def) {
+        std::uint8_t type = 0;
+        std::int32_t width = 0;
+        std::uint8_t flags = 0;
+        if (!readString(def.id) || !readString(def.title) || !read(type) || !read(width) || !read(flags) ||
+            type > static_cast<std::uint8_t>(ColumnType::Bool)) {
+            return false;
+        }
+        def.type = static_cast<ColumnType>(type);
+        def.width = width;
+        def.is_tree = flags & kTree;
+        def.is_pinned = flags & kPinned;
+        def.is_editable = flags & kEditable;
+        def.is_primary = flags & kPrimary;
+        return true;
+    }
+
+    bool skip(std::size_t size) {
+        if (remaining() < size) return false;
+        position_ += size;
+        return true;
+    }
+
+    static std::size_t padding(std::size_t offset, std::size_t alignment) {
+        return (alignment - offset % alignment) % alignment;
+    }
+
+private:
+    std::string_view bytes_;
+    std::size_t position_ = 0;
+};
+
+// write() until every byte is out; false on the first error (errno is set).
+inline bool writeFully(int fd, std::string_view bytes) {
+    while (!bytes.empty()) {
+        const ssize_t written = ::write(fd, bytes.data(), bytes.size());
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        bytes.remove_prefix(static_cast<std::size_t>(written));
+    }
+    return true;
+}
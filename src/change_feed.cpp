@@ -0,0 +1,146 @@
+#include "change_feed.h"
+
+#include "epoch.h"
+
+#include <algorithm>
+#include <utility>
+
+Subscription::Subscription(std::string table_id, std::size_t capacity, std::function<void()> on_ready)
+    : table_id_(std::move(table_id)),
+      capacity_(capacity),
+      on_ready_(std::move(on_ready)) {}
+
+bool Subscription::wait(std::chrono::steady_clock::time_point deadline) {
+    std::unique_lock lock(mutex_);
+    ready_.wait_until(lock, deadline, [&] { return closed_ || overflowed_ || !pending_.empty(); });
+    return !closed_;
+}
+
+Subscription::Batch Subscription::drain() {
+    Batch batch;
+    std::lock_guard lock(mutex_);
+    batch.deltas.swap(pending_);
+    pending_index_.clear();
+    batch.version = version_;
+    batch.resync_required = std::exchange(overflowed_, false);
+    return batch;
+}
+
+bool Subscription::closed() const {
+    std::lock_guard lock(mutex_);
+    return closed_;
+}
+
+void Subscription::close() {
+    {
+        std::lock_guard lock(mutex_);
+        closed_ = true;
+    }
+    ready_.notify_all();
+}
+
+void Subscription::push(const CellDelta& delta) {
+    bool became_ready = false;
+    {
+        std::lock_guard lock(mutex_);
+        if (closed_) return;
+        version_ = delta.version;
+        if (overflowed_) return;  // the watcher will refetch everything anyway
+
+        std::string key;
+        key.reserve(delta.row_id.size() + 1 + delta.column_id.size());
+        key.append(delta.row_id).push_back('\0');
+        key.append(delta.column_id);
+
+        if (auto it = pending_index_.find(key); it != pending_index_.end()) {
+            CellDelta& queued = pending_[it->second];
+            queued.value = delta.value;
+            queued.version = delta.version;
+            return;
+        }
+
+        became_ready = pending_.empty();
+        if (pending_.size() == capacity_) {
+            pending_.clear();
+            pending_index_.clear();
+            overflowed_ = true;
+        } else {
+            pending_index_.emplace(std::move(key), pending_.size());
+            pending_.push_back(delta);
+        }
+    }
+
+    if (became_ready) {
+        ready_.notify_all();
+        if (on_ready_) on_ready_();
+    }
+}
+
+void Subscription::invalidate(std::uint64_t version) {
+    {
+        std::lock_guard lock(mutex_);
+        if (closed_) return;
+        version_ = version;
+        pending_.clear();
+        pending_index_.clear();
+        overflowed_ = true;
+    }
+    ready_.notify_all();
+    if (on_ready_) on_ready_();
+}
+
+ChangeFeed::ChangeFeed()
+    : owner_(std::make_shared<Registry>()),
+      registry_(owner_.get()) {}
+
+ChangeFeed::~ChangeFeed() = default;
+
+std::shared_ptr<Subscription> ChangeFeed::subscribe(const std::string& table_id,
+                                                    std::function<void()> on_ready,
+                                                    std::size_t capacity) {
+    auto subscription = std::make_shared<Subscription>(table_id, std::max<std::size_t>(capacity, 1), std::move(on_ready));
+
+    std::lock_guard lock(mutex_);
+    auto next = std::make_shared<Registry>(*owner_);
+    (*next)[table_id].push_back(subscription);
+    registry_.store(next.get(), std::memory_order_seq_cst);
+    Epoch::retire(std::exchange(owner_, std::move(next)));
+    return subscription;
+}
+
+void ChangeFeed::unsubscribe(const std::shared_ptr<Subscription>& subscription) {
+    subscription->close();
+
+    std::lock_guard lock(mutex_);
+    auto next = std::make_shared<Registry>(*owner_);
+    auto it = next->find(subscription->tableId());
+    if (it == next->end()) return;
+    std::erase(it->second, subscription);
+    if (it->second.empty()) next->erase(it);
+    registry_.store(next.get(), std::memory_order_seq_cst);
+    Epoch::retire(std::exchange(owner_, std::move(next)));
+}
+
+void ChangeFeed::publish(const std::string& table_id, const std::vector<CellDelta>& deltas) {
+    Epoch::Guard guard;
+    const Registry* registry = registry_.load(std::memory_order_seq_cst);
+    auto it = registry->find(table_id);
+    if (it == registry->end()) return;
+
+    for (const auto& subscription : it->second) {
+        for (const auto& delta : deltas) {
+            subscription->push(delta);
+        }
+    }
+}
+
+void ChangeFeed::resync(const std::string& table_id, std::uint64_t version) {
+    Epoch::Guard guard;
+    const Registry* registry = registry_.load(std::memory_order_seq_cst);
+    auto it = registry->find(table_id);
+    if (it == registry->end()) return;
+
+    for (const auto& subscription : it->second) {
+        subscription->invalidate(version);
+    }
+}
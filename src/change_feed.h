@@ -0,0 +1,102 @@
+#pragma once
+
+#include "column_store.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// One cell edit as published to watchers.
+struct CellDelta {
+    std::string row_id;
+    std::string column_id;
+    CellValue value;
+    std::uint64_t version = 0;  // table version that contains the edit
+};
+
+// Bounded queue of pending deltas for one watcher of one table.
+//
+// The writer never waits on a subscription: a push only takes the
+// subscription's own short-lived lock. While deltas are pending, a new edit
+// of the same cell replaces the queued value instead of adding an entry, so a
+// slow watcher sees the latest value of every cell it missed. If more than
+// `capacity` distinct cells are pending, the queue is dropped and the watcher
+// is told to resynchronize from a full read.
+class Subscription {
+public:
+    struct Batch {
+        std::vector<CellDelta> deltas;
+        std::uint64_t version = 0;  // newest version covered by the batch
+        bool resync_required = false;
+    };
+
+    Subscription(std::string table_id, std::size_t capacity, std::function<void()> on_ready);
+
+    const std::string& tableId() const { return table_id_; }
+
+    // Blocks until deltas are pending, the subscription is closed, or the
+    // deadline passes. Returns false once the subscription is closed.
+    bool wait(std::chrono::steady_clock::time_point deadline);
+
+    // Takes everything pending; never blocks on the writer.
+    Batch drain();
+
+    bool closed() const;
+    void close();
+
+private:
+    friend class ChangeFeed;
+
+    void push(const CellDelta& delta);
+    void invalidate(std::uint64_t version);
+
+    const std::string table_id_;
+    const std::size_t capacity_;
+    const std::function<void()> on_ready_;  // called when the queue becomes non-empty
+
+    mutable std::mutex mutex_;
+    std::condition_variable ready_;
+    std::vector<CellDelta> pending_;
+    std::unordered_map<std::string, std::size_t> pending_index_;  // row id + '\0' + column id -> pending_ slot
+    std::uint64_t version_ = 0;
+    bool overflowed_ = false;
+    bool closed_ = false;
+};
+
+// Fans cell deltas out to the subscriptions of each table. The subscriber
+// registry is copy-on-write and read under an epoch guard, so publishing
+// never contends with subscribe/unsubscribe.
+class ChangeFeed {
+public:
+    static constexpr std::size_t kDefaultCapacity = 1024;
+
+    ChangeFeed();
+    ~ChangeFeed();
+
+    std::shared_ptr<Subscription> subscribe(const std::string& table_id,
+                                            std::function<void()> on_ready = {},
+                                            std::size_t capacity = kDefaultCapacity);
+    void unsubscribe(const std::shared_ptr<Subscription>& subscription);
+
+    // Callers publish the deltas of one table version in version order.
+    void publish(const std::string& table_id, const std::vector<CellDelta>& deltas);
+
+    // Tells every watcher of the table to refetch it, for changes that are
+    // not cell edits (the whole table was replaced).
+    void resync(const std::string& table_id, std::uint64_t version);
+
+private:
+    using Registry = std::unordered_map<std::string, std::vector<std::shared_ptr<Subscription>>>;
+
+    std::mutex mutex_;  // serializes registry updates
+    std::shared_ptr<const Registry> owner_;
+    std::atomic<const Registry*> registry_;
+};
@@ -0,0 +1,304 @@
+#include "column_store.h"
+
+#include <algorithm>
+#include <functional>
+#include <type_traits>
+
+std::string toString(ColumnType t) {
+    switch (t) {
+    case ColumnType::String:
+        return "string";
+    case ColumnType::Number:
+        return "number";
+    case ColumnType::Currency:
+        return "currency";
+    case ColumnType::Bool:
+        return "bool";
+    }
+    return "string";
+}
+
+std::optional<ColumnType> columnTypeFromString(std::string_view name) {
+    if (name == "string") return ColumnType::String;
+    if (name == "number") return ColumnType::Number;
+    if (name == "currency") return ColumnType::Currency;
+    if (name == "bool") return ColumnType::Bool;
+    return std::nullopt;
+}
+
+ColumnSegment::ColumnSegment(ColumnType type)
+    : type_(type) {
+    if (type_ == ColumnType::String) dictionary_offsets_.push_back(0);
+}
+
+CellValue ColumnSegment::get(std::size_t i) const {
+    return visit(i, [](auto value) -> CellValue {
+        if constexpr (std::is_same_v<decltype(value), std::string_view>) {
+            return std::string(value);
+        } else {
+            return value;
+        }
+    });
+}
+
+ColumnSegment::Storage ColumnSegment::storage() const {
+    return {size_, nulls_, int_tags_, bools_, numbers_, codes_, dictionary_bytes_, dictionary_offsets_};
+}
+
+std::optional<ColumnSegment> ColumnSegment::restore(ColumnType type, const Storage& storage) {
+    const std::size_t size = storage.size;
+    const std::size_t words = (size + 63) / 64;
+    const bool numeric = isNumeric(type);
+    const bool string = type == ColumnType::String;
+    if (size > kSegmentRows || storage.nulls.size() != words ||
+        storage.int_tags.size() != (numeric ? words : 0) ||
+        storage.bools.size() != (type == ColumnType::Bool ? words : 0) ||
+        storage.numbers.size() != (numeric ? size : 0) || storage.codes.size() != (string ? size : 0) ||
+        (!string && (!storage.dictionary_offsets.empty() || !storage.dictionary_bytes.empty()))) {
+        return std::nullopt;
+    }
+
+    ColumnSegment segment(type);
+    segment.size_ = size;
+    segment.nulls_.assign(storage.nulls.begin(), storage.nulls.end());
+    segment.int_tags_.assign(storage.int_tags.begin(), storage.int_tags.end());
+    segment.bools_.assign(storage.bools.begin(), storage.bools.end());
+    segment.numbers_.assign(storage.numbers.begin(), storage.numbers.end());
+    segment.codes_.assign(storage.codes.begin(), storage.codes.end());
+
+    if (string) {
+        const auto& offsets = storage.dictionary_offsets;
+        if (offsets.empty() || offsets.front() != 0 || offsets.back() != storage.dictionary_bytes.size() ||
+            !std::is_sorted(offsets.begin(), offsets.end())) {
+            return std::nullopt;
+        }
+        // Null rows may keep a stale code; only live codes must be in range.
+        for (std::size_t i = 0; i < size; ++i) {
+            if (!segment.isNull(i) && segment.codes_[i] + 1 >= offsets.size()) return std::nullopt;
+        }
+        segment.dictionary_bytes_.assign(storage.dictionary_bytes);
+        segment.dictionary_offsets_.assign(offsets.begin(), offsets.end());
+        // dictionary_lookup_ stays empty until internString() needs it.
+    }
+    return segment;
+}
+
+void ColumnSegment::grow() {
+    if ((size_ & 63) == 0) {
+        nulls_.push_back(0);
+        if (type_ == ColumnType::Number || type_ == ColumnType::Currency) int_tags_.push_back(0);
+        if (type_ == ColumnType::Bool) bools_.push_back(0);
+    }
+
+    switch (type_) {
+    case ColumnType::String:
+        codes_.push_back(0);
+        break;
+    case ColumnType::Number:
+    case ColumnType::Currency:
+        numbers_.push_back(0.0);
+        break;
+    case ColumnType::Bool:
+        break;
+    }
+    ++size_;
+}
+
+bool ColumnSegment::append(const CellValue& value) {
+    grow();
+    if (set(size_ - 1, value)) return true;
+
+    // Roll back the slot so a rejected value leaves the segment unchanged.
+    --size_;
+    if (type_ == ColumnType::String) codes_.pop_back();
+    if (type_ == ColumnType::Number || type_ == ColumnType::Currency) numbers_.pop_back();
+    if ((size_ & 63) == 0) {
+        nulls_.pop_back();
+        if (type_ == ColumnType::Number || type_ == ColumnType::Currency) int_tags_.pop_back();
+        if (type_ == ColumnType::Bool) bools_.pop_back();
+    }
+    return false;
+}
+
+void ColumnSegment::appendString(std::string_view value) {
+    grow();
+    codes_[size_ - 1] = internString(value);
+}
+
+void ColumnSegment::appendFrom(const ColumnSegment& source, std::size_t i) {
+    grow();
+    const std::size_t row = size_ - 1;
+    if (source.isNull(i)) {
+        assignBit(nulls_, row, true);
+        return;
+    }
+    switch (type_) {
+    case ColumnType::String:
+        codes_[row] = internString(source.string(i));
+        break;
+    case ColumnType::Number:
+    case ColumnType::Currency:
+        numbers_[row] = source.numbers_[i];
+        assignBit(int_tags_, row, source.isIntTagged(i));
+        break;
+    case ColumnType::Bool:
+        assignBit(bools_, row, source.boolean(i));
+        break;
+    }
+}
+
+bool ColumnSegment::set(std::size_t i, const CellValue& value) {
+    if (std::holds_alternative<std::nullptr_t>(value)) {
+        assignBit(nulls_, i, true);
+        return true;
+    }
+
+    switch (type_) {
+    case ColumnType::String:
+        if (!std::holds_alternative<std::string>(value)) return false;
+        codes_[i] = internString(std::get<std::string>(value));
+        break;
+    case ColumnType::Number:
+    case ColumnType::Currency:
+        if (std::holds_alternative<int>(value)) {
+            numbers_[i] = static_cast<double>(std::get<int>(value));
+            assignBit(int_tags_, i, true);
+        } else if (std::holds_alternative<double>(value)) {
+            numbers_[i] = std::get<double>(value);
+            assignBit(int_tags_, i, false);
+        } else {
+            return false;
+        }
+        break;
+    case ColumnType::Bool:
+        if (!std::holds_alternative<bool>(value)) return false;
+        assignBit(bools_, i, std::get<bool>(value));
+        break;
+    }
+
+    assignBit(nulls_, i, false);
+    return true;
+}
+
+std::size_t ColumnSegment::memoryUsage() const {
+    return sizeof(*this) + (nulls_.capacity() + int_tags_.capacity() + bools_.capacity()) * sizeof(std::uint64_t) +
+           numbers_.capacity() * sizeof(double) + codes_.capacity() * sizeof(std::uint32_t) +
+           dictionary_bytes_.capacity() +
+           (dictionary_offsets_.capacity() + dictionary_lookup_.capacity()) * sizeof(std::uint32_t);
+}
+
+std::uint32_t ColumnSegment::internString(std::string_view value) {
+    // Dead entries pile up when cells are overwritten; drop them once they
+    // outnumber the rows that can possibly reference the dictionary.
+    if (dictionary_offsets_.size() > 2 * kSegmentRows) compactDictionary();
+
+    const std::size_t entries = dictionary_offsets_.size() - 1;
+    if ((entries + 1) * 2 > dictionary_lookup_.size()) {
+        std::size_t capacity = dictionary_lookup_.empty() ? 16 : dictionary_lookup_.size() * 2;
+        while ((entries + 1) * 2 > capacity) capacity *= 2;
+        dictionary_lookup_.assign(capacity, kEmptySlot);
+        rebuildDictionaryLookup();
+    }
+
+    const std::size_t mask = dictionary_lookup_.size() - 1;
+    for (std::size_t slot = std::hash<std::string_view>{}(value) & mask;; slot = (slot + 1) & mask) {
+        const std::uint32_t code = dictionary_lookup_[slot];
+        if (code == kEmptySlot) {
+            const auto new_code = static_cast<std::uint32_t>(dictionary_offsets_.size() - 1);
+            dictionary_bytes_.append(value);
+            dictionary_offsets_.push_back(static_cast<std::uint32_t>(dictionary_bytes_.size()));
+            dictionary_lookup_[slot] = new_code;
+            return new_code;
+        }
+        if (dictionaryEntry(code) == value) return code;
+    }
+}
+
+void ColumnSegment::rebuildDictionaryLookup() {
+    std::fill(dictionary_lookup_.begin(), dictionary_lookup_.end(), kEmptySlot);
+    const std::size_t mask = dictionary_lookup_.size() - 1;
+    for (std::uint32_t code = 0; code + 1 < dictionary_offsets_.size(); ++code) {
+        std::size_t slot = std::hash<std::string_view>{}(dictionaryEntry(code)) & mask;
+        while (dictionary_lookup_[slot] != kEmptySlot) slot = (slot + 1) & mask;
+        dictionary_lookup_[slot] = code;
+    }
+}
+
+void ColumnSegment::compactDictionary() {
+    std::vector<std::uint32_t> remap(dictionary_offsets_.size() - 1, kEmptySlot);
+    std::string bytes;
+    std::vector<std::uint32_t> offsets{0};
+
+    for (std::size_t i = 0; i < size_; ++i) {
+        if (isNull(i)) continue;
+        std::uint32_t& mapped = remap[codes_[i]];
+        if (mapped == kEmptySlot) {
+            mapped = static_cast<std::uint32_t>(offsets.size() - 1);
+            bytes.append(dictionaryEntry(codes_[i]));
+            offsets.push_back(static_cast<std::uint32_t>(bytes.size()));
+        }
+        codes_[i] = mapped;
+    }
+
+    dictionary_bytes_ = std::move(bytes);
+    dictionary_offsets_ = std::move(offsets);
+    rebuildDictionaryLookup();
+}
+
+ColumnSegment& Column::tailWithRoom() {
+    if (segments_.empty() || segments_.back()->full()) {
+        segments_.push_back(std::make_shared<ColumnSegment>(type_));
+    }
+    return mutableSegment(segments_.size() - 1);
+}
+
+bool Column::append(const CellValue& value) {
+    ColumnSegment& tail = tailWithRoom();
+    if (!tail.append(value)) {
+        if (tail.size() == 0) segments_.pop_back();
+        return false;
+    }
+    ++size_;
+    return true;
+}
+
+void Column::appendString(std::string_view value) {
+    tailWithRoom().appendString(value);
+    ++size_;
+}
+
+void Column::appendColumn(const Column& other) {
+    if (size_ % kSegmentRows == 0) {
+        // Segment-aligned: share the segments instead of copying rows.
+        segments_.insert(segments_.end(), other.segments_.begin(), other.segments_.end());
+        size_ += other.size_;
+        return;
+    }
+    for (const auto& source : other.segments_) {
+        for (std::size_t i = 0; i < source->size(); ++i) {
+            tailWithRoom().appendFrom(*source, i);
+        }
+    }
+    size_ += other.size_;
+}
+
+void Column::appendSegment(ColumnSegment segment) {
+    size_ += segment.size();
+    segments_.push_back(std::make_shared<ColumnSegment>(std::move(segment)));
+}
+
+std::size_t Column::memoryUsage() const {
+    std::size_t total = sizeof(*this) + segments_.capacity() * sizeof(std::shared_ptr<ColumnSegment>);
+    for (const auto& segment : segments_) {
+        total += segment->memoryUsage();
+    }
+    return total;
+}
+
+ColumnSegment& Column::mutableSegment(std::size_t index) {
+    auto& segment = segments_[index];
+    // Only this column can hand out new references to its segments, so a
+    // use count of one means no published version can observe the write.
+    if (segment.use_count() != 1) segment = std::make_shared<ColumnSegment>(*segment);
+    return *segment;
+}
@@ -0,0 +1,223 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <variant>
+#include <vector>
+
+// Universal value used for cells (aligned with protobuf oneof)
+using CellValue = std::variant<std::string, int, double, bool, std::nullptr_t>;
+
+enum class ColumnType {
+    String,
+    Number,
+    Currency,
+    Bool,
+};
+
+std::string toString(ColumnType t);
+std::optional<ColumnType> columnTypeFromString(std::string_view name);
+
+inline bool isNumeric(ColumnType t) { return t == ColumnType::Number || t == ColumnType::Currency; }
+
+// True when value can be stored in a column of type t (null always can).
+inline bool fitsColumnType(ColumnType t, const CellValue& value) {
+    if (std::holds_alternative<std::nullptr_t>(value)) return true;
+    switch (t) {
+    case ColumnType::String:
+        return std::holds_alternative<std::string>(value);
+    case ColumnType::Number:
+    case ColumnType::Currency:
+        return std::holds_alternative<int>(value) || std::holds_alternative<double>(value);
+    case ColumnType::Bool:
+        return std::holds_alternative<bool>(value);
+    }
+    return false;
+}
+
+// Value stored for a number read from text, JSON or protobuf: a Number
+// column keeps integral values that fit an int as ints, everything else is
+// a double.
+inline CellValue numberCellValue(ColumnType t, double number) {
+    if (t == ColumnType::Number && std::floor(number) == number && number >= std::numeric_limits<int>::min() &&
+        number <= std::numeric_limits<int>::max()) {
+        return static_cast<int>(number);
+    }
+    return number;
+}
+
+// Rows per column segment. Segments keep dictionaries small (codes stay dense
+// and lookups cache-resident) and let a column grow without moving old data.
+inline constexpr std::size_t kSegmentRows = 4096;
+
+// Fixed-capacity slice of a column stored in its physical type:
+//   String          -> dictionary codes + concatenated dictionary bytes
+//   Number/Currency -> doubles + "written as int" tag bitmap
+//   Bool            -> bitmap
+// Every type carries a null bitmap.
+class ColumnSegment {
+public:
+    explicit ColumnSegment(ColumnType type);
+
+    std::size_t size() const { return size_; }
+    bool full() const { return size_ == kSegmentRows; }
+
+    bool isNull(std::size_t i) const { return testBit(nulls_, i); }
+    double number(std::size_t i) const { return numbers_[i]; }
+    bool isIntTagged(std::size_t i) const { return testBit(int_tags_, i); }
+    bool boolean(std::size_t i) const { return testBit(bools_, i); }
+    std::string_view string(std::size_t i) const { return dictionaryEntry(codes_[i]); }
+
+    // Raw storage for column scans. Bit i of a word array is bit i % 64 of
+    // word i / 64; a null row's value slot holds an arbitrary stale value.
+    std::span<const std::uint64_t> nullWords() const { return nulls_; }
+    std::span<const std::uint64_t> boolWords() const { return bools_; }
+    std::span<const double> numbers() const { return numbers_; }
+    std::span<const std::uint32_t> codes() const { return codes_; }
+    std::span<const std::uint64_t> intTagWords() const { return int_tags_; }
+
+    // Segment-local dictionary of a String segment. Codes of non-null rows
+    // are in [0, dictionarySize()); entries may be unreferenced.
+    std::uint32_t code(std::size_t i) const { return codes_[i]; }
+    std::size_t dictionarySize() const { return dictionary_offsets_.size() - 1; }
+    std::string_view dictionaryEntry(std::uint32_t code) const {
+        return std::string_view(dictionary_bytes_).substr(dictionary_offsets_[code],
+                                                          dictionary_offsets_[code + 1] - dictionary_offsets_[code]);
+    }
+
+    // Calls visitor with nullptr, std::string_view, int, double or bool.
+    template <typename Visitor>
+    decltype(auto) visit(std::size_t i, Visitor&& visitor) const {
+        if (isNull(i)) return visitor(nullptr);
+        switch (type_) {
+        case ColumnType::String:
+            return visitor(string(i));
+        case ColumnType::Number:
+        case ColumnType::Currency:
+            if (isIntTagged(i)) return visitor(static_cast<int>(numbers_[i]));
+            return visitor(numbers_[i]);
+        case ColumnType::Bool:
+            return visitor(boolean(i));
+        }
+        return visitor(nullptr);
+    }
+
+    CellValue get(std::size_t i) const;
+
+    // Everything a segment stores, in the layout of the accessors above.
+    struct Storage {
+        std::size_t size = 0;
+        std::span<const std::uint64_t> nulls;
+        std::span<const std::uint64_t> int_tags;
+        std::span<const std::uint64_t> bools;
+        std::span<const double> numbers;
+        std::span<const std::uint32_t> codes;
+        std::string_view dictionary_bytes;
+        std::span<const std::uint32_t> dictionary_offsets;
+    };
+
+    Storage storage() const;
+
+    // Bulk-copies storage produced by storage(), e.g. from a mapped snapshot.
+    // Returns nullopt when the arrays do not describe a valid segment of
+    // this type.
+    static std::optional<ColumnSegment> restore(ColumnType type, const Storage& storage);
+
+    // Both return false when the value does not fit the column type.
+    bool append(const CellValue& value);
+    bool set(std::size_t i, const CellValue& value);
+
+    // String segments only; no std::string is materialized.
+    void appendString(std::string_view value);
+    // Appends row i of a segment of the same type.
+    void appendFrom(const ColumnSegment& source, std::size_t i);
+
+    std::size_t memoryUsage() const;
+
+private:
+    static constexpr std::uint32_t kEmptySlot = UINT32_MAX;
+
+    static bool testBit(const std::vector<std::uint64_t>& bits, std::size_t i) {
+        return (bits[i >> 6] >> (i & 63)) & 1U;
+    }
+    static void assignBit(std::vector<std::uint64_t>& bits, std::size_t i, bool on) {
+        const std::uint64_t mask = std::uint64_t{1} << (i & 63);
+        if (on) {
+            bits[i >> 6] |= mask;
+        } else {
+            bits[i >> 6] &= ~mask;
+        }
+    }
+
+    void grow();  // adds a zeroed, non-null row
+    std::uint32_t internString(std::string_view value);
+    void rebuildDictionaryLookup();
+    void compactDictionary();
+
+    ColumnType type_;
+    std::size_t size_ = 0;
+    std::vector<std::uint64_t> nulls_;
+    std::vector<std::uint64_t> int_tags_;
+    std::vector<std::uint64_t> bools_;
+    std::vector<double> numbers_;
+    std::vector<std::uint32_t> codes_;
+    std::string dictionary_bytes_;
+    std::vector<std::uint32_t> dictionary_offsets_;  // entry i is [offsets[i], offsets[i + 1])
+    std::vector<std::uint32_t> dictionary_lookup_;   // open-addressing hash set of codes
+};
+
+// Typed column made of fixed-size segments, addressed by row slot.
+//
+// Copying a Column is shallow: the copy shares every segment with the
+// original. The first write to a shared segment clones it, so published
+// table versions are never mutated and a new version only pays for the
+// segments it actually changes.
+class Column {
+public:
+    explicit Column(ColumnType type)
+        : type_(type) {}
+
+    ColumnType type() const { return type_; }
+    std::size_t size() const { return size_; }
+
+    const ColumnSegment& segment(std::size_t index) const { return *segments_[index]; }
+    std::size_t segmentCount() const { return segments_.size(); }
+
+    bool isNull(std::size_t row) const { return segments_[row / kSegmentRows]->isNull(row % kSegmentRows); }
+
+    template <typename Visitor>
+    decltype(auto) visit(std::size_t row, Visitor&& visitor) const {
+        return segments_[row / kSegmentRows]->visit(row % kSegmentRows, std::forward<Visitor>(visitor));
+    }
+
+    CellValue get(std::size_t row) const { return segments_[row / kSegmentRows]->get(row % kSegmentRows); }
+
+    bool append(const CellValue& value);
+    void appendString(std::string_view value);  // String columns only
+    // Appends every row of a column of the same type. When this column ends
+    // on a segment boundary the segments are shared, not copied.
+    void appendColumn(const Column& other);
+    // Appends a whole segment; every segment already in the column must be full.
+    void appendSegment(ColumnSegment segment);
+    bool set(std::size_t row, const CellValue& value) {
+        return mutableSegment(row / kSegmentRows).set(row % kSegmentRows, value);
+    }
+
+    std::size_t memoryUsage() const;
+
+private:
+    ColumnSegment& mutableSegment(std::size_t index);
+    ColumnSegment& tailWithRoom();
+
+    ColumnType type_;
+    std::size_t size_ = 0;
+    std::vector<std::shared_ptr<ColumnSegment>> segments_;
+};
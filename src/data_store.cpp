@@ -0,0 +1,1042 @@
+#include "data_store.h"
+
+#include "procedural_table.h"
+#include "snapshot.h"
+#include "wal.h"
+
+#include <algorithm>
+#include <charconv>
+#include <condition_variable>
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+
+namespace {
+
+constexpr const char* kSnapshotFile = "/snapshot.bin";
+
+// Images of single tables, named by PutTable records: table-<number>.bin.
+std::string imageName(std::uint64_t number) {
+    char name[40];
+    std::snprintf(name, sizeof(name), "table-%020llu.bin", static_cast<unsigned long long>(number));
+    return name;
+}
+
+std::optional<std::uint64_t> imageNumber(std::string_view name) {
+    if (!name.starts_with("table-") || !name.ends_with(".bin")) return std::nullopt;
+    const std::string_view digits = name.substr(6, name.size() - 10);
+    std::uint64_t number = 0;
+    auto [end, parse_error] = std::from_chars(digits.data(), digits.data() + digits.size(), number);
+    if (parse_error != std::errc{} || end != digits.data() + digits.size()) return std::nullopt;
+    return number;
+}
+
+// Applies a logged batch to a table being recovered, unless the table
+// already contains its version.
+void replayRecord(Table& table, const LogRecord& record) {
+    if (record.version <= table.version) return;
+    table.version = record.version;
+    for (const CellEdit& edit : record.edits) {
+        auto row = table.findRow(edit.row_id);
+        auto ordinal = table.findColumnOrdinal(edit.column_id);
+        if (row && ordinal) table.setCell(*row, *ordinal, edit.value);
+    }
+}
+
+}  // namespace
+
+template <typename T>
+static std::size_t stringMapMemory(const StringMap<T>& map) {
+    // Node-based map: one node per entry plus the bucket array.
+    std::size_t total = map.bucket_count() * sizeof(void*) +
+                        map.size() * (sizeof(typename StringMap<T>::value_type) + 2 * sizeof(void*));
+    for (const auto& [key, value] : map) {
+        if (key.capacity() > 15) total += key.capacity() + 1;
+    }
+    return total;
+}
+
+std::size_t RowIndex::memoryUsage() const {
+    std::size_t total = stringMapMemory(orphans) +
+                        (id_slots.capacity() + parent_slots.capacity() + roots.capacity()) * sizeof(std::uint32_t) +
+                        children.capacity() * sizeof(std::vector<std::uint32_t>);
+    for (const auto& list : children) {
+        total += list.capacity() * sizeof(std::uint32_t);
+    }
+    return total;
+}
+
+std::optional<std::size_t> Table::findRow(std::string_view row_id) const {
+    const auto& id_slots = index->id_slots;
+    if (id_slots.empty()) return std::nullopt;
+    const std::size_t mask = id_slots.size() - 1;
+    for (std::size_t probe = std::hash<std::string_view>{}(row_id) & mask;; probe = (probe + 1) & mask) {
+        const std::uint32_t slot = id_slots[probe];
+        if (slot == kNoSlot) return std::nullopt;
+        if (rowId(slot) == row_id) return slot;
+    }
+}
+
+RowIndex& Table::mutableIndex() {
+    // Same ownership argument as Column::mutableSegment.
+    if (index.use_count() != 1) index = std::make_shared<RowIndex>(*index);
+    return const_cast<RowIndex&>(*index);
+}
+
+void Table::indexRowId(RowIndex& rows, std::uint32_t slot) {
+    if ((rowCount() + 1) * 2 > rows.id_slots.size()) {
+        std::size_t capacity = rows.id_slots.empty() ? 16 : rows.id_slots.size() * 2;
+        while ((rowCount() + 1) * 2 > capacity) capacity *= 2;
+        rows.id_slots.assign(capacity, kNoSlot);
+        // Re-insert every slot already appended; the new one is handled below.
+        for (std::uint32_t existing = 0; existing < slot; ++existing) {
+            std::size_t probe = std::hash<std::string_view>{}(rowId(existing)) & (capacity - 1);
+            while (rows.id_slots[probe] != kNoSlot) probe = (probe + 1) & (capacity - 1);
+            rows.id_slots[probe] = existing;
+        }
+    }
+
+    const std::size_t mask = rows.id_slots.size() - 1;
+    std::size_t probe = std::hash<std::string_view>{}(rowId(slot)) & mask;
+    while (rows.id_slots[probe] != kNoSlot) probe = (probe + 1) & mask;
+    rows.id_slots[probe] = slot;
+}
+
+void Table::reindexRowIds() {
+    RowIndex& rows = mutableIndex();
+    std::size_t capacity = 16;
+    while ((rowCount() + 1) * 2 > capacity) capacity *= 2;
+    rows.id_slots.assign(capacity, kNoSlot);
+    for (std::uint32_t slot = 0; slot < rowCount(); ++slot) {
+        std::size_t probe = std::hash<std::string_view>{}(rowId(slot)) & (capacity - 1);
+        while (rows.id_slots[probe] != kNoSlot) probe = (probe + 1) & (capacity - 1);
+        rows.id_slots[probe] = slot;
+    }
+}
+
+bool Table::buildIndexes(std::string& error) {
+    const std::size_t rows = rowCount();
+    if (rows >= kNoSlot) {
+        error = "Too many rows";
+        return false;
+    }
+
+    auto built = std::make_shared<RowIndex>();
+    std::size_t capacity = 16;
+    while ((rows + 1) * 2 > capacity) capacity *= 2;
+    built->id_slots.assign(capacity, kNoSlot);
+    for (std::uint32_t slot = 0; slot < rows; ++slot) {
+        const std::string_view id = rowId(slot);
+        std::size_t probe = std::hash<std::string_view>{}(id) & (capacity - 1);
+        for (; built->id_slots[probe] != kNoSlot; probe = (probe + 1) & (capacity - 1)) {
+            if (rowId(built->id_slots[probe]) == id) {
+                error = "Duplicate row id " + std::string(id);
+                return false;
+            }
+        }
+        built->id_slots[probe] = slot;
+    }
+    index = built;
+
+    // Children end up in slot order, the order appendRow() produces.
+    // Siblings tend to be adjacent, so the last parent looked up is kept.
+    built->parent_slots.assign(rows, kNoSlot);
+    built->children.resize(rows);
+    std::optional<std::string_view> last_parent_id;
+    std::optional<std::size_t> last_parent;
+    for (std::uint32_t slot = 0; slot < rows; ++slot) {
+        const auto parent_id = parentId(slot);
+        if (parent_id && parent_id != last_parent_id) {
+            last_parent_id = parent_id;
+            last_parent = findRow(*parent_id);
+        }
+        if (!parent_id) {
+            built->roots.push_back(slot);
+        } else if (auto parent = last_parent) {
+            built->parent_slots[slot] = static_cast<std::uint32_t>(*parent);
+            built->children[*parent].push_back(slot);
+        } else {
+            built->orphans[std::string(*parent_id)].push_back(slot);
+        }
+    }
+
+    // Preorder from every row without a parent slot. A row it never reaches
+    // sits on a parent cycle.
+    std::vector<std::uint32_t> order;
+    order.reserve(rows);
+    std::vector<std::uint32_t> stack;
+    for (std::uint32_t slot = 0; slot < rows; ++slot) {
+        if (built->parent_slots[slot] != kNoSlot) continue;
+        stack.push_back(slot);
+        while (!stack.empty()) {
+            const std::uint32_t node = stack.back();
+            stack.pop_back();
+            order.push_back(node);
+            const auto& below = built->children[node];
+            stack.insert(stack.end(), below.rbegin(), below.rend());
+        }
+    }
+    if (order.size() != rows) {
+        std::vector<bool> reached(rows, false);
+        for (std::uint32_t slot : order) reached[slot] = true;
+        const auto cycle = std::find(reached.begin(), reached.end(), false) - reached.begin();
+        error = "Row " + std::string(rowId(cycle)) + " is its own ancestor";
+        return false;
+    }
+
+    // Reverse preorder visits every row after all of its descendants.
+    for (std::size_t ordinal = 0; ordinal < schema.size(); ++ordinal) {
+        if (!hasRollup(ordinal)) continue;
+        std::vector<Aggregate> totals(rows);
+        for (std::uint32_t slot = 0; slot < rows; ++slot) {
+            if (auto value = numericCell(slot, ordinal)) totals[slot].add(*value);
+        }
+        for (auto it = order.rbegin(); it != order.rend(); ++it) {
+            const std::uint32_t parent = built->parent_slots[*it];
+            if (parent != kNoSlot) totals[parent].merge(totals[*it]);
+        }
+        RollupColumn rollup;
+        for (const Aggregate& total : totals) {
+            rollup.append(total);
+        }
+        rollups[ordinal] = std::move(rollup);
+    }
+    return true;
+}
+
+void Table::setSchema(std::vector<ColumnDef> defs) {
+    schema = std::move(defs);
+    columns.clear();
+    columns.reserve(schema.size());
+    rollups.assign(schema.size(), RollupColumn{});
+    text_indexes.assign(schema.size(), TextIndex{});
+    auto ordinals = std::make_shared<StringMap<std::uint32_t>>();
+    for (std::size_t i = 0; i < schema.size(); ++i) {
+        columns.emplace_back(schema[i].type);
+        ordinals->emplace(schema[i].id, static_cast<std::uint32_t>(i));
+    }
+    column_index = std::move(ordinals);
+}
+
+bool Table::alterSchema(std::vector<ColumnDef> defs, std::string& error) {
+    auto ordinals = std::make_shared<StringMap<std::uint32_t>>();
+    for (std::size_t i = 0; i < defs.size(); ++i) {
+        const ColumnDef& def = defs[i];
+        if (def.id.empty()) {
+            error = "Column ids must not be empty";
+            return false;
+        }
+        if (!ordinals->emplace(def.id, static_cast<std::uint32_t>(i)).second) {
+            error = "Duplicate column " + def.id;
+            return false;
+        }
+        if (auto kept = findColumnOrdinal(def.id); kept && schema[*kept].type != def.type) {
+            error = "Column " + def.id + " cannot change its type";
+            return false;
+        }
+    }
+    if (findColumnOrdinal(primary_key) && !ordinals->contains(primary_key)) {
+        error = "The primary key column cannot be removed";
+        return false;
+    }
+
+    // Kept columns are moved, not copied: their segments stay shared with
+    // the versions this one was copied from.
+    std::vector<Column> next_columns;
+    std::vector<RollupColumn> next_rollups(defs.size());
+    std::vector<TextIndex> next_text_indexes(defs.size());
+    next_columns.reserve(defs.size());
+    for (std::size_t i = 0; i < defs.size(); ++i) {
+        if (auto kept = findColumnOrdinal(defs[i].id)) {
+            next_columns.push_back(std::move(columns[*kept]));
+            next_rollups[i] = std::move(rollups[*kept]);
+            next_text_indexes[i] = std::move(text_indexes[*kept]);
+            continue;
+        }
+        Column& column = next_columns.emplace_back(defs[i].type);
+        for (std::size_t slot = 0; slot < rowCount(); ++slot) {
+            column.append(CellValue{nullptr});
+            if (isNumeric(defs[i].type)) next_rollups[i].append();
+        }
+        if (defs[i].type == ColumnType::String) next_text_indexes[i].build(column);
+    }
+    schema = std::move(defs);
+    columns = std::move(next_columns);
+    rollups = std::move(next_rollups);
+    text_indexes = std::move(next_text_indexes);
+    column_index = std::move(ordinals);
+    return true;
+}
+
+bool Table::appendRow(const std::string& row_id,
+                      const std::optional<std::string>& parent_id,
+                      const std::vector<std::pair<std::string, CellValue>>& cells) {
+    if (findRow(row_id)) return false;
+    if (parent_id.has_value() && parent_id.value() == row_id) return false;
+
+    std::optional<std::size_t> parent;
+    if (parent_id.has_value()) parent = findRow(parent_id.value());
+    if (parent && index->orphans.contains(row_id)) {
+        // Adopting the waiting children must not close a loop: reject the row
+        // if its parent chain tops out at an orphan waiting for this very row.
+        std::size_t top = *parent;
+        while (index->parent_slots[top] != kNoSlot) top = index->parent_slots[top];
+        if (parentId(top) == std::optional<std::string_view>(row_id)) return false;
+    }
+
+    std::vector<const CellValue*> ordered(schema.size(), nullptr);
+    for (const auto& [key, value] : cells) {
+        auto ordinal = findColumnOrdinal(key);
+        if (!ordinal) return false;
+        ordered[*ordinal] = &value;
+    }
+
+    // Validate before touching any column so a bad row is rejected as a whole.
+    for (std::size_t i = 0; i < schema.size(); ++i) {
+        if (ordered[i] && !fitsColumnType(schema[i].type, *ordered[i])) return false;
+    }
+
+    row_ids.append(row_id);
+    parent_ids.append(parent_id.has_value() ? CellValue{parent_id.value()} : CellValue{nullptr});
+    for (std::size_t i = 0; i < schema.size(); ++i) {
+        columns[i].append(ordered[i] ? *ordered[i] : CellValue{nullptr});
+    }
+
+    const auto slot = static_cast<std::uint32_t>(rowCount() - 1);
+    RowIndex& rows = mutableIndex();
+    indexRowId(rows, slot);
+    rows.children.emplace_back();
+    rows.parent_slots.push_back(kNoSlot);
+
+    if (!parent_id.has_value()) {
+        rows.roots.push_back(slot);
+    } else if (parent) {
+        rows.parent_slots[slot] = static_cast<std::uint32_t>(*parent);
+        rows.children[*parent].push_back(slot);
+    } else {
+        rows.orphans[parent_id.value()].push_back(slot);
+    }
+
+    // Adopt children that arrived before this row.
+    if (auto waiting = rows.orphans.find(row_id); waiting != rows.orphans.end()) {
+        for (std::uint32_t child : waiting->second) {
+            rows.parent_slots[child] = slot;
+        }
+        auto& list = rows.children[slot];
+        list.insert(list.end(), waiting->second.begin(), waiting->second.end());
+        rows.orphans.erase(waiting);
+    }
+
+    rollupAppended(slot);
+    return true;
+}
+
+bool Table::setCell(std::size_t slot, std::size_t ordinal, const CellValue& value) {
+    const std::optional<double> before = numericCell(slot, ordinal);
+    if (!columns[ordinal].set(slot, value)) return false;
+    rollupChanged(slot, ordinal, before);
+    if (schema[ordinal].type == ColumnType::String) text_indexes[ordinal].changed(columns[ordinal], slot);
+    return true;
+}
+
+void Table::buildTextIndexes() {
+    text_indexes.assign(schema.size(), TextIndex{});
+    for (std::size_t ordinal = 0; ordinal < schema.size(); ++ordinal) {
+        if (schema[ordinal].type == ColumnType::String) text_indexes[ordinal].build(columns[ordinal]);
+    }
+}
+
+std::optional<double> Table::numericCell(std::size_t slot, std::size_t ordinal) const {
+    if (!hasRollup(ordinal) || columns[ordinal].isNull(slot)) return std::nullopt;
+    return columns[ordinal].segment(slot / kSegmentRows).number(slot % kSegmentRows);
+}
+
+void Table::rollupAppended(std::uint32_t slot) {
+    const auto& parents = index->parent_slots;
+    for (std::size_t ordinal = 0; ordinal < schema.size(); ++ordinal) {
+        if (!hasRollup(ordinal)) continue;
+        RollupColumn& rollup = rollups[ordinal];
+        rollup.append();
+
+        // The new row's subtree is itself plus any orphans it just adopted,
+        // whose own roll-ups are already complete.
+        Aggregate subtree;
+        if (auto value = numericCell(slot, ordinal)) subtree.add(*value);
+        for (std::uint32_t child : index->children[slot]) {
+            subtree.merge(rollup.at(child));
+        }
+        rollup.mutableAt(slot) = subtree;
+
+        for (std::uint32_t node = parents[slot]; node != kNoSlot; node = parents[node]) {
+            rollup.mutableAt(node).merge(subtree);
+        }
+    }
+}
+
+void Table::rollupChanged(std::size_t slot, std::size_t ordinal, std::optional<double> before) {
+    if (!hasRollup(ordinal)) return;
+    const std::optional<double> after = numericCell(slot, ordinal);
+    if (before == after) return;
+
+    RollupColumn& rollup = rollups[ordinal];
+    const auto& parents = index->parent_slots;
+    for (std::size_t node = slot; node != kNoSlot; node = parents[node]) {
+        Aggregate& total = rollup.mutableAt(node);
+        if (before) {
+            total.sum -= *before;
+            --total.count;
+        }
+        if (after) {
+            total.sum += *after;
+            ++total.count;
+        }
+        if (total.count == 0) total.sum = 0.0;  // drop accumulated rounding error
+
+        if (before && (*before == total.min || *before == total.max)) {
+            // The old value may have been the extreme: rebuild min/max from
+            // the row itself and its children, which are already up to date.
+            Aggregate extremes;
+            if (auto own = numericCell(node, ordinal)) extremes.add(*own);
+            for (std::uint32_t child : index->children[node]) {
+                extremes.merge(rollup.at(child));
+            }
+            total.min = extremes.min;
+            total.max = extremes.max;
+        } else if (after) {
+            total.min = std::min(total.min, *after);
+            total.max = std::max(total.max, *after);
+        }
+    }
+}
+
+std::size_t Table::memoryUsage() const {
+    std::size_t total = sizeof(*this) + schema.capacity() * sizeof(ColumnDef) + row_ids.memoryUsage() +
+                        parent_ids.memoryUsage() + (column_index ? stringMapMemory(*column_index) : 0) +
+                        index->memoryUsage();
+    for (const auto& column : columns) {
+        total += column.memoryUsage();
+    }
+    for (const auto& rollup : rollups) {
+        total += rollup.memoryUsage();
+    }
+    for (const auto& text_index : text_indexes) {
+        total += text_index.memoryUsage();
+    }
+    return total;
+}
+
+DataStore::DataStore() {
+    for (CatalogShard& shard : catalog_) {
+        shard.owner = std::make_shared<const CatalogMap>();
+        shard.current.store(shard.owner.get(), std::memory_order_release);
+    }
+
+    Table employees;
+    employees.id = "employees";
+    employees.name = "HR";
+    employees.primary_key = "id";
+    employees.parent_key = "pid";
+    employees.setSchema({
+        {"id", "ID", ColumnType::String, 120, true, true, false, true},
+        {"name", "Name", ColumnType::String, 260, true, false, true, false},
+        {"position", "Position", ColumnType::String, 200, false, false, true, false},
+        {"salary", "Salary", ColumnType::Currency, 120, false, false, true, false},
+        {"active", "Active", ColumnType::Bool, 80, false, false, true, false},
+    });
+
+    employees.appendRow("1", std::nullopt, {{"id", "1"}, {"name", "Ivanov I.I."}, {"position", "CEO"}, {"salary", 500000}, {"active", true}});
+    employees.appendRow("2", std::make_optional<std::string>("1"), {{"id", "2"}, {"name", "Petrov P.P."}, {"position", "CTO"}, {"salary", 400000}, {"active", true}});
+    employees.appendRow("3", std::make_optional<std::string>("2"), {{"id", "3"}, {"name", "Sidorov S.S."}, {"position", "Senior Engineer"}, {"salary", 300000}, {"active", true}});
+    employees.appendRow("4", std::make_optional<std::string>("2"), {{"id", "4"}, {"name", "Kuznetsov K.K."}, {"position", "Junior Engineer"}, {"salary", 80000}, {"active", false}});
+    employees.appendRow("5", std::nullopt, {{"id", "5"}, {"name", "Accounting"}, {"position", "Department"}, {"salary", 0}, {"active", true}});
+    employees.appendRow("6", std::make_optional<std::string>("5"), {{"id", "6"}, {"name", "Smirnova A.A."}, {"position", "Chief Accountant"}, {"salary", 250000}, {"active", true}});
+
+    addTable(std::move(employees));
+
+    Table inventory;
+    inventory.id = "inventory";
+    inventory.name = "Warehouse";
+    inventory.primary_key = "sku";
+    inventory.parent_key = "parent_sku";
+    inventory.setSchema({
+        {"sku", "SKU", ColumnType::String, 160, true, true, false, true},
+        {"item_name", "Item", ColumnType::String, 300, false, false, true, false},
+        {"qty", "Quantity", ColumnType::Number, 100, false, false, true, false},
+        {"price", "Unit price", ColumnType::Currency, 120, false, false, true, false},
+        {"zone", "Zone", ColumnType::String, 80, false, false, true, false},
+    });
+
+    inventory.appendRow("100", std::nullopt, {{"sku", "ELEC-001"}, {"item_name", "Electronics"}, {"qty", 0}, {"price", 0.0}, {"zone", "A"}});
+    inventory.appendRow("101", std::make_optional<std::string>("100"), {{"sku", "CPU-INT-9"}, {"item_name", "Intel Core i9"}, {"qty", 45}, {"price", 500.0}, {"zone", "A1"}});
+    inventory.appendRow("102", std::make_optional<std::string>("100"), {{"sku", "GPU-NV-40"}, {"item_name", "Nvidia RTX 4090"}, {"qty", 12}, {"price", 1800.0}, {"zone", "A2"}});
+    inventory.appendRow("200", std::nullopt, {{"sku", "FURN-001"}, {"item_name", "Furniture"}, {"qty", 0}, {"price", 0.0}, {"zone", "B"}});
+    inventory.appendRow("201", std::make_optional<std::string>("200"), {{"sku", "CH-OFF-B"}, {"item_name", "Office Chair"}, {"qty", 150}, {"price", 120.0}, {"zone", "B5"}});
+
+    addTable(std::move(inventory));
+}
+
+DataStore::~DataStore() = default;
+
+bool DataStore::openDurable(const DurabilityOptions& options, std::string& error) {
+    std::error_code ec;
+    std::filesystem::create_directories(options.directory, ec);
+    if (ec) {
+        error = "Cannot create " + options.directory + ": " + ec.message();
+        return false;
+    }
+
+    // The snapshot, when there is one, replaces the built-in tables.
+    auto snapshot = loadSnapshot(options.directory + kSnapshotFile, error);
+    if (!error.empty()) return false;
+    std::uint64_t segment = 0;
+    if (snapshot) {
+        for (CatalogShard& shard : catalog_) {
+            std::lock_guard lock(shard.mutex);
+            publishShard(shard, std::make_shared<const CatalogMap>());
+        }
+        for (Table& table : snapshot->tables) {
+            addTable(std::move(table));
+        }
+        segment = snapshot->log_segment;
+    }
+
+    // Replay into one private copy per table, then publish each table once.
+    // A null copy is a table the log drops.
+    StringMap<std::shared_ptr<Table>> recovering;
+    for (const auto& slot : holdSlots()) {
+        recovering.emplace(slot->owner->id, std::make_shared<Table>(*slot->owner));
+    }
+    std::uint64_t replayed = 0;
+    std::vector<std::string> images;  // named by replayed records
+    std::string replay_error;
+    auto apply = [&](const LogRecord& record) {
+        if (!replay_error.empty()) return;
+        ++replayed;
+        auto it = recovering.find(record.table_id);
+        const std::shared_ptr<Table> table = it == recovering.end() ? nullptr : it->second;
+        switch (record.kind) {
+        case LogRecord::Kind::Edits:
+            if (table) replayRecord(*table, record);
+            return;
+        case LogRecord::Kind::PutTable: {
+            images.push_back(record.image);
+            if (table && record.version <= table->version) return;
+            auto image = loadSnapshot(options.directory + "/" + record.image, replay_error);
+            if (!image || image->tables.size() != 1) {
+                if (replay_error.empty()) replay_error = "Missing table image " + record.image;
+                return;
+            }
+            auto loaded = std::make_shared<Table>(std::move(image->tables.front()));
+            loaded->version = record.version;
+            loaded->buildTextIndexes();
+            recovering[record.table_id] = std::move(loaded);
+            return;
+        }
+        case LogRecord::Kind::DropTable:
+            if (!table || record.version < table->version) return;
+            first_version_ = std::max(first_version_.load(), table->version + 1);
+            it->second = nullptr;
+            return;
+        case LogRecord::Kind::AlterSchema:
+            if (!table || record.version <= table->version) return;
+            if (!table->alterSchema(record.schema, replay_error)) return;
+            table->version = record.version;
+            return;
+        }
+    };
+    // Segments older than the snapshot are leftovers of an interrupted
+    // checkpoint.
+    WriteAheadLog::removeSegmentsBefore(options.directory, segment);
+    for (std::uint64_t existing : WriteAheadLog::listSegments(options.directory)) {
+        if (!WriteAheadLog::replay(options.directory, existing, apply, error)) return false;
+        if (!replay_error.empty()) {
+            error = "Write-ahead log segment " + std::to_string(existing) + ": " + replay_error;
+            return false;
+        }
+        segment = existing + 1;
+    }
+    for (auto& [id, table] : recovering) {
+        auto handle = holdSlot(id);
+        if (!handle) {
+            if (table) addTable(std::move(*table));
+            continue;
+        }
+        TableSlot& slot = *handle;
+        if (!table) {
+            CatalogShard& shard = catalog_[shardIndex(id)];
+            std::lock_guard catalog(shard.mutex);
+            auto next = std::make_shared<CatalogMap>(*shard.owner);
+            next->erase(id);
+            publishShard(shard, std::move(next));
+            continue;
+        }
+        std::lock_guard lock(slot.write_mutex);
+        if (table->version == slot.owner->version) continue;
+        // Replayed edits are not in the change log.
+        slot.changed_rows.reset(table->version);
+        publish(slot, std::move(table));
+    }
+
+    // Images no record names were written by catalog changes that never
+    // got logged.
+    std::uint64_t next_image = 0;
+    std::error_code list_error;
+    for (const auto& entry : std::filesystem::directory_iterator(options.directory, list_error)) {
+        const std::string name = entry.path().filename().string();
+        const auto number = imageNumber(name);
+        if (!number) continue;
+        next_image = std::max(next_image, *number + 1);
+        if (std::find(images.begin(), images.end(), name) == images.end()) std::filesystem::remove(entry.path(), list_error);
+    }
+    next_image_ = next_image;
+    logged_images_ = std::move(images);
+
+    log_ = WriteAheadLog::open(options.directory, segment, options.sync, options.sync_interval, error);
+    if (!log_) return false;
+    durable_directory_ = options.directory;
+    if (replayed == 0) checkpointed_ = 0;
+    if (options.snapshot_interval.count() > 0) {
+        checkpointer_ = std::jthread([this, interval = options.snapshot_interval](std::stop_token stop) {
+            runCheckpoints(stop, interval);
+        });
+    }
+    return true;
+}
+
+bool DataStore::checkpoint(std::string& error) {
+    if (!log_) {
+        error = "Durability is not enabled";
+        return false;
+    }
+    std::lock_guard lock(checkpoint_mutex_);
+    return checkpointLocked(error);
+}
+
+bool DataStore::checkpointLocked(std::string& error) {
+    const std::uint64_t appended = log_->appended();
+    if (checkpointed_ == appended) return true;
+
+    // Every record in the segments before the new one belongs to a version
+    // at or below the one pinned next: writers log and publish under the
+    // table's write lock.
+    const auto segment = log_->rotate();
+    if (!segment) {
+        error = "Write-ahead log failed";
+        return false;
+    }
+    const auto slots = holdSlots();
+    std::vector<std::shared_ptr<const Table>> tables;
+    tables.reserve(slots.size());
+    for (const auto& slot : slots) {
+        std::lock_guard write(slot->write_mutex);
+        // Procedural tables are generated again on start.
+        if (!slot->dropped && !slot->owner->procedural) tables.push_back(slot->owner);
+    }
+    if (!writeSnapshot(durable_directory_ + kSnapshotFile, tables, *segment, error)) return false;
+
+    WriteAheadLog::removeSegmentsBefore(durable_directory_, *segment);
+    for (const std::string& image : logged_images_) {
+        std::error_code ec;
+        std::filesystem::remove(durable_directory_ + "/" + image, ec);
+    }
+    logged_images_.clear();
+    checkpointed_ = appended;
+    return true;
+}
+
+void DataStore::runCheckpoints(std::stop_token stop, std::chrono::seconds interval) {
+    std::mutex mutex;
+    std::condition_variable_any wake;
+    std::unique_lock lock(mutex);
+    while (!wake.wait_for(lock, stop, interval, [] { return false; })) {
+        if (stop.stop_requested()) return;
+        std::string error;
+        if (!checkpoint(error)) std::cerr << "Checkpoint failed: " << error << std::endl;
+    }
+}
+
+void RowChangeLog::reset(std::uint64_t floor) {
+    std::lock_guard lock(mutex_);
+    entries_.clear();
+    floor_ = floor;
+}
+
+void RowChangeLog::append(std::uint64_t version, const std::vector<std::size_t>& slots) {
+    std::lock_guard lock(mutex_);
+    for (std::size_t slot : slots) entries_.emplace_back(version, slot);
+    while (entries_.size() > kCapacity) {
+        // Changes after the dropped entry's version may be incomplete, but
+        // the ones after the previous version no longer are.
+        floor_ = entries_.front().first;
+        entries_.pop_front();
+    }
+}
+
+std::optional<std::vector<std::size_t>> RowChangeLog::changedSince(std::uint64_t since, std::uint64_t upto) const {
+    std::vector<std::size_t> slots;
+    {
+        std::lock_guard lock(mutex_);
+        if (since < floor_ || since > upto) return std::nullopt;
+        // Entries are in version order: scan back from the newest.
+        for (auto it = entries_.rbegin(); it != entries_.rend() && it->first > since; ++it) {
+            if (it->first <= upto) slots.push_back(it->second);
+        }
+    }
+    std::sort(slots.begin(), slots.end());
+    slots.erase(std::unique(slots.begin(), slots.end()), slots.end());
+    return slots;
+}
+
+DataStore::TableSlot* DataStore::findSlot(std::string_view id) const {
+    const CatalogMap& shard = *catalog_[shardIndex(id)].current.load(std::memory_order_seq_cst);
+    auto it = shard.find(id);
+    return it == shard.end() ? nullptr : it->second.get();
+}
+
+std::shared_ptr<DataStore::TableSlot> DataStore::holdSlot(std::string_view id) const {
+    Epoch::Guard guard;
+    const CatalogMap& shard = *catalog_[shardIndex(id)].current.load(std::memory_order_seq_cst);
+    auto it = shard.find(id);
+    return it == shard.end() ? nullptr : it->second;
+}
+
+std::vector<std::shared_ptr<DataStore::TableSlot>> DataStore::holdSlots() const {
+    std::vector<std::shared_ptr<TableSlot>> slots;
+    Epoch::Guard guard;
+    for (const CatalogShard& shard : catalog_) {
+        for (const auto& [id, slot] : *shard.current.load(std::memory_order_seq_cst)) {
+            slots.push_back(slot);
+        }
+    }
+    return slots;
+}
+
+std::shared_ptr<DataStore::TableSlot> DataStore::makeSlot(std::shared_ptr<Table> table) {
+    auto slot = std::make_shared<TableSlot>(table->version);
+    slot->current.store(table.get(), std::memory_order_release);
+    slot->owner = std::move(table);
+    return slot;
+}
+
+void DataStore::addTable(Table table) {
+    table.buildTextIndexes();
+    CatalogShard& shard = catalog_[shardIndex(table.id)];
+    std::lock_guard lock(shard.mutex);
+    auto next = std::make_shared<CatalogMap>(*shard.owner);
+    auto slot = makeSlot(std::make_shared<Table>(std::move(table)));
+    (*next)[slot->owner->id] = std::move(slot);
+    publishShard(shard, std::move(next));
+}
+
+void DataStore::publishShard(CatalogShard& shard, std::shared_ptr<const CatalogMap> next) {
+    shard.current.store(next.get(), std::memory_order_seq_cst);
+    Epoch::retire(std::exchange(shard.owner, std::move(next)));
+}
+
+void DataStore::publish(TableSlot& slot, std::shared_ptr<Table> next) {
+    slot.current.store(next.get(), std::memory_order_seq_cst);
+    Epoch::retire(std::exchange(slot.owner, std::move(next)));
+}
+
+void DataStore::replace(TableSlot& slot, std::shared_ptr<Table> next) {
+    next->version = slot.owner->version + 1;
+    const std::uint64_t version = next->version;
+    const std::string id = next->id;
+    // Row slots of the old version mean nothing in the new one.
+    slot.changed_rows.reset(version);
+    publish(slot, std::move(next));
+    changes_.resync(id, version);
+}
+
+std::unique_lock<std::mutex> DataStore::lockCatalogChange() {
+    return log_ ? std::unique_lock(checkpoint_mutex_) : std::unique_lock<std::mutex>();
+}
+
+bool DataStore::writeImage(const std::shared_ptr<const Table>& table, std::string& image, std::string& error) {
+    image.clear();
+    // Procedural tables are generated again on start.
+    if (!log_ || table->procedural) return true;
+    image = imageName(next_image_++);
+    return writeSnapshot(durable_directory_ + "/" + image, {table}, 0, error);
+}
+
+std::uint64_t DataStore::logCatalogChange(const LogRecord& record) {
+    if (!log_ || (record.kind == LogRecord::Kind::PutTable && record.image.empty())) return 0;
+    if (!record.image.empty()) logged_images_.push_back(record.image);
+    return log_->append(record);
+}
+
+bool DataStore::waitCatalogChange(std::uint64_t ticket, std::string& error) {
+    if (ticket == 0 || log_->waitDurable(ticket)) return true;
+    error = "Write-ahead log failed";
+    return false;
+}
+
+bool DataStore::putTable(Table table, std::string& error) {
+    table.buildTextIndexes();
+    auto next = std::make_shared<Table>(std::move(table));
+    std::string image;
+    if (!writeImage(next, image, error)) return false;
+    std::uint64_t ticket = 0;
+    {
+        auto durable = lockCatalogChange();
+        CatalogShard& shard = catalog_[shardIndex(next->id)];
+        std::lock_guard catalog(shard.mutex);
+        LogRecord record;
+        record.kind = LogRecord::Kind::PutTable;
+        record.table_id = next->id;
+        record.image = image;
+        if (auto it = shard.owner->find(next->id); it != shard.owner->end()) {
+            TableSlot& slot = *it->second;
+            // Logged under the writer lock, ahead of the next version's edits.
+            std::lock_guard lock(slot.write_mutex);
+            replace(slot, next);
+            record.version = next->version;
+            ticket = logCatalogChange(record);
+        } else {
+            next->version = first_version_.load();
+            record.version = next->version;
+            auto map = std::make_shared<CatalogMap>(*shard.owner);
+            map->emplace(next->id, makeSlot(next));
+            publishShard(shard, std::move(map));
+            ticket = logCatalogChange(record);
+        }
+    }
+    return waitCatalogChange(ticket, error);
+}
+
+CatalogStatus DataStore::createTable(Table table, std::string& error) {
+    if (table.id.empty()) {
+        error = "Table id must not be empty";
+        return CatalogStatus::Invalid;
+    }
+    table.buildTextIndexes();
+    auto next = std::make_shared<Table>(std::move(table));
+    std::string image;
+    if (!writeImage(next, image, error)) return CatalogStatus::Failed;
+    std::uint64_t ticket = 0;
+    {
+        auto durable = lockCatalogChange();
+        CatalogShard& shard = catalog_[shardIndex(next->id)];
+        std::lock_guard catalog(shard.mutex);
+        if (shard.owner->contains(next->id)) {
+            if (!image.empty()) std::filesystem::remove(durable_directory_ + "/" + image);
+            error = "Table already exists";
+            return CatalogStatus::AlreadyExists;
+        }
+        next->version = first_version_.load();
+        auto map = std::make_shared<CatalogMap>(*shard.owner);
+        map->emplace(next->id, makeSlot(next));
+        publishShard(shard, std::move(map));
+        LogRecord record;
+        record.kind = LogRecord::Kind::PutTable;
+        record.table_id = next->id;
+        record.version = next->version;
+        record.image = image;
+        ticket = logCatalogChange(record);
+    }
+    return waitCatalogChange(ticket, error) ? CatalogStatus::Ok : CatalogStatus::NotDurable;
+}
+
+CatalogStatus DataStore::dropTable(const std::string& id, std::string& error) {
+    std::uint64_t ticket = 0;
+    {
+        auto durable = lockCatalogChange();
+        CatalogShard& shard = catalog_[shardIndex(id)];
+        std::lock_guard catalog(shard.mutex);
+        auto it = shard.owner->find(id);
+        if (it == shard.owner->end()) {
+            error = "Table not found";
+            return CatalogStatus::NotFound;
+        }
+        // The handle keeps the slot alive once the old map is reclaimed.
+        const std::shared_ptr<TableSlot> slot = it->second;
+        std::lock_guard lock(slot->write_mutex);
+        slot->dropped = true;
+        const std::uint64_t last = slot->owner->version;
+        std::uint64_t first = first_version_.load();
+        while (first <= last && !first_version_.compare_exchange_weak(first, last + 1)) {
+        }
+
+        auto next = std::make_shared<CatalogMap>(*shard.owner);
+        next->erase(id);
+        publishShard(shard, std::move(next));
+        changes_.resync(id, last);
+        // Replay meets the dropped table's edits first, so a table created
+        // with the same id later never receives them.
+        LogRecord record;
+        record.kind = LogRecord::Kind::DropTable;
+        record.table_id = id;
+        record.version = last;
+        ticket = logCatalogChange(record);
+    }
+    return waitCatalogChange(ticket, error) ? CatalogStatus::Ok : CatalogStatus::NotDurable;
+}
+
+CatalogStatus DataStore::alterSchema(const std::string& id, std::vector<ColumnDef> schema, std::string& error) {
+    auto slot = holdSlot(id);
+    if (!slot) {
+        error = "Table not found";
+        return CatalogStatus::NotFound;
+    }
+    std::uint64_t ticket = 0;
+    {
+        auto durable = lockCatalogChange();
+        std::lock_guard lock(slot->write_mutex);
+        if (slot->dropped) {
+            error = "Table not found";
+            return CatalogStatus::NotFound;
+        }
+        if (slot->owner->procedural) {
+            // The generated values and the edits follow the column ordinals.
+            error = "Procedural tables cannot be altered";
+            return CatalogStatus::Invalid;
+        }
+        LogRecord record;
+        record.kind = LogRecord::Kind::AlterSchema;
+        record.table_id = id;
+        record.schema = schema;
+        auto next = std::make_shared<Table>(*slot->owner);
+        if (!next->alterSchema(std::move(schema), error)) return CatalogStatus::Invalid;
+        replace(*slot, next);
+        record.version = next->version;
+        ticket = logCatalogChange(record);
+    }
+    return waitCatalogChange(ticket, error) ? CatalogStatus::Ok : CatalogStatus::NotDurable;
+}
+
+TableView DataStore::read(const std::string& id) const {
+    return TableView([&]() -> const Table* {
+        const TableSlot* slot = findSlot(id);
+        return slot ? slot->current.load(std::memory_order_seq_cst) : nullptr;
+    });
+}
+
+std::optional<std::vector<std::size_t>> DataStore::changedRows(const Table& table, std::uint64_t since) const {
+    auto slot = holdSlot(table.id);
+    if (!slot) return std::nullopt;
+    return slot->changed_rows.changedSince(since, table.version);
+}
+
+std::vector<std::pair<std::string, std::string>> DataStore::listTables() const {
+    std::vector<std::pair<std::string, std::string>> list;
+    {
+        Epoch::Guard guard;
+        for (const CatalogShard& shard : catalog_) {
+            for (const auto& [id, slot] : *shard.current.load(std::memory_order_seq_cst)) {
+                list.push_back({id, slot->current.load(std::memory_order_seq_cst)->name});
+            }
+        }
+    }
+    std::sort(list.begin(), list.end());
+    return list;
+}
+
+bool DataStore::updateCell(const std::string& table_id,
+                           const std::string& row_id,
+                           const std::string& column_id,
+                           const CellValue& value,
+                           std::string& error_message) {
+    std::vector<std::string> errors;
+    if (updateCells(table_id, {{row_id, column_id, value}}, errors)) return true;
+    error_message = errors.front();
+    return false;
+}
+
+bool DataStore::updateCells(const std::string& table_id,
+                            const std::vector<CellEdit>& edits,
+                            std::vector<std::string>& errors) {
+    errors.assign(edits.size(), std::string());
+    auto handle = holdSlot(table_id);
+    if (edits.empty()) return handle != nullptr;
+    if (!handle) {
+        std::fill(errors.begin(), errors.end(), "Table not found");
+        return false;
+    }
+
+    TableSlot& slot = *handle;
+    std::unique_lock lock(slot.write_mutex);
+    if (slot.dropped) {
+        std::fill(errors.begin(), errors.end(), "Table not found");
+        return false;
+    }
+    const Table& current = *slot.owner;
+
+    // Validate everything against the current version before copying it.
+    std::vector<std::pair<std::size_t, std::size_t>> targets;  // (row slot, column ordinal) per edit
+    targets.reserve(edits.size());
+    bool valid = true;
+    for (std::size_t i = 0; i < edits.size(); ++i) {
+        const CellEdit& edit = edits[i];
+        std::string& error = errors[i];
+        targets.emplace_back(0, 0);
+
+        const ColumnDef* column = findColumn(current, edit.column_id);
+        if (!column) {
+            error = "Column not found";
+        } else if (column->is_primary) {
+            error = "Primary key column is read-only";
+        } else if (!column->is_editable) {
+            error = "Column is read-only";
+        } else if (!fitsColumnType(column->type, edit.value)) {
+            error = "Value does not match column type";
+        } else if (auto row = current.procedural ? current.procedural->findRow(edit.row_id) : current.findRow(edit.row_id)) {
+            targets.back() = {*row, static_cast<std::size_t>(column - current.schema.data())};
+            continue;
+        } else {
+            error = "Row not found";
+        }
+        valid = false;
+    }
+    if (!valid) return false;
+    // Edits of procedural tables are not logged; they are lost on restart
+    // with the rest of the table.
+    const bool logged = log_ && !current.procedural;
+    if (logged && log_->failed()) {
+        std::fill(errors.begin(), errors.end(), "Write-ahead log unavailable");
+        return false;
+    }
+
+    auto next = std::make_shared<Table>(current);
+    next->version = current.version + 1;
+    std::vector<CellDelta> deltas;
+    deltas.reserve(edits.size());
+    std::vector<std::size_t> rows;
+    rows.reserve(edits.size());
+    for (std::size_t i = 0; i < edits.size(); ++i) {
+        const auto [row, ordinal] = targets[i];
+        rows.push_back(row);
+        if (next->procedural) {
+            // Readers of older versions skip the edit, so it can be recorded
+            // before the version is published. Values that fit the column
+            // are stored as they are.
+            next->procedural->edit(next->version, row, ordinal, edits[i].value);
+            deltas.push_back({edits[i].row_id, edits[i].column_id, edits[i].value, next->version});
+            continue;
+        }
+        next->setCell(row, ordinal, edits[i].value);
+        // Publish the stored form of the value so watchers see what readers see.
+        deltas.push_back({edits[i].row_id, edits[i].column_id, next->columns[ordinal].get(row), next->version});
+    }
+
+    // Logged under the writer lock, so the log holds each table's versions
+    // in order.
+    const WriteAheadLog::Ticket ticket = logged ? log_->append(table_id, next->version, edits) : 0;
+    // Before publishing, so a reader of the new version finds its rows.
+    slot.changed_rows.append(next->version, rows);
+    publish(slot, std::move(next));
+    // Still under the writer lock, so deltas reach watchers in version order.
+    changes_.publish(table_id, deltas);
+    lock.unlock();
+
+    if (logged && !log_->waitDurable(ticket)) {
+        std::fill(errors.begin(), errors.end(), "Update applied but not durable: write-ahead log failed");
+        return false;
+    }
+    return true;
+}
+
+const ColumnDef* findColumn(const Table& table, std::string_view column_id) {
+    auto ordinal = table.findColumnOrdinal(column_id);
+    return ordinal ? &table.schema[*ordinal] : nullptr;
+}
@@ -0,0 +1,383 @@
+#pragma once
+
+#include "change_feed.h"
+#include "column_store.h"
+#include "epoch.h"
+#include "rollup.h"
+#include "text_index.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+struct ColumnDef {
+    std::string id;
+    std::string title;
+    ColumnType type;
+    int width;
+    bool is_tree;
+    bool is_pinned;
+    bool is_editable;
+    bool is_primary;
+};
+
+// Transparent hash so string-keyed indexes can be probed with string_view.
+struct StringHash {
+    using is_transparent = void;
+    std::size_t operator()(std::string_view value) const { return std::hash<std::string_view>{}(value); }
+};
+
+template <typename T>
+using StringMap = std::unordered_map<std::string, T, StringHash, std::equal_to<>>;
+
+inline constexpr std::uint32_t kNoSlot = UINT32_MAX;
+
+class ProceduralTable;
+
+// Row lookup structures maintained by Table::appendRow.
+struct RowIndex {
+    std::vector<std::uint32_t> id_slots;               // open-addressing hash set of slots keyed by row id
+    std::vector<std::uint32_t> parent_slots;           // row slot -> parent slot, kNoSlot for roots/orphans
+    std::vector<std::vector<std::uint32_t>> children;  // row slot -> child slots in insertion order
+    std::vector<std::uint32_t> roots;                  // slots without a parent id
+    StringMap<std::vector<std::uint32_t>> orphans;     // missing parent id -> waiting child slots
+
+    std::size_t memoryUsage() const;
+};
+
+// Column-oriented table: row slot i is the i-th entry of every column.
+//
+// A published Table is an immutable version. Writers copy it (cheaply: the
+// columns and indexes are shared until written), mutate the copy and publish
+// it as the next version.
+struct Table : std::enable_shared_from_this<Table> {
+    std::string id;
+    std::string name;
+    std::string primary_key;
+    std::string parent_key;
+    std::vector<ColumnDef> schema;
+    std::uint64_t version = 0;  // bumped on every published change
+
+    Column row_ids{ColumnType::String};     // primary key value per row slot
+    Column parent_ids{ColumnType::String};  // parent key for tree nodes, null for roots
+    std::vector<Column> columns;            // parallel to schema
+    std::vector<RollupColumn> rollups;      // parallel to schema, only filled for Number/Currency
+    std::vector<TextIndex> text_indexes;    // parallel to schema, only filled for String
+
+    std::shared_ptr<const StringMap<std::uint32_t>> column_index;  // column id -> schema ordinal
+    std::shared_ptr<const RowIndex> index = std::make_shared<RowIndex>();
+
+    // Set when the rows are generated rather than stored; this table then
+    // has none of its own. See procedural_table.h.
+    std::shared_ptr<ProceduralTable> procedural;
+
+    std::size_t rowCount() const { return row_ids.size(); }
+
+    std::string_view rowId(std::size_t slot) const {
+        return row_ids.segment(slot / kSegmentRows).string(slot % kSegmentRows);
+    }
+
+    std::optional<std::string_view> parentId(std::size_t slot) const {
+        const ColumnSegment& segment = parent_ids.segment(slot / kSegmentRows);
+        if (segment.isNull(slot % kSegmentRows)) return std::nullopt;
+        return segment.string(slot % kSegmentRows);
+    }
+
+    std::optional<std::size_t> findRow(std::string_view row_id) const;
+
+    std::optional<std::size_t> findColumnOrdinal(std::string_view column_id) const {
+        if (!column_index) return std::nullopt;
+        auto it = column_index->find(column_id);
+        if (it == column_index->end()) return std::nullopt;
+        return it->second;
+    }
+
+    const std::vector<std::uint32_t>& children(std::size_t slot) const { return index->children[slot]; }
+
+    bool hasRollup(std::size_t ordinal) const { return isNumeric(schema[ordinal].type); }
+    const Aggregate& rollup(std::size_t slot, std::size_t ordinal) const { return rollups[ordinal].at(slot); }
+
+    // Replaces the schema and creates one empty column per definition.
+    void setSchema(std::vector<ColumnDef> defs);
+
+    // Replaces the schema, keeping the values, roll-ups and text indexes of
+    // the columns whose id stays; see DataStore::alterSchema for the rules.
+    bool alterSchema(std::vector<ColumnDef> defs, std::string& error);
+
+    // Appends a row; cells missing from the list are stored as null. Rejects
+    // duplicate row ids and values that do not match their column type.
+    bool appendRow(const std::string& row_id,
+                   const std::optional<std::string>& parent_id,
+                   const std::vector<std::pair<std::string, CellValue>>& cells);
+
+    // Sets one cell and patches the roll-ups of the row and its ancestors,
+    // and the text index of a String column.
+    bool setCell(std::size_t slot, std::size_t ordinal, const CellValue& value);
+
+    // Rebuilds the row id lookup from row_ids, for tables restored in bulk.
+    void reindexRowIds();
+
+    // Builds the row index and the roll-ups from scratch, for tables whose
+    // columns were filled in bulk. Parents may appear after their children.
+    // Fails on duplicate row ids and on rows that are their own ancestor.
+    bool buildIndexes(std::string& error);
+
+    // Builds the text index of every String column from scratch. Tables
+    // get them as they enter the catalog.
+    void buildTextIndexes();
+
+    std::size_t memoryUsage() const;
+
+private:
+    std::optional<double> numericCell(std::size_t slot, std::size_t ordinal) const;
+    void rollupAppended(std::uint32_t slot);
+    void rollupChanged(std::size_t slot, std::size_t ordinal, std::optional<double> before);
+
+    RowIndex& mutableIndex();
+    void indexRowId(RowIndex& rows, std::uint32_t slot);
+};
+
+// Pins the current version of a table. Reads through the view never take a
+// lock and stay consistent while writers publish newer versions. Views are
+// meant to be short-lived and stay on the creating thread; use share() to
+// keep a version alive beyond that.
+class TableView {
+public:
+    explicit operator bool() const { return table_ != nullptr; }
+    const Table& operator*() const { return *table_; }
+    const Table* operator->() const { return table_; }
+    const Table* get() const { return table_; }
+
+    std::shared_ptr<const Table> share() const { return table_ ? table_->shared_from_this() : nullptr; }
+
+private:
+    friend class DataStore;
+
+    // find() runs once the guard is pinned and returns the version to view.
+    template <typename Find>
+    explicit TableView(Find&& find)
+        : table_(find()) {}
+
+    Epoch::Guard guard_;  // must be pinned before table_ is loaded
+    const Table* table_;
+};
+
+// One cell assignment of a batch update.
+struct CellEdit {
+    std::string row_id;
+    std::string column_id;
+    CellValue value;
+};
+
+// When an acknowledged update is guaranteed to survive a crash.
+enum class SyncPolicy {
+    Always,    // fsynced before the update is acknowledged
+    Interval,  // written before it is acknowledged, fsynced in the background
+    Never,     // written before it is acknowledged, flushed whenever the OS decides
+};
+
+struct DurabilityOptions {
+    std::string directory;  // write-ahead log segments and the latest snapshot
+    SyncPolicy sync = SyncPolicy::Always;
+    std::chrono::milliseconds sync_interval{100};  // SyncPolicy::Interval only
+    std::chrono::seconds snapshot_interval{60};    // 0 disables periodic snapshots
+};
+
+// Row slots touched by the recent versions of one table, so a client that
+// holds some version can fetch just the rows changed since. At most
+// kCapacity entries are kept; the oldest are dropped first.
+class RowChangeLog {
+public:
+    static constexpr std::size_t kCapacity = std::size_t{1} << 16;
+
+    explicit RowChangeLog(std::uint64_t floor) : floor_(floor) {}
+
+    // Forgets every entry: any row may have changed by version floor.
+    void reset(std::uint64_t floor);
+
+    void append(std::uint64_t version, const std::vector<std::size_t>& slots);
+
+    // Sorted, distinct slots of the rows changed by versions in (since,
+    // upto]; nullopt when some of those versions are no longer logged.
+    std::optional<std::vector<std::size_t>> changedSince(std::uint64_t since, std::uint64_t upto) const;
+
+private:
+    mutable std::mutex mutex_;
+    std::deque<std::pair<std::uint64_t, std::size_t>> entries_;  // (version, row slot), oldest first
+    std::uint64_t floor_;  // every change after this version is in entries_
+};
+
+// Outcome of a change to the set of tables or to a table's schema.
+enum class CatalogStatus {
+    Ok,
+    NotFound,
+    AlreadyExists,
+    Invalid,     // the table or schema was rejected; see the error
+    NotDurable,  // applied, but the write-ahead log failed
+    Failed,      // not applied: the table image could not be written
+};
+
+class WriteAheadLog;
+struct LogRecord;
+
+class DataStore {
+public:
+    DataStore();
+    ~DataStore();
+
+    // Restores the tables from options.directory (the latest snapshot, then
+    // the write-ahead log written since) and logs every later update there.
+    // Call once, before serving any request.
+    bool openDurable(const DurabilityOptions& options, std::string& error);
+    // Whether openDurable() succeeded: writes then wait for the log.
+    bool durable() const { return log_ != nullptr; }
+
+    // Snapshots every table and deletes the log segments the snapshot
+    // covers. Runs periodically once openDurable() succeeds.
+    bool checkpoint(std::string& error);
+
+    // Publishes a complete table as the next version of the table with the
+    // same id, or adds it when there is none. Watchers are told to refetch.
+    // With a write-ahead log the table is written to an image file next to
+    // the log, and a record naming it is durable before the call returns;
+    // the catalog changes below are logged the same way.
+    bool putTable(Table table, std::string& error);
+
+    // Adds a table, which may already hold rows. Its versions start above
+    // those of every table dropped before, so nothing keyed by id and
+    // version mistakes it for an earlier table with the same id.
+    CatalogStatus createTable(Table table, std::string& error);
+
+    // Removes a table. Views of it stay readable; writers that have not
+    // published yet fail with "Table not found". Watchers are told to
+    // refetch, which then fails.
+    CatalogStatus dropTable(const std::string& id, std::string& error);
+
+    // Replaces the column definitions of a table as its next version.
+    // Columns that keep their id keep their values and must keep their
+    // type; added columns are null in every row. The primary key column
+    // cannot be removed. Watchers are told to refetch.
+    CatalogStatus alterSchema(const std::string& id, std::vector<ColumnDef> schema, std::string& error);
+
+    // (id, name) of every table, sorted by id. Takes no lock, so tables
+    // created or dropped meanwhile may or may not be listed.
+    std::vector<std::pair<std::string, std::string>> listTables() const;
+
+    TableView read(const std::string& id) const;
+
+    bool updateCell(const std::string& table_id,
+                    const std::string& row_id,
+                    const std::string& column_id,
+                    const CellValue& value,
+                    std::string& error_message);
+
+    // Applies every edit as one new table version, or none of them. errors
+    // is resized to edits.size(); entry i is empty when edit i is valid.
+    // Returns true when the batch was applied.
+    //
+    // With a write-ahead log, the call returns once the batch is as durable
+    // as the sync policy promises. Readers may see the new version slightly
+    // earlier, since the table lock is released before waiting on the log so
+    // that concurrent writers share one flush.
+    bool updateCells(const std::string& table_id,
+                     const std::vector<CellEdit>& edits,
+                     std::vector<std::string>& errors);
+
+    // Cell-level deltas of every published update, tagged with the version.
+    ChangeFeed& changes() { return changes_; }
+
+    // Slots of the rows of table that changed after version since, or
+    // nullopt when the change log no longer reaches back that far.
+    std::optional<std::vector<std::size_t>> changedRows(const Table& table, std::uint64_t since) const;
+
+private:
+    struct TableSlot {
+        std::atomic<const Table*> current{nullptr};
+        std::shared_ptr<const Table> owner;  // guarded by write_mutex
+        std::mutex write_mutex;              // serializes writers of this table
+        RowChangeLog changed_rows;           // appended before each publish
+        bool dropped = false;                // guarded by write_mutex
+
+        explicit TableSlot(std::uint64_t version) : changed_rows(version) {}
+    };
+
+    // The catalog maps table ids to slots. It is split by id hash into
+    // shards, each an immutable map that a catalog change replaces with an
+    // edited copy, retiring the old map through Epoch. Looking a table up
+    // is two atomic loads and a hash probe without any lock, and a catalog
+    // change copies one shard: about 1/kCatalogShards of the tables.
+    // Dropped slots live on while a retired map or a writer refers to them.
+    static constexpr std::size_t kCatalogShards = 64;
+    using CatalogMap = StringMap<std::shared_ptr<TableSlot>>;
+    struct alignas(64) CatalogShard {
+        std::atomic<const CatalogMap*> current{nullptr};
+        std::shared_ptr<const CatalogMap> owner;  // guarded by mutex
+        std::mutex mutex;                         // serializes changes to this shard
+    };
+
+    static std::size_t shardIndex(std::string_view id) { return StringHash{}(id) % kCatalogShards; }
+    // Valid while the caller's Epoch::Guard stays pinned.
+    TableSlot* findSlot(std::string_view id) const;
+    // Kept alive by the handle, for writers that may block.
+    std::shared_ptr<TableSlot> holdSlot(std::string_view id) const;
+    std::vector<std::shared_ptr<TableSlot>> holdSlots() const;
+
+    static std::shared_ptr<TableSlot> makeSlot(std::shared_ptr<Table> table);
+    // Adds a table while nothing is served yet.
+    void addTable(Table table);
+    // Caller holds shard.mutex.
+    static void publishShard(CatalogShard& shard, std::shared_ptr<const CatalogMap> next);
+    // Caller holds slot.write_mutex.
+    static void publish(TableSlot& slot, std::shared_ptr<Table> next);
+    // Replaces the table of a live slot with next as its next version.
+    // Caller holds slot.write_mutex.
+    void replace(TableSlot& slot, std::shared_ptr<Table> next);
+
+    // With a write-ahead log, held while a catalog change is published and
+    // logged, so that a checkpoint covers both or neither.
+    std::unique_lock<std::mutex> lockCatalogChange();
+    // Writes the image a PutTable record names, before any lock is taken.
+    // Leaves image empty when the table is not logged.
+    bool writeImage(const std::shared_ptr<const Table>& table, std::string& image, std::string& error);
+    // Caller holds the lock returned by lockCatalogChange(). Returns the
+    // log ticket, or 0 when nothing is logged.
+    std::uint64_t logCatalogChange(const LogRecord& record);
+    // Called once the locks are released, so concurrent changes share a flush.
+    bool waitCatalogChange(std::uint64_t ticket, std::string& error);
+    // Caller holds checkpoint_mutex_.
+    bool checkpointLocked(std::string& error);
+    void runCheckpoints(std::stop_token stop, std::chrono::seconds interval);
+
+    std::array<CatalogShard, kCatalogShards> catalog_;
+    // Versions of created tables start here: past the last version of every
+    // dropped table.
+    std::atomic<std::uint64_t> first_version_{0};
+    ChangeFeed changes_;
+
+    std::string durable_directory_;
+    std::unique_ptr<WriteAheadLog> log_;
+    std::mutex checkpoint_mutex_;  // one checkpoint at a time; guards checkpointed_ and logged_images_
+    // Log records appended before the last snapshot; nullopt while records
+    // replayed at startup are not covered by a snapshot yet.
+    std::optional<std::uint64_t> checkpointed_;
+    // Images named by records the last snapshot does not cover; the next
+    // checkpoint deletes them.
+    std::vector<std::string> logged_images_;
+    std::atomic<std::uint64_t> next_image_{0};
+    std::jthread checkpointer_;  // last member: stops before the log closes
+};
+
+const ColumnDef* findColumn(const Table& table, std::string_view column_id);
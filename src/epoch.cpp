@@ -0,0 +1,109 @@
+#include "epoch.h"
+
+#include <atomic>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace {
+
+// One record per live thread that has ever pinned. Records are recycled when
+// threads exit and never freed, so scanning the list needs no synchronization
+// beyond the atomics themselves.
+struct alignas(64) ThreadRecord {
+    std::atomic<std::uint64_t> epoch{0};  // 0 while the thread is not pinned
+    std::atomic<bool> in_use{false};
+    ThreadRecord* next = nullptr;
+};
+
+struct Retired {
+    std::shared_ptr<const void> object;
+    std::uint64_t epoch;
+};
+
+std::atomic<std::uint64_t> global_epoch{1};
+std::atomic<ThreadRecord*> records{nullptr};
+
+std::mutex retired_mutex;
+std::vector<Retired> retired;
+
+ThreadRecord* acquireRecord() {
+    for (ThreadRecord* record = records.load(std::memory_order_acquire); record; record = record->next) {
+        bool expected = false;
+        if (!record->in_use.load(std::memory_order_relaxed) &&
+            record->in_use.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+            return record;
+        }
+    }
+
+    auto* record = new ThreadRecord;
+    record->in_use.store(true, std::memory_order_relaxed);
+    ThreadRecord* head = records.load(std::memory_order_relaxed);
+    do {
+        record->next = head;
+    } while (!records.compare_exchange_weak(head, record, std::memory_order_release, std::memory_order_relaxed));
+    return record;
+}
+
+struct ThreadState {
+    ThreadRecord* record = acquireRecord();
+    unsigned depth = 0;
+
+    ~ThreadState() { record->in_use.store(false, std::memory_order_release); }
+};
+
+thread_local ThreadState thread_state;
+
+std::uint64_t oldestPinnedEpoch() {
+    std::uint64_t oldest = UINT64_MAX;
+    for (ThreadRecord* record = records.load(std::memory_order_acquire); record; record = record->next) {
+        const std::uint64_t epoch = record->epoch.load(std::memory_order_seq_cst);
+        if (epoch != 0 && epoch < oldest) oldest = epoch;
+    }
+    return oldest;
+}
+
+}  // namespace
+
+Epoch::Guard::Guard() {
+    ThreadState& state = thread_state;
+    if (state.depth++ == 0) {
+        // seq_cst pairs with the writer's publish + scan: either the writer
+        // sees this pin, or this reader sees the already-published version.
+        state.record->epoch.store(global_epoch.load(std::memory_order_seq_cst), std::memory_order_seq_cst);
+    }
+}
+
+Epoch::Guard::~Guard() {
+    ThreadState& state = thread_state;
+    if (--state.depth == 0) {
+        state.record->epoch.store(0, std::memory_order_release);
+    }
+}
+
+void Epoch::retire(std::shared_ptr<const void> object) {
+    const std::uint64_t epoch = global_epoch.fetch_add(1, std::memory_order_seq_cst);
+
+    std::vector<std::shared_ptr<const void>> reclaimable;
+    {
+        std::lock_guard lock(retired_mutex);
+        retired.push_back({std::move(object), epoch});
+
+        const std::uint64_t oldest = oldestPinnedEpoch();
+        auto keep = retired.begin();
+        for (auto it = retired.begin(); it != retired.end(); ++it) {
+            if (it->epoch < oldest) {
+                reclaimable.push_back(std::move(it->object));
+            } else {
+                *keep++ = std::move(*it);
+            }
+        }
+        retired.erase(keep, retired.end());
+    }
+    // Destructors run outside the lock; they may be arbitrarily expensive.
+}
+
+std::size_t Epoch::pending() {
+    std::lock_guard lock(retired_mutex);
+    return retired.size();
+}
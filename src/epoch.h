@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+// Epoch-based reclamation for objects published through atomic pointers.
+//
+// Readers wrap every access to a published object in an Epoch::Guard. Pinning
+// only writes the reader's own cache line, so readers never contend with each
+// other or with writers. A writer that unpublishes an object hands its owning
+// pointer to Epoch::retire; the object is released once every reader that
+// could still observe it has left its guard.
+class Epoch {
+public:
+    class Guard {
+    public:
+        Guard();
+        ~Guard();
+
+        Guard(const Guard&) = delete;
+        Guard& operator=(const Guard&) = delete;
+    };
+
+    // Releases object after all guards active at the time of the call exit.
+    static void retire(std::shared_ptr<const void> object);
+
+    // Number of retired objects still waiting for readers to leave.
+    static std::size_t pending();
+};
@@ -0,0 +1,107 @@
+#include "json_writer.h"
+
+#include <charconv>
+#include <cmath>
+
+void JsonWriter::appendEscaped(std::string& out, std::string_view text) {
+    static constexpr char kHex[] = "0123456789abcdef";
+
+    std::size_t plain = 0;  // start of the run not yet copied
+    for (std::size_t i = 0; i < text.size(); ++i) {
+        const auto c = static_cast<unsigned char>(text[i]);
+        if (c >= 0x20 && c != '"' && c != '\\') continue;
+
+        out.append(text.data() + plain, i - plain);
+        plain = i + 1;
+        switch (c) {
+        case '"': out.append("\\\""); break;
+        case '\\': out.append("\\\\"); break;
+        case '\n': out.append("\\n"); break;
+        case '\r': out.append("\\r"); break;
+        case '\t': out.append("\\t"); break;
+        case '\b': out.append("\\b"); break;
+        case '\f': out.append("\\f"); break;
+        default:
+            out.append("\\u00");
+            out.push_back(kHex[c >> 4]);
+            out.push_back(kHex[c & 0xf]);
+        }
+    }
+    out.append(text.data() + plain, text.size() - plain);
+}
+
+std::string JsonWriter::keyFragment(std::string_view name) {
+    std::string fragment;
+    fragment.reserve(name.size() + 3);
+    fragment.push_back('"');
+    appendEscaped(fragment, name);
+    fragment.append("\":");
+    return fragment;
+}
+
+void JsonWriter::key(std::string_view name) {
+    separate();
+    out_.push_back('"');
+    appendEscaped(out_, name);
+    out_.append("\":");
+    comma_ = false;
+}
+
+void JsonWriter::value(std::string_view text) {
+    separate();
+    out_.push_back('"');
+    appendEscaped(out_, text);
+    out_.push_back('"');
+    comma_ = true;
+}
+
+void JsonWriter::value(std::int64_t number) {
+    separate();
+    char buffer[24];
+    auto [end, ec] = std::to_chars(buffer, buffer + sizeof(buffer), number);
+    out_.append(buffer, end);
+    comma_ = true;
+}
+
+void JsonWriter::value(std::uint64_t number) {
+    separate();
+    char buffer[24];
+    auto [end, ec] = std::to_chars(buffer, buffer + sizeof(buffer), number);
+    out_.append(buffer, end);
+    comma_ = true;
+}
+
+void JsonWriter::value(double number) {
+    if (!std::isfinite(number)) {
+        null();
+        return;
+    }
+    separate();
+    // Shortest text that parses back to the same double.
+    char buffer[32];
+    auto [end, ec] = std::to_chars(buffer, buffer + sizeof(buffer), number);
+    out_.append(buffer, end);
+    comma_ = true;
+}
+
+void JsonWriter::value(bool flag) {
+    separate();
+    out_.append(flag ? "true" : "false");
+    comma_ = true;
+}
+
+void JsonWriter::null() {
+    separate();
+    out_.append("null");
+    comma_ = true;
+}
+
+std::string jsonError(std::string_view message) {
+    std::string out;
+    JsonWriter json(out);
+    json.beginObject();
+    json.key("error");
+    json.value(message);
+    json.endObject();
+    return out;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Appends JSON text straight to a caller-owned buffer, without building a
+// document tree. The writer only inserts separators; callers are trusted to
+// nest begin/end calls correctly and to put a key before every object member.
+class JsonWriter {
+public:
+    explicit JsonWriter(std::string& out)
+        : out_(out) {}
+
+    void beginObject() { open('{'); }
+    void endObject() { close('}'); }
+    void beginArray() { open('['); }
+    void endArray() { close(']'); }
+
+    // Writes `"name":`, escaping the name.
+    void key(std::string_view name);
+
+    // Writes a fragment produced by keyFragment() as the next member key.
+    void rawKey(std::string_view fragment) {
+        separate();
+        out_.append(fragment);
+        comma_ = false;
+    }
+
+    void value(std::string_view text);
+    void value(const char* text) { value(std::string_view(text)); }
+    void value(std::int64_t number);
+    void value(std::uint64_t number);
+    void value(int number) { value(static_cast<std::int64_t>(number)); }
+    void value(double number);  // non-finite numbers are written as null
+    void value(bool flag);
+    void null();
+
+    // The `"name":` text of a key, escaped once so that it can be reused
+    // for every row.
+    static std::string keyFragment(std::string_view name);
+
+    // Appends the escaped contents of a JSON string, without quotes.
+    static void appendEscaped(std::string& out, std::string_view text);
+
+private:
+    void separate() {
+        if (comma_) out_.push_back(',');
+    }
+
+    void open(char bracket) {
+        separate();
+        out_.push_back(bracket);
+        comma_ = false;
+    }
+
+    void close(char bracket) {
+        out_.push_back(bracket);
+        comma_ = true;
+    }
+
+    std::string& out_;
+    bool comma_ = false;  // the next element needs a leading comma
+};
+
+// {"error":"<message>"}
+std::string jsonError(std::string_view message);
@@ -1,599 +1,950 @@
+#include "arrow_ipc.h"
 #include "crow.h"
-#include "table.grpc.pb.h"
+#include "data_store.h"
+#include "json_writer.h"
+#include "metrics.h"
+#include "procedural_table.h"
+#include "query.h"
+#include "response_cache.h"
+#include "rest_json.h"
+#include "service_common.h"
+#include "table_export.h"
+#include "table_loader.h"
+#include "table_service.h"
+#include "text_search.h"
 
 #include <algorithm>
-#include <cmath>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
+#include <stop_token>
 #include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <future>
 #include <iostream>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <optional>
+#include <random>
+#include <span>
 #include <string>
+#include <string_view>
+#include <system_error>
 #include <thread>
-#include <variant>
 #include <vector>
 
-#include <grpcpp/grpcpp.h>
-
-// Universal value used for cells (aligned with protobuf oneof)
-using CellValue = std::variant<std::string, int, double, bool, std::nullptr_t>;
-
-enum class ColumnType {
-    String,
-    Number,
-    Currency,
-    Bool,
-};
-
-std::string toString(ColumnType t) {
-    switch (t) {
-    case ColumnType::String:
-        return "string";
-    case ColumnType::Number:
-        return "number";
-    case ColumnType::Currency:
-        return "currency";
-    case ColumnType::Bool:
-        return "bool";
+// Splits a comma-separated query parameter; a missing parameter is empty.
+std::vector<std::string_view> splitParam(const char* param) {
+    std::vector<std::string_view> parts;
+    if (!param) return parts;
+    std::string_view rest(param);
+    while (!rest.empty()) {
+        const std::size_t comma = rest.find(',');
+        if (comma != 0) parts.push_back(rest.substr(0, comma));
+        if (comma == std::string_view::npos) break;
+        rest.remove_prefix(comma + 1);
     }
-    return "string";
+    return parts;
 }
 
-struct ColumnDef {
-    std::string id;
-    std::string title;
-    ColumnType type;
-    int width;
-    bool is_tree;
-    bool is_pinned;
-    bool is_editable;
-    bool is_primary;
-};
-
-struct Row {
-    std::string id;                          // primary key value
-    std::optional<std::string> parent_id;    // parent key for tree nodes
-    std::map<std::string, CellValue> cells;  // dynamic cells keyed by column id
-};
-
-struct Table {
-    std::string id;
-    std::string name;
-    std::string primary_key;
-    std::string parent_key;
-    std::vector<ColumnDef> schema;
-    std::vector<Row> rows;
-};
-
-crow::json::wvalue valueToJson(const CellValue& v) {
-    if (std::holds_alternative<int>(v)) return std::get<int>(v);
-    if (std::holds_alternative<double>(v)) return std::get<double>(v);
-    if (std::holds_alternative<bool>(v)) return std::get<bool>(v);
-    if (std::holds_alternative<std::string>(v)) return std::get<std::string>(v);
-    return nullptr;
-}
-
-class DataStore {
+// Pushes change-feed batches to WebSocket watchers from one thread, so
+// writers only enqueue a ready connection and never serialize JSON.
+class WebSocketWatchers {
 public:
-    DataStore();
-
-    std::vector<std::pair<std::string, std::string>> listTables() const;
+    explicit WebSocketWatchers(DataStore& db)
+        : db_(db),
+          pump_([this](std::stop_token stop) { run(stop); }) {}
+
+    bool open(crow::websocket::connection& conn, const std::string& table_id) {
+        if (!db_.read(table_id)) return false;
+
+        // Register under the lock so the pump cannot see a ready connection
+        // before its watcher entry exists.
+        std::lock_guard lock(mutex_);
+        auto* key = &conn;
+        auto subscription = db_.changes().subscribe(table_id, [this, key] { markReady(key); });
+        std::uint64_t baseline = 0;
+        {
+            auto table = db_.read(table_id);
+            baseline = table ? table->version : 0;
+        }
 
-    Table* getTable(const std::string& id) {
-        auto it = tables_.find(id);
-        if (it == tables_.end()) return nullptr;
-        return &it->second;
+        watchers_[key] = {subscription, baseline};
+        crow::json::wvalue hello;
+        hello["version"] = baseline;
+        hello["resyncRequired"] = false;
+        hello["deltas"] = crow::json::wvalue::list();
+        conn.send_text(hello.dump());
+        return true;
     }
 
-    const Table* getTable(const std::string& id) const {
-        auto it = tables_.find(id);
-        if (it == tables_.end()) return nullptr;
-        return &it->second;
+    void close(crow::websocket::connection& conn) {
+        std::shared_ptr<Subscription> subscription;
+        {
+            std::lock_guard lock(mutex_);
+            auto it = watchers_.find(&conn);
+            if (it == watchers_.end()) return;
+            subscription = it->second.subscription;
+            watchers_.erase(it);
+        }
+        db_.changes().unsubscribe(subscription);
     }
 
-    bool updateCell(const std::string& table_id,
-                    const std::string& row_id,
-                    const std::string& column_id,
-                    const CellValue& value,
-                    std::string& error_message);
-
 private:
-    std::map<std::string, Table> tables_;
-};
-
-DataStore::DataStore() {
-    Table employees;
-    employees.id = "employees";
-    employees.name = "HR";
-    employees.primary_key = "id";
-    employees.parent_key = "pid";
-    employees.schema = {
-        {"id", "ID", ColumnType::String, 120, true, true, false, true},
-        {"name", "Name", ColumnType::String, 260, true, false, true, false},
-        {"position", "Position", ColumnType::String, 200, false, false, true, false},
-        {"salary", "Salary", ColumnType::Currency, 120, false, false, true, false},
-        {"active", "Active", ColumnType::Bool, 80, false, false, true, false},
+    struct Watcher {
+        std::shared_ptr<Subscription> subscription;
+        std::uint64_t baseline = 0;
     };
 
-    employees.rows.push_back({"1", std::nullopt, {{"id", "1"}, {"name", "Ivanov I.I."}, {"position", "CEO"}, {"salary", 500000}, {"active", true}}});
-    employees.rows.push_back({"2", std::make_optional<std::string>("1"), {{"id", "2"}, {"name", "Petrov P.P."}, {"position", "CTO"}, {"salary", 400000}, {"active", true}}});
-    employees.rows.push_back({"3", std::make_optional<std::string>("2"), {{"id", "3"}, {"name", "Sidorov S.S."}, {"position", "Senior Engineer"}, {"salary", 300000}, {"active", true}}});
-    employees.rows.push_back({"4", std::make_optional<std::string>("2"), {{"id", "4"}, {"name", "Kuznetsov K.K."}, {"position", "Junior Engineer"}, {"salary", 80000}, {"active", false}}});
-    employees.rows.push_back({"5", std::nullopt, {{"id", "5"}, {"name", "Accounting"}, {"position", "Department"}, {"salary", 0}, {"active", true}}});
-    employees.rows.push_back({"6", std::make_optional<std::string>("5"), {{"id", "6"}, {"name", "Smirnova A.A."}, {"position", "Chief Accountant"}, {"salary", 250000}, {"active", true}}});
-
-    tables_[employees.id] = std::move(employees);
-
-    Table inventory;
-    inventory.id = "inventory";
-    inventory.name = "Warehouse";
-    inventory.primary_key = "sku";
-    inventory.parent_key = "parent_sku";
-    inventory.schema = {
-        {"sku", "SKU", ColumnType::String, 160, true, true, false, true},
-        {"item_name", "Item", ColumnType::String, 300, false, false, true, false},
-        {"qty", "Quantity", ColumnType::Number, 100, false, false, true, false},
-        {"price", "Unit price", ColumnType::Currency, 120, false, false, true, false},
-        {"zone", "Zone", ColumnType::String, 80, false, false, true, false},
-    };
-
-    inventory.rows.push_back({"100", std::nullopt, {{"sku", "ELEC-001"}, {"item_name", "Electronics"}, {"qty", 0}, {"price", 0.0}, {"zone", "A"}}});
-    inventory.rows.push_back({"101", std::make_optional<std::string>("100"), {{"sku", "CPU-INT-9"}, {"item_name", "Intel Core i9"}, {"qty", 45}, {"price", 500.0}, {"zone", "A1"}}});
-    inventory.rows.push_back({"102", std::make_optional<std::string>("100"), {{"sku", "GPU-NV-40"}, {"item_name", "Nvidia RTX 4090"}, {"qty", 12}, {"price", 1800.0}, {"zone", "A2"}}});
-    inventory.rows.push_back({"200", std::nullopt, {{"sku", "FURN-001"}, {"item_name", "Furniture"}, {"qty", 0}, {"price", 0.0}, {"zone", "B"}}});
-    inventory.rows.push_back({"201", std::make_optional<std::string>("200"), {{"sku", "CH-OFF-B"}, {"item_name", "Office Chair"}, {"qty", 150}, {"price", 120.0}, {"zone", "B5"}}});
-
-    tables_[inventory.id] = std::move(inventory);
-}
-
-std::vector<std::pair<std::string, std::string>> DataStore::listTables() const {
-    std::vector<std::pair<std::string, std::string>> list;
-    list.reserve(tables_.size());
-    for (const auto& [key, val] : tables_) {
-        list.push_back({key, val.name});
+    void markReady(crow::websocket::connection* conn) {
+        {
+            std::lock_guard lock(ready_mutex_);
+            ready_.push_back(conn);
+        }
+        wake_.notify_one();
     }
-    return list;
-}
 
-bool DataStore::updateCell(const std::string& table_id,
-                           const std::string& row_id,
-                           const std::string& column_id,
-                           const CellValue& value,
-                           std::string& error_message) {
-    auto table_it = tables_.find(table_id);
-    if (table_it == tables_.end()) {
-        error_message = "Table not found";
-        return false;
+    void run(std::stop_token stop) {
+        std::vector<crow::websocket::connection*> ready;
+        for (;;) {
+            {
+                std::unique_lock lock(ready_mutex_);
+                if (!wake_.wait(lock, stop, [&] { return !ready_.empty(); })) break;
+                ready.swap(ready_);
+            }
+
+            // Holding mutex_ while sending keeps close() from racing with a
+            // send on a connection Crow is about to destroy.
+            std::lock_guard lock(mutex_);
+            for (auto* conn : ready) {
+                auto it = watchers_.find(conn);
+                if (it == watchers_.end()) continue;
+                auto batch = it->second.subscription->drain();
+                std::erase_if(batch.deltas, [&](const CellDelta& delta) { return delta.version <= it->second.baseline; });
+                if (batch.deltas.empty() && !batch.resync_required) continue;
+                conn->send_text(buildChangesJson(batch).dump());
+            }
+            ready.clear();
+        }
     }
 
-    Table& table = table_it->second;
-    auto col_it = std::find_if(table.schema.begin(), table.schema.end(), [&](const ColumnDef& c) {
-        return c.id == column_id;
-    });
+    DataStore& db_;
+    std::mutex mutex_;  // guards watchers_
+    std::map<crow::websocket::connection*, Watcher> watchers_;
+    std::mutex ready_mutex_;
+    std::condition_variable_any wake_;
+    std::vector<crow::websocket::connection*> ready_;
+    std::jthread pump_;  // last member: starts after everything it uses
+};
 
-    if (col_it == table.schema.end()) {
-        error_message = "Column not found";
-        return false;
-    }
+struct CommandLine {
+    GrpcServerOptions grpc;
+    std::uint16_t http_port = 8083;
+    std::string http_unix_socket;  // a second REST listener when set
+    TableExportOptions table_export;
+    std::size_t response_cache_bytes = ResponseCache::kDefaultCapacity;
+    DurabilityOptions durability;  // disabled while directory is empty
+    std::vector<std::pair<std::string, std::string>> imports;  // schema file, data file
+    ProceduralSpec synthetic{0, 16, 1};                         // no synthetic table while rows is 0
+};
 
-    if (col_it->is_primary) {
-        error_message = "Primary key column is read-only";
+// Loads one --import=SCHEMA,DATA pair into db.
+bool importTable(DataStore& db, const std::string& schema_path, const std::string& data_path, std::string& error) {
+    std::ifstream file(schema_path);
+    if (!file) {
+        error = "Cannot open " + schema_path;
         return false;
     }
-
-    if (!col_it->is_editable) {
-        error_message = "Column is read-only";
+    const std::string text((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    const auto body = crow::json::load(text);
+    Table table;
+    if (!body) {
+        error = schema_path + ": invalid JSON";
         return false;
     }
-
-    auto row_it = std::find_if(table.rows.begin(), table.rows.end(), [&](const Row& r) {
-        return r.id == row_id;
-    });
-
-    if (row_it == table.rows.end()) {
-        error_message = "Row not found";
+    if (!parseSchemaJson(body, table, error)) {
+        error = schema_path + ": " + error;
         return false;
     }
 
-    row_it->cells[column_id] = value;
+    ImportStats stats;
+    if (!loadTableFile(table, data_path, error, &stats)) return false;
+    const std::string id = table.id;
+    if (!db.putTable(std::move(table), error)) return false;
+    std::cout << "Imported " << stats.rows << " rows into " << id << " in " << stats.seconds << " s ("
+              << static_cast<std::uint64_t>(stats.rowsPerSecond()) << " rows/s, peak RSS "
+              << stats.peak_rss_bytes / (1024 * 1024) << " MiB)" << std::endl;
     return true;
 }
 
-const ColumnDef* findColumn(const Table& table, const std::string& column_id) {
-    auto it = std::find_if(table.schema.begin(), table.schema.end(), [&](const ColumnDef& column) {
-        return column.id == column_id;
-    });
-    return it == table.schema.end() ? nullptr : &(*it);
+void sendError(crow::response& res, int code, std::string_view message) {
+    res.code = code;
+    res.body = jsonError(message);
+    res.end();
 }
 
-std::optional<CellValue> parseJsonValueForColumn(const crow::json::rvalue& node,
-                                                 const ColumnDef& column,
-                                                 std::string& error_message) {
-    using crow::json::type;
-
-    if (node.t() == type::Null) return std::nullptr_t{};
-
-    switch (column.type) {
-    case ColumnType::String:
-        if (node.t() == type::String) return node.s();
-        error_message = "Expected string value";
-        return std::nullopt;
-    case ColumnType::Bool:
-        if (node.t() == type::True || node.t() == type::False) return node.b();
-        error_message = "Expected boolean value";
-        return std::nullopt;
-    case ColumnType::Number:
-    case ColumnType::Currency:
-        if (node.t() == type::Number) {
-            double number = node.d();
-            if (column.type == ColumnType::Number && std::floor(number) == number) {
-                return static_cast<int>(number);
-            }
-            return number;
-        }
-        error_message = "Expected numeric value";
-        return std::nullopt;
+void sendCatalogError(crow::response& res, CatalogStatus status, const std::string& error) {
+    switch (status) {
+    case CatalogStatus::Ok:
+        break;
+    case CatalogStatus::NotFound:
+        return sendError(res, 404, error);
+    case CatalogStatus::AlreadyExists:
+        return sendError(res, 409, error);
+    case CatalogStatus::Invalid:
+        return sendError(res, 400, error);
+    case CatalogStatus::NotDurable:
+        return sendError(res, 500, "applied but not durable: " + error);
+    case CatalogStatus::Failed:
+        return sendError(res, 500, error);
     }
+}
 
-    error_message = "Unsupported type";
-    return std::nullopt;
+// Entity tags for conditional GETs. A data tag names the table version,
+// behind a token drawn at startup because versions start over when the
+// store is not durable. A schema tag hashes the schema document, so it
+// survives the cell edits that bump the version. Representations other
+// than JSON get tags of their own.
+std::string dataETag(const Table& table, std::string_view instance, std::string_view representation = {}) {
+    std::string tag = "\"" + std::string(instance) + "-" + std::to_string(table.version);
+    if (!representation.empty()) tag.append("-").append(representation);
+    return tag + "\"";
 }
 
-tables::ColumnType toProtoColumnType(ColumnType type) {
-    switch (type) {
-    case ColumnType::String:
-        return tables::COLUMN_TYPE_STRING;
-    case ColumnType::Number:
-        return tables::COLUMN_TYPE_NUMBER;
-    case ColumnType::Currency:
-        return tables::COLUMN_TYPE_CURRENCY;
-    case ColumnType::Bool:
-        return tables::COLUMN_TYPE_BOOL;
-    }
-    return tables::COLUMN_TYPE_STRING;
+constexpr std::string_view kArrowStreamType = "application/vnd.apache.arrow.stream";
+constexpr std::string_view kArrowFileType = "application/vnd.apache.arrow.file";
+
+// The Arrow format an Accept header asks for, if any. Quality values are
+// not weighed: naming an Arrow media type selects it.
+std::optional<ArrowFormat> acceptedArrowFormat(std::string_view accept) {
+    if (accept.find(kArrowStreamType) != std::string_view::npos) return ArrowFormat::Stream;
+    if (accept.find(kArrowFileType) != std::string_view::npos) return ArrowFormat::File;
+    return std::nullopt;
 }
 
-tables::Value toProtoValue(const CellValue& value) {
-    tables::Value proto;
-    if (std::holds_alternative<std::string>(value)) {
-        proto.set_string_value(std::get<std::string>(value));
-    } else if (std::holds_alternative<int>(value)) {
-        proto.set_int_value(static_cast<int64_t>(std::get<int>(value)));
-    } else if (std::holds_alternative<double>(value)) {
-        proto.set_double_value(std::get<double>(value));
-    } else if (std::holds_alternative<bool>(value)) {
-        proto.set_bool_value(std::get<bool>(value));
-    } else {
-        proto.set_null_value(::google::protobuf::NullValue::NULL_VALUE);
-    }
-    return proto;
+std::string schemaETag(std::string_view schema_json) {
+    std::uint64_t hash = 14695981039346656037ull;  // FNV-1a
+    for (unsigned char c : schema_json) hash = (hash ^ c) * 1099511628211ull;
+    char text[16];
+    auto end = std::to_chars(text, text + sizeof text, hash, 16).ptr;
+    return "\"s" + std::string(text, end) + "\"";
 }
 
-std::optional<CellValue> parseProtoValueForColumn(const tables::Value& proto_value,
-                                                  const ColumnDef& column,
-                                                  std::string& error_message) {
-    switch (proto_value.kind_case()) {
-    case tables::Value::kNullValue:
-        return std::nullptr_t{};
-    case tables::Value::kStringValue:
-        if (column.type == ColumnType::String) return proto_value.string_value();
-        error_message = "Expected string value";
-        return std::nullopt;
-    case tables::Value::kBoolValue:
-        if (column.type == ColumnType::Bool) return proto_value.bool_value();
-        error_message = "Expected boolean value";
-        return std::nullopt;
-    case tables::Value::kIntValue:
-        if (column.type == ColumnType::Currency) return static_cast<double>(proto_value.int_value());
-        if (column.type == ColumnType::Number) return static_cast<int>(proto_value.int_value());
-        error_message = "Expected numeric value";
-        return std::nullopt;
-    case tables::Value::kDoubleValue:
-        if (column.type == ColumnType::Currency) return proto_value.double_value();
-        if (column.type == ColumnType::Number) {
-            double number = proto_value.double_value();
-            if (std::floor(number) == number) return static_cast<int>(number);
-            return number;
+// Sets the ETag header, and answers 304 Not Modified when the request's
+// If-None-Match lists the tag (compared weakly, as RFC 9110 asks) or "*".
+bool endIfNotModified(const crow::request& req, crow::response& res, const std::string& etag) {
+    res.add_header("ETag", etag);
+    std::string_view tags = req.get_header_value("If-None-Match");
+    while (!tags.empty()) {
+        const std::size_t comma = tags.find(',');
+        std::string_view tag = tags.substr(0, comma);
+        tags = comma == std::string_view::npos ? std::string_view{} : tags.substr(comma + 1);
+        while (!tag.empty() && tag.front() == ' ') tag.remove_prefix(1);
+        while (!tag.empty() && tag.back() == ' ') tag.remove_suffix(1);
+        if (tag.starts_with("W/")) tag.remove_prefix(2);
+        if (tag == etag || tag == "*") {
+            res.code = 304;
+            res.end();
+            return true;
         }
-        error_message = "Expected numeric value";
-        return std::nullopt;
-    case tables::Value::KIND_NOT_SET:
-    default:
-        error_message = "Value is missing";
-        return std::nullopt;
     }
+    return false;
 }
 
-void fillProtoSchema(const Table& table, tables::TableSchema* schema) {
-    schema->set_table_id(table.id);
-    schema->set_name(table.name);
-    schema->set_primary_key(table.primary_key);
-    schema->set_parent_key(table.parent_key);
-
-    for (const auto& column : table.schema) {
-        auto* proto_column = schema->add_columns();
-        proto_column->set_id(column.id);
-        proto_column->set_title(column.title);
-        proto_column->set_type(toProtoColumnType(column.type));
-        proto_column->set_width(column.width);
-        proto_column->set_is_tree(column.is_tree);
-        proto_column->set_is_pinned(column.is_pinned);
-        proto_column->set_is_editable(column.is_editable && !column.is_primary);
-        proto_column->set_is_primary(column.is_primary);
-    }
-}
+// Crow middleware that times every request and counts its status and body
+// size under the route that served it. Routes are recognized from the URL,
+// so table ids never become label values.
+struct HttpMetrics {
+    static constexpr std::string_view kUnmatched = "<unmatched>";
 
-class TableServiceImpl final : public tables::TableService::Service {
-public:
-    explicit TableServiceImpl(DataStore& db)
-        : db_(db) {}
-
-    grpc::Status ListTables(grpc::ServerContext*,
-                            const tables::ListTablesRequest*,
-                            tables::ListTablesResponse* response) override {
-        auto list = db_.listTables();
-        for (const auto& [id, name] : list) {
-            auto* info = response->add_tables();
-            info->set_id(id);
-            info->set_name(name);
-        }
-        return grpc::Status::OK;
-    }
+    struct context {
+        std::chrono::steady_clock::time_point started;
+    };
 
-    grpc::Status GetSchema(grpc::ServerContext*,
-                           const tables::GetSchemaRequest* request,
-                           tables::GetSchemaResponse* response) override {
-        const Table* table = db_.getTable(request->table_id());
-        if (!table) {
-            return grpc::Status(grpc::StatusCode::NOT_FOUND, "table not found");
-        }
+    void before_handle(crow::request&, crow::response&, context& ctx) { ctx.started = std::chrono::steady_clock::now(); }
 
-        fillProtoSchema(*table, response->mutable_schema());
-        return grpc::Status::OK;
+    void after_handle(crow::request& req, crow::response& res, context& ctx) {
+        RequestMetrics* entry = metrics->route(routeOf(req));
+        if (!entry) entry = metrics->route(kUnmatched);
+        entry->finish(static_cast<std::size_t>(res.code) / 100, std::chrono::steady_clock::now() - ctx.started,
+                      res.body.size());
     }
 
-    grpc::Status GetData(grpc::ServerContext*,
-                         const tables::GetDataRequest* request,
-                         tables::GetDataResponse* response) override {
-        const Table* table = db_.getTable(request->table_id());
-        if (!table) {
-            return grpc::Status(grpc::StatusCode::NOT_FOUND, "table not found");
-        }
+    // The CROW_ROUTE pattern of a request's URL.
+    static std::string routeOf(const crow::request& req) {
+        const std::string_view url = req.url;
+        if (req.method == crow::HTTPMethod::Options && url.starts_with("/api/")) return "/api/<path>";
+        constexpr std::string_view kTable = "/api/table/";
+        if (!url.starts_with(kTable)) return std::string(url);
+        const std::size_t slash = url.find('/', kTable.size());
+        if (slash == std::string_view::npos) return "/api/table/<string>";
+        return "/api/table/<string>" + std::string(url.substr(slash));
+    }
+
+    Metrics* metrics = nullptr;
+};
 
-        for (const auto& row : table->rows) {
-            auto* proto_row = response->add_rows();
-            proto_row->set_id(row.id);
-            if (row.parent_id.has_value()) proto_row->set_parent_id(row.parent_id.value());
+// Returns false on an unknown or malformed flag.
+bool parseCommandLine(int argc, char** argv, CommandLine& options) {
+    auto parseCount = [](std::string_view text, auto& out) {
+        auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), out);
+        return ec == std::errc{} && end == text.data() + text.size();
+    };
 
-            auto* cells = proto_row->mutable_cells();
-            for (const auto& [key, value] : row.cells) {
-                (*cells)[key] = toProtoValue(value);
+    for (int i = 1; i < argc; ++i) {
+        const std::string_view arg = argv[i];
+        const std::size_t eq = arg.find('=');
+        const std::string_view name = arg.substr(0, eq);
+        const std::string_view value = eq == std::string_view::npos ? std::string_view{} : arg.substr(eq + 1);
+
+        bool valid = false;
+        if (name == "--grpc-address") {
+            options.grpc.address = std::string(value);
+            valid = !value.empty();
+        } else if (name == "--grpc-unix-socket") {
+            options.grpc.unix_socket = std::string(value);
+            valid = !value.empty();
+        } else if (name == "--http-port") {
+            valid = parseCount(value, options.http_port) && options.http_port > 0;
+        } else if (name == "--http-unix-socket") {
+            options.http_unix_socket = std::string(value);
+            valid = !value.empty();
+        } else if (name == "--export-dir") {
+            options.table_export.directory = std::string(value);
+            valid = !value.empty();
+        } else if (name == "--export-interval-ms") {
+            std::int64_t ms = 0;
+            valid = parseCount(value, ms) && ms > 0;
+            options.table_export.interval = std::chrono::milliseconds(ms);
+        } else if (name == "--grpc-cqs") {
+            valid = parseCount(value, options.grpc.completion_queues);
+        } else if (name == "--grpc-threads-per-cq") {
+            valid = parseCount(value, options.grpc.threads_per_queue);
+        } else if (name == "--grpc-pin-cqs") {
+            options.grpc.pin_threads = true;
+            valid = value.empty();
+        } else if (name == "--grpc-memory-quota") {
+            valid = parseCount(value, options.grpc.memory_quota_bytes);
+        } else if (name == "--grpc-max-import-bytes") {
+            valid = parseCount(value, options.grpc.max_import_bytes);
+        } else if (name == "--response-cache-bytes") {
+            valid = parseCount(value, options.response_cache_bytes);
+        } else if (name == "--data-dir") {
+            options.durability.directory = std::string(value);
+            valid = !value.empty();
+        } else if (name == "--wal-sync") {
+            valid = true;
+            if (value == "always") {
+                options.durability.sync = SyncPolicy::Always;
+            } else if (value == "interval") {
+                options.durability.sync = SyncPolicy::Interval;
+            } else if (value == "never") {
+                options.durability.sync = SyncPolicy::Never;
+            } else {
+                valid = false;
             }
+        } else if (name == "--wal-sync-interval-ms") {
+            std::int64_t ms = 0;
+            valid = parseCount(value, ms) && ms > 0;
+            options.durability.sync_interval = std::chrono::milliseconds(ms);
+        } else if (name == "--snapshot-interval-s") {
+            std::int64_t seconds = 0;
+            valid = parseCount(value, seconds) && seconds >= 0;
+            options.durability.snapshot_interval = std::chrono::seconds(seconds);
+        } else if (name == "--import") {
+            const std::size_t comma = value.find(',');
+            valid = comma != 0 && comma != std::string_view::npos && comma + 1 < value.size();
+            if (valid) options.imports.emplace_back(value.substr(0, comma), value.substr(comma + 1));
+        } else if (name == "--synthetic-rows") {
+            valid = parseCount(value, options.synthetic.rows);
+        } else if (name == "--synthetic-fanout") {
+            valid = parseCount(value, options.synthetic.fanout);
+        } else if (name == "--synthetic-seed") {
+            valid = parseCount(value, options.synthetic.seed);
         }
 
-        return grpc::Status::OK;
+        if (!valid) {
+            std::cerr << "Invalid argument: " << arg << "\n"
+                      << "Usage: " << argv[0]
+                      << " [--grpc-address=HOST:PORT] [--grpc-unix-socket=PATH] [--grpc-cqs=N]"
+                         " [--grpc-threads-per-cq=N] [--grpc-pin-cqs] [--grpc-memory-quota=BYTES]"
+                         " [--grpc-max-import-bytes=BYTES] [--http-port=PORT] [--http-unix-socket=PATH]"
+                         " [--response-cache-bytes=BYTES]"
+                         " [--data-dir=PATH] [--wal-sync=always|interval|never] [--wal-sync-interval-ms=N]"
+                         " [--snapshot-interval-s=N] [--export-dir=PATH] [--export-interval-ms=N]"
+                         " [--import=SCHEMA.json,DATA.csv|DATA.ndjson ...] [--synthetic-rows=N]"
+                         " [--synthetic-fanout=N] [--synthetic-seed=N]" << std::endl;
+            return false;
+        }
     }
+    return true;
+}
 
-    grpc::Status UpdateCell(grpc::ServerContext*,
-                            const tables::UpdateCellRequest* request,
-                            tables::UpdateCellResponse* response) override {
-        const Table* table = db_.getTable(request->table_id());
-        if (!table) {
-            response->set_ok(false);
-            response->set_error_message("table not found");
-            return grpc::Status::OK;
-        }
+int main(int argc, char** argv) {
+    CommandLine options;
+    if (!parseCommandLine(argc, argv, options)) return 2;
 
-        const ColumnDef* column = findColumn(*table, request->column_id());
-        if (!column) {
-            response->set_ok(false);
-            response->set_error_message("column not found");
-            return grpc::Status::OK;
+    DataStore db;
+    if (!options.durability.directory.empty()) {
+        const auto started = std::chrono::steady_clock::now();
+        std::string error;
+        if (!db.openDurable(options.durability, error)) {
+            std::cerr << "Cannot open data directory: " << error << std::endl;
+            return 1;
         }
-
-        std::string parse_error;
-        auto value_opt = parseProtoValueForColumn(request->value(), *column, parse_error);
-        if (!value_opt.has_value()) {
-            response->set_ok(false);
-            response->set_error_message(parse_error);
-            return grpc::Status::OK;
+        const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - started);
+        std::cout << "Recovered tables from " << options.durability.directory << " in " << elapsed.count() << " ms"
+                  << std::endl;
+    }
+    // After recovery, so an imported file replaces what the snapshot held.
+    for (const auto& [schema_path, data_path] : options.imports) {
+        std::string error;
+        if (!importTable(db, schema_path, data_path, error)) {
+            std::cerr << "Import failed: " << error << std::endl;
+            return 1;
         }
-
-        std::string update_error;
-        if (!db_.updateCell(request->table_id(), request->row_id(), request->column_id(), value_opt.value(), update_error)) {
-            response->set_ok(false);
-            response->set_error_message(update_error);
-            return grpc::Status::OK;
+    }
+    if (options.synthetic.rows > 0) {
+        std::string error;
+        if (db.createTable(makeSyntheticTable(options.synthetic), error) != CatalogStatus::Ok) {
+            std::cerr << "Cannot add the synthetic table: " << error << std::endl;
+            return 1;
         }
+        std::cout << "Generating " << options.synthetic.rows << " synthetic rows on demand" << std::endl;
+    }
+    ResponseCache cache(options.response_cache_bytes);
+
+    // Every REST route is registered before anything is served; gRPC
+    // methods are registered by the server.
+    Metrics metrics;
+    static constexpr std::string_view kRoutes[] = {
+        "/api/<path>", "/api/tables", "/api/table/<string>", "/api/table/<string>/schema", "/api/table/<string>/rollups",
+        "/api/table/<string>/update", "/api/table/<string>/update/batch", "/api/watch", "/metrics",
+        HttpMetrics::kUnmatched,
+    };
+    for (std::string_view route : kRoutes) metrics.addRoute(route);
+    RequestMetrics& data_route = metrics.addRoute("/api/table/<string>/data", true);
+    RequestMetrics& query_route = metrics.addRoute("/api/table/<string>/query", true);
+    RequestMetrics& window_route = metrics.addRoute("/api/table/<string>/window", true);
+    RequestMetrics& search_route = metrics.addRoute("/api/table/<string>/search", true);
+
+    // Read-only table files for local readers; see table_export_format.h.
+    std::optional<TableExporter> exporter;
+    if (!options.table_export.directory.empty()) {
+        std::string error;
+        exporter.emplace(db, options.table_export);
+        if (!exporter->start(error)) {
+            std::cerr << "Cannot export tables: " << error << std::endl;
+            return 1;
+        }
+    }
 
-        response->set_ok(true);
-        return grpc::Status::OK;
+    AsyncTableServer grpc_server(db, cache, metrics, options.grpc);
+    if (!grpc_server.start()) {
+        std::cerr << "Failed to start gRPC server" << std::endl;
+        return 1;
     }
+    std::cout << "gRPC server listening on " << grpc_server.options().address << " ("
+              << grpc_server.options().completion_queues << " completion queues x "
+              << grpc_server.options().threads_per_queue << " threads)" << std::endl;
+    if (!options.grpc.unix_socket.empty()) std::cout << "gRPC server listening on unix:" << options.grpc.unix_socket << std::endl;
 
-private:
-    DataStore& db_;
-};
+    auto setCors = [](crow::response& res) {
+        res.add_header("Access-Control-Allow-Origin", "*");
+        res.add_header("Access-Control-Allow-Methods", "GET, POST, PUT, DELETE, OPTIONS");
+        res.add_header("Access-Control-Allow-Headers", "Content-Type, If-None-Match");
+    };
 
-crow::json::wvalue buildSchemaJson(const Table& table) {
-    crow::json::wvalue payload;
-    payload["tableId"] = table.id;
-    payload["name"] = table.name;
-    payload["primaryKey"] = table.primary_key;
-    payload["parentKey"] = table.parent_key;
-
-    for (std::size_t i = 0; i < table.schema.size(); ++i) {
-        const auto& column = table.schema[i];
-        payload["columns"][i]["id"] = column.id;
-        payload["columns"][i]["title"] = column.title;
-        payload["columns"][i]["type"] = toString(column.type);
-        payload["columns"][i]["width"] = column.width;
-        payload["columns"][i]["isTreeColumn"] = column.is_tree;
-        payload["columns"][i]["isPinned"] = column.is_pinned;
-        payload["columns"][i]["isEditable"] = column.is_editable && !column.is_primary;
-        payload["columns"][i]["isPrimary"] = column.is_primary;
-    }
+    // Eight hex digits for the data ETags of this process.
+    std::string instance(8, '0');
+    std::to_chars(instance.data(), instance.data() + instance.size(), std::random_device{}() | 0x10000000u, 16);
 
-    return payload;
-}
+    // One set of change-feed watchers for every listener.
+    WebSocketWatchers watchers(db);
 
-crow::json::wvalue buildRowsJson(const Table& table) {
-    crow::json::wvalue payload;
+    // Registers every REST route on one listener.
+    auto addRoutes = [&](crow::App<HttpMetrics>& app) {
+        app.get_middleware<HttpMetrics>().metrics = &metrics;
 
-    for (std::size_t i = 0; i < table.rows.size(); ++i) {
-        const auto& row = table.rows[i];
-        payload[i][table.primary_key] = row.id;
+        CROW_ROUTE(app, "/api/<path>").methods("OPTIONS"_method)([setCors](const crow::request&, crow::response& res, const std::string&) {
+            setCors(res);
+            res.end();
+        });
 
-        if (!table.parent_key.empty()) {
-            if (row.parent_id.has_value()) {
-                payload[i][table.parent_key] = row.parent_id.value();
-            } else {
-                payload[i][table.parent_key] = nullptr;
+        CROW_ROUTE(app, "/api/tables")([&db, setCors](const crow::request&, crow::response& res) {
+            setCors(res);
+            res.body = buildTablesJson(db.listTables());
+            res.end();
+        });
+
+        // Body: a schema in the form GET /api/table/<id>/schema returns. The
+        // table starts out empty.
+        CROW_ROUTE(app, "/api/tables").methods("POST"_method)([&db, setCors](const crow::request& req, crow::response& res) {
+            setCors(res);
+            auto body = crow::json::load(req.body);
+            if (!body) {
+                sendError(res, 400, "invalid json");
+                return;
             }
-        }
 
-        for (const auto& [key, value] : row.cells) {
-            payload[i][key] = valueToJson(value);
-        }
-    }
+            Table table;
+            std::string error;
+            if (!parseSchemaJson(body, table, error)) {
+                sendError(res, 400, error);
+                return;
+            }
+            const std::string table_id = table.id;
+            const CatalogStatus status = db.createTable(std::move(table), error);
+            if (status != CatalogStatus::Ok) {
+                sendCatalogError(res, status, error);
+                return;
+            }
 
-    return payload;
-}
+            crow::json::wvalue payload;
+            if (auto created = db.read(table_id)) payload["version"] = created->version;
+            res.code = 201;
+            res.write(payload.dump());
+            res.end();
+        });
+
+        CROW_ROUTE(app, "/api/table/<string>").methods("DELETE"_method)([&db, &cache, setCors](const crow::request&, crow::response& res, std::string table_id) {
+            setCors(res);
+            std::string error;
+            const CatalogStatus status = db.dropTable(table_id, error);
+            // Its payloads can never be served again.
+            cache.erase(table_id);
+            if (status != CatalogStatus::Ok) {
+                sendCatalogError(res, status, error);
+                return;
+            }
+            res.write(R"({"status":"ok"})");
+            res.end();
+        });
+
+        // Body: the schema as GET returns it, with the columns changed; see
+        // DataStore::alterSchema. Only the columns are taken from it.
+        CROW_ROUTE(app, "/api/table/<string>/schema").methods("PUT"_method)([&db, &cache, setCors](const crow::request& req, crow::response& res, std::string table_id) {
+            setCors(res);
+            auto body = crow::json::load(req.body);
+            if (!body) {
+                sendError(res, 400, "invalid json");
+                return;
+            }
 
-int main() {
-    DataStore db;
+            Table parsed;
+            std::string error;
+            if (!parseSchemaJson(body, parsed, error)) {
+                sendError(res, 400, error);
+                return;
+            }
+            if (parsed.id != table_id) {
+                sendError(res, 400, "tableId does not match the URL");
+                return;
+            }
+            const CatalogStatus status = db.alterSchema(table_id, std::move(parsed.schema), error);
+            if (status != CatalogStatus::Ok) {
+                sendCatalogError(res, status, error);
+                return;
+            }
+            cache.erase(table_id);
 
-    TableServiceImpl grpc_service(db);
-    grpc::ServerBuilder builder;
-    const std::string grpc_address = "0.0.0.0:50051";
-    builder.AddListeningPort(grpc_address, grpc::InsecureServerCredentials());
-    builder.RegisterService(&grpc_service);
+            crow::json::wvalue payload;
+            if (auto altered = db.read(table_id)) payload["version"] = altered->version;
+            res.write(payload.dump());
+            res.end();
+        });
+
+        CROW_ROUTE(app, "/api/table/<string>/schema")([&db, &cache, setCors](const crow::request& req, crow::response& res, std::string table_id) {
+            setCors(res);
+            auto table = db.read(table_id);
+            if (!table) {
+                sendError(res, 404, "table not found");
+                return;
+            }
 
-    std::unique_ptr<grpc::Server> grpc_server = builder.BuildAndStart();
-    if (!grpc_server) {
-        std::cerr << "Failed to start gRPC server" << std::endl;
-        return 1;
-    }
-    std::cout << "gRPC server listening on " << grpc_address << std::endl;
+            auto payload = cache.get(*table, ResponseCache::Kind::JsonSchema, [&] { return buildSchemaJson(*table); });
+            res.add_header("Access-Control-Expose-Headers", "ETag");
+            if (endIfNotModified(req, res, schemaETag(*payload))) return;
+            res.write(*payload);
+            res.end();
+        });
+
+        CROW_ROUTE(app, "/api/table/<string>/data")([&db, &cache, &data_route, &instance, setCors](const crow::request& req, crow::response& res, std::string table_id) {
+            setCors(res);
+            auto table = db.read(table_id);
+            if (!table) {
+                sendError(res, 404, "table not found");
+                return;
+            }
+            res.add_header("Vary", "Accept");
+
+            // Every row as Arrow IPC, built a record batch at a time; see
+            // arrow_ipc.h.
+            if (const auto format = acceptedArrowFormat(req.get_header_value("Accept"))) {
+                if (req.url_params.get("cursor") || req.url_params.get("limit")) {
+                    sendError(res, 400, "cursor and limit are not supported for Arrow");
+                    return;
+                }
+                if (table->procedural && table->procedural->rowCount() > kMaxProceduralResponseRows) {
+                    sendError(res, 400, "table has " + std::to_string(table->procedural->rowCount()) +
+                                            " rows, too many for one response; read it with StreamArrow");
+                    return;
+                }
+                const bool file = *format == ArrowFormat::File;
+                res.set_header("Content-Type", std::string(file ? kArrowFileType : kArrowStreamType));
+                res.add_header("Access-Control-Expose-Headers", "ETag, X-Table-Version");
+                res.add_header("X-Table-Version", std::to_string(table->version));
+                if (endIfNotModified(req, res, dataETag(*table, instance, file ? "arrow-file" : "arrow-stream"))) return;
+                auto build = [&] { return encodeArrow(table.share(), *format); };
+                // Procedural tables are not cached, as in GetData.
+                if (table->procedural) {
+                    res.body = build();
+                } else {
+                    res.write(*cache.get(*table, file ? ResponseCache::Kind::ArrowFile : ResponseCache::Kind::ArrowStream,
+                                         build));
+                }
+                data_route.rows->observe(table->procedural ? table->procedural->rowCount() : table->rowCount());
+                res.end();
+                return;
+            }
 
-    std::jthread grpc_thread([&grpc_server]() {
-        grpc_server->Wait();
-    });
-    (void)grpc_thread;
+            // Batched mode: ?cursor=<slot>&limit=<rows> returns one batch and the
+            // cursor of the next one in X-Next-Cursor (absent on the last batch).
+            const char* cursor_param = req.url_params.get("cursor");
+            const char* limit_param = req.url_params.get("limit");
+            if (cursor_param || limit_param) {
+                auto start = parseCursor(cursor_param ? cursor_param : "");
+                auto limit = parseCursor(limit_param ? limit_param : "");
+                const std::size_t rows = table->procedural ? table->procedural->rowCount() : table->rowCount();
+                if (!start.has_value() || !limit.has_value() || *start > rows) {
+                    sendError(res, 400, "invalid cursor or limit");
+                    return;
+                }
+
+                const std::size_t batch_rows = std::min(*limit ? *limit : kDefaultBatchRows, kMaxBatchRows);
+                const std::size_t end = std::min(*start + batch_rows, rows);
+                res.add_header("Access-Control-Expose-Headers", "ETag, X-Next-Cursor, X-Table-Version");
+                res.add_header("X-Table-Version", std::to_string(table->version));
+                if (end < rows) res.add_header("X-Next-Cursor", std::to_string(end));
+                if (endIfNotModified(req, res, dataETag(*table, instance))) return;
+                res.body = table->procedural ? buildProceduralRowsJson(*table, *start, end) : buildRowsJson(*table, *start, end);
+                data_route.rows->observe(end - *start);
+                res.end();
+                return;
+            }
 
-    crow::SimpleApp app;
+            res.add_header("Access-Control-Expose-Headers", "ETag, X-Table-Version");
+            res.add_header("X-Table-Version", std::to_string(table->version));
+            if (endIfNotModified(req, res, dataETag(*table, instance))) return;
+            // Procedural tables are not cached, as in GetData.
+            if (table->procedural) {
+                if (table->procedural->rowCount() > kMaxProceduralResponseRows) {
+                    sendError(res, 400, "table has " + std::to_string(table->procedural->rowCount()) +
+                                            " rows, too many for one response; page it with cursor and limit");
+                    return;
+                }
+                res.write(buildProceduralRowsJson(*table));
+                data_route.rows->observe(table->procedural->rowCount());
+                res.end();
+                return;
+            }
+            auto payload = cache.get(*table, ResponseCache::Kind::JsonData, [&] { return buildRowsJson(*table); });
+            res.write(*payload);
+            data_route.rows->observe(table->rowCount());
+            res.end();
+        });
+
+        CROW_ROUTE(app, "/api/table/<string>/rollups")([&db, setCors](const crow::request& req, crow::response& res, std::string table_id) {
+            setCors(res);
+            auto table = db.read(table_id);
+            if (!table) {
+                sendError(res, 404, "table not found");
+                return;
+            }
+            if (table->procedural) {
+                sendError(res, 400, kProceduralUnsupported);
+                return;
+            }
 
-    auto setCors = [](crow::response& res) {
-        res.add_header("Access-Control-Allow-Origin", "*");
-        res.add_header("Access-Control-Allow-Methods", "GET, POST, OPTIONS");
-        res.add_header("Access-Control-Allow-Headers", "Content-Type");
-    };
+            auto targets = resolveRollupTargets(*table, splitParam(req.url_params.get("rows")), splitParam(req.url_params.get("columns")));
+            if (!targets.error.empty()) {
+                sendError(res, targets.not_found ? 404 : 400, targets.error);
+                return;
+            }
 
-    CROW_ROUTE(app, "/api/<path>").methods("OPTIONS"_method)([setCors](const crow::request&, crow::response& res, const std::string&) {
-        setCors(res);
-        res.end();
-    });
-
-    CROW_ROUTE(app, "/api/tables")([&db, setCors](const crow::request&, crow::response& res) {
-        setCors(res);
-        crow::json::wvalue payload;
-        auto list = db.listTables();
-        for (std::size_t i = 0; i < list.size(); ++i) {
-            payload[i]["id"] = list[i].first;
-            payload[i]["name"] = list[i].second;
-        }
-        res.write(payload.dump());
-        res.end();
-    });
-
-    CROW_ROUTE(app, "/api/table/<string>/schema")([&db, setCors](const crow::request&, crow::response& res, std::string table_id) {
-        setCors(res);
-        const Table* table = db.getTable(table_id);
-        if (!table) {
-            res.code = 404;
-            res.write(R"({"error":"table not found"})");
+            res.write(buildRollupsJson(*table, targets).dump());
             res.end();
-            return;
-        }
+        });
+
+        // Change feed: ws://host:8083/api/watch?table=<id>. The first message
+        // carries the baseline version; later ones carry cell deltas.
+        CROW_WEBSOCKET_ROUTE(app, "/api/watch")
+            .onaccept([](const crow::request& req, void** userdata) {
+                const char* table_id = req.url_params.get("table");
+                if (!table_id) return false;
+                *userdata = new std::string(table_id);
+                return true;
+            })
+            .onopen([&watchers](crow::websocket::connection& conn) {
+                std::unique_ptr<std::string> table_id(static_cast<std::string*>(conn.userdata()));
+                conn.userdata(nullptr);
+                if (!table_id || !watchers.open(conn, *table_id)) conn.close("table not found");
+            })
+            .onclose([&watchers](crow::websocket::connection& conn, const std::string&, uint16_t) {
+                delete static_cast<std::string*>(conn.userdata());
+                watchers.close(conn);
+            });
+
+        // Filter, sort and page a table server-side; see parseQueryJson for the
+        // body. Ancestors of matching rows are returned with matched=false.
+        CROW_ROUTE(app, "/api/table/<string>/query").methods("POST"_method)([&db, &query_route, setCors](const crow::request& req, crow::response& res, std::string table_id) {
+            setCors(res);
+            auto body = crow::json::load(req.body);
+            if (!body) {
+                sendError(res, 400, "invalid json");
+                return;
+            }
 
-        auto payload = buildSchemaJson(*table);
-        res.write(payload.dump());
-        res.end();
-    });
-
-    CROW_ROUTE(app, "/api/table/<string>/data")([&db, setCors](const crow::request&, crow::response& res, std::string table_id) {
-        setCors(res);
-        const Table* table = db.getTable(table_id);
-        if (!table) {
-            res.code = 404;
-            res.write(R"({"error":"table not found"})");
-            res.end();
-            return;
-        }
+            auto table = db.read(table_id);
+            if (!table) {
+                sendError(res, 404, "table not found");
+                return;
+            }
+            if (table->procedural) {
+                sendError(res, 400, kProceduralUnsupported);
+                return;
+            }
 
-        auto payload = buildRowsJson(*table);
-        res.write(payload.dump());
-        res.end();
-    });
-
-    CROW_ROUTE(app, "/api/table/<string>/update").methods("POST"_method)([&db, setCors](const crow::request& req, crow::response& res, std::string table_id) {
-        setCors(res);
-        auto body = crow::json::load(req.body);
-        if (!body) {
-            res.code = 400;
-            res.write(R"({"error":"invalid json"})");
+            QuerySpec spec;
+            std::vector<std::size_t> projection;
+            std::string error;
+            if (!parseQueryJson(body, *table, spec, projection, error)) {
+                sendError(res, 400, error);
+                return;
+            }
+
+            QueryResult result = runQuery(*table, spec);
+            if (!result.error.empty()) {
+                sendError(res, 400, result.error);
+                return;
+            }
+            res.body = buildQueryJson(*table, result, projection);
+            query_route.rows->observe(result.slots.size());
             res.end();
-            return;
-        }
+        });
+
+        // One viewport of the tree with the given rows expanded, for virtual
+        // scrolling; see parseWindowJson for the body.
+        CROW_ROUTE(app, "/api/table/<string>/window").methods("POST"_method)([&db, &window_route, setCors](const crow::request& req, crow::response& res, std::string table_id) {
+            setCors(res);
+            auto body = crow::json::load(req.body);
+            if (!body) {
+                sendError(res, 400, "invalid json");
+                return;
+            }
 
-        const Table* table = db.getTable(table_id);
-        if (!table) {
-            res.code = 404;
-            res.write(R"({"error":"table not found"})");
+            auto table = db.read(table_id);
+            if (!table) {
+                sendError(res, 404, "table not found");
+                return;
+            }
+            if (table->procedural) {
+                sendError(res, 400, kProceduralUnsupported);
+                return;
+            }
+
+            std::vector<std::uint32_t> expanded;
+            std::size_t offset = 0;
+            std::size_t limit = 0;
+            std::vector<std::size_t> projection;
+            std::string error;
+            if (!parseWindowJson(body, *table, expanded, offset, limit, projection, error)) {
+                sendError(res, 400, error);
+                return;
+            }
+
+            const TreeWindow window = treeWindow(*table, std::move(expanded), offset, limit);
+            res.body = buildWindowJson(*table, window, projection);
+            window_route.rows->observe(window.slots.size());
             res.end();
-            return;
-        }
+        });
+
+        // Ranked rows whose String cells contain the text, each with its
+        // ancestor ids; see parseSearchJson for the body.
+        CROW_ROUTE(app, "/api/table/<string>/search").methods("POST"_method)([&db, &search_route, setCors](const crow::request& req, crow::response& res, std::string table_id) {
+            setCors(res);
+            auto body = crow::json::load(req.body);
+            if (!body) {
+                sendError(res, 400, "invalid json");
+                return;
+            }
+
+            auto table = db.read(table_id);
+            if (!table) {
+                sendError(res, 404, "table not found");
+                return;
+            }
+            if (table->procedural) {
+                sendError(res, 400, kProceduralUnsupported);
+                return;
+            }
+
+            SearchSpec spec;
+            std::string error;
+            if (!parseSearchJson(body, *table, spec, error)) {
+                sendError(res, 400, error);
+                return;
+            }
 
-        if (!body.has("row_id") || !body.has("column_id") || !body.has("value")) {
-            res.code = 400;
-            res.write(R"({"error":"row_id, column_id and value are required"})");
+            const SearchResult result = runSearch(*table, spec);
+            if (!result.error.empty()) {
+                sendError(res, 400, result.error);
+                return;
+            }
+            res.body = buildSearchJson(*table, result);
+            search_route.rows->observe(result.hits.size());
             res.end();
-            return;
-        }
+        });
+
+        // Body: {"edits":[{"row_id":..,"column_id":..,"value":..},...]}. The
+        // edits are applied as one version only if all of them are valid.
+        CROW_ROUTE(app, "/api/table/<string>/update/batch").methods("POST"_method)([&db, &metrics, setCors](const crow::request& req, crow::response& res, std::string table_id) {
+            setCors(res);
+            auto body = crow::json::load(req.body);
+            if (!body || !body.has("edits") || body["edits"].t() != crow::json::type::List) {
+                sendError(res, 400, "edits array is required");
+                return;
+            }
 
-        std::string row_id = body["row_id"].s();
-        std::string column_id = body["column_id"].s();
+            const auto& items = body["edits"];
+            const std::size_t count = items.size();
+            std::vector<std::string> errors(count);
+            std::vector<CellEdit> edits;
+            edits.reserve(count);
+            {
+                auto table = db.read(table_id);
+                if (!table) {
+                    sendError(res, 404, "table not found");
+                    return;
+                }
+
+                for (std::size_t i = 0; i < count; ++i) {
+                    const auto& item = items[i];
+                    if (item.t() != crow::json::type::Object || !item.has("row_id") || !item.has("column_id") || !item.has("value")) {
+                        errors[i] = "row_id, column_id and value are required";
+                        continue;
+                    }
+
+                    std::string column_id = item["column_id"].s();
+                    const ColumnDef* column = findColumn(*table, column_id);
+                    if (!column) {
+                        errors[i] = "column not found";
+                        continue;
+                    }
+
+                    auto value_opt = parseJsonValueForColumn(item["value"], *column, errors[i]);
+                    if (!value_opt.has_value()) continue;
+                    edits.push_back({item["row_id"].s(), std::move(column_id), std::move(value_opt.value())});
+                }
+            }
 
-        const ColumnDef* column = findColumn(*table, column_id);
-        if (!column) {
-            res.code = 404;
-            res.write(R"({"error":"column not found"})");
+            bool applied = edits.size() == count;
+            if (applied) applied = db.updateCells(table_id, edits, errors);
+            for (const std::string& error : errors) {
+                if (applied || !error.empty()) metrics.recordUpdate(error);
+            }
+
+            crow::json::wvalue payload;
+            payload["applied"] = applied;
+            auto& results = payload["results"];
+            results = crow::json::wvalue::list();
+            for (std::size_t i = 0; i < count; ++i) {
+                results[i]["ok"] = errors[i].empty();
+                if (!errors[i].empty()) results[i]["error"] = errors[i];
+            }
+            if (!applied) res.code = 400;
+            res.write(payload.dump());
             res.end();
-            return;
-        }
+        });
+
+        CROW_ROUTE(app, "/api/table/<string>/update").methods("POST"_method)([&db, &metrics, setCors](const crow::request& req, crow::response& res, std::string table_id) {
+            setCors(res);
+            auto reject = [&](int code, const std::string& error) {
+                metrics.recordUpdate(error);
+                sendError(res, code, error);
+            };
+
+            auto body = crow::json::load(req.body);
+            if (!body) {
+                reject(400, "invalid json");
+                return;
+            }
+
+            auto table = db.read(table_id);
+            if (!table) {
+                reject(404, "table not found");
+                return;
+            }
+
+            if (!body.has("row_id") || !body.has("column_id") || !body.has("value")) {
+                reject(400, "row_id, column_id and value are required");
+                return;
+            }
+
+            std::string row_id = body["row_id"].s();
+            std::string column_id = body["column_id"].s();
 
-        std::string parse_error;
-        auto value_opt = parseJsonValueForColumn(body["value"], *column, parse_error);
-        if (!value_opt.has_value()) {
-            res.code = 400;
-            res.write(std::string("{\"error\":\"") + parse_error + "\"}");
+            const ColumnDef* column = findColumn(*table, column_id);
+            if (!column) {
+                reject(404, "column not found");
+                return;
+            }
+
+            std::string parse_error;
+            auto value_opt = parseJsonValueForColumn(body["value"], *column, parse_error);
+            if (!value_opt.has_value()) {
+                reject(400, parse_error);
+                return;
+            }
+
+            std::string update_error;
+            if (!db.updateCell(table_id, row_id, column_id, value_opt.value(), update_error)) {
+                reject(400, update_error);
+                return;
+            }
+
+            metrics.recordUpdate({});
+            res.write(R"({"status":"ok"})");
             res.end();
-            return;
-        }
+        });
 
-        std::string update_error;
-        if (!db.updateCell(table_id, row_id, column_id, value_opt.value(), update_error)) {
-            res.code = 400;
-            res.write(std::string("{\"error\":\"") + update_error + "\"}");
+        // Prometheus text exposition of every instrument in metrics.h.
+        CROW_ROUTE(app, "/metrics")([&db, &cache, &metrics](const crow::request&, crow::response& res) {
+            res.set_header("Content-Type", "text/plain; version=0.0.4; charset=utf-8");
+            res.body = metrics.render(db, cache);
             res.end();
-            return;
-        }
+        });
+    };
 
-        res.write(R"({"status":"ok"})");
-        res.end();
-    });
+    crow::App<HttpMetrics> app;
+    addRoutes(app);
+
+    // The same routes on a Unix domain socket, for clients on this host.
+    std::optional<crow::App<HttpMetrics>> local_app;
+    std::future<void> local_served;
+    if (!options.http_unix_socket.empty()) {
+        std::error_code ec;
+        if (std::filesystem::is_socket(options.http_unix_socket, ec)) std::filesystem::remove(options.http_unix_socket, ec);
+        local_app.emplace();
+        addRoutes(*local_app);
+        local_served = local_app->local_socket_path(options.http_unix_socket).multithreaded().run_async();
+    }
 
-    app.port(8083).multithreaded().run();
+    app.port(options.http_port).multithreaded().run();
+    if (local_app) local_app->stop();
 
-    grpc_server->Shutdown();
+    grpc_server.shutdown();
     return 0;
 }
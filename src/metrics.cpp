@@ -0,0 +1,285 @@
+#include "metrics.h"
+
+#include "response_cache.h"
+
+#include <charconv>
+#include <cmath>
+#include <vector>
+
+namespace {
+
+// Indexed by grpc::StatusCode.
+constexpr std::string_view kGrpcCodes[] = {
+    "OK", "CANCELLED", "UNKNOWN", "INVALID_ARGUMENT", "DEADLINE_EXCEEDED", "NOT_FOUND",
+    "ALREADY_EXISTS", "PERMISSION_DENIED", "RESOURCE_EXHAUSTED", "FAILED_PRECONDITION", "ABORTED",
+    "OUT_OF_RANGE", "UNIMPLEMENTED", "INTERNAL", "UNAVAILABLE", "DATA_LOSS", "UNAUTHENTICATED",
+};
+
+// Indexed by HTTP status / 100.
+constexpr std::string_view kHttpClasses[] = {"other", "1xx", "2xx", "3xx", "4xx", "5xx"};
+
+// Counts and sizes print as integers rather than in exponent form.
+void appendNumber(std::string& out, double value) {
+    char buffer[32];
+    const bool integral = value == std::floor(value) && std::fabs(value) < 1e15;
+    auto [end, ec] = integral ? std::to_chars(buffer, buffer + sizeof(buffer), static_cast<std::int64_t>(value))
+                              : std::to_chars(buffer, buffer + sizeof(buffer), value);
+    out.append(buffer, end);
+}
+
+void appendLabel(std::string& out, std::string_view name, std::string_view value) {
+    out.append(name).append("=\"");
+    for (char c : value) {
+        if (c == '\\' || c == '"') {
+            out.push_back('\\');
+            out.push_back(c);
+        } else if (c == '\n') {
+            out.append("\\n");
+        } else {
+            out.push_back(c);
+        }
+    }
+    out.push_back('"');
+}
+
+void appendFamily(std::string& out, std::string_view name, std::string_view type, std::string_view help) {
+    out.append("# HELP ").append(name).append(" ").append(help).append("\n");
+    out.append("# TYPE ").append(name).append(" ").append(type).append("\n");
+}
+
+void appendSample(std::string& out, std::string_view name, std::string_view labels, double value) {
+    out.append(name);
+    if (!labels.empty()) out.append("{").append(labels).append("}");
+    out.push_back(' ');
+    appendNumber(out, value);
+    out.push_back('\n');
+}
+
+std::vector<const RequestMetrics*> sorted(const StringMap<std::unique_ptr<RequestMetrics>>& entries) {
+    std::vector<const RequestMetrics*> list;
+    list.reserve(entries.size());
+    for (const auto& [name, entry] : entries) list.push_back(entry.get());
+    std::sort(list.begin(), list.end(), [](const auto* a, const auto* b) { return a->name < b->name; });
+    return list;
+}
+
+// The request families of either the gRPC methods or the REST routes.
+void renderRequests(std::string& out,
+                    const StringMap<std::unique_ptr<RequestMetrics>>& entries,
+                    std::string_view prefix,
+                    std::string_view label,
+                    std::string_view status_label,
+                    std::span<const std::string_view> statuses) {
+    const auto list = sorted(entries);
+    const std::string p(prefix);
+    std::string labels;
+    auto labelsOf = [&](const RequestMetrics& entry) -> const std::string& {
+        labels.clear();
+        appendLabel(labels, label, entry.name);
+        return labels;
+    };
+
+    appendFamily(out, p + "_requests_total", "counter", "Finished requests by status.");
+    for (const RequestMetrics* entry : list) {
+        for (std::size_t s = 0; s < statuses.size(); ++s) {
+            const std::uint64_t count = entry->responses.value(s);
+            if (count == 0) continue;
+            std::string status = labelsOf(*entry);
+            status.push_back(',');
+            appendLabel(status, status_label, statuses[s]);
+            appendSample(out, p + "_requests_total", status, static_cast<double>(count));
+        }
+    }
+
+    appendFamily(out, p + "_duration_seconds", "histogram", "Time from arrival to the response being handed to the transport.");
+    for (const RequestMetrics* entry : list) entry->seconds.render(out, p + "_duration_seconds", labelsOf(*entry));
+
+    appendFamily(out, p + "_response_bytes", "histogram", "Response body size.");
+    for (const RequestMetrics* entry : list) entry->bytes.render(out, p + "_response_bytes", labelsOf(*entry));
+
+    appendFamily(out, p + "_response_rows", "histogram", "Rows returned by the requests that return rows.");
+    for (const RequestMetrics* entry : list) {
+        if (entry->rows) entry->rows->render(out, p + "_response_rows", labelsOf(*entry));
+    }
+}
+
+}  // namespace
+
+ShardedCounters::ShardedCounters(std::size_t width)
+    : width_(width),
+      lines_per_shard_((width + 7) / 8),
+      lines_(new Line[kMetricShards * lines_per_shard_]()) {}
+
+std::uint64_t ShardedCounters::value(std::size_t i) const {
+    std::uint64_t total = 0;
+    for (std::size_t shard = 0; shard < kMetricShards; ++shard) {
+        total += cell(shard, i).load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+const std::array<std::uint64_t, 17> Histogram::kNanosecondBounds = {
+    50'000,      100'000,     250'000,       500'000,       1'000'000,     2'500'000,
+    5'000'000,   10'000'000,  25'000'000,    50'000'000,    100'000'000,   250'000'000,
+    500'000'000, 1'000'000'000, 2'500'000'000, 5'000'000'000, 10'000'000'000,
+};
+const std::array<std::uint64_t, 11> Histogram::kByteBounds = {
+    256, 1 << 10, 4 << 10, 16 << 10, 64 << 10, 256 << 10, 1 << 20, 4 << 20, 16 << 20, 64 << 20, 256 << 20,
+};
+const std::array<std::uint64_t, 8> Histogram::kRowBounds = {
+    1, 10, 100, 1'000, 10'000, 100'000, 1'000'000, 10'000'000,
+};
+
+Histogram::Histogram(std::span<const std::uint64_t> bounds, double divisor)
+    : bounds_(bounds),
+      divisor_(divisor),
+      counters_(bounds.size() + 2) {}
+
+void Histogram::render(std::string& out, std::string_view name, std::string_view labels) const {
+    // Read the buckets once: the count must equal the +Inf bucket even while
+    // observations keep arriving.
+    std::vector<std::uint64_t> buckets(bounds_.size() + 1);
+    for (std::size_t i = 0; i < buckets.size(); ++i) buckets[i] = counters_.value(i);
+    const std::uint64_t sum = counters_.value(bounds_.size() + 1);
+
+    std::string series;
+    std::uint64_t cumulative = 0;
+    for (std::size_t i = 0; i < buckets.size(); ++i) {
+        cumulative += buckets[i];
+        series.assign(labels);
+        if (!series.empty()) series.push_back(',');
+        series.append("le=\"");
+        if (i < bounds_.size()) {
+            appendNumber(series, static_cast<double>(bounds_[i]) / divisor_);
+        } else {
+            series.append("+Inf");
+        }
+        series.push_back('"');
+        appendSample(out, std::string(name) + "_bucket", series, static_cast<double>(cumulative));
+    }
+    appendSample(out, std::string(name) + "_sum", labels, static_cast<double>(sum) / divisor_);
+    appendSample(out, std::string(name) + "_count", labels, static_cast<double>(cumulative));
+}
+
+void LabeledCounter::add(std::string_view label) {
+    Shard& shard = shards_[metricShard()];
+    std::lock_guard lock(shard.mutex);
+    auto it = shard.counts.find(label);
+    if (it == shard.counts.end()) {
+        if (shard.counts.size() >= kMaxLabels) label = "other";
+        it = shard.counts.try_emplace(std::string(label), 0).first;
+    }
+    ++it->second;
+}
+
+std::vector<std::pair<std::string, std::uint64_t>> LabeledCounter::values() const {
+    StringMap<std::uint64_t> totals;
+    for (const Shard& shard : shards_) {
+        std::lock_guard lock(shard.mutex);
+        for (const auto& [label, count] : shard.counts) totals[label] += count;
+    }
+    std::vector<std::pair<std::string, std::uint64_t>> list(totals.begin(), totals.end());
+    std::sort(list.begin(), list.end());
+    return list;
+}
+
+RequestMetrics::RequestMetrics(std::string name, std::size_t statuses, bool counts_rows)
+    : name(std::move(name)),
+      responses(statuses) {
+    if (counts_rows) rows.emplace(Histogram::kRowBounds, 1.0);
+}
+
+void RequestMetrics::finish(std::size_t status, std::chrono::steady_clock::duration elapsed, std::size_t size) {
+    // Every gRPC code has a counter; an HTTP status past 5xx counts as "other".
+    responses.add(status < responses.width() ? status : 0);
+    seconds.observe(elapsed);
+    bytes.observe(size);
+}
+
+RequestMetrics& Metrics::addRpc(std::string_view method, bool counts_rows) {
+    auto& entry = rpcs_[std::string(method)];
+    entry = std::make_unique<RequestMetrics>(std::string(method), std::size(kGrpcCodes), counts_rows);
+    return *entry;
+}
+
+RequestMetrics& Metrics::addRoute(std::string_view route, bool counts_rows) {
+    auto& entry = routes_[std::string(route)];
+    entry = std::make_unique<RequestMetrics>(std::string(route), std::size(kHttpClasses), counts_rows);
+    return *entry;
+}
+
+RequestMetrics* Metrics::rpc(std::string_view method) const {
+    auto it = rpcs_.find(method);
+    return it == rpcs_.end() ? nullptr : it->second.get();
+}
+
+RequestMetrics* Metrics::route(std::string_view route) const {
+    auto it = routes_.find(route);
+    return it == routes_.end() ? nullptr : it->second.get();
+}
+
+std::string Metrics::render(const DataStore& db, const ResponseCache& cache) const {
+    std::string out;
+    out.reserve(64 << 10);
+
+    renderRequests(out, rpcs_, "table_grpc", "method", "code", kGrpcCodes);
+    renderRequests(out, routes_, "table_http", "route", "status", kHttpClasses);
+
+    std::string labels;
+    appendFamily(out, "table_cell_updates_total", "counter", "Cell edits by result: ok, or the error returned.");
+    for (const auto& [result, count] : updates_.values()) {
+        labels.clear();
+        appendLabel(labels, "result", result);
+        appendSample(out, "table_cell_updates_total", labels, static_cast<double>(count));
+    }
+
+    struct TableSizes {
+        std::string labels;
+        std::size_t rows;
+        std::size_t bytes;
+        std::size_t text_index_bytes;
+        std::uint64_t version;
+    };
+    std::vector<TableSizes> tables;
+    for (const auto& [id, name] : db.listTables()) {
+        auto table = db.read(id);
+        if (!table) continue;
+        labels.clear();
+        appendLabel(labels, "table", id);
+        std::size_t text_index_bytes = 0;
+        for (const auto& text_index : table->text_indexes) text_index_bytes += text_index.memoryUsage();
+        tables.push_back({labels, table->rowCount(), table->memoryUsage(), text_index_bytes, table->version});
+    }
+    appendFamily(out, "table_rows", "gauge", "Rows in the current version of each table.");
+    for (const auto& table : tables) appendSample(out, "table_rows", table.labels, static_cast<double>(table.rows));
+    appendFamily(out, "table_memory_bytes", "gauge", "Approximate memory held by the current version of each table.");
+    for (const auto& table : tables) appendSample(out, "table_memory_bytes", table.labels, static_cast<double>(table.bytes));
+    appendFamily(out, "table_text_index_bytes", "gauge", "Part of table_memory_bytes held by the text indexes of String columns.");
+    for (const auto& table : tables) {
+        appendSample(out, "table_text_index_bytes", table.labels, static_cast<double>(table.text_index_bytes));
+    }
+    appendFamily(out, "table_version", "gauge", "Current version of each table.");
+    for (const auto& table : tables) appendSample(out, "table_version", table.labels, static_cast<double>(table.version));
+
+    const ResponseCache::Stats stats = cache.stats();
+    appendFamily(out, "table_response_cache_hits_total", "counter", "Whole-table responses served from the cache.");
+    appendSample(out, "table_response_cache_hits_total", {}, static_cast<double>(stats.hits));
+    appendFamily(out, "table_response_cache_misses_total", "counter", "Whole-table responses built on a cache miss.");
+    appendSample(out, "table_response_cache_misses_total", {}, static_cast<double>(stats.misses));
+    appendFamily(out, "table_response_cache_evictions_total", "counter", "Entries evicted to stay within capacity.");
+    appendSample(out, "table_response_cache_evictions_total", {}, static_cast<double>(stats.evictions));
+    appendFamily(out, "table_response_cache_bytes", "gauge", "Bytes held by cached responses.");
+    appendSample(out, "table_response_cache_bytes", {}, static_cast<double>(stats.bytes));
+    appendFamily(out, "table_response_cache_capacity_bytes", "gauge", "Configured response cache capacity.");
+    appendSample(out, "table_response_cache_capacity_bytes", {}, static_cast<double>(cache.capacity()));
+    appendFamily(out, "table_response_cache_entries", "gauge", "Cached responses.");
+    appendSample(out, "table_response_cache_entries", {}, static_cast<double>(stats.entries));
+
+    appendFamily(out, "table_response_build_seconds", "histogram", "Time to serialize a whole-table response on a cache miss.");
+    for (ResponseCache::Kind kind : ResponseCache::kKinds) {
+        labels.clear();
+        appendLabel(labels, "kind", ResponseCache::kindName(kind));
+        cache.buildTime(kind).render(out, "table_response_build_seconds", labels);
+    }
+    return out;
+}
@@ -0,0 +1,145 @@
+#pragma once
+
+#include "data_store.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+class ResponseCache;
+
+// Instruments for the request paths, rendered in the Prometheus text format.
+// Each writer thread is given one of kMetricShards rows of counters on first
+// use, so concurrent updates land on different cache lines and take no lock;
+// a scrape sums the rows.
+inline constexpr std::size_t kMetricShards = 16;
+
+inline std::size_t metricShard() {
+    static std::atomic<std::size_t> next{0};
+    thread_local const std::size_t shard = next.fetch_add(1, std::memory_order_relaxed) % kMetricShards;
+    return shard;
+}
+
+// width counters per shard, each shard on cache lines of its own.
+class ShardedCounters {
+public:
+    explicit ShardedCounters(std::size_t width);
+
+    void add(std::size_t i, std::uint64_t n = 1) { cell(metricShard(), i).fetch_add(n, std::memory_order_relaxed); }
+
+    std::uint64_t value(std::size_t i) const;
+    std::size_t width() const { return width_; }
+
+private:
+    struct alignas(64) Line {
+        std::atomic<std::uint64_t> cells[8];
+    };
+
+    std::atomic<std::uint64_t>& cell(std::size_t shard, std::size_t i) const {
+        return lines_[shard * lines_per_shard_ + i / 8].cells[i % 8];
+    }
+
+    std::size_t width_;
+    std::size_t lines_per_shard_;
+    std::unique_ptr<Line[]> lines_;
+};
+
+// Histogram of integer observations: nanoseconds, bytes or rows. bounds are
+// the inclusive bucket upper bounds in those units, and divisor converts
+// them and the sum to the exported unit (1e9 for seconds).
+class Histogram {
+public:
+    static const std::array<std::uint64_t, 17> kNanosecondBounds;  // 50us .. 10s
+    static const std::array<std::uint64_t, 11> kByteBounds;        // 256 B .. 256 MiB
+    static const std::array<std::uint64_t, 8> kRowBounds;          // 1 .. 10M
+
+    Histogram(std::span<const std::uint64_t> bounds, double divisor);
+
+    void observe(std::uint64_t value) {
+        const auto bucket = static_cast<std::size_t>(std::lower_bound(bounds_.begin(), bounds_.end(), value) - bounds_.begin());
+        counters_.add(bucket);
+        counters_.add(bounds_.size() + 1, value);
+    }
+
+    void observe(std::chrono::steady_clock::duration elapsed) {
+        observe(static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+    }
+
+    // Appends the _bucket, _sum and _count series. labels is empty or a
+    // comma-separated list of name="value" pairs.
+    void render(std::string& out, std::string_view name, std::string_view labels) const;
+
+private:
+    std::span<const std::uint64_t> bounds_;
+    double divisor_;
+    ShardedCounters counters_;  // a counter per bucket, the +Inf bucket, then the sum
+};
+
+// Counters keyed by a label value only known at run time. Each shard has
+// its own map and mutex, so writers on different threads never contend;
+// past kMaxLabels distinct values, new ones are counted as "other".
+class LabeledCounter {
+public:
+    static constexpr std::size_t kMaxLabels = 64;
+
+    void add(std::string_view label);
+
+    // Summed over the shards, sorted by label.
+    std::vector<std::pair<std::string, std::uint64_t>> values() const;
+
+private:
+    struct alignas(64) Shard {
+        mutable std::mutex mutex;
+        StringMap<std::uint64_t> counts;
+    };
+
+    std::array<Shard, kMetricShards> shards_;
+};
+
+// One RPC method or REST route.
+struct RequestMetrics {
+    RequestMetrics(std::string name, std::size_t statuses, bool counts_rows);
+
+    // status is the gRPC status code, or the HTTP status class (code / 100).
+    void finish(std::size_t status, std::chrono::steady_clock::duration elapsed, std::size_t bytes);
+
+    const std::string name;
+    ShardedCounters responses;  // by gRPC status code, or by HTTP status class
+    Histogram seconds{Histogram::kNanosecondBounds, 1e9};
+    Histogram bytes{Histogram::kByteBounds, 1.0};
+    std::optional<Histogram> rows;  // methods and routes that return rows
+};
+
+class Metrics {
+public:
+    // Method and route entries are looked up without a lock, so every one
+    // must be added before serving starts.
+    RequestMetrics& addRpc(std::string_view method, bool counts_rows = false);
+    RequestMetrics& addRoute(std::string_view route, bool counts_rows = false);
+
+    RequestMetrics* rpc(std::string_view method) const;
+    RequestMetrics* route(std::string_view route) const;
+
+    // The outcome of one cell edit; error is empty when it was applied.
+    void recordUpdate(std::string_view error) { updates_.add(error.empty() ? std::string_view("ok") : error); }
+
+    // Every instrument, plus per-table sizes and the response cache
+    // statistics, which are read at scrape time.
+    std::string render(const DataStore& db, const ResponseCache& cache) const;
+
+private:
+    StringMap<std::unique_ptr<RequestMetrics>> rpcs_;    // by method name
+    StringMap<std::unique_ptr<RequestMetrics>> routes_;  // by route pattern
+    LabeledCounter updates_;
+};
@@ -0,0 +1,147 @@
+#include "procedural_table.h"
+
+#include <algorithm>
+#include <charconv>
+#include <mutex>
+#include <ranges>
+#include <system_error>
+
+namespace {
+
+// The splitmix64 finalizer: consecutive inputs give unrelated outputs.
+std::uint64_t mix(std::uint64_t x) {
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+}  // namespace
+
+std::optional<std::size_t> ProceduralTable::findRow(std::string_view row_id) const {
+    std::uint64_t row = 0;
+    auto [end, ec] = std::from_chars(row_id.data(), row_id.data() + row_id.size(), row);
+    if (ec != std::errc{} || end != row_id.data() + row_id.size() || row >= spec_.rows) return std::nullopt;
+    // "007" is not the id of row 7.
+    if (row_id.size() > 1 && row_id.front() == '0') return std::nullopt;
+    return static_cast<std::size_t>(row);
+}
+
+std::optional<std::size_t> ProceduralTable::parentRow(std::size_t row) const {
+    if (spec_.fanout == 0 || row < spec_.fanout) return std::nullopt;
+    return row / spec_.fanout - 1;
+}
+
+// Rows must be sorted and distinct.
+template <typename Rows>
+std::shared_ptr<const Table> ProceduralTable::materialize(const Table& header, const Rows& rows) const {
+    auto table = std::make_shared<Table>();
+    table->id = header.id;
+    table->name = header.name;
+    table->primary_key = header.primary_key;
+    table->parent_key = header.parent_key;
+    table->version = header.version;
+    table->setSchema(header.schema);
+
+    std::string id;
+    std::string parent_id;
+    std::string text;
+    for (std::size_t row : rows) {
+        id = std::to_string(row);
+        const auto parent = parentRow(row);
+        if (parent) parent_id = std::to_string(*parent);
+        table->row_ids.appendString(id);
+        if (parent) {
+            table->parent_ids.appendString(parent_id);
+        } else {
+            table->parent_ids.append(CellValue{nullptr});
+        }
+
+        for (std::size_t ordinal = 0; ordinal < header.schema.size(); ++ordinal) {
+            const ColumnDef& column = header.schema[ordinal];
+            Column& cells = table->columns[ordinal];
+            if (column.id == header.primary_key && column.type == ColumnType::String) {
+                cells.appendString(id);
+                continue;
+            }
+            if (column.id == header.parent_key && column.type == ColumnType::String) {
+                if (parent) {
+                    cells.appendString(parent_id);
+                } else {
+                    cells.append(CellValue{nullptr});
+                }
+                continue;
+            }
+            const std::uint64_t hash = mix(mix(spec_.seed + row) + ordinal);
+            switch (column.type) {
+            case ColumnType::String:
+                text = column.id;
+                text += ' ';
+                text += std::to_string(hash % 100000);
+                cells.appendString(text);
+                break;
+            case ColumnType::Number:
+                cells.append(CellValue{static_cast<int>(hash % 100000)});
+                break;
+            case ColumnType::Currency:
+                cells.append(CellValue{static_cast<double>(hash % 10000000) / 100.0});
+                break;
+            case ColumnType::Bool:
+                cells.append(CellValue{(hash & 1) != 0});
+                break;
+            }
+        }
+    }
+
+    if (!std::ranges::empty(rows)) {
+        std::shared_lock lock(mutex_);
+        auto last = edits_.upper_bound(*std::ranges::prev(std::ranges::end(rows)));
+        for (auto it = edits_.lower_bound(*std::ranges::begin(rows)); it != last; ++it) {
+            const auto found = std::ranges::lower_bound(rows, it->first);
+            if (*found != it->first) continue;
+            const auto slot = static_cast<std::size_t>(found - std::ranges::begin(rows));
+            for (const Edit& edit : it->second) {
+                if (edit.version <= header.version) table->columns[edit.ordinal].set(slot, edit.value);
+            }
+        }
+    }
+
+    // Cannot fail: ids are distinct and every parent precedes its children.
+    std::string error;
+    table->buildIndexes(error);
+    return table;
+}
+
+std::shared_ptr<const Table> ProceduralTable::rows(const Table& header, std::size_t begin, std::size_t end) const {
+    end = std::min(end, rowCount());
+    begin = std::min(begin, end);
+    return materialize(header, std::views::iota(begin, end));
+}
+
+std::shared_ptr<const Table> ProceduralTable::rows(const Table& header, std::span<const std::size_t> rows) const {
+    return materialize(header, rows);
+}
+
+void ProceduralTable::edit(std::uint64_t version, std::size_t row, std::size_t ordinal, const CellValue& value) {
+    std::unique_lock lock(mutex_);
+    edits_[row].push_back({version, ordinal, value});
+}
+
+Table makeSyntheticTable(const ProceduralSpec& spec) {
+    Table table;
+    table.id = "synthetic";
+    table.name = "Synthetic";
+    table.primary_key = "id";
+    table.parent_key = "parent";
+    table.setSchema({
+        {"id", "ID", ColumnType::String, 120, true, true, false, true},
+        {"parent", "Parent", ColumnType::String, 120, false, false, false, false},
+        {"item", "Item", ColumnType::String, 240, false, false, true, false},
+        {"category", "Category", ColumnType::String, 140, false, false, true, false},
+        {"qty", "Quantity", ColumnType::Number, 100, false, false, true, false},
+        {"price", "Unit price", ColumnType::Currency, 120, false, false, true, false},
+        {"active", "Active", ColumnType::Bool, 80, false, false, true, false},
+    });
+    table.procedural = std::make_shared<ProceduralTable>(spec);
+    return table;
+}
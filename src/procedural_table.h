@@ -0,0 +1,79 @@
+#pragma once
+
+#include "data_store.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <optional>
+#include <shared_mutex>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+struct ProceduralSpec {
+    std::uint64_t rows = 0;
+    std::uint32_t fanout = 0;  // children per row; 0 for a flat table
+    std::uint64_t seed = 0;
+};
+
+// Rows of a procedural table, computed from the seed and the row index when
+// they are read, so a table of any size takes constant memory plus its
+// edits. The table itself is an ordinary Table without rows whose
+// `procedural` member points here; it carries the schema and the version.
+//
+// Row i has the id "i". With a fan-out f, rows 0 .. f-1 are roots and row
+// i >= f is a child of row i / f - 1, so the children of row p are rows
+// (p + 1) f .. (p + 2) f - 1 and the tree is log_f(rows) deep. The primary
+// key column holds the row id, a parent key column the parent id, and every
+// other cell a value hashed from the seed, the row and the column.
+//
+// Edits are kept in a sparse overlay, tagged with the table version that
+// made them, so each version reads as of itself. They are not logged: the
+// table is generated again on every start and is left out of snapshots.
+// Reads that work on stored rows (queries, windows, roll-ups, columnar
+// data, search) refuse the table; the table export skips it.
+class ProceduralTable {
+public:
+    // GetData and the unpaged /data route materialize this many rows at a time.
+    static constexpr std::size_t kChunkRows = std::size_t{1} << 16;
+
+    explicit ProceduralTable(const ProceduralSpec& spec)
+        : spec_(spec) {}
+
+    const ProceduralSpec& spec() const { return spec_; }
+    std::size_t rowCount() const { return static_cast<std::size_t>(spec_.rows); }
+
+    std::optional<std::size_t> findRow(std::string_view row_id) const;
+    std::optional<std::size_t> parentRow(std::size_t row) const;
+
+    // Rows [begin, end), or the listed rows, as of header's version, as an
+    // ordinary table with header's schema and version. Slot k holds the k-th
+    // row; parents outside the set are orphans there.
+    std::shared_ptr<const Table> rows(const Table& header, std::size_t begin, std::size_t end) const;
+    std::shared_ptr<const Table> rows(const Table& header, std::span<const std::size_t> rows) const;
+
+    // Records an edit made by version. Versions must not decrease; callers
+    // hold the table's write lock.
+    void edit(std::uint64_t version, std::size_t row, std::size_t ordinal, const CellValue& value);
+
+private:
+    struct Edit {
+        std::uint64_t version;
+        std::size_t ordinal;
+        CellValue value;
+    };
+
+    template <typename Rows>
+    std::shared_ptr<const Table> materialize(const Table& header, const Rows& rows) const;
+
+    ProceduralSpec spec_;
+    mutable std::shared_mutex mutex_;
+    std::map<std::size_t, std::vector<Edit>> edits_;  // by row, oldest first
+};
+
+// The "synthetic" table added by --synthetic-rows: a tree of line items
+// with a column of every type.
+Table makeSyntheticTable(const ProceduralSpec& spec);
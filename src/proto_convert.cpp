@@ -0,0 +1,395 @@
+#include "proto_convert.h"
+
+#include "procedural_table.h"
+
+#include <algorithm>
+#include <cmath>
+#include <unordered_map>
+#include <vector>
+#include <variant>
+
+#include <google/protobuf/arena.h>
+
+namespace {
+
+google::protobuf::ArenaOptions arenaOptions() {
+    google::protobuf::ArenaOptions options;
+    options.start_block_size = 64 << 10;
+    options.max_block_size = 4 << 20;
+    return options;
+}
+
+void markNull(tables::ColumnVector* vector, std::size_t rows, std::size_t i) {
+    std::string& nulls = *vector->mutable_nulls();
+    if (nulls.empty()) nulls.assign((rows + 7) / 8, '\0');
+    nulls[i >> 3] = static_cast<char>(nulls[i >> 3] | (1 << (i & 7)));
+}
+
+// Dictionary-encodes strings that do not come from a column segment (parent
+// ids). Keys view the table's own storage, which outlives the encoder.
+class StringEncoder {
+public:
+    StringEncoder(tables::ColumnVector* vector, std::size_t rows)
+        : vector_(vector),
+          rows_(rows) {
+        vector_->mutable_codes()->Reserve(static_cast<int>(rows));
+    }
+
+    void add(std::string_view value) {
+        auto [it, inserted] = codes_.try_emplace(value, static_cast<std::uint32_t>(codes_.size()));
+        if (inserted) vector_->add_dictionary(value.data(), value.size());
+        vector_->add_codes(it->second);
+    }
+
+    void addNull() {
+        markNull(vector_, rows_, static_cast<std::size_t>(vector_->codes_size()));
+        vector_->add_codes(0);
+    }
+
+private:
+    tables::ColumnVector* vector_;
+    std::size_t rows_;
+    std::unordered_map<std::string_view, std::uint32_t> codes_;
+};
+
+// Calls fn(i, segment, index) for rows [begin, end) of a column, where i
+// counts from begin and index is the row's position in its segment.
+template <typename Fn>
+void forEachRow(const Column& column, std::size_t begin, std::size_t end, Fn&& fn) {
+    for (std::size_t slot = begin; slot < end;) {
+        const std::size_t segment_index = slot / kSegmentRows;
+        const ColumnSegment& segment = column.segment(segment_index);
+        const std::size_t segment_end = std::min(end, (segment_index + 1) * kSegmentRows);
+        for (; slot < segment_end; ++slot) fn(slot - begin, segment, slot % kSegmentRows);
+    }
+}
+
+void encodeColumn(const Column& column, std::size_t begin, std::size_t end, tables::ColumnVector* vector) {
+    const std::size_t rows = end - begin;
+    switch (column.type()) {
+    case ColumnType::String: {
+        // Reuse each segment's dictionary: only entries the rows reference
+        // are sent, and no string is hashed. A string shared by several
+        // segments is sent once per segment.
+        auto* codes = vector->mutable_codes();
+        codes->Reserve(static_cast<int>(rows));
+        std::vector<std::uint32_t> remap;
+        const ColumnSegment* current = nullptr;
+        forEachRow(column, begin, end, [&](std::size_t i, const ColumnSegment& segment, std::size_t index) {
+            if (&segment != current) {
+                current = &segment;
+                remap.assign(segment.dictionarySize(), UINT32_MAX);
+            }
+            if (segment.isNull(index)) {
+                markNull(vector, rows, i);
+                codes->Add(0);
+                return;
+            }
+            std::uint32_t& code = remap[segment.code(index)];
+            if (code == UINT32_MAX) {
+                code = static_cast<std::uint32_t>(vector->dictionary_size());
+                const std::string_view entry = segment.dictionaryEntry(segment.code(index));
+                vector->add_dictionary(entry.data(), entry.size());
+            }
+            codes->Add(code);
+        });
+        break;
+    }
+    case ColumnType::Number: {
+        // Integers until the first fractional value, then everything as doubles.
+        auto* ints = vector->mutable_int_values();
+        auto* doubles = vector->mutable_double_values();
+        ints->Reserve(static_cast<int>(rows));
+        bool fractional = false;
+        forEachRow(column, begin, end, [&](std::size_t i, const ColumnSegment& segment, std::size_t index) {
+            const bool null = segment.isNull(index);
+            if (null) markNull(vector, rows, i);
+            const double value = null ? 0.0 : segment.number(index);
+            if (!fractional && !null && !segment.isIntTagged(index)) {
+                fractional = true;
+                doubles->Reserve(static_cast<int>(rows));
+                for (std::int64_t previous : *ints) doubles->Add(static_cast<double>(previous));
+                ints->Clear();
+            }
+            if (fractional) {
+                doubles->Add(value);
+            } else {
+                ints->Add(static_cast<std::int64_t>(value));
+            }
+        });
+        break;
+    }
+    case ColumnType::Currency: {
+        auto* doubles = vector->mutable_double_values();
+        doubles->Reserve(static_cast<int>(rows));
+        forEachRow(column, begin, end, [&](std::size_t i, const ColumnSegment& segment, std::size_t index) {
+            if (segment.isNull(index)) {
+                markNull(vector, rows, i);
+                doubles->Add(0.0);
+            } else {
+                doubles->Add(segment.number(index));
+            }
+        });
+        break;
+    }
+    case ColumnType::Bool: {
+        auto* bools = vector->mutable_bool_values();
+        bools->Reserve(static_cast<int>(rows));
+        forEachRow(column, begin, end, [&](std::size_t i, const ColumnSegment& segment, std::size_t index) {
+            if (segment.isNull(index)) {
+                markNull(vector, rows, i);
+                bools->Add(false);
+            } else {
+                bools->Add(segment.boolean(index));
+            }
+        });
+        break;
+    }
+    }
+}
+
+}  // namespace
+
+tables::ColumnType toProtoColumnType(ColumnType type) {
+    switch (type) {
+    case ColumnType::String:
+        return tables::COLUMN_TYPE_STRING;
+    case ColumnType::Number:
+        return tables::COLUMN_TYPE_NUMBER;
+    case ColumnType::Currency:
+        return tables::COLUMN_TYPE_CURRENCY;
+    case ColumnType::Bool:
+        return tables::COLUMN_TYPE_BOOL;
+    }
+    return tables::COLUMN_TYPE_STRING;
+}
+
+std::optional<ColumnType> fromProtoColumnType(tables::ColumnType type) {
+    switch (type) {
+    case tables::COLUMN_TYPE_STRING:
+        return ColumnType::String;
+    case tables::COLUMN_TYPE_NUMBER:
+        return ColumnType::Number;
+    case tables::COLUMN_TYPE_CURRENCY:
+        return ColumnType::Currency;
+    case tables::COLUMN_TYPE_BOOL:
+        return ColumnType::Bool;
+    default:
+        return std::nullopt;
+    }
+}
+
+std::optional<PredicateOp> fromProtoPredicateOp(tables::PredicateOp op) {
+    switch (op) {
+    case tables::PREDICATE_OP_EQ:
+        return PredicateOp::Eq;
+    case tables::PREDICATE_OP_NE:
+        return PredicateOp::Ne;
+    case tables::PREDICATE_OP_LT:
+        return PredicateOp::Lt;
+    case tables::PREDICATE_OP_LE:
+        return PredicateOp::Le;
+    case tables::PREDICATE_OP_GT:
+        return PredicateOp::Gt;
+    case tables::PREDICATE_OP_GE:
+        return PredicateOp::Ge;
+    case tables::PREDICATE_OP_PREFIX:
+        return PredicateOp::Prefix;
+    case tables::PREDICATE_OP_IS_NULL:
+        return PredicateOp::IsNull;
+    case tables::PREDICATE_OP_NOT_NULL:
+        return PredicateOp::NotNull;
+    default:
+        return std::nullopt;
+    }
+}
+
+tables::SearchMatch toProtoSearchMatch(SearchMatch match) {
+    switch (match) {
+    case SearchMatch::Exact:
+        return tables::SEARCH_MATCH_EXACT;
+    case SearchMatch::Prefix:
+        return tables::SEARCH_MATCH_PREFIX;
+    case SearchMatch::WordStart:
+        return tables::SEARCH_MATCH_WORD_START;
+    case SearchMatch::Substring:
+        return tables::SEARCH_MATCH_SUBSTRING;
+    }
+    return tables::SEARCH_MATCH_SUBSTRING;
+}
+
+tables::Value toProtoValue(const CellValue& value) {
+    tables::Value proto;
+    if (std::holds_alternative<std::string>(value)) {
+        proto.set_string_value(std::get<std::string>(value));
+    } else if (std::holds_alternative<int>(value)) {
+        proto.set_int_value(static_cast<int64_t>(std::get<int>(value)));
+    } else if (std::holds_alternative<double>(value)) {
+        proto.set_double_value(std::get<double>(value));
+    } else if (std::holds_alternative<bool>(value)) {
+        proto.set_bool_value(std::get<bool>(value));
+    } else {
+        proto.set_null_value(::google::protobuf::NullValue::NULL_VALUE);
+    }
+    return proto;
+}
+
+std::optional<CellValue> parseProtoValueForColumn(const tables::Value& proto_value,
+                                                  const ColumnDef& column,
+                                                  std::string& error_message) {
+    switch (proto_value.kind_case()) {
+    case tables::Value::kNullValue:
+        return std::nullptr_t{};
+    case tables::Value::kStringValue:
+        if (column.type == ColumnType::String) return proto_value.string_value();
+        error_message = "Expected string value";
+        return std::nullopt;
+    case tables::Value::kBoolValue:
+        if (column.type == ColumnType::Bool) return proto_value.bool_value();
+        error_message = "Expected boolean value";
+        return std::nullopt;
+    case tables::Value::kIntValue:
+        if (column.type == ColumnType::Currency) return static_cast<double>(proto_value.int_value());
+        if (column.type == ColumnType::Number) return static_cast<int>(proto_value.int_value());
+        error_message = "Expected numeric value";
+        return std::nullopt;
+    case tables::Value::kDoubleValue:
+        if (isNumeric(column.type)) return numberCellValue(column.type, proto_value.double_value());
+        error_message = "Expected numeric value";
+        return std::nullopt;
+    case tables::Value::KIND_NOT_SET:
+    default:
+        error_message = "Value is missing";
+        return std::nullopt;
+    }
+}
+
+void fillProtoRow(const Table& table, std::size_t slot, tables::Row* proto_row, std::span<const std::size_t> columns) {
+    const std::string_view id = table.rowId(slot);
+    proto_row->set_id(id.data(), id.size());
+    if (auto parent = table.parentId(slot)) proto_row->set_parent_id(parent->data(), parent->size());
+
+    auto* cells = proto_row->mutable_cells();
+    if (columns.empty()) {
+        for (std::size_t c = 0; c < table.schema.size(); ++c) {
+            table.columns[c].visit(slot, ProtoCellVisitor{&(*cells)[table.schema[c].id]});
+        }
+        return;
+    }
+    for (std::size_t c : columns) {
+        table.columns[c].visit(slot, ProtoCellVisitor{&(*cells)[table.schema[c].id]});
+    }
+}
+
+void fillProtoSchema(const Table& table, tables::TableSchema* schema) {
+    schema->set_table_id(table.id);
+    schema->set_name(table.name);
+    schema->set_primary_key(table.primary_key);
+    schema->set_parent_key(table.parent_key);
+
+    for (const auto& column : table.schema) {
+        auto* proto_column = schema->add_columns();
+        proto_column->set_id(column.id);
+        proto_column->set_title(column.title);
+        proto_column->set_type(toProtoColumnType(column.type));
+        proto_column->set_width(column.width);
+        proto_column->set_is_tree(column.is_tree);
+        proto_column->set_is_pinned(column.is_pinned);
+        proto_column->set_is_editable(column.is_editable && !column.is_primary);
+        proto_column->set_is_primary(column.is_primary);
+    }
+}
+
+std::optional<ColumnDef> fromProtoColumnDef(const tables::ColumnDef& column) {
+    auto type = fromProtoColumnType(column.type());
+    if (!type) return std::nullopt;
+    return ColumnDef{column.id(), column.title(), *type, column.width(), column.is_tree(),
+                     column.is_pinned(), column.is_editable(), column.is_primary()};
+}
+
+bool fromProtoSchema(const tables::TableSchema& schema, Table& table, std::string& error_message) {
+    std::vector<ColumnDef> columns;
+    columns.reserve(schema.columns_size());
+    for (const auto& proto_column : schema.columns()) {
+        auto column = fromProtoColumnDef(proto_column);
+        if (!column) {
+            error_message = "Unknown type of column " + proto_column.id();
+            return false;
+        }
+        columns.push_back(std::move(*column));
+    }
+    table.id = schema.table_id();
+    table.name = schema.name();
+    table.primary_key = schema.primary_key();
+    table.parent_key = schema.parent_key();
+    table.setSchema(std::move(columns));
+    return true;
+}
+
+void fillColumnarData(const Table& table, std::size_t begin, std::size_t end, tables::ColumnarData* data) {
+    end = std::min(end, table.rowCount());
+    begin = std::min(begin, end);
+    const std::size_t rows = end - begin;
+    data->set_version(table.version);
+    data->set_row_offset(begin);
+    data->set_row_count(static_cast<std::uint32_t>(rows));
+
+    auto* row_ids = data->mutable_row_ids();
+    row_ids->Reserve(static_cast<int>(rows));
+    StringEncoder parents(data->mutable_parent_ids(), rows);
+    for (std::size_t slot = begin; slot < end; ++slot) {
+        const std::string_view id = table.rowId(slot);
+        row_ids->Add()->assign(id.data(), id.size());
+        if (auto parent = table.parentId(slot)) {
+            parents.add(*parent);
+        } else {
+            parents.addNull();
+        }
+    }
+
+    data->mutable_columns()->Reserve(static_cast<int>(table.schema.size()));
+    for (std::size_t c = 0; c < table.schema.size(); ++c) {
+        auto* vector = data->add_columns();
+        vector->set_ordinal(static_cast<std::uint32_t>(c));
+        encodeColumn(table.columns[c], begin, end, vector);
+    }
+}
+
+std::string serializeDataResponse(const Table& table) {
+    google::protobuf::Arena arena(arenaOptions());
+    auto* message = google::protobuf::Arena::CreateMessage<tables::GetDataResponse>(&arena);
+    const std::size_t rows = table.rowCount();
+    message->mutable_rows()->Reserve(static_cast<int>(rows));
+    for (std::size_t slot = 0; slot < rows; ++slot) {
+        fillProtoRow(table, slot, message->add_rows());
+    }
+    message->set_version(table.version);
+    return message->SerializeAsString();
+}
+
+std::string serializeDataResponse(const Table& table, std::span<const std::size_t> slots) {
+    google::protobuf::Arena arena(arenaOptions());
+    auto* message = google::protobuf::Arena::CreateMessage<tables::GetDataResponse>(&arena);
+    message->mutable_rows()->Reserve(static_cast<int>(slots.size()));
+    for (std::size_t slot : slots) {
+        fillProtoRow(table, slot, message->add_rows());
+    }
+    message->set_version(table.version);
+    return message->SerializeAsString();
+}
+
+std::string serializeProceduralDataResponse(const Table& table) {
+    const ProceduralTable& rows = *table.procedural;
+    std::string out = serializeDataResponse(table);  // just the version
+    for (std::size_t begin = 0; begin < rows.rowCount(); begin += ProceduralTable::kChunkRows) {
+        out += serializeDataResponse(*rows.rows(table, begin, begin + ProceduralTable::kChunkRows));
+    }
+    return out;
+}
+
+std::string serializeColumnarData(const Table& table, std::size_t begin, std::size_t end) {
+    google::protobuf::Arena arena(arenaOptions());
+    auto* message = google::protobuf::Arena::CreateMessage<tables::ColumnarData>(&arena);
+    fillColumnarData(table, begin, end, message);
+    return message->SerializeAsString();
+}
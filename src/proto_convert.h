@@ -0,0 +1,64 @@
+#pragma once
+
+#include "data_store.h"
+#include "query.h"
+#include "text_search.h"
+#include "table.pb.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+
+// Fills a protobuf value from a value produced by Column::visit.
+struct ProtoCellVisitor {
+    tables::Value* proto;
+
+    void operator()(std::nullptr_t) const { proto->set_null_value(::google::protobuf::NullValue::NULL_VALUE); }
+    void operator()(std::string_view v) const { proto->set_string_value(v.data(), v.size()); }
+    void operator()(int v) const { proto->set_int_value(static_cast<int64_t>(v)); }
+    void operator()(double v) const { proto->set_double_value(v); }
+    void operator()(bool v) const { proto->set_bool_value(v); }
+};
+
+tables::ColumnType toProtoColumnType(ColumnType type);
+std::optional<ColumnType> fromProtoColumnType(tables::ColumnType type);
+
+std::optional<PredicateOp> fromProtoPredicateOp(tables::PredicateOp op);
+
+tables::SearchMatch toProtoSearchMatch(SearchMatch match);
+
+tables::Value toProtoValue(const CellValue& value);
+
+std::optional<CellValue> parseProtoValueForColumn(const tables::Value& proto_value,
+                                                  const ColumnDef& column,
+                                                  std::string& error_message);
+
+// columns lists the schema ordinals to include; empty includes all.
+void fillProtoRow(const Table& table, std::size_t slot, tables::Row* proto_row,
+                  std::span<const std::size_t> columns = {});
+
+void fillProtoSchema(const Table& table, tables::TableSchema* schema);
+
+// nullopt when the column type is unknown.
+std::optional<ColumnDef> fromProtoColumnDef(const tables::ColumnDef& column);
+
+// Sets the id, name, keys and schema of an empty table.
+bool fromProtoSchema(const tables::TableSchema& schema, Table& table, std::string& error_message);
+
+// Fills the column-major form of rows [begin, end).
+void fillColumnarData(const Table& table, std::size_t begin, std::size_t end, tables::ColumnarData* data);
+
+// Wire encodings of the whole-table GetData response, of one holding only
+// the rows at slots, and of the columnar form of rows [begin, end). The
+// messages are built in an arena, so the per-cell map entries and values
+// are freed at once.
+std::string serializeDataResponse(const Table& table);
+std::string serializeDataResponse(const Table& table, std::span<const std::size_t> slots);
+// The whole-table response of a procedural table, materialized
+// ProceduralTable::kChunkRows rows at a time; the wire encodings of the
+// chunks are concatenated, which merges their rows.
+std::string serializeProceduralDataResponse(const Table& table);
+std::string serializeColumnarData(const Table& table, std::size_t begin, std::size_t end);
@@ -0,0 +1,289 @@
+#include "query.h"
+
+#include <algorithm>
+#include <functional>
+#include <string_view>
+#include <variant>
+
+namespace {
+
+double numericOperand(const CellValue& value) {
+    if (std::holds_alternative<int>(value)) return std::get<int>(value);
+    return std::get<double>(value);
+}
+
+// mask[i] &= cmp(values[i], operand). Plain loops over contiguous arrays so
+// the compiler can vectorize them.
+template <typename Compare>
+void narrowNumbers(const double* values, std::size_t rows, double operand, std::uint8_t* mask, Compare cmp) {
+    for (std::size_t i = 0; i < rows; ++i) {
+        mask[i] &= static_cast<std::uint8_t>(cmp(values[i], operand));
+    }
+}
+
+void narrowNumbers(const double* values, std::size_t rows, PredicateOp op, double operand, std::uint8_t* mask) {
+    switch (op) {
+    case PredicateOp::Eq: narrowNumbers(values, rows, operand, mask, std::equal_to<double>{}); break;
+    case PredicateOp::Ne: narrowNumbers(values, rows, operand, mask, std::not_equal_to<double>{}); break;
+    case PredicateOp::Lt: narrowNumbers(values, rows, operand, mask, std::less<double>{}); break;
+    case PredicateOp::Le: narrowNumbers(values, rows, operand, mask, std::less_equal<double>{}); break;
+    case PredicateOp::Gt: narrowNumbers(values, rows, operand, mask, std::greater<double>{}); break;
+    case PredicateOp::Ge: narrowNumbers(values, rows, operand, mask, std::greater_equal<double>{}); break;
+    default: break;
+    }
+}
+
+// mask[i] &= (bit i of words) == expected
+void narrowBits(std::span<const std::uint64_t> words, std::size_t rows, bool expected, std::uint8_t* mask) {
+    const std::uint64_t flip = expected ? 0 : ~std::uint64_t{0};
+    for (std::size_t i = 0; i < rows; ++i) {
+        mask[i] &= static_cast<std::uint8_t>(((words[i >> 6] ^ flip) >> (i & 63)) & 1);
+    }
+}
+
+bool matchesString(std::string_view value, PredicateOp op, std::string_view operand) {
+    switch (op) {
+    case PredicateOp::Eq: return value == operand;
+    case PredicateOp::Ne: return value != operand;
+    case PredicateOp::Prefix: return value.starts_with(operand);
+    default: return false;
+    }
+}
+
+void narrowSegment(const ColumnSegment& segment, ColumnType type, const Predicate& predicate, std::uint8_t* mask,
+                   std::vector<std::uint8_t>& dictionary_matches) {
+    const std::size_t rows = segment.size();
+    if (predicate.op == PredicateOp::IsNull || predicate.op == PredicateOp::NotNull) {
+        narrowBits(segment.nullWords(), rows, predicate.op == PredicateOp::IsNull, mask);
+        return;
+    }
+
+    // Null slots hold stale values; comparisons never match them.
+    narrowBits(segment.nullWords(), rows, false, mask);
+
+    switch (type) {
+    case ColumnType::Number:
+    case ColumnType::Currency:
+        narrowNumbers(segment.numbers().data(), rows, predicate.op, numericOperand(predicate.operand), mask);
+        break;
+    case ColumnType::Bool:
+        narrowBits(segment.boolWords(), rows, std::get<bool>(predicate.operand) == (predicate.op == PredicateOp::Eq), mask);
+        break;
+    case ColumnType::String: {
+        // Decide each dictionary entry once, then look the answer up by code.
+        const std::string_view operand = std::get<std::string>(predicate.operand);
+        dictionary_matches.resize(segment.dictionarySize());
+        for (std::uint32_t code = 0; code < dictionary_matches.size(); ++code) {
+            dictionary_matches[code] = matchesString(segment.dictionaryEntry(code), predicate.op, operand);
+        }
+        // A null slot's code may point past the dictionary (it is empty in an
+        // all-null segment, and compaction leaves null codes unmapped), so
+        // only rows still in the mask are looked up.
+        const std::uint32_t* codes = segment.codes().data();
+        const std::size_t entries = dictionary_matches.size();
+        for (std::size_t i = 0; i < rows; ++i) {
+            if (mask[i]) mask[i] = codes[i] < entries && dictionary_matches[codes[i]];
+        }
+        break;
+    }
+    }
+}
+
+std::string validate(const Table& table, const QuerySpec& spec) {
+    for (const auto& predicate : spec.predicates) {
+        if (predicate.ordinal >= table.schema.size()) return "Column not found";
+        if (predicate.op == PredicateOp::IsNull || predicate.op == PredicateOp::NotNull) continue;
+
+        const ColumnType type = table.schema[predicate.ordinal].type;
+        if (std::holds_alternative<std::nullptr_t>(predicate.operand)) return "Use is_null/not_null to match null cells";
+        if (!fitsColumnType(type, predicate.operand)) return "Value does not match column type";
+        switch (predicate.op) {
+        case PredicateOp::Lt:
+        case PredicateOp::Le:
+        case PredicateOp::Gt:
+        case PredicateOp::Ge:
+            if (!isNumeric(type)) return "Ordering comparisons need a number or currency column";
+            break;
+        case PredicateOp::Prefix:
+            if (type != ColumnType::String) return "Prefix match needs a string column";
+            break;
+        default:
+            break;
+        }
+    }
+    for (const auto& key : spec.sort) {
+        if (key.ordinal >= table.schema.size()) return "Column not found";
+    }
+    return {};
+}
+
+// Sort keys extracted once per row, so comparisons do not dispatch on the
+// column type. Holds a table-sized copy of each key; pass it to std::sort
+// through std::cref.
+class RowOrder {
+public:
+    RowOrder(const RowOrder&) = delete;
+    RowOrder& operator=(const RowOrder&) = delete;
+
+    RowOrder(const Table& table, const std::vector<SortKey>& keys, const std::vector<std::uint32_t>& slots)
+        : keys_(keys),
+          columns_(keys.size()) {
+        const std::size_t rows = table.rowCount();
+        for (std::size_t k = 0; k < keys.size(); ++k) {
+            const Column& column = table.columns[keys[k].ordinal];
+            auto& values = columns_[k];
+            values.nulls.assign(rows, 0);
+            if (column.type() == ColumnType::String) {
+                values.strings.resize(rows);
+            } else {
+                values.numbers.resize(rows);
+            }
+            for (std::uint32_t slot : slots) {
+                const ColumnSegment& segment = column.segment(slot / kSegmentRows);
+                const std::size_t i = slot % kSegmentRows;
+                if (segment.isNull(i)) {
+                    values.nulls[slot] = 1;
+                } else if (column.type() == ColumnType::String) {
+                    values.strings[slot] = segment.string(i);
+                } else if (column.type() == ColumnType::Bool) {
+                    values.numbers[slot] = segment.boolean(i) ? 1.0 : 0.0;
+                } else {
+                    values.numbers[slot] = segment.number(i);
+                }
+            }
+        }
+    }
+
+    bool empty() const { return keys_.empty(); }
+
+    bool operator()(std::uint32_t a, std::uint32_t b) const {
+        for (std::size_t k = 0; k < keys_.size(); ++k) {
+            const auto& values = columns_[k];
+            if (values.nulls[a] != values.nulls[b]) return values.nulls[b];
+            if (values.nulls[a]) continue;
+
+            int order = 0;
+            if (!values.strings.empty()) {
+                order = values.strings[a].compare(values.strings[b]);
+            } else if (values.numbers[a] != values.numbers[b]) {
+                order = values.numbers[a] < values.numbers[b] ? -1 : 1;
+            }
+            if (order != 0) return keys_[k].descending ? order > 0 : order < 0;
+        }
+        return a < b;
+    }
+
+private:
+    struct Values {
+        std::vector<std::uint8_t> nulls;
+        std::vector<double> numbers;
+        std::vector<std::string_view> strings;
+    };
+
+    const std::vector<SortKey>& keys_;
+    std::vector<Values> columns_;
+};
+
+}  // namespace
+
+bool parsePredicateOp(std::string_view name, PredicateOp& op) {
+    static constexpr std::pair<std::string_view, PredicateOp> kOps[] = {
+        {"eq", PredicateOp::Eq},         {"ne", PredicateOp::Ne},         {"lt", PredicateOp::Lt},
+        {"le", PredicateOp::Le},         {"gt", PredicateOp::Gt},         {"ge", PredicateOp::Ge},
+        {"prefix", PredicateOp::Prefix}, {"is_null", PredicateOp::IsNull}, {"not_null", PredicateOp::NotNull},
+    };
+    for (const auto& [candidate, value] : kOps) {
+        if (candidate == name) {
+            op = value;
+            return true;
+        }
+    }
+    return false;
+}
+
+QueryResult runQuery(const Table& table, const QuerySpec& spec) {
+    QueryResult result;
+    result.error = validate(table, spec);
+    if (!result.error.empty()) return result;
+
+    const std::size_t rows = table.rowCount();
+    std::vector<std::uint8_t> matched(rows, 1);
+    std::vector<std::uint8_t> dictionary_matches;
+    for (const auto& predicate : spec.predicates) {
+        const Column& column = table.columns[predicate.ordinal];
+        for (std::size_t s = 0; s < column.segmentCount(); ++s) {
+            narrowSegment(column.segment(s), column.type(), predicate, matched.data() + s * kSegmentRows, dictionary_matches);
+        }
+    }
+
+    // Keep every ancestor of a match. The walk stops at the first ancestor
+    // already kept, so each row is visited at most twice.
+    const RowIndex& index = *table.index;
+    const bool tree = !table.parent_key.empty();
+    std::vector<std::uint8_t> kept(matched);
+    std::vector<std::uint32_t> kept_slots;
+    for (std::uint32_t slot = 0; slot < rows; ++slot) {
+        if (!matched[slot]) continue;
+        ++result.match_count;
+        if (!tree) continue;
+        for (std::uint32_t parent = index.parent_slots[slot]; parent != kNoSlot && !kept[parent];
+             parent = index.parent_slots[parent]) {
+            kept[parent] = 1;
+        }
+    }
+    for (std::uint32_t slot = 0; slot < rows; ++slot) {
+        if (kept[slot]) kept_slots.push_back(slot);
+    }
+
+    const RowOrder order(table, spec.sort, kept_slots);
+    std::vector<std::uint32_t> ordered;
+    ordered.reserve(kept_slots.size());
+    if (!tree) {
+        ordered = std::move(kept_slots);
+        if (!order.empty()) std::sort(ordered.begin(), ordered.end(), std::cref(order));
+    } else {
+        // Depth-first over kept rows; rows without a parent in the table
+        // (roots and orphans) are the top level.
+        std::vector<std::uint32_t> top;
+        for (std::uint32_t slot : kept_slots) {
+            if (index.parent_slots[slot] == kNoSlot) top.push_back(slot);
+        }
+        if (!order.empty()) std::sort(top.begin(), top.end(), std::cref(order));
+
+        std::vector<std::uint32_t> stack(top.rbegin(), top.rend());
+        std::vector<std::uint32_t> siblings;
+        while (!stack.empty()) {
+            const std::uint32_t slot = stack.back();
+            stack.pop_back();
+            ordered.push_back(slot);
+
+            siblings.clear();
+            for (std::uint32_t child : table.children(slot)) {
+                if (kept[child]) siblings.push_back(child);
+            }
+            if (!order.empty()) std::sort(siblings.begin(), siblings.end(), std::cref(order));
+            stack.insert(stack.end(), siblings.rbegin(), siblings.rend());
+        }
+    }
+    result.row_count = ordered.size();
+
+    const std::size_t begin = std::min(spec.offset, ordered.size());
+    const std::size_t end = spec.limit && spec.limit < ordered.size() - begin ? begin + spec.limit : ordered.size();
+    if (tree && begin < end) {
+        // Ancestors of any row in the page are either in the page or
+        // ancestors of its first row, which precede it in depth-first order.
+        std::vector<std::uint32_t> ancestors;
+        for (std::uint32_t parent = index.parent_slots[ordered[begin]]; parent != kNoSlot;
+             parent = index.parent_slots[parent]) {
+            ancestors.push_back(parent);
+        }
+        result.slots.assign(ancestors.rbegin(), ancestors.rend());
+    }
+    result.slots.insert(result.slots.end(), ordered.begin() + static_cast<std::ptrdiff_t>(begin),
+                        ordered.begin() + static_cast<std::ptrdiff_t>(end));
+    result.matched.reserve(result.slots.size());
+    for (std::uint32_t slot : result.slots) {
+        result.matched.push_back(matched[slot] != 0);
+    }
+    return result;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "data_store.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+enum class PredicateOp {
+    Eq,
+    Ne,
+    Lt,
+    Le,
+    Gt,
+    Ge,
+    Prefix,   // String only
+    IsNull,   // operand ignored
+    NotNull,  // operand ignored
+};
+
+// Comparisons never match null cells. Lt/Le/Gt/Ge need a Number or Currency
+// column; Eq/Ne work on every type.
+struct Predicate {
+    std::size_t ordinal = 0;
+    PredicateOp op = PredicateOp::Eq;
+    CellValue operand;
+};
+
+// Nulls sort last in either direction.
+struct SortKey {
+    std::size_t ordinal = 0;
+    bool descending = false;
+};
+
+struct QuerySpec {
+    std::vector<Predicate> predicates;  // all must hold
+    std::vector<SortKey> sort;          // ties keep row slot order
+    std::size_t offset = 0;
+    std::size_t limit = 0;              // 0 returns every row from offset on
+};
+
+// Rows of one result page, in display order. For a tree table the full
+// result is the matching rows plus all their ancestors, in depth-first order
+// with siblings sorted; a page that starts inside a subtree is preceded by
+// the ancestors of its first row, so every page renders as a tree.
+struct QueryResult {
+    std::vector<std::uint32_t> slots;
+    std::vector<bool> matched;  // parallel to slots; false for ancestors kept only for context
+    std::size_t match_count = 0;
+    std::size_t row_count = 0;  // rows of the full result, before paging
+    std::string error;
+};
+
+// Predicates are evaluated column at a time: each narrows a byte mask over
+// a segment's contiguous values, and string predicates are decided once
+// per dictionary entry.
+QueryResult runQuery(const Table& table, const QuerySpec& spec);
+
+bool parsePredicateOp(std::string_view name, PredicateOp& op);
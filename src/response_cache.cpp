@@ -0,0 +1,104 @@
+#include "response_cache.h"
+
+#include <utility>
+
+ResponseCache::ResponseCache(std::size_t capacity_bytes)
+    : capacity_(capacity_bytes) {
+    build_time_.reserve(kKinds.size());
+    for (std::size_t i = 0; i < kKinds.size(); ++i) build_time_.emplace_back(Histogram::kNanosecondBounds, 1e9);
+}
+
+std::string_view ResponseCache::kindName(Kind kind) {
+    switch (kind) {
+    case Kind::ProtoSchema:
+        return "proto_schema";
+    case Kind::ProtoData:
+        return "proto_data";
+    case Kind::ProtoColumnarData:
+        return "proto_columnar_data";
+    case Kind::JsonSchema:
+        return "json_schema";
+    case Kind::JsonData:
+        return "json_data";
+    case Kind::ArrowStream:
+        return "arrow_stream";
+    case Kind::ArrowFile:
+        return "arrow_file";
+    }
+    return "unknown";
+}
+
+std::string ResponseCache::makeKey(std::string_view table_id, Kind kind) {
+    std::string key;
+    key.reserve(table_id.size() + 2);
+    key.append(table_id).push_back('\0');
+    key.push_back(static_cast<char>(kind));
+    return key;
+}
+
+ResponseCache::Payload ResponseCache::find(const std::string& key, std::uint64_t version) {
+    {
+        std::lock_guard lock(mutex_);
+        auto it = entries_.find(key);
+        if (it != entries_.end() && it->second->version == version) {
+            lru_.splice(lru_.begin(), lru_, it->second);
+            hits_.fetch_add(1, std::memory_order_relaxed);
+            return it->second->payload;
+        }
+    }
+    misses_.fetch_add(1, std::memory_order_relaxed);
+    return nullptr;
+}
+
+void ResponseCache::insert(std::string key, std::uint64_t version, const Payload& payload) {
+    const std::size_t size = payload->size() + key.size();
+    if (size > capacity_) return;
+
+    std::lock_guard lock(mutex_);
+    if (auto it = entries_.find(key); it != entries_.end()) {
+        // A concurrent miss may already have cached the same or a newer version.
+        if (it->second->version >= version) return;
+        bytes_ -= it->second->payload->size() + it->second->key.size();
+        auto entry = it->second;
+        entries_.erase(it);
+        lru_.erase(entry);
+    }
+
+    lru_.push_front({std::move(key), version, payload});
+    entries_.emplace(lru_.front().key, lru_.begin());
+    bytes_ += size;
+    evictLocked();
+}
+
+void ResponseCache::evictLocked() {
+    while (bytes_ > capacity_) {
+        const Entry& victim = lru_.back();
+        bytes_ -= victim.payload->size() + victim.key.size();
+        entries_.erase(victim.key);
+        lru_.pop_back();
+        evictions_.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void ResponseCache::erase(std::string_view table_id) {
+    std::lock_guard lock(mutex_);
+    for (Kind kind : kKinds) {
+        auto it = entries_.find(makeKey(table_id, kind));
+        if (it == entries_.end()) continue;
+        bytes_ -= it->second->payload->size() + it->second->key.size();
+        auto entry = it->second;
+        entries_.erase(it);
+        lru_.erase(entry);
+    }
+}
+
+ResponseCache::Stats ResponseCache::stats() const {
+    Stats stats;
+    stats.hits = hits_.load(std::memory_order_relaxed);
+    stats.misses = misses_.load(std::memory_order_relaxed);
+    stats.evictions = evictions_.load(std::memory_order_relaxed);
+    std::lock_guard lock(mutex_);
+    stats.bytes = bytes_;
+    stats.entries = lru_.size();
+    return stats;
+}
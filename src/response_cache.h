@@ -0,0 +1,98 @@
+#pragma once
+
+#include "data_store.h"
+#include "metrics.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Serialized whole-table responses, at most one per table and kind. An entry
+// is only served for the table version it was built from. A read of a newer
+// version rebuilds it. Reads of older, still pinned versions miss without
+// evicting the newer entry. When the cached bytes exceed the capacity, the
+// least recently used entries are evicted.
+class ResponseCache {
+public:
+    static constexpr std::size_t kDefaultCapacity = 256u << 20;
+
+    enum class Kind : std::uint8_t {
+        ProtoSchema,        // tables::GetSchemaResponse wire bytes
+        ProtoData,          // tables::GetDataResponse wire bytes
+        ProtoColumnarData,  // tables::ColumnarData of every row
+        JsonSchema,
+        JsonData,
+        ArrowStream,  // Arrow IPC stream of every row
+        ArrowFile,    // Arrow IPC file of every row
+    };
+    static constexpr std::array<Kind, 7> kKinds = {Kind::ProtoSchema, Kind::ProtoData, Kind::ProtoColumnarData,
+                                                   Kind::JsonSchema, Kind::JsonData, Kind::ArrowStream,
+                                                   Kind::ArrowFile};
+    static std::string_view kindName(Kind kind);
+
+    using Payload = std::shared_ptr<const std::string>;
+
+    struct Stats {
+        std::uint64_t hits = 0;
+        std::uint64_t misses = 0;
+        std::uint64_t evictions = 0;
+        std::size_t bytes = 0;
+        std::size_t entries = 0;
+    };
+
+    explicit ResponseCache(std::size_t capacity_bytes = kDefaultCapacity);
+
+    // Returns the cached payload for table.version, calling build() to make
+    // it on a miss. build() runs without the cache lock held, and is timed.
+    template <typename Build>
+    Payload get(const Table& table, Kind kind, Build&& build) {
+        std::string key = makeKey(table.id, kind);
+        if (Payload payload = find(key, table.version)) return payload;
+        const auto started = std::chrono::steady_clock::now();
+        auto payload = std::make_shared<const std::string>(build());
+        build_time_[static_cast<std::size_t>(kind)].observe(std::chrono::steady_clock::now() - started);
+        insert(std::move(key), table.version, payload);
+        return payload;
+    }
+
+    // Drops every entry of a table.
+    void erase(std::string_view table_id);
+
+    Stats stats() const;
+    std::size_t capacity() const { return capacity_; }
+    const Histogram& buildTime(Kind kind) const { return build_time_[static_cast<std::size_t>(kind)]; }
+
+private:
+    struct Entry {
+        std::string key;
+        std::uint64_t version = 0;
+        Payload payload;
+    };
+
+    static std::string makeKey(std::string_view table_id, Kind kind);
+
+    Payload find(const std::string& key, std::uint64_t version);
+    void insert(std::string key, std::uint64_t version, const Payload& payload);
+    void evictLocked();
+
+    const std::size_t capacity_;
+
+    mutable std::mutex mutex_;
+    std::list<Entry> lru_;  // most recently used first
+    std::unordered_map<std::string_view, std::list<Entry>::iterator> entries_;  // keys point into lru_
+    std::size_t bytes_ = 0;
+
+    std::atomic<std::uint64_t> hits_{0};
+    std::atomic<std::uint64_t> misses_{0};
+    std::atomic<std::uint64_t> evictions_{0};
+    std::vector<Histogram> build_time_;  // by Kind
+};
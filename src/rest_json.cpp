@@ -0,0 +1,592 @@
+#include "rest_json.h"
+
+#include "json_writer.h"
+#include "procedural_table.h"
+
+#include <algorithm>
+#include <cmath>
+#include <variant>
+
+// Converts a value produced by Column::visit into its JSON form.
+struct JsonCellVisitor {
+    crow::json::wvalue operator()(std::nullptr_t) const { return nullptr; }
+    crow::json::wvalue operator()(std::string_view v) const { return std::string(v); }
+    crow::json::wvalue operator()(int v) const { return v; }
+    crow::json::wvalue operator()(double v) const { return v; }
+    crow::json::wvalue operator()(bool v) const { return v; }
+};
+
+std::optional<CellValue> parseJsonValueForColumn(const crow::json::rvalue& node,
+                                                 const ColumnDef& column,
+                                                 std::string& error_message) {
+    using crow::json::type;
+
+    if (node.t() == type::Null) return std::nullptr_t{};
+
+    switch (column.type) {
+    case ColumnType::String:
+        if (node.t() == type::String) return node.s();
+        error_message = "Expected string value";
+        return std::nullopt;
+    case ColumnType::Bool:
+        if (node.t() == type::True || node.t() == type::False) return node.b();
+        error_message = "Expected boolean value";
+        return std::nullopt;
+    case ColumnType::Number:
+    case ColumnType::Currency:
+        if (node.t() == type::Number) return numberCellValue(column.type, node.d());
+        error_message = "Expected numeric value";
+        return std::nullopt;
+    }
+
+    error_message = "Unsupported type";
+    return std::nullopt;
+}
+
+// Writes a value produced by Column::visit.
+struct JsonWriterCellVisitor {
+    JsonWriter& json;
+
+    void operator()(std::nullptr_t) const { json.null(); }
+    void operator()(std::string_view v) const { json.value(v); }
+    void operator()(int v) const { json.value(v); }
+    void operator()(double v) const { json.value(v); }
+    void operator()(bool v) const { json.value(v); }
+};
+
+std::string buildTablesJson(const std::vector<std::pair<std::string, std::string>>& list) {
+    std::string out;
+    JsonWriter json(out);
+    json.beginArray();
+    for (const auto& [id, name] : list) {
+        json.beginObject();
+        json.key("id");
+        json.value(id);
+        json.key("name");
+        json.value(name);
+        json.endObject();
+    }
+    json.endArray();
+    return out;
+}
+
+std::string buildSchemaJson(const Table& table) {
+    std::string out;
+    out.reserve(128 + table.schema.size() * 192);
+    JsonWriter json(out);
+    json.beginObject();
+    json.key("tableId");
+    json.value(table.id);
+    json.key("name");
+    json.value(table.name);
+    json.key("primaryKey");
+    json.value(table.primary_key);
+    json.key("parentKey");
+    json.value(table.parent_key);
+
+    json.key("columns");
+    json.beginArray();
+    for (const auto& column : table.schema) {
+        json.beginObject();
+        json.key("id");
+        json.value(column.id);
+        json.key("title");
+        json.value(column.title);
+        json.key("type");
+        json.value(toString(column.type));
+        json.key("width");
+        json.value(column.width);
+        json.key("isTreeColumn");
+        json.value(column.is_tree);
+        json.key("isPinned");
+        json.value(column.is_pinned);
+        json.key("isEditable");
+        json.value(column.is_editable && !column.is_primary);
+        json.key("isPrimary");
+        json.value(column.is_primary);
+        json.endObject();
+    }
+    json.endArray();
+    json.endObject();
+    return out;
+}
+
+// Writes rows in the shape of /data. Member-key fragments are escaped once
+// per response rather than once per cell. A schema column named like the
+// primary or parent key supplies that member itself, and is kept even when
+// a projection leaves it out, so rows are identified the same way as in
+// /data.
+class RowJsonWriter {
+public:
+    // columns lists the schema ordinals to write; empty writes all.
+    RowJsonWriter(const Table& table, std::span<const std::size_t> columns = {})
+        : table_(table) {
+        auto primary = table.findColumnOrdinal(table.primary_key);
+        auto parent = table.parent_key.empty() ? std::nullopt : table.findColumnOrdinal(table.parent_key);
+        write_primary_ = !primary;
+        write_parent_ = !table.parent_key.empty() && !parent;
+        primary_key_ = JsonWriter::keyFragment(table.primary_key);
+        parent_key_ = JsonWriter::keyFragment(table.parent_key);
+
+        std::vector<bool> selected(table.schema.size(), columns.empty());
+        for (std::size_t c : columns) selected[c] = true;
+        if (primary) selected[*primary] = true;
+        if (parent) selected[*parent] = true;
+        for (std::size_t c = 0; c < table.schema.size(); ++c) {
+            if (!selected[c]) continue;
+            columns_.push_back(c);
+            column_keys_.push_back(JsonWriter::keyFragment(table.schema[c].id));
+            row_estimate_ += column_keys_.back().size() + 12;
+        }
+    }
+
+    // Rough bytes per row, for reserving output buffers.
+    std::size_t rowEstimate() const { return row_estimate_; }
+
+    void write(JsonWriter& json, std::size_t slot) const {
+        json.beginObject();
+        if (write_primary_) {
+            json.rawKey(primary_key_);
+            json.value(table_.rowId(slot));
+        }
+        if (write_parent_) {
+            json.rawKey(parent_key_);
+            if (auto parent = table_.parentId(slot)) {
+                json.value(*parent);
+            } else {
+                json.null();
+            }
+        }
+        for (std::size_t i = 0; i < columns_.size(); ++i) {
+            json.rawKey(column_keys_[i]);
+            table_.columns[columns_[i]].visit(slot, JsonWriterCellVisitor{json});
+        }
+        json.endObject();
+    }
+
+private:
+    const Table& table_;
+    bool write_primary_ = false;
+    bool write_parent_ = false;
+    std::string primary_key_;
+    std::string parent_key_;
+    std::vector<std::size_t> columns_;
+    std::vector<std::string> column_keys_;
+    std::size_t row_estimate_ = 2;
+};
+
+std::string buildRowsJson(const Table& table, std::size_t begin, std::size_t end) {
+    end = std::min(end, table.rowCount());
+    begin = std::min(begin, end);
+
+    const RowJsonWriter rows(table);
+    std::string out;
+    out.reserve(2 + (end - begin) * rows.rowEstimate());
+    JsonWriter json(out);
+    json.beginArray();
+    for (std::size_t slot = begin; slot < end; ++slot) {
+        rows.write(json, slot);
+    }
+    json.endArray();
+    return out;
+}
+
+std::string buildProceduralRowsJson(const Table& table, std::size_t begin, std::size_t end) {
+    const ProceduralTable& rows = *table.procedural;
+    end = std::min(end, rows.rowCount());
+    begin = std::min(begin, end);
+
+    std::string out;
+    JsonWriter json(out);
+    json.beginArray();
+    for (std::size_t first = begin; first < end; first += ProceduralTable::kChunkRows) {
+        const auto chunk = rows.rows(table, first, std::min(end, first + ProceduralTable::kChunkRows));
+        const RowJsonWriter writer(*chunk);
+        if (first == begin) out.reserve(2 + (end - begin) * writer.rowEstimate());
+        for (std::size_t slot = 0; slot < chunk->rowCount(); ++slot) {
+            writer.write(json, slot);
+        }
+    }
+    json.endArray();
+    return out;
+}
+
+std::string buildQueryJson(const Table& table, const QueryResult& result, std::span<const std::size_t> columns) {
+    const RowJsonWriter rows(table, columns);
+    std::string out;
+    out.reserve(128 + result.slots.size() * (rows.rowEstimate() + 6));
+    JsonWriter json(out);
+    json.beginObject();
+    json.key("version");
+    json.value(table.version);
+    json.key("matchCount");
+    json.value(result.match_count);
+    json.key("rowCount");
+    json.value(result.row_count);
+    json.key("rows");
+    json.beginArray();
+    for (std::uint32_t slot : result.slots) {
+        rows.write(json, slot);
+    }
+    json.endArray();
+    json.key("matched");
+    json.beginArray();
+    for (bool matched : result.matched) {
+        json.value(matched);
+    }
+    json.endArray();
+    json.endObject();
+    return out;
+}
+
+std::string buildWindowJson(const Table& table, const TreeWindow& window, std::span<const std::size_t> columns) {
+    const RowJsonWriter rows(table, columns);
+    std::string out;
+    out.reserve(128 + window.slots.size() * (rows.rowEstimate() + 12));
+    JsonWriter json(out);
+    json.beginObject();
+    json.key("version");
+    json.value(table.version);
+    json.key("visibleCount");
+    json.value(window.visible_count);
+    json.key("rows");
+    json.beginArray();
+    for (std::uint32_t slot : window.slots) {
+        rows.write(json, slot);
+    }
+    json.endArray();
+    json.key("depths");
+    json.beginArray();
+    for (std::uint32_t depth : window.depths) {
+        json.value(std::uint64_t{depth});
+    }
+    json.endArray();
+    json.key("childCounts");
+    json.beginArray();
+    for (std::uint32_t slot : window.slots) {
+        json.value(std::uint64_t{table.children(slot).size()});
+    }
+    json.endArray();
+    json.endObject();
+    return out;
+}
+
+std::string buildSearchJson(const Table& table, const SearchResult& result) {
+    static constexpr std::string_view kMatchNames[] = {"exact", "prefix", "word_start", "substring"};
+    std::string out;
+    out.reserve(128 + result.hits.size() * 128);
+    JsonWriter json(out);
+    json.beginObject();
+    json.key("version");
+    json.value(table.version);
+    json.key("matchCount");
+    json.value(std::uint64_t{result.match_count});
+    json.key("hits");
+    json.beginArray();
+    for (const SearchHit& hit : result.hits) {
+        json.beginObject();
+        json.key("rowId");
+        json.value(table.rowId(hit.slot));
+        json.key("columnId");
+        json.value(table.schema[hit.ordinal].id);
+        json.key("value");
+        json.value(table.columns[hit.ordinal].segment(hit.slot / kSegmentRows).string(hit.slot % kSegmentRows));
+        json.key("match");
+        json.value(kMatchNames[static_cast<std::size_t>(hit.match)]);
+        json.key("ancestors");
+        json.beginArray();
+        for (std::uint32_t ancestor : ancestorSlots(table, hit.slot)) {
+            json.value(table.rowId(ancestor));
+        }
+        json.endArray();
+        json.endObject();
+    }
+    json.endArray();
+    json.endObject();
+    return out;
+}
+
+crow::json::wvalue buildRollupsJson(const Table& table, const RollupTargets& targets) {
+    crow::json::wvalue payload;
+    payload["version"] = table.version;
+
+    auto& rows = payload["rows"];
+    rows = crow::json::wvalue::object();
+    for (std::size_t slot : targets.rows) {
+        auto& row = rows[std::string(table.rowId(slot))];
+        for (std::size_t ordinal : targets.columns) {
+            const Aggregate& total = table.rollup(slot, ordinal);
+            auto& column = row[table.schema[ordinal].id];
+            column["sum"] = total.sum;
+            column["count"] = total.count;
+            if (total.empty()) {
+                column["min"] = nullptr;
+                column["max"] = nullptr;
+            } else {
+                column["min"] = total.min;
+                column["max"] = total.max;
+            }
+        }
+    }
+    return payload;
+}
+
+crow::json::wvalue buildChangesJson(const Subscription::Batch& batch) {
+    crow::json::wvalue payload;
+    payload["version"] = batch.version;
+    payload["resyncRequired"] = batch.resync_required;
+
+    auto& deltas = payload["deltas"];
+    deltas = crow::json::wvalue::list();
+    for (std::size_t i = 0; i < batch.deltas.size(); ++i) {
+        const auto& delta = batch.deltas[i];
+        deltas[i]["rowId"] = delta.row_id;
+        deltas[i]["columnId"] = delta.column_id;
+        deltas[i]["value"] = std::visit(JsonCellVisitor{}, delta.value);
+        deltas[i]["version"] = delta.version;
+    }
+    return payload;
+}
+
+bool parseQueryJson(const crow::json::rvalue& body, const Table& table, QuerySpec& spec,
+                    std::vector<std::size_t>& projection, std::string& error) {
+    using crow::json::type;
+
+    auto resolve = [&](const crow::json::rvalue& node, std::size_t& ordinal) {
+        if (node.t() != type::String) {
+            error = "column_id must be a string";
+            return false;
+        }
+        auto found = table.findColumnOrdinal(node.s());
+        if (!found) {
+            error = "column not found: " + std::string(node.s());
+            return false;
+        }
+        ordinal = *found;
+        return true;
+    };
+    auto count = [&](const char* name, std::size_t& out) {
+        if (!body.has(name)) return true;
+        const auto& node = body[name];
+        if (node.t() != type::Number || node.d() < 0 || node.d() != std::floor(node.d())) {
+            error = std::string(name) + " must be a non-negative integer";
+            return false;
+        }
+        out = static_cast<std::size_t>(node.u());
+        return true;
+    };
+    auto list = [&](const char* name) {
+        if (body.has(name) && body[name].t() != type::List) {
+            error = std::string(name) + " must be an array";
+            return false;
+        }
+        return true;
+    };
+
+    if (body.t() != type::Object) {
+        error = "query must be an object";
+        return false;
+    }
+    if (!list("predicates") || !list("sort") || !list("column_ids")) return false;
+    if (!count("offset", spec.offset) || !count("limit", spec.limit)) return false;
+
+    if (body.has("predicates")) {
+        for (const auto& item : body["predicates"]) {
+            if (item.t() != type::Object || !item.has("column_id") || !item.has("op")) {
+                error = "predicates need column_id and op";
+                return false;
+            }
+            Predicate& predicate = spec.predicates.emplace_back();
+            if (!resolve(item["column_id"], predicate.ordinal)) return false;
+            if (item["op"].t() != type::String || !parsePredicateOp(std::string(item["op"].s()), predicate.op)) {
+                error = "unknown predicate op";
+                return false;
+            }
+            if (predicate.op == PredicateOp::IsNull || predicate.op == PredicateOp::NotNull) continue;
+            if (!item.has("value")) {
+                error = "predicate value is required";
+                return false;
+            }
+            auto operand = parseJsonValueForColumn(item["value"], table.schema[predicate.ordinal], error);
+            if (!operand) return false;
+            predicate.operand = std::move(*operand);
+        }
+    }
+    if (body.has("sort")) {
+        for (const auto& item : body["sort"]) {
+            if (item.t() != type::Object || !item.has("column_id")) {
+                error = "sort keys need column_id";
+                return false;
+            }
+            SortKey& key = spec.sort.emplace_back();
+            if (!resolve(item["column_id"], key.ordinal)) return false;
+            key.descending = item.has("descending") && item["descending"].t() == type::True;
+        }
+    }
+    if (body.has("column_ids")) {
+        for (const auto& item : body["column_ids"]) {
+            if (!resolve(item, projection.emplace_back())) return false;
+        }
+    }
+    return true;
+}
+
+bool parseWindowJson(const crow::json::rvalue& body, const Table& table, std::vector<std::uint32_t>& expanded,
+                     std::size_t& offset, std::size_t& limit, std::vector<std::size_t>& projection, std::string& error) {
+    using crow::json::type;
+
+    auto count = [&](const char* name, std::size_t& out) {
+        if (!body.has(name)) return true;
+        const auto& node = body[name];
+        if (node.t() != type::Number || node.d() < 0 || node.d() != std::floor(node.d())) {
+            error = std::string(name) + " must be a non-negative integer";
+            return false;
+        }
+        out = static_cast<std::size_t>(node.u());
+        return true;
+    };
+    auto strings = [&](const char* name, auto&& each) {
+        if (!body.has(name)) return true;
+        if (body[name].t() != type::List) {
+            error = std::string(name) + " must be an array";
+            return false;
+        }
+        for (const auto& item : body[name]) {
+            if (item.t() != type::String) {
+                error = std::string(name) + " must hold strings";
+                return false;
+            }
+            if (!each(std::string(item.s()))) return false;
+        }
+        return true;
+    };
+
+    if (body.t() != type::Object) {
+        error = "window must be an object";
+        return false;
+    }
+    if (!count("offset", offset) || !count("limit", limit)) return false;
+    return strings("expanded", [&](const std::string& row_id) {
+               if (auto slot = table.findRow(row_id)) expanded.push_back(static_cast<std::uint32_t>(*slot));
+               return true;
+           }) &&
+           strings("column_ids", [&](const std::string& column_id) {
+               auto ordinal = table.findColumnOrdinal(column_id);
+               if (!ordinal) {
+                   error = "column not found: " + column_id;
+                   return false;
+               }
+               projection.push_back(*ordinal);
+               return true;
+           });
+}
+
+bool parseSearchJson(const crow::json::rvalue& body, const Table& table, SearchSpec& spec, std::string& error) {
+    using crow::json::type;
+
+    if (body.t() != type::Object) {
+        error = "search must be an object";
+        return false;
+    }
+    if (!body.has("text") || body["text"].t() != type::String) {
+        error = "text must be a string";
+        return false;
+    }
+    spec.text = body["text"].s();
+    if (body.has("prefix")) {
+        if (body["prefix"].t() != type::True && body["prefix"].t() != type::False) {
+            error = "prefix must be a boolean";
+            return false;
+        }
+        spec.prefix = body["prefix"].b();
+    }
+    if (body.has("limit")) {
+        const auto& node = body["limit"];
+        if (node.t() != type::Number || node.d() < 0 || node.d() != std::floor(node.d())) {
+            error = "limit must be a non-negative integer";
+            return false;
+        }
+        spec.limit = static_cast<std::size_t>(node.u());
+    }
+    if (body.has("column_ids")) {
+        if (body["column_ids"].t() != type::List) {
+            error = "column_ids must be an array";
+            return false;
+        }
+        for (const auto& item : body["column_ids"]) {
+            if (item.t() != type::String) {
+                error = "column_ids must hold strings";
+                return false;
+            }
+            auto ordinal = table.findColumnOrdinal(item.s());
+            if (!ordinal) {
+                error = "column not found: " + std::string(item.s());
+                return false;
+            }
+            spec.ordinals.push_back(*ordinal);
+        }
+    }
+    return true;
+}
+
+bool parseSchemaJson(const crow::json::rvalue& body, Table& table, std::string& error) {
+    using crow::json::type;
+
+    auto text = [&](const crow::json::rvalue& object, const char* key, std::string& out) {
+        if (!object.has(key)) return true;
+        if (object[key].t() != type::String) return false;
+        out = object[key].s();
+        return true;
+    };
+    auto flag = [&](const crow::json::rvalue& object, const char* key, bool& out) {
+        if (!object.has(key)) return true;
+        if (object[key].t() != type::True && object[key].t() != type::False) return false;
+        out = object[key].b();
+        return true;
+    };
+
+    if (body.t() != type::Object || !text(body, "tableId", table.id) || !text(body, "name", table.name) ||
+        !text(body, "primaryKey", table.primary_key) || !text(body, "parentKey", table.parent_key)) {
+        error = "Schema must be an object with string tableId, name, primaryKey and parentKey";
+        return false;
+    }
+    if (table.id.empty() || table.primary_key.empty()) {
+        error = "Schema needs tableId and primaryKey";
+        return false;
+    }
+    if (!body.has("columns") || body["columns"].t() != type::List) {
+        error = "Schema needs a columns list";
+        return false;
+    }
+
+    std::vector<ColumnDef> columns;
+    for (const auto& item : body["columns"]) {
+        ColumnDef column{"", "", ColumnType::String, 120, false, false, true, false};
+        std::string type_name = "string";
+        if (item.t() != type::Object || !text(item, "id", column.id) || column.id.empty() ||
+            !text(item, "title", column.title) || !text(item, "type", type_name) ||
+            !flag(item, "isTreeColumn", column.is_tree) || !flag(item, "isPinned", column.is_pinned) ||
+            !flag(item, "isEditable", column.is_editable) || !flag(item, "isPrimary", column.is_primary)) {
+            error = "Malformed column definition";
+            return false;
+        }
+        auto type = columnTypeFromString(type_name);
+        if (!type) {
+            error = "Unknown column type " + type_name;
+            return false;
+        }
+        column.type = *type;
+        if (item.has("width")) {
+            if (item["width"].t() != type::Number) {
+                error = "Malformed column definition";
+                return false;
+            }
+            column.width = static_cast<int>(item["width"].i());
+        }
+        if (column.title.empty()) column.title = column.id;
+        columns.push_back(std::move(column));
+    }
+    if (table.name.empty()) table.name = table.id;
+    table.setSchema(std::move(columns));
+    return true;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "change_feed.h"
+#include "crow.h"
+#include "data_store.h"
+#include "query.h"
+#include "service_common.h"
+#include "text_search.h"
+#include "tree_window.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Request and response bodies of the REST routes. The bulk payloads (/tables,
+// /schema, /data, /query, /window, /search) are written straight into a string with
+// JsonWriter; the small ones go through crow's JSON tree.
+
+std::optional<CellValue> parseJsonValueForColumn(const crow::json::rvalue& node,
+                                                 const ColumnDef& column,
+                                                 std::string& error_message);
+
+std::string buildTablesJson(const std::vector<std::pair<std::string, std::string>>& list);
+std::string buildSchemaJson(const Table& table);
+
+// Rows [begin, end) in slot order, clamped to the table.
+std::string buildRowsJson(const Table& table, std::size_t begin = 0, std::size_t end = SIZE_MAX);
+// The same for a procedural table, materialized ProceduralTable::kChunkRows
+// rows at a time.
+std::string buildProceduralRowsJson(const Table& table, std::size_t begin = 0, std::size_t end = SIZE_MAX);
+
+std::string buildQueryJson(const Table& table, const QueryResult& result, std::span<const std::size_t> columns);
+// depths and childCounts are parallel to rows.
+std::string buildWindowJson(const Table& table, const TreeWindow& window, std::span<const std::size_t> columns);
+// Each hit: {"rowId", "columnId", "value", "match":"exact|prefix|word_start|substring",
+// "ancestors":[row ids, root first]}.
+std::string buildSearchJson(const Table& table, const SearchResult& result);
+crow::json::wvalue buildRollupsJson(const Table& table, const RollupTargets& targets);
+crow::json::wvalue buildChangesJson(const Subscription::Batch& batch);
+
+// Reads a /query body:
+//   {"predicates":[{"column_id":..,"op":"eq|ne|lt|le|gt|ge|prefix|is_null|not_null","value":..}],
+//    "sort":[{"column_id":..,"descending":false}], "column_ids":[..], "offset":0, "limit":0}
+// Every member is optional.
+bool parseQueryJson(const crow::json::rvalue& body, const Table& table, QuerySpec& spec,
+                    std::vector<std::size_t>& projection, std::string& error);
+
+// Reads a /window body: {"expanded":[row ids..], "offset":0, "limit":0, "column_ids":[..]}.
+// Every member is optional; unknown expanded row ids are skipped.
+bool parseWindowJson(const crow::json::rvalue& body, const Table& table, std::vector<std::uint32_t>& expanded,
+                     std::size_t& offset, std::size_t& limit, std::vector<std::size_t>& projection, std::string& error);
+
+// Reads a /search body: {"text":.., "column_ids":[..], "prefix":false, "limit":0}.
+// Only text is required.
+bool parseSearchJson(const crow::json::rvalue& body, const Table& table, SearchSpec& spec, std::string& error);
+
+// Reads a schema in the form GET /api/table/<id>/schema returns into an
+// empty table. Only tableId, primaryKey and the column ids are required.
+bool parseSchemaJson(const crow::json::rvalue& body, Table& table, std::string& error);
@@ -0,0 +1,24 @@
+#include "rollup.h"
+
+Aggregate& RollupColumn::mutableAt(std::size_t slot) {
+    auto& chunk = chunks_[slot / kChunkRows];
+    // Same ownership argument as Column::mutableSegment.
+    if (chunk.use_count() != 1) chunk = std::make_shared<Chunk>(*chunk);
+    return (*chunk)[slot % kChunkRows];
+}
+
+void RollupColumn::append() {
+    // Entries past size_ are never written, so they already hold an empty
+    // aggregate; only a new chunk is needed.
+    if (size_ % kChunkRows == 0) chunks_.push_back(std::make_shared<Chunk>());
+    ++size_;
+}
+
+void RollupColumn::append(const Aggregate& value) {
+    append();
+    (*chunks_.back())[(size_ - 1) % kChunkRows] = value;
+}
+
+std::size_t RollupColumn::memoryUsage() const {
+    return sizeof(*this) + chunks_.capacity() * sizeof(std::shared_ptr<Chunk>) + chunks_.size() * sizeof(Chunk);
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <vector>
+
+// sum/count/min/max over the non-null values of a Number/Currency column in
+// one row's subtree (the row itself included).
+struct Aggregate {
+    double sum = 0.0;
+    double min = std::numeric_limits<double>::infinity();
+    double max = -std::numeric_limits<double>::infinity();
+    std::uint64_t count = 0;
+
+    bool empty() const { return count == 0; }
+
+    void add(double value) {
+        sum += value;
+        if (value < min) min = value;
+        if (value > max) max = value;
+        ++count;
+    }
+
+    void merge(const Aggregate& other) {
+        sum += other.sum;
+        if (other.min < min) min = other.min;
+        if (other.max > max) max = other.max;
+        count += other.count;
+    }
+};
+
+// One Aggregate per row slot, stored in copy-on-write chunks so that a new
+// table version only copies the chunks holding the ancestors it touched.
+class RollupColumn {
+public:
+    static constexpr std::size_t kChunkRows = 1024;
+
+    std::size_t size() const { return size_; }
+
+    const Aggregate& at(std::size_t slot) const { return (*chunks_[slot / kChunkRows])[slot % kChunkRows]; }
+    Aggregate& mutableAt(std::size_t slot);
+
+    // Adds an empty aggregate for a newly appended row.
+    void append();
+    // Adds a precomputed aggregate, e.g. when restoring a saved table.
+    void append(const Aggregate& value);
+
+    std::size_t memoryUsage() const;
+
+private:
+    using Chunk = std::array<Aggregate, kChunkRows>;
+
+    std::size_t size_ = 0;
+    std::vector<std::shared_ptr<Chunk>> chunks_;
+};
@@ -0,0 +1,80 @@
+#pragma once
+
+// Request handling shared by the gRPC service and the REST routes.
+
+#include "data_store.h"
+
+#include <charconv>
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+// Default and maximum rows per batch for streamed and cursor-paged reads.
+constexpr std::size_t kDefaultBatchRows = 1000;
+constexpr std::size_t kMaxBatchRows = 100000;
+
+// A procedural table keeps no rows, so reads that walk them (columnar data,
+// roll-ups, queries, windows, search) refuse it rather than answer as if it
+// were empty. Whole-table reads materialize it, up to this many rows; larger
+// ones must be paged or streamed.
+constexpr std::string_view kProceduralUnsupported = "not supported for procedural tables";
+constexpr std::size_t kMaxProceduralResponseRows = 1000000;
+
+// Stream cursors are the decimal row slot to continue from. Row slots are
+// append-only, so a cursor stays meaningful across table versions.
+inline std::optional<std::size_t> parseCursor(std::string_view cursor) {
+    if (cursor.empty()) return 0;
+    std::size_t slot = 0;
+    auto [end, ec] = std::from_chars(cursor.data(), cursor.data() + cursor.size(), slot);
+    if (ec != std::errc{} || end != cursor.data() + cursor.size()) return std::nullopt;
+    return slot;
+}
+
+// Rows and columns addressed by a roll-up request. Empty id lists select the
+// root rows and every column that has roll-ups.
+struct RollupTargets {
+    std::vector<std::size_t> rows;
+    std::vector<std::size_t> columns;
+    std::string error;
+    bool not_found = false;
+};
+
+template <typename RowIds, typename ColumnIds>
+RollupTargets resolveRollupTargets(const Table& table, const RowIds& row_ids, const ColumnIds& column_ids) {
+    RollupTargets targets;
+    if (row_ids.empty()) {
+        targets.rows.assign(table.index->roots.begin(), table.index->roots.end());
+    }
+    for (const auto& row_id : row_ids) {
+        auto slot = table.findRow(row_id);
+        if (!slot) {
+            targets.error = "row not found";
+            targets.not_found = true;
+            return targets;
+        }
+        targets.rows.push_back(*slot);
+    }
+
+    if (column_ids.empty()) {
+        for (std::size_t c = 0; c < table.schema.size(); ++c) {
+            if (table.hasRollup(c)) targets.columns.push_back(c);
+        }
+    }
+    for (const auto& column_id : column_ids) {
+        auto ordinal = table.findColumnOrdinal(column_id);
+        if (!ordinal) {
+            targets.error = "column not found";
+            targets.not_found = true;
+            return targets;
+        }
+        if (!table.hasRollup(*ordinal)) {
+            targets.error = "column has no roll-ups";
+            return targets;
+        }
+        targets.columns.push_back(*ordinal);
+    }
+    return targets;
+}
@@ -0,0 +1,340 @@
+#include "snapshot.h"
+
+#include "binary_io.h"
+
+#include <algorithm>
+#include <bit>
+#include <cerrno>
+#include <cstring>
+#include <functional>
+#include <span>
+#include <string_view>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Layout, every integer in native byte order:
+//
+//   header   "TBLSNAP\0", u32 format, u32 table count, u64 log segment,
+//            u64 hash fingerprint
+//   table    strings id, name, primary_key, parent_key; u64 version;
+//            u32 column count, then per column: strings id, title;
+//            u8 type; i32 width; u8 flags (tree, pinned, editable, primary)
+//            u64 row count
+//            columns row_ids, parent_ids, then one per schema entry
+//            arrays id slots, parent slots, child offsets (rows + 1), child
+//            slots, roots
+//            u32 orphan count, then per orphan list: string parent id, array slots
+//            per Number/Currency column: array of Aggregate
+//   column   u32 segment count, then per segment: u64 size; arrays nulls,
+//            int tags, bools, numbers, codes, dictionary offsets, dictionary bytes
+//
+// An array is a u64 element count, zero padding up to the element alignment
+// (relative to the start of the file) and the elements.
+
+namespace {
+
+constexpr char kMagic[8] = {'T', 'B', 'L', 'S', 'N', 'A', 'P', '\0'};
+constexpr std::uint32_t kFormat = 1;
+constexpr std::size_t kFlushBytes = 1u << 20;
+
+// The row id hash set is saved as is. It is only reused when the loading
+// build hashes strings the same way; otherwise it is rebuilt.
+std::uint64_t hashFingerprint() {
+    return std::hash<std::string_view>{}("snapshot row id hash");
+}
+
+std::string systemError(std::string_view what, const std::string& path) {
+    return std::string(what) + " " + path + ": " + std::strerror(errno);
+}
+
+// Buffers encoded bytes and writes them out in large chunks, tracking the
+// file offset for array alignment.
+class SnapshotWriter {
+public:
+    explicit SnapshotWriter(int fd)
+        : fd_(fd) {}
+
+    std::string& buffer() { return buffer_; }
+
+    template <typename T>
+    void putArray(std::span<const T> values) {
+        putPod(buffer_, static_cast<std::uint64_t>(values.size()));
+        buffer_.append(BinaryReader::padding(written_ + buffer_.size(), alignof(T)), '\0');
+        buffer_.append(reinterpret_cast<const char*>(values.data()), values.size_bytes());
+        if (buffer_.size() >= kFlushBytes) flush();
+    }
+
+    void putColumn(const Column& column) {
+        putPod(buffer_, static_cast<std::uint32_t>(column.segmentCount()));
+        for (std::size_t s = 0; s < column.segmentCount(); ++s) {
+            const ColumnSegment::Storage storage = column.segment(s).storage();
+            putPod(buffer_, static_cast<std::uint64_t>(storage.size));
+            putArray(storage.nulls);
+            putArray(storage.int_tags);
+            putArray(storage.bools);
+            putArray(storage.numbers);
+            putArray(storage.codes);
+            putArray(storage.dictionary_offsets);
+            putArray(std::span<const char>(storage.dictionary_bytes));
+        }
+    }
+
+    bool flush() {
+        ok_ = ok_ && writeFully(fd_, buffer_);
+        written_ += buffer_.size();
+        buffer_.clear();
+        return ok_;
+    }
+
+private:
+    int fd_;
+    std::string buffer_;
+    std::uint64_t written_ = 0;
+    bool ok_ = true;
+};
+
+void putTable(SnapshotWriter& out, const Table& table) {
+    std::string& buffer = out.buffer();
+    putString(buffer, table.id);
+    putString(buffer, table.name);
+    putString(buffer, table.primary_key);
+    putString(buffer, table.parent_key);
+    putPod(buffer, table.version);
+    putPod(buffer, static_cast<std::uint32_t>(table.schema.size()));
+    for (const ColumnDef& def : table.schema) {
+        putColumnDef(buffer, def);
+    }
+
+    const std::size_t rows = table.rowCount();
+    putPod(buffer, static_cast<std::uint64_t>(rows));
+    out.putColumn(table.row_ids);
+    out.putColumn(table.parent_ids);
+    for (const Column& column : table.columns) {
+        out.putColumn(column);
+    }
+
+    const RowIndex& index = *table.index;
+    std::vector<std::uint32_t> child_offsets;
+    std::vector<std::uint32_t> child_slots;
+    child_offsets.reserve(rows + 1);
+    child_offsets.push_back(0);
+    for (std::size_t slot = 0; slot < rows; ++slot) {
+        child_slots.insert(child_slots.end(), index.children[slot].begin(), index.children[slot].end());
+        child_offsets.push_back(static_cast<std::uint32_t>(child_slots.size()));
+    }
+    out.putArray(std::span<const std::uint32_t>(index.id_slots));
+    out.putArray(std::span<const std::uint32_t>(index.parent_slots));
+    out.putArray(std::span<const std::uint32_t>(child_offsets));
+    out.putArray(std::span<const std::uint32_t>(child_slots));
+    out.putArray(std::span<const std::uint32_t>(index.roots));
+    putPod(buffer, static_cast<std::uint32_t>(index.orphans.size()));
+    for (const auto& [parent_id, slots] : index.orphans) {
+        putString(buffer, parent_id);
+        out.putArray(std::span<const std::uint32_t>(slots));
+    }
+
+    std::vector<Aggregate> aggregates;
+    for (std::size_t ordinal = 0; ordinal < table.schema.size(); ++ordinal) {
+        if (!table.hasRollup(ordinal)) continue;
+        aggregates.clear();
+        aggregates.reserve(rows);
+        for (std::size_t slot = 0; slot < rows; ++slot) {
+            aggregates.push_back(table.rollup(slot, ordinal));
+        }
+        out.putArray(std::span<const Aggregate>(aggregates));
+    }
+}
+
+bool readColumn(BinaryReader& in, ColumnType type, std::size_t rows, Column& column) {
+    std::uint32_t segments = 0;
+    if (!in.read(segments) || segments != (rows + kSegmentRows - 1) / kSegmentRows) return false;
+    for (std::uint32_t s = 0; s < segments; ++s) {
+        ColumnSegment::Storage storage;
+        std::uint64_t size = 0;
+        std::span<const char> dictionary_bytes;
+        if (!in.read(size) || !in.readArray(storage.nulls) || !in.readArray(storage.int_tags) ||
+            !in.readArray(storage.bools) || !in.readArray(storage.numbers) || !in.readArray(storage.codes) ||
+            !in.readArray(storage.dictionary_offsets) || !in.readArray(dictionary_bytes)) {
+            return false;
+        }
+        // Every segment but the last is full.
+        const std::size_t expected = s + 1 < segments ? kSegmentRows : rows - s * kSegmentRows;
+        if (size != expected) return false;
+        storage.size = expected;
+        storage.dictionary_bytes = std::string_view(dictionary_bytes.data(), dictionary_bytes.size());
+
+        auto segment = ColumnSegment::restore(type, storage);
+        if (!segment) return false;
+        column.appendSegment(std::move(*segment));
+    }
+    return true;
+}
+
+bool slotsInRange(std::span<const std::uint32_t> slots, std::size_t rows, bool allow_none) {
+    return std::all_of(slots.begin(), slots.end(), [&](std::uint32_t slot) {
+        return slot < rows || (allow_none && slot == kNoSlot);
+    });
+}
+
+bool readTable(BinaryReader& in, bool same_hash, Table& table) {
+    std::uint32_t column_count = 0;
+    if (!in.readString(table.id) || !in.readString(table.name) || !in.readString(table.primary_key) ||
+        !in.readString(table.parent_key) || !in.read(table.version) || !in.read(column_count)) {
+        return false;
+    }
+
+    std::vector<ColumnDef> defs(column_count);
+    for (ColumnDef& def : defs) {
+        if (!in.readColumnDef(def)) return false;
+    }
+    table.setSchema(std::move(defs));
+
+    std::uint64_t rows = 0;
+    if (!in.read(rows) || rows >= kNoSlot) return false;
+    if (!readColumn(in, ColumnType::String, rows, table.row_ids) ||
+        !readColumn(in, ColumnType::String, rows, table.parent_ids)) {
+        return false;
+    }
+    for (std::size_t ordinal = 0; ordinal < table.schema.size(); ++ordinal) {
+        if (!readColumn(in, table.schema[ordinal].type, rows, table.columns[ordinal])) return false;
+    }
+
+    auto index = std::make_shared<RowIndex>();
+    std::span<const std::uint32_t> id_slots;
+    std::span<const std::uint32_t> parent_slots;
+    std::span<const std::uint32_t> child_offsets;
+    std::span<const std::uint32_t> child_slots;
+    std::span<const std::uint32_t> roots;
+    std::uint32_t orphan_lists = 0;
+    if (!in.readArray(id_slots) || !in.readArray(parent_slots) || !in.readArray(child_offsets) || !in.readArray(child_slots) ||
+        !in.readArray(roots) || !in.read(orphan_lists)) {
+        return false;
+    }
+    if (parent_slots.size() != rows || child_offsets.size() != rows + 1 || child_offsets.front() != 0 ||
+        child_offsets.back() != child_slots.size() || !std::is_sorted(child_offsets.begin(), child_offsets.end()) ||
+        !slotsInRange(parent_slots, rows, true) || !slotsInRange(child_slots, rows, false) ||
+        !slotsInRange(roots, rows, false)) {
+        return false;
+    }
+    // Lookups rely on a power-of-two size and at least one free slot.
+    const bool id_slots_usable = same_hash && std::has_single_bit(id_slots.size()) && id_slots.size() > rows &&
+                                 slotsInRange(id_slots, rows, true);
+    if (id_slots_usable) index->id_slots.assign(id_slots.begin(), id_slots.end());
+    index->parent_slots.assign(parent_slots.begin(), parent_slots.end());
+    index->roots.assign(roots.begin(), roots.end());
+    index->children.resize(rows);
+    for (std::size_t slot = 0; slot < rows; ++slot) {
+        index->children[slot].assign(child_slots.begin() + child_offsets[slot],
+                                     child_slots.begin() + child_offsets[slot + 1]);
+    }
+    for (std::uint32_t i = 0; i < orphan_lists; ++i) {
+        std::string parent_id;
+        std::span<const std::uint32_t> slots;
+        if (!in.readString(parent_id) || !in.readArray(slots) || !slotsInRange(slots, rows, false)) return false;
+        index->orphans.emplace(std::move(parent_id), std::vector<std::uint32_t>(slots.begin(), slots.end()));
+    }
+    table.index = std::move(index);
+    if (!id_slots_usable) table.reindexRowIds();
+
+    for (std::size_t ordinal = 0; ordinal < table.schema.size(); ++ordinal) {
+        if (!table.hasRollup(ordinal)) continue;
+        std::span<const Aggregate> aggregates;
+        if (!in.readArray(aggregates) || aggregates.size() != rows) return false;
+        for (const Aggregate& aggregate : aggregates) {
+            table.rollups[ordinal].append(aggregate);
+        }
+    }
+    return true;
+}
+
+}  // namespace
+
+bool writeSnapshot(const std::string& path,
+                   const std::vector<std::shared_ptr<const Table>>& tables,
+                   std::uint64_t log_segment,
+                   std::string& error) {
+    const std::string temporary = path + ".tmp";
+    const int fd = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        error = systemError("Cannot create", temporary);
+        return false;
+    }
+
+    SnapshotWriter out(fd);
+    out.buffer().append(kMagic, sizeof(kMagic));
+    putPod(out.buffer(), kFormat);
+    putPod(out.buffer(), static_cast<std::uint32_t>(tables.size()));
+    putPod(out.buffer(), log_segment);
+    putPod(out.buffer(), hashFingerprint());
+    for (const auto& table : tables) {
+        putTable(out, *table);
+    }
+
+    const bool written = out.flush() && ::fsync(fd) == 0;
+    if (!written) error = systemError("Cannot write", temporary);
+    ::close(fd);
+    if (!written) {
+        ::unlink(temporary.c_str());
+        return false;
+    }
+    if (::rename(temporary.c_str(), path.c_str()) != 0) {
+        error = systemError("Cannot replace", path);
+        ::unlink(temporary.c_str());
+        return false;
+    }
+
+    // Make the rename itself durable.
+    const std::string directory = path.substr(0, path.find_last_of('/') + 1);
+    const int dir = ::open(directory.empty() ? "." : directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir >= 0) {
+        ::fsync(dir);
+        ::close(dir);
+    }
+    return true;
+}
+
+std::optional<Snapshot> loadSnapshot(const std::string& path, std::string& error) {
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        if (errno != ENOENT) error = systemError("Cannot open", path);
+        return std::nullopt;
+    }
+    struct stat info{};
+    if (::fstat(fd, &info) != 0 || info.st_size == 0) {
+        error = "Cannot read " + path;
+        ::close(fd);
+        return std::nullopt;
+    }
+
+    const auto size = static_cast<std::size_t>(info.st_size);
+    void* mapped = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapped == MAP_FAILED) {
+        error = systemError("Cannot map", path);
+        return std::nullopt;
+    }
+    ::madvise(mapped, size, MADV_WILLNEED);
+
+    // The mapping is page-aligned, so file offsets are memory alignments.
+    BinaryReader in(std::string_view(static_cast<const char*>(mapped), size));
+    Snapshot snapshot;
+    char magic[sizeof(kMagic)];
+    std::uint32_t format = 0;
+    std::uint32_t table_count = 0;
+    std::uint64_t fingerprint = 0;
+    bool ok = in.read(magic) && std::memcmp(magic, kMagic, sizeof(kMagic)) == 0 && in.read(format) &&
+              format == kFormat && in.read(table_count) && in.read(snapshot.log_segment) && in.read(fingerprint);
+    for (std::uint32_t i = 0; ok && i < table_count; ++i) {
+        ok = readTable(in, fingerprint == hashFingerprint(), snapshot.tables.emplace_back());
+    }
+    ::munmap(mapped, size);
+
+    if (!ok || in.remaining() != 0) {
+        error = "Corrupt snapshot " + path;
+        return std::nullopt;
+    }
+    return snapshot;
+}
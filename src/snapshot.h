@@ -0,0 +1,28 @@
+#pragma once
+
+#include "data_store.h"
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+// Binary image of every table, so that a restart does not replay the whole
+// write-ahead log. Column segments, the row index and the roll-ups are stored
+// as the raw arrays they live in, 8-byte aligned, and loading maps the file
+// and bulk-copies each array: no row is parsed or appended one at a time.
+struct Snapshot {
+    std::uint64_t log_segment = 0;  // first write-ahead log segment the snapshot does not cover
+    std::vector<Table> tables;
+};
+
+// Writes a temporary file next to path, syncs it and renames it over path,
+// so a crash leaves either the old or the new snapshot in place.
+bool writeSnapshot(const std::string& path,
+                   const std::vector<std::shared_ptr<const Table>>& tables,
+                   std::uint64_t log_segment,
+                   std::string& error);
+
+// Returns nullopt with an empty error when there is no snapshot at path.
+std::optional<Snapshot> loadSnapshot(const std::string& path, std::string& error);
@@ -0,0 +1,347 @@
+#include "table_export.h"
+
+#include "table_export_format.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstddef>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <span>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr std::size_t kKeptVersions = 2;
+
+std::string systemError(std::string_view what, const std::string& path) {
+    return std::string(what) + " " + path + ": " + std::strerror(errno);
+}
+
+std::uint64_t bitmapBytes(std::size_t rows) {
+    return (rows + 63) / 64 * sizeof(std::uint64_t);
+}
+
+// Hands out 8-byte aligned byte ranges of the file being laid out, and
+// remembers the strings to copy into them.
+class FileLayout {
+public:
+    std::uint64_t reserve(std::uint64_t bytes) {
+        const std::uint64_t offset = size_;
+        size_ += (bytes + 7) & ~std::uint64_t{7};
+        return offset;
+    }
+
+    ExportString string(std::string_view text) {
+        strings_.emplace_back(reserve(text.size()), text);
+        return {strings_.back().first, text.size()};
+    }
+
+    std::uint64_t size() const { return size_; }
+
+    void copyStrings(char* base) const {
+        for (const auto& [offset, text] : strings_) {
+            std::memcpy(base + offset, text.data(), text.size());
+        }
+    }
+
+private:
+    std::uint64_t size_ = 0;
+    std::vector<std::pair<std::uint64_t, std::string_view>> strings_;
+};
+
+ExportColumn planColumn(FileLayout& layout, const Column& column, std::size_t rows) {
+    ExportColumn entry{};
+    entry.type = static_cast<ExportType>(column.type());
+    entry.nulls = layout.reserve(bitmapBytes(rows));
+    switch (column.type()) {
+    case ColumnType::String: {
+        std::uint64_t bytes = 0;
+        for (std::size_t row = 0; row < rows; ++row) {
+            if (!column.isNull(row)) bytes += column.segment(row / kSegmentRows).string(row % kSegmentRows).size();
+        }
+        entry.values = layout.reserve((rows + 1) * sizeof(std::uint64_t));
+        entry.extra = layout.reserve(bytes);
+        break;
+    }
+    case ColumnType::Number:
+    case ColumnType::Currency:
+        entry.values = layout.reserve(rows * sizeof(double));
+        entry.extra = layout.reserve(bitmapBytes(rows));
+        break;
+    case ColumnType::Bool:
+        entry.values = layout.reserve(bitmapBytes(rows));
+        break;
+    }
+    return entry;
+}
+
+ExportColumn planColumn(FileLayout& layout, const Column& column, std::size_t rows, const ColumnDef& def) {
+    ExportColumn entry = planColumn(layout, column, rows);
+    entry.id = layout.string(def.id);
+    entry.title = layout.string(def.title);
+    entry.width = def.width;
+    entry.flags = static_cast<std::uint8_t>((def.is_tree ? kExportTree : 0) | (def.is_pinned ? kExportPinned : 0) |
+                                            (def.is_editable ? kExportEditable : 0) |
+                                            (def.is_primary ? kExportPrimary : 0));
+    return entry;
+}
+
+// Segments start on word boundaries (kSegmentRows is a multiple of 64), so
+// their bitmaps are copied word for word.
+void copyBitmap(std::span<const std::uint64_t> words, std::size_t segment, std::size_t rows, char* to) {
+    constexpr std::size_t kSegmentWords = kSegmentRows / 64;
+    const std::size_t first = segment * kSegmentWords;
+    const std::size_t count = std::min(words.size(), (rows + 63) / 64 - first);
+    std::memcpy(to + first * sizeof(std::uint64_t), words.data(), count * sizeof(std::uint64_t));
+}
+
+void fillColumn(const Column& column, const ExportColumn& entry, std::size_t rows, char* base) {
+    std::uint64_t string_bytes = 0;
+    auto* offsets = reinterpret_cast<std::uint64_t*>(base + entry.values);
+    for (std::size_t s = 0; s < column.segmentCount(); ++s) {
+        const ColumnSegment& segment = column.segment(s);
+        const ColumnSegment::Storage storage = segment.storage();
+        const std::size_t first = s * kSegmentRows;
+        copyBitmap(storage.nulls, s, rows, base + entry.nulls);
+        switch (column.type()) {
+        case ColumnType::String:
+            for (std::size_t i = 0; i < storage.size; ++i) {
+                offsets[first + i] = string_bytes;
+                if (segment.isNull(i)) continue;
+                const std::string_view text = segment.string(i);
+                std::memcpy(base + entry.extra + string_bytes, text.data(), text.size());
+                string_bytes += text.size();
+            }
+            break;
+        case ColumnType::Number:
+        case ColumnType::Currency:
+            std::memcpy(base + entry.values + first * sizeof(double), storage.numbers.data(),
+                        storage.size * sizeof(double));
+            copyBitmap(storage.int_tags, s, rows, base + entry.extra);
+            break;
+        case ColumnType::Bool:
+            copyBitmap(storage.bools, s, rows, base + entry.values);
+            break;
+        }
+    }
+    if (column.type() == ColumnType::String) offsets[rows] = string_bytes;
+}
+
+// Writes the table to a temporary file in place through a shared mapping,
+// then renames it to path.
+bool writeDataFile(const Table& table, const std::string& path, std::string& error) {
+    const std::size_t rows = table.rowCount();
+    FileLayout layout;
+    ExportHeader header{};
+    layout.reserve(sizeof(ExportHeader));
+    std::vector<ExportColumn> columns;
+    columns.reserve(table.schema.size() + 2);
+    layout.reserve((table.schema.size() + 2) * sizeof(ExportColumn));
+    header.id = layout.string(table.id);
+    header.name = layout.string(table.name);
+    header.primary_key = layout.string(table.primary_key);
+    header.parent_key = layout.string(table.parent_key);
+    columns.push_back(planColumn(layout, table.row_ids, rows));
+    columns.push_back(planColumn(layout, table.parent_ids, rows));
+    for (std::size_t ordinal = 0; ordinal < table.schema.size(); ++ordinal) {
+        columns.push_back(planColumn(layout, table.columns[ordinal], rows, table.schema[ordinal]));
+    }
+    std::memcpy(header.magic, kExportMagic, sizeof(kExportMagic));
+    header.layout = kExportLayout;
+    header.column_count = static_cast<std::uint32_t>(table.schema.size());
+    header.version = table.version;
+    header.row_count = rows;
+    header.file_size = layout.size();
+
+    const std::string temporary = path + ".tmp";
+    const int fd = ::open(temporary.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        error = systemError("Cannot create", temporary);
+        return false;
+    }
+    void* mapped = MAP_FAILED;
+    if (::ftruncate(fd, static_cast<off_t>(layout.size())) == 0) {
+        mapped = ::mmap(nullptr, layout.size(), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    if (mapped == MAP_FAILED) error = systemError("Cannot map", temporary);
+    ::close(fd);
+    if (mapped == MAP_FAILED) {
+        ::unlink(temporary.c_str());
+        return false;
+    }
+
+    // The file is zero-filled, which covers padding and unused bitmap bits.
+    char* base = static_cast<char*>(mapped);
+    std::memcpy(base, &header, sizeof(header));
+    std::memcpy(base + sizeof(header), columns.data(), columns.size() * sizeof(ExportColumn));
+    layout.copyStrings(base);
+    fillColumn(table.row_ids, columns[0], rows, base);
+    fillColumn(table.parent_ids, columns[1], rows, base);
+    for (std::size_t ordinal = 0; ordinal < table.columns.size(); ++ordinal) {
+        fillColumn(table.columns[ordinal], columns[ordinal + 2], rows, base);
+    }
+    ::munmap(mapped, layout.size());
+
+    if (::rename(temporary.c_str(), path.c_str()) != 0) {
+        error = systemError("Cannot replace", path);
+        ::unlink(temporary.c_str());
+        return false;
+    }
+    return true;
+}
+
+// Replaces the head of a table and maps its current field for writing.
+std::uint64_t* createHead(const std::string& path, std::uint64_t version, std::string& error) {
+    ExportHead head{};
+    std::memcpy(head.magic, kExportHeadMagic, sizeof(kExportHeadMagic));
+    head.layout = kExportLayout;
+    head.current = version;
+
+    const std::string temporary = path + ".tmp";
+    const int fd = ::open(temporary.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        error = systemError("Cannot create", temporary);
+        return nullptr;
+    }
+    void* mapped = MAP_FAILED;
+    if (::pwrite(fd, &head, sizeof(head), 0) == static_cast<ssize_t>(sizeof(head))) {
+        mapped = ::mmap(nullptr, sizeof(head), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    if (mapped == MAP_FAILED) error = systemError("Cannot write", temporary);
+    ::close(fd);
+    if (mapped != MAP_FAILED && ::rename(temporary.c_str(), path.c_str()) != 0) {
+        error = systemError("Cannot replace", path);
+        ::munmap(mapped, sizeof(head));
+        mapped = MAP_FAILED;
+    }
+    if (mapped == MAP_FAILED) {
+        ::unlink(temporary.c_str());
+        return nullptr;
+    }
+    return &static_cast<ExportHead*>(mapped)->current;
+}
+
+void closeHead(std::uint64_t* current) {
+    std::atomic_ref(*current).store(kExportClosed, std::memory_order_release);
+    ::munmap(reinterpret_cast<char*>(current) - offsetof(ExportHead, current), sizeof(ExportHead));
+}
+
+// Data files of the table left by an earlier server: "<stem>.<version>.tbl"
+// and their temporaries.
+void removeStaleFiles(const std::string& directory, std::string_view table_id) {
+    const std::string prefix = exportStem(table_id) + ".";
+    std::error_code ec;
+    for (const auto& entry : std::filesystem::directory_iterator(directory, ec)) {
+        const std::string name = entry.path().filename().string();
+        if (name.starts_with(prefix) && (name.ends_with(".tbl") || name.ends_with(".tbl.tmp"))) {
+            std::filesystem::remove(entry.path(), ec);
+        }
+    }
+}
+
+}  // namespace
+
+TableExporter::TableExporter(const DataStore& db, TableExportOptions options)
+    : db_(db),
+      options_(std::move(options)) {}
+
+TableExporter::~TableExporter() {
+    thread_.request_stop();
+    if (thread_.joinable()) thread_.join();
+    for (auto& [id, exported] : exported_) {
+        if (exported.current) closeHead(exported.current);
+    }
+}
+
+bool TableExporter::start(std::string& error) {
+    std::error_code ec;
+    std::filesystem::create_directories(options_.directory, ec);
+    if (ec) {
+        error = "Cannot create " + options_.directory + ": " + ec.message();
+        return false;
+    }
+    if (!exportChanged(error)) return false;
+    thread_ = std::jthread([this](std::stop_token stop) { run(stop); });
+    return true;
+}
+
+bool TableExporter::exportChanged(std::string& error) {
+    std::lock_guard lock(mutex_);
+    const auto tables = db_.listTables();
+    bool ok = true;
+    for (const auto& [id, name] : tables) {
+        std::shared_ptr<const Table> table = db_.read(id).share();
+        // Procedural tables have no stored rows to map.
+        if (!table || table->procedural) continue;
+        Exported& exported = exported_[id];
+        if (!exported.versions.empty() && exported.versions.back() == table->version) continue;
+        // Keep going so that one failing table does not hold back the others.
+        if (!exportTable(*table, exported, error)) ok = false;
+    }
+
+    for (auto it = exported_.begin(); it != exported_.end();) {
+        const bool listed = std::any_of(tables.begin(), tables.end(), [&](const auto& entry) { return entry.first == it->first; });
+        if (listed) {
+            ++it;
+        } else {
+            removeTable(it->first, it->second);
+            it = exported_.erase(it);
+        }
+    }
+    return ok;
+}
+
+bool TableExporter::exportTable(const Table& table, Exported& exported, std::string& error) {
+    if (!exported.current) removeStaleFiles(options_.directory, table.id);
+    if (!writeDataFile(table, exportDataPath(options_.directory, table.id, table.version), error)) return false;
+
+    if (exported.current) {
+        std::atomic_ref(*exported.current).store(table.version, std::memory_order_release);
+    } else {
+        exported.current = createHead(exportHeadPath(options_.directory, table.id), table.version, error);
+        if (!exported.current) {
+            ::unlink(exportDataPath(options_.directory, table.id, table.version).c_str());
+            return false;
+        }
+    }
+
+    exported.versions.push_back(table.version);
+    while (exported.versions.size() > kKeptVersions) {
+        ::unlink(exportDataPath(options_.directory, table.id, exported.versions.front()).c_str());
+        exported.versions.pop_front();
+    }
+    return true;
+}
+
+void TableExporter::removeTable(const std::string& id, Exported& exported) {
+    if (exported.current) {
+        closeHead(exported.current);
+        exported.current = nullptr;
+    }
+    ::unlink(exportHeadPath(options_.directory, id).c_str());
+    for (std::uint64_t version : exported.versions) {
+        ::unlink(exportDataPath(options_.directory, id, version).c_str());
+    }
+}
+
+void TableExporter::run(std::stop_token stop) {
+    std::mutex mutex;
+    std::condition_variable_any wake;
+    std::unique_lock lock(mutex);
+    while (!wake.wait_for(lock, stop, options_.interval, [] { return false; })) {
+        if (stop.stop_requested()) return;
+        std::string error;
+        if (!exportChanged(error)) std::cerr << "Table export failed: " << error << std::endl;
+    }
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "data_store.h"
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <stop_token>
+#include <string>
+#include <thread>
+
+struct TableExportOptions {
+    std::string directory;                      // empty: no export
+    std::chrono::milliseconds interval{100};    // how often tables are checked for new versions
+};
+
+// Publishes every table under options.directory in the layout described in
+// table_export_format.h, so that processes on the same host can map the
+// data instead of calling GetData. A background thread checks the tables
+// every interval and exports the ones with a new version; the versions
+// published within one interval are coalesced into the newest.
+class TableExporter {
+public:
+    TableExporter(const DataStore& db, TableExportOptions options);
+    ~TableExporter();  // stops the thread and marks every head closed
+
+    TableExporter(const TableExporter&) = delete;
+    TableExporter& operator=(const TableExporter&) = delete;
+
+    // Exports every table once, then starts the thread.
+    bool start(std::string& error);
+
+    // Exports the tables whose version changed since their last export and
+    // removes the files of tables that no longer exist.
+    bool exportChanged(std::string& error);
+
+private:
+    struct Exported {
+        std::uint64_t* current = nullptr;  // in the mapped head
+        std::deque<std::uint64_t> versions;  // data files on disk, oldest first
+    };
+
+    bool exportTable(const Table& table, Exported& exported, std::string& error);
+    void removeTable(const std::string& id, Exported& exported);
+    void run(std::stop_token stop);
+
+    const DataStore& db_;
+    TableExportOptions options_;
+    std::mutex mutex_;  // one pass at a time; guards exported_
+    std::map<std::string, Exported> exported_;
+    std::jthread thread_;  // calls exportChanged() every interval
+};
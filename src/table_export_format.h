@@ -0,0 +1,115 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Layout of the read-only table files that TableExporter publishes for
+// readers on the same host (table_export_reader.h maps them). Integers are
+// in native byte order and offsets count from the start of their file, so
+// writer and reader must share an architecture.
+//
+// <directory>/<stem>.head     ExportHead. current is the version of the data
+//                             file to map and the only field that changes:
+//                             it is stored once that file is complete, which
+//                             makes it the atomic swap. kExportClosed means
+//                             the server stopped; reopen the head once it is
+//                             back. The head is replaced when a server starts.
+// <directory>/<stem>.<v>.tbl  Version v of the table, never modified: an
+//                             ExportHeader, ExportColumn[column_count + 2]
+//                             (row ids, parent ids, then the schema columns
+//                             in order), then the arrays and strings those
+//                             point to, each 8-byte aligned:
+//
+//   nulls              u64 words; bit r % 64 of word r / 64 is set when row
+//                      r is null. Row ids are never null.
+//   String             values: u64 offsets[row_count + 1]; extra: the bytes.
+//                      Row r is [offsets[r], offsets[r + 1]), empty if null.
+//   Number, Currency   values: f64[row_count]; extra: bitmap of the rows
+//                      written as integers. Null rows hold any value.
+//   Bool               values: bitmap of the true rows; extra: 0.
+//
+// The two newest data files of a table are kept and older ones unlinked. A
+// mapping outlives the unlink; a reader that finds its file gone rereads
+// current and maps the newer one.
+
+inline constexpr char kExportHeadMagic[8] = {'T', 'B', 'L', 'H', 'E', 'A', 'D', '\0'};
+inline constexpr char kExportMagic[8] = {'T', 'B', 'L', 'E', 'X', 'P', 'T', '\0'};
+inline constexpr std::uint32_t kExportLayout = 1;
+inline constexpr std::uint64_t kExportClosed = UINT64_MAX;
+
+// Same order as ColumnType.
+enum class ExportType : std::uint8_t { String, Number, Currency, Bool };
+
+enum ExportFlag : std::uint8_t {
+    kExportTree = 1,
+    kExportPinned = 2,
+    kExportEditable = 4,
+    kExportPrimary = 8,
+};
+
+struct ExportString {
+    std::uint64_t offset;
+    std::uint64_t size;
+};
+
+struct ExportHead {
+    char magic[8];
+    std::uint32_t layout;
+    std::uint32_t reserved;
+    std::uint64_t current;  // accessed through std::atomic_ref
+};
+
+struct ExportHeader {
+    char magic[8];
+    std::uint32_t layout;
+    std::uint32_t column_count;  // schema columns
+    std::uint64_t version;
+    std::uint64_t row_count;
+    std::uint64_t file_size;
+    ExportString id;
+    ExportString name;
+    ExportString primary_key;
+    ExportString parent_key;
+};
+
+struct ExportColumn {
+    ExportString id;
+    ExportString title;
+    ExportType type;
+    std::uint8_t flags;  // ExportFlag bits
+    std::uint16_t reserved;
+    std::int32_t width;
+    std::uint64_t nulls;
+    std::uint64_t values;
+    std::uint64_t extra;
+};
+
+static_assert(sizeof(ExportHead) == 24 && sizeof(ExportHeader) == 104 && sizeof(ExportColumn) == 64);
+
+// File name stem of a table: letters, digits, '_' and '-' are kept, every
+// other byte becomes %XX, so no stem contains '.' or '/'.
+inline std::string exportStem(std::string_view table_id) {
+    static constexpr char kHex[] = "0123456789ABCDEF";
+    std::string stem;
+    stem.reserve(table_id.size());
+    for (unsigned char c : table_id) {
+        if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_' || c == '-') {
+            stem += static_cast<char>(c);
+        } else {
+            stem += '%';
+            stem += kHex[c >> 4];
+            stem += kHex[c & 15];
+        }
+    }
+    return stem;
+}
+
+inline std::string exportHeadPath(const std::string& directory, std::string_view table_id) {
+    return directory + "/" + exportStem(table_id) + ".head";
+}
+
+inline std::string exportDataPath(const std::string& directory, std::string_view table_id, std::uint64_t version) {
+    return directory + "/" + exportStem(table_id) + "." + std::to_string(version) + ".tbl";
+}
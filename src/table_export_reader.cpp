@@ -0,0 +1,179 @@
+#include "table_export_reader.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+// How often current() rereads the head when the file it names is already
+// gone: only possible when the exporter publishes two versions in between.
+constexpr int kOpenAttempts = 8;
+
+std::string systemError(std::string_view what, const std::string& path) {
+    return std::string(what) + " " + path + ": " + std::strerror(errno);
+}
+
+// Maps the whole file read-only; the size is returned in size.
+const char* mapFile(const std::string& path, std::size_t& size, std::string& error) {
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        const int open_errno = errno;
+        error = systemError("Cannot open", path);
+        errno = open_errno;
+        return nullptr;
+    }
+    struct stat info{};
+    void* mapped = MAP_FAILED;
+    if (::fstat(fd, &info) == 0 && info.st_size > 0) {
+        size = static_cast<std::size_t>(info.st_size);
+        mapped = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    if (mapped == MAP_FAILED) error = systemError("Cannot map", path);
+    ::close(fd);
+    return mapped == MAP_FAILED ? nullptr : static_cast<const char*>(mapped);
+}
+
+std::uint64_t bitmapBytes(std::uint64_t rows) {
+    return (rows + 63) / 64 * sizeof(std::uint64_t);
+}
+
+}  // namespace
+
+std::shared_ptr<const MappedTable> MappedTable::open(const std::string& path, std::string& error) {
+    std::size_t size = 0;
+    const char* base = mapFile(path, size, error);
+    if (!base) return nullptr;
+
+    std::shared_ptr<MappedTable> table(new MappedTable(base, size));
+    if (!table->validate()) {
+        error = "Not a valid table export: " + path;
+        errno = EINVAL;
+        return nullptr;
+    }
+    return table;
+}
+
+MappedTable::~MappedTable() {
+    ::munmap(const_cast<char*>(base_), size_);
+}
+
+const MappedColumn* MappedTable::findColumn(std::string_view id) const {
+    auto it = std::find_if(columns_.begin(), columns_.end(), [&](const MappedColumn& column) { return column.id() == id; });
+    return it == columns_.end() ? nullptr : &*it;
+}
+
+bool MappedTable::validate() {
+    if (size_ < sizeof(ExportHeader) || std::memcmp(header_->magic, kExportMagic, sizeof(kExportMagic)) != 0 ||
+        header_->layout != kExportLayout || header_->file_size != size_ || header_->row_count >= (std::uint64_t{1} << 40)) {
+        return false;
+    }
+    const std::uint64_t entries = std::uint64_t{header_->column_count} + 2;
+    if (!inFile(sizeof(ExportHeader), entries * sizeof(ExportColumn))) return false;
+    for (const ExportString* s : {&header_->id, &header_->name, &header_->primary_key, &header_->parent_key}) {
+        if (!inFile(s->offset, s->size)) return false;
+    }
+
+    const auto* entry = reinterpret_cast<const ExportColumn*>(base_ + sizeof(ExportHeader));
+    if (entry[0].type != ExportType::String || entry[1].type != ExportType::String ||
+        !bindColumn(entry[0], row_ids_) || !bindColumn(entry[1], parent_ids_)) {
+        return false;
+    }
+    columns_.resize(header_->column_count);
+    for (std::size_t i = 0; i < columns_.size(); ++i) {
+        if (!bindColumn(entry[i + 2], columns_[i])) return false;
+    }
+    return true;
+}
+
+bool MappedTable::bindColumn(const ExportColumn& entry, MappedColumn& column) const {
+    const std::uint64_t rows = header_->row_count;
+    auto words = [&](std::uint64_t offset, std::span<const std::uint64_t>& out) {
+        if (offset % 8 != 0 || !inFile(offset, bitmapBytes(rows))) return false;
+        out = {reinterpret_cast<const std::uint64_t*>(base_ + offset), static_cast<std::size_t>((rows + 63) / 64)};
+        return true;
+    };
+
+    if (!inFile(entry.id.offset, entry.id.size) || !inFile(entry.title.offset, entry.title.size) ||
+        !words(entry.nulls, column.nulls_)) {
+        return false;
+    }
+    column.entry_ = &entry;
+    column.id_ = text(entry.id);
+    column.title_ = text(entry.title);
+
+    switch (entry.type) {
+    case ExportType::String: {
+        if (entry.values % 8 != 0 || !inFile(entry.values, (rows + 1) * sizeof(std::uint64_t))) return false;
+        column.offsets_ = {reinterpret_cast<const std::uint64_t*>(base_ + entry.values), static_cast<std::size_t>(rows + 1)};
+        // Checked once here, so string() can slice without bounds checks.
+        if (column.offsets_.front() != 0 || !std::is_sorted(column.offsets_.begin(), column.offsets_.end()) ||
+            !inFile(entry.extra, column.offsets_.back())) {
+            return false;
+        }
+        column.bytes_ = base_ + entry.extra;
+        return true;
+    }
+    case ExportType::Number:
+    case ExportType::Currency:
+        if (entry.values % 8 != 0 || !inFile(entry.values, rows * sizeof(double))) return false;
+        column.numbers_ = {reinterpret_cast<const double*>(base_ + entry.values), static_cast<std::size_t>(rows)};
+        return words(entry.extra, column.extra_words_);
+    case ExportType::Bool:
+        return words(entry.values, column.value_words_);
+    }
+    return false;
+}
+
+std::unique_ptr<TableExportReader> TableExportReader::open(const std::string& directory,
+                                                           std::string_view table_id,
+                                                           std::string& error) {
+    const std::string path = exportHeadPath(directory, table_id);
+    std::size_t size = 0;
+    const char* base = mapFile(path, size, error);
+    if (!base) return nullptr;
+
+    const auto* head = reinterpret_cast<const ExportHead*>(base);
+    if (size != sizeof(ExportHead) || std::memcmp(head->magic, kExportHeadMagic, sizeof(kExportHeadMagic)) != 0 ||
+        head->layout != kExportLayout) {
+        ::munmap(const_cast<char*>(base), size);
+        error = "Not a valid table export head: " + path;
+        return nullptr;
+    }
+    return std::unique_ptr<TableExportReader>(new TableExportReader(directory, std::string(table_id), head));
+}
+
+TableExportReader::~TableExportReader() {
+    ::munmap(const_cast<ExportHead*>(head_), sizeof(ExportHead));
+}
+
+std::uint64_t TableExportReader::headVersion() const {
+    // A lock-free atomic load does not write, so it works on the read-only mapping.
+    return std::atomic_ref(const_cast<std::uint64_t&>(head_->current)).load(std::memory_order_acquire);
+}
+
+std::shared_ptr<const MappedTable> TableExportReader::current(std::string& error) {
+    for (int attempt = 0; attempt < kOpenAttempts; ++attempt) {
+        const std::uint64_t version = headVersion();
+        if (version == kExportClosed) {
+            error = "The table is no longer exported";
+            return table_;
+        }
+        if (table_ && table_->version() == version) return table_;
+
+        auto table = MappedTable::open(exportDataPath(directory_, table_id_, version), error);
+        if (table) {
+            table_ = std::move(table);
+            return table_;
+        }
+        if (errno != ENOENT) return table_;
+    }
+    return table_;
+}
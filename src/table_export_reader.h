@@ -0,0 +1,150 @@
+#pragma once
+
+#include "table_export_format.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Client side of the table export: maps the files that TableExporter
+// writes (layout in table_export_format.h) and reads them in place. Only
+// depends on the C++ library and POSIX, so co-located clients can link it
+// without protobuf, gRPC or the server.
+
+// One column of a mapped table. Row arguments are not checked against the
+// row count.
+class MappedColumn {
+public:
+    std::string_view id() const { return id_; }
+    std::string_view title() const { return title_; }
+    ExportType type() const { return entry_->type; }
+    std::uint8_t flags() const { return entry_->flags; }  // ExportFlag bits
+    int width() const { return entry_->width; }
+
+    bool isNull(std::size_t row) const { return testBit(nulls_, row); }
+
+    // String columns.
+    std::string_view string(std::size_t row) const {
+        return std::string_view(bytes_ + offsets_[row], offsets_[row + 1] - offsets_[row]);
+    }
+
+    // Number and Currency columns; isInt() is true for values written as
+    // integers.
+    double number(std::size_t row) const { return numbers_[row]; }
+    bool isInt(std::size_t row) const { return testBit(extra_words_, row); }
+
+    // Bool columns.
+    bool boolean(std::size_t row) const { return testBit(value_words_, row); }
+
+    // Whole arrays for scans, in the layout described in the format header.
+    std::span<const std::uint64_t> nullWords() const { return nulls_; }
+    std::span<const double> numbers() const { return numbers_; }
+
+private:
+    friend class MappedTable;
+
+    static bool testBit(std::span<const std::uint64_t> words, std::size_t i) { return (words[i >> 6] >> (i & 63)) & 1U; }
+
+    const ExportColumn* entry_ = nullptr;
+    std::string_view id_;
+    std::string_view title_;
+    std::span<const std::uint64_t> nulls_;
+    std::span<const std::uint64_t> offsets_;
+    const char* bytes_ = nullptr;
+    std::span<const double> numbers_;
+    std::span<const std::uint64_t> value_words_;
+    std::span<const std::uint64_t> extra_words_;
+};
+
+// One exported table version, mapped read-only. The data stays valid for
+// as long as the object lives, even after the exporter has moved on and
+// unlinked the file.
+class MappedTable {
+public:
+    // Maps and validates one data file. Returns nullptr with error set when
+    // the file cannot be mapped or does not match the layout; errno is
+    // ENOENT when it does not exist, e.g. because it was already unlinked.
+    static std::shared_ptr<const MappedTable> open(const std::string& path, std::string& error);
+
+    ~MappedTable();
+    MappedTable(const MappedTable&) = delete;
+    MappedTable& operator=(const MappedTable&) = delete;
+
+    std::uint64_t version() const { return header_->version; }
+    std::size_t rowCount() const { return static_cast<std::size_t>(header_->row_count); }
+    std::string_view id() const { return text(header_->id); }
+    std::string_view name() const { return text(header_->name); }
+    std::string_view primaryKey() const { return text(header_->primary_key); }
+    std::string_view parentKey() const { return text(header_->parent_key); }
+
+    std::string_view rowId(std::size_t row) const { return row_ids_.string(row); }
+    std::optional<std::string_view> parentId(std::size_t row) const {
+        if (parent_ids_.isNull(row)) return std::nullopt;
+        return parent_ids_.string(row);
+    }
+
+    // The schema columns, in order.
+    std::span<const MappedColumn> columns() const { return columns_; }
+    const MappedColumn* findColumn(std::string_view id) const;
+
+private:
+    MappedTable(const char* base, std::size_t size)
+        : base_(base),
+          size_(size),
+          header_(reinterpret_cast<const ExportHeader*>(base)) {}
+
+    bool validate();
+    bool bindColumn(const ExportColumn& entry, MappedColumn& column) const;
+    bool inFile(std::uint64_t offset, std::uint64_t bytes) const { return offset <= size_ && bytes <= size_ - offset; }
+    std::string_view text(const ExportString& s) const { return std::string_view(base_ + s.offset, s.size); }
+
+    const char* base_;
+    std::size_t size_;
+    const ExportHeader* header_;
+    MappedColumn row_ids_;
+    MappedColumn parent_ids_;
+    std::vector<MappedColumn> columns_;
+};
+
+// Follows the exported versions of one table through its head file.
+// Checking for a new version is one atomic load of shared memory; only a
+// changed version costs system calls. Not thread-safe: use one reader per
+// thread, or share the MappedTable it returns.
+class TableExportReader {
+public:
+    // Maps the head of table_id in directory. Returns nullptr with error set
+    // when the table is not exported there.
+    static std::unique_ptr<TableExportReader> open(const std::string& directory,
+                                                   std::string_view table_id,
+                                                   std::string& error);
+
+    ~TableExportReader();
+    TableExportReader(const TableExportReader&) = delete;
+    TableExportReader& operator=(const TableExportReader&) = delete;
+
+    // The newest exported version, mapped when it changed since the last
+    // call. Returns the previous mapping, or nullptr, with error set when
+    // the new version cannot be mapped or the exporter has stopped.
+    std::shared_ptr<const MappedTable> current(std::string& error);
+
+    // The version the head points at, without mapping it; kExportClosed
+    // once the exporter has stopped.
+    std::uint64_t headVersion() const;
+
+private:
+    TableExportReader(std::string directory, std::string table_id, const ExportHead* head)
+        : directory_(std::move(directory)),
+          table_id_(std::move(table_id)),
+          head_(head) {}
+
+    std::string directory_;
+    std::string table_id_;
+    const ExportHead* head_;
+    std::shared_ptr<const MappedTable> table_;
+};
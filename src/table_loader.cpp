@@ -0,0 +1,799 @@
+#include "table_loader.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <deque>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr std::size_t kMinChunkBytes = std::size_t{1} << 20;
+constexpr std::size_t kNoField = static_cast<std::size_t>(-1);
+constexpr std::string_view kByteOrderMark = "\xEF\xBB\xBF";
+
+// Every field name a record may use.
+struct FieldMap {
+    std::vector<std::string> names;
+    StringMap<std::size_t> by_name;
+    std::size_t row_id = kNoField;      // field named after primary_key
+    std::size_t parent_id = kNoField;   // field named after parent_key, if the table has one
+    std::vector<std::size_t> columns;   // schema ordinal -> field
+};
+
+FieldMap mapFields(const Table& table) {
+    FieldMap map;
+    auto add = [&](const std::string& name) {
+        auto [it, added] = map.by_name.emplace(name, map.names.size());
+        if (added) map.names.push_back(name);
+        return it->second;
+    };
+    map.row_id = add(table.primary_key);
+    if (!table.parent_key.empty()) map.parent_id = add(table.parent_key);
+    for (const ColumnDef& column : table.schema) {
+        map.columns.push_back(add(column.id));
+    }
+    return map;
+}
+
+enum class FieldKind { Null, Text, String, Number, Bool };
+
+// One field of a record. Text is an untyped CSV field, converted according
+// to its column; the other kinds are JSON values.
+struct Field {
+    FieldKind kind = FieldKind::Null;
+    std::string_view text;  // Text, String and Number
+    bool flag = false;      // Bool
+};
+
+bool parseNumber(std::string_view text, double& number) {
+    const char* end = text.data() + text.size();
+    auto [stop, parse_error] = std::from_chars(text.data(), end, number);
+    return parse_error == std::errc{} && stop == end && std::isfinite(number);
+}
+
+bool appendCell(Column& column, const Field& field, std::string& error) {
+    if (field.kind == FieldKind::Null) {
+        column.append(nullptr);
+        return true;
+    }
+
+    switch (column.type()) {
+    case ColumnType::String:
+        if (field.kind == FieldKind::Text || field.kind == FieldKind::String) {
+            column.appendString(field.text);
+            return true;
+        }
+        error = "Expected string value";
+        return false;
+    case ColumnType::Bool:
+        if (field.kind == FieldKind::Bool) {
+            column.append(field.flag);
+            return true;
+        }
+        if (field.kind == FieldKind::Text && (field.text == "true" || field.text == "false")) {
+            column.append(field.text == "true");
+            return true;
+        }
+        error = "Expected boolean value";
+        return false;
+    case ColumnType::Number:
+    case ColumnType::Currency: {
+        double number = 0.0;
+        if ((field.kind == FieldKind::Text || field.kind == FieldKind::Number) && parseNumber(field.text, number)) {
+            column.append(numberCellValue(column.type(), number));
+            return true;
+        }
+        error = "Expected numeric value";
+        return false;
+    }
+    }
+    return false;
+}
+
+// Row and parent ids are strings; a JSON number keeps its literal text, also
+// in a column that shares the key's name. Returns false for booleans.
+bool keyText(Field& field, std::string_view& text) {
+    if (field.kind == FieldKind::Bool) return false;
+    if (field.kind == FieldKind::Number) field.kind = FieldKind::String;
+    text = field.kind == FieldKind::Null ? std::string_view() : field.text;
+    return true;
+}
+
+// Columns of rows parsed from the input.
+struct Rows {
+    Column row_ids{ColumnType::String};
+    Column parent_ids{ColumnType::String};
+    std::vector<Column> columns;
+};
+
+// One chunk of the input. Its first head_rows rows complete the last column
+// segment of the chunks before it; the rest start a new segment, so merging
+// shares the body's segments instead of copying them.
+struct Chunk {
+    std::size_t begin = 0;  // byte range of the input, starting at a record
+    std::size_t end = 0;
+    std::size_t records = 0;
+    std::size_t head_rows = 0;
+    Rows head;
+    Rows body;
+    std::string error;
+    std::size_t error_offset = 0;  // start of the failing record
+};
+
+bool appendRecord(Rows& rows, const FieldMap& fields, std::vector<Field>& values, std::string& error) {
+    std::string_view id;
+    if (!keyText(values[fields.row_id], id)) {
+        error = "Expected string value";
+        return false;
+    }
+    if (id.empty()) {
+        error = "Missing row id";
+        return false;
+    }
+    std::string_view parent;
+    if (fields.parent_id != kNoField && !keyText(values[fields.parent_id], parent)) {
+        error = "Expected string value";
+        return false;
+    }
+
+    rows.row_ids.appendString(id);
+    if (parent.empty()) {
+        rows.parent_ids.append(nullptr);
+    } else {
+        rows.parent_ids.appendString(parent);
+    }
+    for (std::size_t ordinal = 0; ordinal < rows.columns.size(); ++ordinal) {
+        if (!appendCell(rows.columns[ordinal], values[fields.columns[ordinal]], error)) return false;
+    }
+    return true;
+}
+
+// Fields that need unescaping are decoded into strings that stay put until
+// the next record: a deque never moves its elements.
+class Scratch {
+public:
+    void reset() { used_ = 0; }
+
+    std::string& next() {
+        if (used_ == buffers_.size()) buffers_.emplace_back();
+        std::string& buffer = buffers_[used_++];
+        buffer.clear();
+        return buffer;
+    }
+
+private:
+    std::deque<std::string> buffers_;
+    std::size_t used_ = 0;
+};
+
+// RFC 4180 records: fields separated by commas, optionally quoted, with ""
+// for a quote and line breaks allowed inside quotes. CRLF is accepted.
+class CsvReader {
+public:
+    CsvReader(std::string_view text, std::size_t position)
+        : text_(text),
+          position_(position) {}
+
+    std::size_t position() const { return position_; }
+
+    // Returns false at the end of the input.
+    bool skipBlankLines() {
+        while (position_ < text_.size() && (text_[position_] == '\n' || text_[position_] == '\r')) ++position_;
+        return position_ < text_.size();
+    }
+
+    bool next(std::vector<Field>& fields, std::string& error) {
+        fields.clear();
+        scratch_.reset();
+        for (;;) {
+            Field& field = fields.emplace_back();
+            if (position_ < text_.size() && text_[position_] == '"') {
+                if (!readQuoted(field, error)) return false;
+            } else {
+                const std::size_t start = position_;
+                while (position_ < text_.size() && text_[position_] != ',' && text_[position_] != '\n') ++position_;
+                std::string_view raw = text_.substr(start, position_ - start);
+                if (!raw.empty() && raw.back() == '\r' && (position_ == text_.size() || text_[position_] == '\n')) {
+                    raw.remove_suffix(1);
+                }
+                if (raw.find('"') != std::string_view::npos) {
+                    error = "Quote inside unquoted field";
+                    return false;
+                }
+                if (!raw.empty()) field = {FieldKind::Text, raw};
+            }
+
+            if (position_ == text_.size()) return true;
+            switch (text_[position_++]) {
+            case ',':
+                continue;
+            case '\n':
+                return true;
+            default:
+                error = "Unexpected character after closing quote";
+                return false;
+            }
+        }
+    }
+
+private:
+    bool readQuoted(Field& field, std::string& error) {
+        const std::size_t start = ++position_;
+        std::string* decoded = nullptr;
+        for (;;) {
+            const std::size_t quote = text_.find('"', position_);
+            if (quote == std::string_view::npos) {
+                error = "Unterminated quoted field";
+                return false;
+            }
+            if (quote + 1 < text_.size() && text_[quote + 1] == '"') {
+                if (!decoded) decoded = &scratch_.next();
+                decoded->append(text_.substr(position_, quote + 1 - position_));
+                position_ = quote + 2;
+                continue;
+            }
+
+            if (decoded) {
+                decoded->append(text_.substr(position_, quote - position_));
+                field = {FieldKind::Text, *decoded};
+            } else {
+                field = {FieldKind::Text, text_.substr(start, quote - start)};
+            }
+            position_ = quote + 1;
+            if (position_ < text_.size() && text_[position_] == '\r' &&
+                (position_ + 1 == text_.size() || text_[position_ + 1] == '\n')) {
+                ++position_;
+            }
+            return true;
+        }
+    }
+
+    std::string_view text_;
+    std::size_t position_;
+    Scratch scratch_;
+};
+
+void appendUtf8(std::string& out, std::uint32_t code) {
+    if (code < 0x80) {
+        out.push_back(static_cast<char>(code));
+    } else if (code < 0x800) {
+        out.push_back(static_cast<char>(0xC0 | (code >> 6)));
+        out.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+    } else if (code < 0x10000) {
+        out.push_back(static_cast<char>(0xE0 | (code >> 12)));
+        out.push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+    } else {
+        out.push_back(static_cast<char>(0xF0 | (code >> 18)));
+        out.push_back(static_cast<char>(0x80 | ((code >> 12) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+    }
+}
+
+// One flat JSON object per line: values are strings, numbers, booleans or
+// null. An object may not span lines, so every line break is a record
+// boundary.
+class JsonReader {
+public:
+    JsonReader(std::string_view text, std::size_t position)
+        : text_(text),
+          position_(position) {}
+
+    std::size_t position() const { return position_; }
+
+    // Returns false at the end of the input.
+    bool skipBlankLines() {
+        while (position_ < text_.size() &&
+               (text_[position_] == '\n' || text_[position_] == ' ' || text_[position_] == '\t' ||
+                text_[position_] == '\r')) {
+            ++position_;
+        }
+        return position_ < text_.size();
+    }
+
+    // values is indexed by field and must be all null on entry.
+    bool next(const FieldMap& fields, std::vector<Field>& values, std::vector<bool>& seen, std::string& error) {
+        scratch_.reset();
+        std::fill(seen.begin(), seen.end(), false);
+        if (!consume('{')) {
+            error = "Expected a JSON object";
+            return false;
+        }
+        skipSpace();
+        if (!consume('}')) {
+            for (;;) {
+                skipSpace();
+                std::string_view key;
+                if (position_ == text_.size() || text_[position_] != '"') {
+                    error = "Expected a field name";
+                    return false;
+                }
+                if (!readString(key, error)) return false;
+                skipSpace();
+                if (!consume(':')) {
+                    error = "Expected ':' after field name";
+                    return false;
+                }
+                auto field = fields.by_name.find(key);
+                if (field == fields.by_name.end()) {
+                    error = "Unknown field " + std::string(key);
+                    return false;
+                }
+                if (seen[field->second]) {
+                    error = "Duplicate field " + std::string(key);
+                    return false;
+                }
+                seen[field->second] = true;
+                skipSpace();
+                if (!readValue(values[field->second], error)) return false;
+                skipSpace();
+                if (consume(',')) continue;
+                if (consume('}')) break;
+                error = "Expected ',' or '}'";
+                return false;
+            }
+        }
+
+        skipSpace();
+        if (position_ < text_.size() && !consume('\n')) {
+            error = "Expected one object per line";
+            return false;
+        }
+        return true;
+    }
+
+private:
+    // Spaces within a line only.
+    void skipSpace() {
+        while (position_ < text_.size() &&
+               (text_[position_] == ' ' || text_[position_] == '\t' || text_[position_] == '\r')) {
+            ++position_;
+        }
+    }
+
+    bool consume(char c) {
+        if (position_ == text_.size() || text_[position_] != c) return false;
+        ++position_;
+        return true;
+    }
+
+    bool consumeLiteral(std::string_view literal) {
+        if (text_.substr(position_, literal.size()) != literal) return false;
+        position_ += literal.size();
+        return true;
+    }
+
+    bool readValue(Field& value, std::string& error) {
+        if (position_ == text_.size()) {
+            error = "Expected a value";
+            return false;
+        }
+        const char c = text_[position_];
+        if (c == '"') {
+            value.kind = FieldKind::String;
+            return readString(value.text, error);
+        }
+        if (c == '-' || (c >= '0' && c <= '9')) {
+            const std::size_t start = position_;
+            while (position_ < text_.size() &&
+                   std::string_view("+-.eE0123456789").find(text_[position_]) != std::string_view::npos) {
+                ++position_;
+            }
+            value = {FieldKind::Number, text_.substr(start, position_ - start)};
+            double number = 0.0;
+            if (!parseNumber(value.text, number)) {
+                error = "Invalid number " + std::string(value.text);
+                return false;
+            }
+            return true;
+        }
+        if (consumeLiteral("true")) {
+            value = {FieldKind::Bool, {}, true};
+            return true;
+        }
+        if (consumeLiteral("false")) {
+            value = {FieldKind::Bool, {}, false};
+            return true;
+        }
+        if (consumeLiteral("null")) {
+            value = {};
+            return true;
+        }
+        error = c == '{' || c == '[' ? "Nested values are not supported" : "Expected a value";
+        return false;
+    }
+
+    bool readHex(std::uint32_t& code, std::string& error) {
+        code = 0;
+        if (text_.size() - position_ < 4) {
+            error = "Invalid \\u escape";
+            return false;
+        }
+        for (int i = 0; i < 4; ++i) {
+            const char c = text_[position_++];
+            code <<= 4;
+            if (c >= '0' && c <= '9') {
+                code |= static_cast<std::uint32_t>(c - '0');
+            } else if (c >= 'a' && c <= 'f') {
+                code |= static_cast<std::uint32_t>(c - 'a' + 10);
+            } else if (c >= 'A' && c <= 'F') {
+                code |= static_cast<std::uint32_t>(c - 'A' + 10);
+            } else {
+                error = "Invalid \\u escape";
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // position_ is at the opening quote. Strings without escapes are
+    // returned as views into the input.
+    bool readString(std::string_view& text, std::string& error) {
+        const std::size_t start = ++position_;
+        std::string* decoded = nullptr;
+        for (;;) {
+            if (position_ == text_.size()) {
+                error = "Unterminated string";
+                return false;
+            }
+            const char c = text_[position_++];
+            if (c == '"') break;
+            if (static_cast<unsigned char>(c) < 0x20) {
+                error = c == '\n' ? "Unterminated string" : "Control character in string";
+                return false;
+            }
+            if (c != '\\') {
+                if (decoded) decoded->push_back(c);
+                continue;
+            }
+
+            if (!decoded) {
+                decoded = &scratch_.next();
+                decoded->assign(text_.substr(start, position_ - 1 - start));
+            }
+            if (position_ == text_.size()) {
+                error = "Unterminated string";
+                return false;
+            }
+            switch (text_[position_++]) {
+            case '"':
+                decoded->push_back('"');
+                break;
+            case '\\':
+                decoded->push_back('\\');
+                break;
+            case '/':
+                decoded->push_back('/');
+                break;
+            case 'b':
+                decoded->push_back('\b');
+                break;
+            case 'f':
+                decoded->push_back('\f');
+                break;
+            case 'n':
+                decoded->push_back('\n');
+                break;
+            case 'r':
+                decoded->push_back('\r');
+                break;
+            case 't':
+                decoded->push_back('\t');
+                break;
+            case 'u': {
+                std::uint32_t code = 0;
+                if (!readHex(code, error)) return false;
+                if (code >= 0xDC00 && code <= 0xDFFF) {
+                    error = "Invalid surrogate pair";
+                    return false;
+                }
+                if (code >= 0xD800 && code <= 0xDBFF) {
+                    std::uint32_t low = 0;
+                    if (!consumeLiteral("\\u") || !readHex(low, error) || low < 0xDC00 || low > 0xDFFF) {
+                        error = "Invalid surrogate pair";
+                        return false;
+                    }
+                    code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                }
+                appendUtf8(*decoded, code);
+                break;
+            }
+            default:
+                error = "Invalid escape in string";
+                return false;
+            }
+        }
+        text = decoded ? std::string_view(*decoded) : text_.substr(start, position_ - 1 - start);
+        return true;
+    }
+
+    std::string_view text_;
+    std::size_t position_;
+    Scratch scratch_;
+};
+
+// Reads the CSV header into header (CSV column -> field) and moves begin
+// past it.
+bool readCsvHeader(std::string_view data,
+                   std::size_t& begin,
+                   const FieldMap& fields,
+                   std::vector<std::size_t>& header,
+                   std::string& error) {
+    CsvReader reader(data, begin);
+    std::vector<Field> names;
+    if (!reader.skipBlankLines()) {
+        error = "Missing header row";
+        return false;
+    }
+    if (!reader.next(names, error)) return false;
+
+    std::vector<bool> seen(fields.names.size(), false);
+    for (const Field& name : names) {
+        auto field = fields.by_name.find(name.text);
+        if (field == fields.by_name.end()) {
+            error = "Unknown field " + std::string(name.text);
+            return false;
+        }
+        if (seen[field->second]) {
+            error = "Duplicate field " + std::string(name.text);
+            return false;
+        }
+        seen[field->second] = true;
+        header.push_back(field->second);
+    }
+    if (!seen[fields.row_id]) {
+        error = "Missing field " + fields.names[fields.row_id];
+        return false;
+    }
+    begin = reader.position();
+    return true;
+}
+
+// Cuts [begin, data.size()) into about `count` ranges that each start at a
+// record. For CSV a line break only ends a record outside quotes; the quote
+// parity up to each cut is carried over from the previous one.
+std::vector<std::size_t> splitChunks(std::string_view data, std::size_t begin, ImportFormat format, std::size_t count) {
+    std::vector<std::size_t> bounds{begin};
+    std::size_t scanned = begin;
+    bool in_quotes = false;
+    for (std::size_t i = 1; i < count; ++i) {
+        const std::size_t target = begin + (data.size() - begin) / count * i;
+        if (target <= bounds.back()) continue;
+
+        std::size_t cut = 0;
+        if (format == ImportFormat::Csv) {
+            if (target > scanned) {
+                in_quotes ^= (std::count(data.begin() + scanned, data.begin() + target, '"') & 1) != 0;
+                scanned = target;
+            }
+            cut = scanned;
+            while (cut < data.size()) {
+                const char c = data[cut++];
+                if (c == '"') {
+                    in_quotes = !in_quotes;
+                } else if (c == '\n' && !in_quotes) {
+                    break;
+                }
+            }
+            scanned = cut;
+        } else {
+            cut = data.find('\n', target);
+            cut = cut == std::string_view::npos ? data.size() : cut + 1;
+        }
+        if (cut >= data.size()) break;
+        bounds.push_back(cut);
+    }
+    bounds.push_back(data.size());
+    return bounds;
+}
+
+// Counts the records the readers will find in [begin, end), which starts at
+// a record: lines that the readers do not skip as blank, where for CSV a line
+// only ends a record outside quotes. Exact for valid input.
+std::size_t countRecords(std::string_view data, std::size_t begin, std::size_t end, ImportFormat format) {
+    const std::string_view blank = format == ImportFormat::Csv ? "\r" : " \t\r";
+    std::size_t records = 0;
+    bool in_quotes = false;
+    while (begin < end) {
+        const auto* newline = static_cast<const char*>(std::memchr(data.data() + begin, '\n', end - begin));
+        const std::size_t line_end = newline ? static_cast<std::size_t>(newline - data.data()) : end;
+        const std::string_view line = data.substr(begin, line_end - begin);
+        if (!in_quotes && line.find_first_not_of(blank) != std::string_view::npos) ++records;
+        if (format == ImportFormat::Csv) in_quotes ^= (std::count(line.begin(), line.end(), '"') & 1) != 0;
+        begin = line_end + 1;
+    }
+    return records;
+}
+
+void parseChunk(std::string_view data,
+                ImportFormat format,
+                const Table& table,
+                const FieldMap& fields,
+                const std::vector<std::size_t>& header,
+                Chunk& chunk) {
+    for (Rows* rows : {&chunk.head, &chunk.body}) {
+        rows->columns.reserve(table.schema.size());
+        for (const ColumnDef& column : table.schema) {
+            rows->columns.emplace_back(column.type);
+        }
+    }
+    auto target = [&]() -> Rows& { return chunk.head.row_ids.size() < chunk.head_rows ? chunk.head : chunk.body; };
+    const std::string_view text = data.substr(0, chunk.end);
+    std::vector<Field> values(fields.names.size());
+
+    if (format == ImportFormat::Csv) {
+        CsvReader reader(text, chunk.begin);
+        std::vector<Field> record;
+        while (reader.skipBlankLines()) {
+            chunk.error_offset = reader.position();
+            if (!reader.next(record, chunk.error)) return;
+            if (record.size() != header.size()) {
+                chunk.error = "Expected " + std::to_string(header.size()) + " fields, found " +
+                              std::to_string(record.size());
+                return;
+            }
+            for (std::size_t i = 0; i < record.size(); ++i) {
+                values[header[i]] = record[i];
+            }
+            if (!appendRecord(target(), fields, values, chunk.error)) return;
+        }
+    } else {
+        JsonReader reader(text, chunk.begin);
+        std::vector<bool> seen(fields.names.size(), false);
+        while (reader.skipBlankLines()) {
+            chunk.error_offset = reader.position();
+            std::fill(values.begin(), values.end(), Field{});
+            if (!reader.next(fields, values, seen, chunk.error)) return;
+            if (!appendRecord(target(), fields, values, chunk.error)) return;
+        }
+    }
+}
+
+// Runs work(0) .. work(tasks - 1) on up to `threads` threads.
+template <typename Work>
+void runParallel(std::size_t tasks, unsigned threads, const Work& work) {
+    std::atomic<std::size_t> next{0};
+    auto worker = [&] {
+        for (std::size_t task; (task = next.fetch_add(1, std::memory_order_relaxed)) < tasks;) {
+            work(task);
+        }
+    };
+    std::vector<std::jthread> pool;
+    for (unsigned i = 1; i < std::min<std::size_t>(threads, tasks); ++i) {
+        pool.emplace_back(worker);
+    }
+    worker();
+}
+
+std::size_t lineOf(std::string_view data, std::size_t offset) {
+    return 1 + static_cast<std::size_t>(std::count(data.begin(), data.begin() + offset, '\n'));
+}
+
+std::size_t peakRssBytes() {
+    rusage usage{};
+    ::getrusage(RUSAGE_SELF, &usage);
+    return static_cast<std::size_t>(usage.ru_maxrss) * 1024;  // kilobytes on Linux
+}
+
+}  // namespace
+
+bool loadTable(Table& table, ImportFormat format, std::string_view data, std::string& error, ImportStats* stats) {
+    const auto started = std::chrono::steady_clock::now();
+    if (table.primary_key.empty()) {
+        error = "Table has no primary key";
+        return false;
+    }
+    if (table.parent_key == table.primary_key) {
+        error = "Parent key must differ from the primary key";
+        return false;
+    }
+    const FieldMap fields = mapFields(table);
+
+    std::size_t begin = data.starts_with(kByteOrderMark) ? kByteOrderMark.size() : 0;
+    std::vector<std::size_t> header;
+    if (format == ImportFormat::Csv && !readCsvHeader(data, begin, fields, header, error)) {
+        error = "line 1: " + error;
+        return false;
+    }
+
+    const unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+    const std::size_t wanted = std::clamp<std::size_t>((data.size() - begin) / kMinChunkBytes, 1, threads * 4);
+    const std::vector<std::size_t> bounds = splitChunks(data, begin, format, wanted);
+    std::vector<Chunk> chunks(bounds.size() - 1);
+    for (std::size_t i = 0; i < chunks.size(); ++i) {
+        chunks[i].begin = bounds[i];
+        chunks[i].end = bounds[i + 1];
+    }
+    runParallel(chunks.size(), threads, [&](std::size_t i) {
+        chunks[i].records = countRecords(data, chunks[i].begin, chunks[i].end, format);
+    });
+    std::size_t rows_before = 0;
+    for (Chunk& chunk : chunks) {
+        chunk.head_rows = (kSegmentRows - rows_before % kSegmentRows) % kSegmentRows;
+        rows_before += chunk.records;
+    }
+    runParallel(chunks.size(), threads, [&](std::size_t i) {
+        parseChunk(data, format, table, fields, header, chunks[i]);
+    });
+    // Chunks are in input order, so the first failing one has the first error.
+    for (const Chunk& chunk : chunks) {
+        if (!chunk.error.empty()) {
+            error = "line " + std::to_string(lineOf(data, chunk.error_offset)) + ": " + chunk.error;
+            return false;
+        }
+    }
+
+    // Concatenate the chunks, one task per column. Only the heads are copied.
+    runParallel(2 + table.schema.size(), threads, [&](std::size_t task) {
+        auto pick = [task](auto& owner) -> decltype(owner.row_ids)& {
+            if (task == 0) return owner.row_ids;
+            if (task == 1) return owner.parent_ids;
+            return owner.columns[task - 2];
+        };
+        Column& target = pick(table);
+        for (Chunk& chunk : chunks) {
+            target.appendColumn(pick(chunk.head));
+            target.appendColumn(pick(chunk.body));
+        }
+    });
+    chunks.clear();
+
+    if (!table.buildIndexes(error)) return false;
+
+    if (stats) {
+        stats->rows = table.rowCount();
+        stats->bytes = data.size();
+        stats->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+        stats->peak_rss_bytes = peakRssBytes();
+    }
+    return true;
+}
+
+bool loadTableFile(Table& table, const std::string& path, std::string& error, ImportStats* stats) {
+    const auto format = importFormatForPath(path);
+    if (!format) {
+        error = path + ": unknown data format (expected .csv, .ndjson, .jsonl or .json)";
+        return false;
+    }
+
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat info{};
+    if (fd < 0 || ::fstat(fd, &info) != 0) {
+        error = "Cannot open " + path + ": " + std::strerror(errno);
+        if (fd >= 0) ::close(fd);
+        return false;
+    }
+    const auto size = static_cast<std::size_t>(info.st_size);
+    void* mapped = size ? ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0) : nullptr;
+    ::close(fd);
+    if (mapped == MAP_FAILED) {
+        error = "Cannot map " + path + ": " + std::strerror(errno);
+        return false;
+    }
+    if (mapped) ::madvise(mapped, size, MADV_WILLNEED);
+
+    const bool loaded = loadTable(table, *format, std::string_view(static_cast<const char*>(mapped), size), error, stats);
+    if (mapped) ::munmap(mapped, size);
+    if (!loaded) error = path + ": " + error;
+    return loaded;
+}
+
+std::optional<ImportFormat> importFormatForPath(std::string_view path) {
+    if (path.ends_with(".csv")) return ImportFormat::Csv;
+    if (path.ends_with(".ndjson") || path.ends_with(".jsonl") || path.ends_with(".json")) return ImportFormat::NdJson;
+    return std::nullopt;
+}
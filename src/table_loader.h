@@ -0,0 +1,47 @@
+#pragma once
+
+#include "data_store.h"
+
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <string_view>
+
+enum class ImportFormat {
+    Csv,     // RFC 4180 with a header row of field names
+    NdJson,  // one flat JSON object per line
+};
+
+struct ImportStats {
+    std::size_t rows = 0;
+    std::size_t bytes = 0;
+    double seconds = 0.0;
+    std::size_t peak_rss_bytes = 0;  // of the whole process, sampled when the load ends
+
+    double rowsPerSecond() const { return seconds > 0.0 ? static_cast<double>(rows) / seconds : 0.0; }
+};
+
+// Bulk loader for tables with millions of rows.
+//
+// The input is cut into chunks at record boundaries and the chunks are
+// parsed in parallel into chunk-local columns, which are then concatenated
+// column by column (also in parallel). The row index and the roll-ups are
+// built once at the end with Table::buildIndexes() instead of row by row.
+//
+// Fields named after the table's primary_key and parent_key give each row's
+// id and parent id; when a column has the same id it is filled as well.
+// Every other field must name a column and is typed like a JSON cell edit:
+// a Number column keeps integral values as ints. In CSV an empty unquoted
+// field is null and "" is the empty string; in NDJSON missing fields are
+// null. An empty or null parent id makes the row a root.
+
+// Fills an empty table whose id, keys and schema are already set. Errors
+// name the input line they were found on.
+bool loadTable(Table& table, ImportFormat format, std::string_view data, std::string& error,
+               ImportStats* stats = nullptr);
+
+// Maps the file and loads it; the format follows the extension (.csv, or
+// .ndjson / .jsonl / .json).
+bool loadTableFile(Table& table, const std::string& path, std::string& error, ImportStats* stats = nullptr);
+
+std::optional<ImportFormat> importFormatForPath(std::string_view path);
@@ -0,0 +1,1396 @@
+#include "table_service.h"
+
+#include "arrow_ipc.h"
+#include "metrics.h"
+#include "procedural_table.h"
+#include "proto_convert.h"
+#include "query.h"
+#include "response_cache.h"
+#include "service_common.h"
+#include "table_loader.h"
+#include "text_search.h"
+#include "tree_window.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <iterator>
+#include <iostream>
+#include <mutex>
+#include <optional>
+#include <stop_token>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include <grpcpp/alarm.h>
+#include <grpcpp/resource_quota.h>
+#include <grpcpp/support/server_interceptor.h>
+
+#include <pthread.h>
+#include <sched.h>
+
+namespace {
+
+grpc::Status catalogError(CatalogStatus status, const std::string& error) {
+    switch (status) {
+    case CatalogStatus::Ok:
+        return grpc::Status::OK;
+    case CatalogStatus::NotFound:
+        return grpc::Status(grpc::StatusCode::NOT_FOUND, error);
+    case CatalogStatus::AlreadyExists:
+        return grpc::Status(grpc::StatusCode::ALREADY_EXISTS, error);
+    case CatalogStatus::Invalid:
+        return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, error);
+    case CatalogStatus::Failed:
+        return grpc::Status(grpc::StatusCode::INTERNAL, error);
+    case CatalogStatus::NotDurable:
+        break;
+    }
+    return grpc::Status(grpc::StatusCode::INTERNAL, "Applied but not durable: " + error);
+}
+
+}  // namespace
+
+// Unary handlers. They run on completion-queue threads and must not block
+// on anything but the data store itself, except the writes and catalog
+// changes, which armAll sends to workers when a write-ahead log is open.
+class TableServiceImpl {
+public:
+    TableServiceImpl(DataStore& db, ResponseCache& cache, Metrics& metrics)
+        : db_(db),
+          cache_(cache),
+          metrics_(metrics) {
+        // Every method of the service, so a new RPC is counted without
+        // being listed here.
+        static constexpr std::string_view kRowMethods[] = {"GetData", "GetColumnarData", "StreamData", "StreamArrow",
+                                                           "Query", "GetWindow", "Search"};
+        const auto* service = tables::GetDataRequest::descriptor()->file()->FindServiceByName("TableService");
+        for (int i = 0; i < service->method_count(); ++i) {
+            const std::string& name = service->method(i)->name();
+            metrics.addRpc(name, std::find(std::begin(kRowMethods), std::end(kRowMethods), name) != std::end(kRowMethods));
+        }
+        get_data_rows_ = &*metrics.rpc("GetData")->rows;
+        get_columnar_data_rows_ = &*metrics.rpc("GetColumnarData")->rows;
+        stream_data_rows_ = &*metrics.rpc("StreamData")->rows;
+        stream_arrow_rows_ = &*metrics.rpc("StreamArrow")->rows;
+        query_rows_ = &*metrics.rpc("Query")->rows;
+        window_rows_ = &*metrics.rpc("GetWindow")->rows;
+        search_rows_ = &*metrics.rpc("Search")->rows;
+    }
+
+    grpc::Status ListTables(grpc::ServerContext*,
+                            const tables::ListTablesRequest*,
+                            tables::ListTablesResponse* response) {
+        auto list = db_.listTables();
+        for (const auto& [id, name] : list) {
+            auto* info = response->add_tables();
+            info->set_id(id);
+            info->set_name(name);
+        }
+        return grpc::Status::OK;
+    }
+
+    // GetSchema and GetData are registered raw: the request is parsed here and
+    // the response is the cached wire encoding, sent without a copy.
+    grpc::Status GetSchema(grpc::ServerContext*,
+                           const grpc::ByteBuffer* request_bytes,
+                           grpc::ByteBuffer* response) {
+        tables::GetSchemaRequest request;
+        if (!parseRequest(*request_bytes, request)) {
+            return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, "malformed request");
+        }
+
+        auto table = db_.read(request.table_id());
+        if (!table) {
+            return grpc::Status(grpc::StatusCode::NOT_FOUND, "table not found");
+        }
+
+        *response = toByteBuffer(cache_.get(*table, ResponseCache::Kind::ProtoSchema, [&] {
+            tables::GetSchemaResponse message;
+            fillProtoSchema(*table, message.mutable_schema());
+            return message.SerializeAsString();
+        }));
+        return grpc::Status::OK;
+    }
+
+    grpc::Status GetData(grpc::ServerContext*,
+                         const grpc::ByteBuffer* request_bytes,
+                         grpc::ByteBuffer* response) {
+        tables::GetDataRequest request;
+        if (!parseRequest(*request_bytes, request)) {
+            return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, "malformed request");
+        }
+
+        auto table = db_.read(request.table_id());
+        if (!table) {
+            return grpc::Status(grpc::StatusCode::NOT_FOUND, "table not found");
+        }
+
+        if (request.has_since_version()) {
+            // Deltas depend on the client's version, so they are not cached.
+            auto rows = db_.changedRows(*table, request.since_version());
+            if (!rows) {
+                tables::GetDataResponse message;
+                message.set_version(table->version);
+                message.set_resync_required(true);
+                *response = toByteBuffer(message.SerializeAsString());
+                get_data_rows_->observe(0);
+                return grpc::Status::OK;
+            }
+            // A procedural table's changed rows are its edited row indexes.
+            *response = toByteBuffer(table->procedural
+                                         ? serializeDataResponse(*table->procedural->rows(*table, *rows))
+                                         : serializeDataResponse(*table, *rows));
+            get_data_rows_->observe(rows->size());
+            return grpc::Status::OK;
+        }
+
+        // Procedural tables are not cached: the response would hold every
+        // row the table exists not to store.
+        if (table->procedural) {
+            if (table->procedural->rowCount() > kMaxProceduralResponseRows) {
+                return grpc::Status(grpc::StatusCode::FAILED_PRECONDITION,
+                                    "table has " + std::to_string(table->procedural->rowCount()) +
+                                        " rows, too many for one response; read it with StreamData or StreamArrow");
+            }
+            *response = toByteBuffer(serializeProceduralDataResponse(*table));
+            get_data_rows_->observe(table->procedural->rowCount());
+            return grpc::Status::OK;
+        }
+        *response = toByteBuffer(
+            cache_.get(*table, ResponseCache::Kind::ProtoData, [&] { return serializeDataResponse(*table); }));
+        get_data_rows_->observe(table->rowCount());
+        return grpc::Status::OK;
+    }
+
+    grpc::Status GetColumnarData(grpc::ServerContext*,
+                                 const grpc::ByteBuffer* request_bytes,
+                                 grpc::ByteBuffer* response) {
+        tables::GetColumnarDataRequest request;
+        if (!parseRequest(*request_bytes, request)) {
+            return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, "malformed request");
+        }
+
+        auto table = db_.read(request.table_id());
+        if (!table) {
+            return grpc::Status(grpc::StatusCode::NOT_FOUND, "table not found");
+        }
+        if (table->procedural) {
+            return grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, std::string(kProceduralUnsupported));
+        }
+        if (request.row_offset() > table->rowCount()) {
+            return grpc::Status(grpc::StatusCode::OUT_OF_RANGE, "row_offset is past the last row");
+        }
+
+        const std::size_t begin = request.row_offset();
+        const std::size_t end = request.row_limit() && request.row_limit() < table->rowCount() - begin
+                                    ? begin + request.row_limit()
+                                    : table->rowCount();
+        auto build = [&] { return serializeColumnarData(*table, begin, end); };
+
+        // Only whole-table reads are shared enough to be worth caching.
+        if (begin == 0 && end == table->rowCount()) {
+            *response = toByteBuffer(cache_.get(*table, ResponseCache::Kind::ProtoColumnarData, build));
+        } else {
+            *response = toByteBuffer(std::make_shared<const std::string>(build()));
+        }
+        get_columnar_data_rows_->observe(end - begin);
+        return grpc::Status::OK;
+    }
+
+    grpc::Status UpdateCell(grpc::ServerContext*,
+                            const tables::UpdateCellRequest* request,
+                            tables::UpdateCellResponse* response) {
+        auto fail = [&](const std::string& error) {
+            response->set_ok(false);
+            response->set_error_message(error);
+            metrics_.recordUpdate(error);
+            return grpc::Status::OK;
+        };
+
+        auto table = db_.read(request->table_id());
+        if (!table) return fail("table not found");
+
+        const ColumnDef* column = findColumn(*table, request->column_id());
+        if (!column) return fail("column not found");
+
+        std::string parse_error;
+        auto value_opt = parseProtoValueForColumn(request->value(), *column, parse_error);
+        if (!value_opt.has_value()) return fail(parse_error);
+
+        std::string update_error;
+        if (!db_.updateCell(request->table_id(), request->row_id(), request->column_id(), value_opt.value(), update_error)) {
+            return fail(update_error);
+        }
+
+        response->set_ok(true);
+        metrics_.recordUpdate({});
+        return grpc::Status::OK;
+    }
+
+    grpc::Status BatchUpdateCells(grpc::ServerContext*,
+                                  const tables::BatchUpdateCellsRequest* request,
+                                  tables::BatchUpdateCellsResponse* response) {
+        const int count = request->updates_size();
+        auto* results = response->mutable_results();
+        results->Reserve(count);
+        for (int i = 0; i < count; ++i) {
+            results->Add()->set_ok(true);
+        }
+
+        auto fail = [&](int i, const std::string& error) {
+            auto& result = (*results)[i];
+            result.set_ok(false);
+            result.set_error_message(error);
+            metrics_.recordUpdate(error);
+        };
+
+        std::vector<CellEdit> edits;
+        edits.reserve(static_cast<std::size_t>(count));
+        bool parsed = true;
+        {
+            auto table = db_.read(request->table_id());
+            if (!table) {
+                for (int i = 0; i < count; ++i) fail(i, "table not found");
+                response->set_ok(false);
+                return grpc::Status::OK;
+            }
+
+            for (int i = 0; i < count; ++i) {
+                const auto& update = request->updates(i);
+                const ColumnDef* column = findColumn(*table, update.column_id());
+                if (!column) {
+                    fail(i, "column not found");
+                    parsed = false;
+                    continue;
+                }
+
+                std::string parse_error;
+                auto value_opt = parseProtoValueForColumn(update.value(), *column, parse_error);
+                if (!value_opt.has_value()) {
+                    fail(i, parse_error);
+                    parsed = false;
+                    continue;
+                }
+                edits.push_back({update.row_id(), update.column_id(), std::move(value_opt.value())});
+            }
+        }
+        if (!parsed) {
+            response->set_ok(false);
+            return grpc::Status::OK;
+        }
+
+        std::vector<std::string> errors;
+        const bool applied = db_.updateCells(request->table_id(), edits, errors);
+        response->set_ok(applied);
+        for (int i = 0; i < count; ++i) {
+            if (!errors[static_cast<std::size_t>(i)].empty()) fail(i, errors[static_cast<std::size_t>(i)]);
+            if (applied) metrics_.recordUpdate({});
+        }
+        return grpc::Status::OK;
+    }
+
+    grpc::Status GetRollups(grpc::ServerContext*,
+                            const tables::GetRollupsRequest* request,
+                            tables::GetRollupsResponse* response) {
+        auto table = db_.read(request->table_id());
+        if (!table) {
+            return grpc::Status(grpc::StatusCode::NOT_FOUND, "table not found");
+        }
+        if (table->procedural) {
+            return grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, std::string(kProceduralUnsupported));
+        }
+
+        auto targets = resolveRollupTargets(*table, request->row_ids(), request->column_ids());
+        if (!targets.error.empty()) {
+            return grpc::Status(targets.not_found ? grpc::StatusCode::NOT_FOUND : grpc::StatusCode::INVALID_ARGUMENT,
+                                targets.error);
+        }
+
+        response->set_version(table->version);
+        for (std::size_t slot : targets.rows) {
+            auto* row = response->add_rows();
+            const std::string_view id = table->rowId(slot);
+            row->set_row_id(id.data(), id.size());
+            for (std::size_t ordinal : targets.columns) {
+                const Aggregate& total = table->rollup(slot, ordinal);
+                auto* column = row->add_columns();
+                column->set_column_id(table->schema[ordinal].id);
+                column->set_sum(total.sum);
+                column->set_count(total.count);
+                if (!total.empty()) {
+                    column->set_min(total.min);
+                    column->set_max(total.max);
+                }
+            }
+        }
+        return grpc::Status::OK;
+    }
+
+    grpc::Status Query(grpc::ServerContext*,
+                       const tables::QueryRequest* request,
+                       tables::QueryResponse* response) {
+        auto table = db_.read(request->table_id());
+        if (!table) {
+            return grpc::Status(grpc::StatusCode::NOT_FOUND, "table not found");
+        }
+        if (table->procedural) {
+            return grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, std::string(kProceduralUnsupported));
+        }
+
+        QuerySpec spec;
+        spec.offset = request->offset();
+        spec.limit = request->limit();
+        for (const auto& proto_predicate : request->predicates()) {
+            auto ordinal = table->findColumnOrdinal(proto_predicate.column_id());
+            if (!ordinal) {
+                return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, "column not found: " + proto_predicate.column_id());
+            }
+            auto op = fromProtoPredicateOp(proto_predicate.op());
+            if (!op) {
+                return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, "unknown predicate op");
+            }
+            Predicate& predicate = spec.predicates.emplace_back();
+            predicate.ordinal = *ordinal;
+            predicate.op = *op;
+            if (predicate.op == PredicateOp::IsNull || predicate.op == PredicateOp::NotNull) continue;
+
+            std::string parse_error;
+            auto operand = parseProtoValueForColumn(proto_predicate.operand(), table->schema[*ordinal], parse_error);
+            if (!operand) {
+                return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, parse_error);
+            }
+            predicate.operand = std::move(*operand);
+        }
+        for (const auto& proto_key : request->sort()) {
+            auto ordinal = table->findColumnOrdinal(proto_key.column_id());
+            if (!ordinal) {
+                return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, "column not found: " + proto_key.column_id());
+            }
+            spec.sort.push_back({*ordinal, proto_key.descending()});
+        }
+        std::vector<std::size_t> projection;
+        for (const auto& column_id : request->column_ids()) {
+            auto ordinal = table->findColumnOrdinal(column_id);
+            if (!ordinal) {
+                return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, "column not found: " + column_id);
+            }
+            projection.push_back(*ordinal);
+        }
+
+        QueryResult result = runQuery(*table, spec);
+        if (!result.error.empty()) {
+            return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, result.error);
+        }
+
+        response->set_version(table->version);
+        response->set_match_count(result.match_count);
+        response->set_row_count(result.row_count);
+        response->mutable_rows()->Reserve(static_cast<int>(result.slots.size()));
+        for (std::uint32_t slot : result.slots) {
+            fillProtoRow(*table, slot, response->add_rows(), projection);
+        }
+        query_rows_->observe(result.slots.size());
+        for (bool matched : result.matched) {
+            response->add_matched(matched);
+        }
+        return grpc::Status::OK;
+    }
+
+    grpc::Status GetWindow(grpc::ServerContext*,
+                           const tables::GetWindowRequest* request,
+                           tables::GetWindowResponse* response) {
+        auto table = db_.read(request->table_id());
+        if (!table) {
+            return grpc::Status(grpc::StatusCode::NOT_FOUND, "table not found");
+        }
+        if (table->procedural) {
+            return grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, std::string(kProceduralUnsupported));
+        }
+
+        std::vector<std::size_t> projection;
+        for (const auto& column_id : request->column_ids()) {
+            auto ordinal = table->findColumnOrdinal(column_id);
+            if (!ordinal) {
+                return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, "column not found: " + column_id);
+            }
+            projection.push_back(*ordinal);
+        }
+        std::vector<std::uint32_t> expanded;
+        expanded.reserve(request->expanded_ids_size());
+        for (const auto& row_id : request->expanded_ids()) {
+            if (auto slot = table->findRow(row_id)) expanded.push_back(static_cast<std::uint32_t>(*slot));
+        }
+
+        const TreeWindow window = treeWindow(*table, std::move(expanded), request->offset(), request->limit());
+        response->set_version(table->version);
+        response->set_visible_count(window.visible_count);
+        response->mutable_rows()->Reserve(static_cast<int>(window.slots.size()));
+        for (std::size_t i = 0; i < window.slots.size(); ++i) {
+            const std::uint32_t slot = window.slots[i];
+            fillProtoRow(*table, slot, response->add_rows(), projection);
+            response->add_depths(window.depths[i]);
+            response->add_child_counts(static_cast<std::uint32_t>(table->children(slot).size()));
+        }
+        window_rows_->observe(window.slots.size());
+        return grpc::Status::OK;
+    }
+
+    grpc::Status Search(grpc::ServerContext*,
+                        const tables::SearchRequest* request,
+                        tables::SearchResponse* response) {
+        auto table = db_.read(request->table_id());
+        if (!table) {
+            return grpc::Status(grpc::StatusCode::NOT_FOUND, "table not found");
+        }
+        if (table->procedural) {
+            return grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, std::string(kProceduralUnsupported));
+        }
+
+        SearchSpec spec;
+        spec.text = request->text();
+        spec.prefix = request->prefix();
+        spec.limit = request->limit();
+        for (const auto& column_id : request->column_ids()) {
+            auto ordinal = table->findColumnOrdinal(column_id);
+            if (!ordinal) {
+                return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, "column not found: " + column_id);
+            }
+            spec.ordinals.push_back(*ordinal);
+        }
+
+        const SearchResult result = runSearch(*table, spec);
+        if (!result.error.empty()) {
+            return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, result.error);
+        }
+
+        response->set_version(table->version);
+        response->set_match_count(result.match_count);
+        response->mutable_hits()->Reserve(static_cast<int>(result.hits.size()));
+        for (const SearchHit& hit : result.hits) {
+            auto* proto = response->add_hits();
+            proto->set_row_id(std::string(table->rowId(hit.slot)));
+            proto->set_column_id(table->schema[hit.ordinal].id);
+            proto->set_value(std::string(table->columns[hit.ordinal].segment(hit.slot / kSegmentRows).string(hit.slot % kSegmentRows)));
+            proto->set_match(toProtoSearchMatch(hit.match));
+            for (std::uint32_t ancestor : ancestorSlots(*table, hit.slot)) {
+                proto->add_ancestor_ids(std::string(table->rowId(ancestor)));
+            }
+        }
+        search_rows_->observe(result.hits.size());
+        return grpc::Status::OK;
+    }
+
+    // Runs on the import worker once the client has sent all of the data.
+    grpc::Status ImportTable(const tables::TableSchema& schema,
+                             tables::ImportFormat format,
+                             std::string_view data,
+                             tables::ImportTableResponse* response) {
+        if (format != tables::IMPORT_FORMAT_CSV && format != tables::IMPORT_FORMAT_NDJSON) {
+            return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, "unknown import format");
+        }
+
+        Table table;
+        std::string error;
+        if (!fromProtoSchema(schema, table, error)) {
+            return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, error);
+        }
+        ImportStats stats;
+        if (!loadTable(table, format == tables::IMPORT_FORMAT_NDJSON ? ImportFormat::NdJson : ImportFormat::Csv, data,
+                       error, &stats)) {
+            return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, error);
+        }
+        if (!db_.putTable(std::move(table), error)) {
+            return grpc::Status(grpc::StatusCode::INTERNAL, "Import applied but not durable: " + error);
+        }
+        // Payloads of the old contents can never be served again.
+        cache_.erase(schema.table_id());
+
+        if (auto imported = db_.read(schema.table_id())) response->set_version(imported->version);
+        response->set_row_count(stats.rows);
+        response->set_seconds(stats.seconds);
+        response->set_rows_per_second(stats.rowsPerSecond());
+        response->set_peak_rss_bytes(stats.peak_rss_bytes);
+        return grpc::Status::OK;
+    }
+
+    grpc::Status CreateTable(grpc::ServerContext*,
+                             const tables::CreateTableRequest* request,
+                             tables::CreateTableResponse* response) {
+        Table table;
+        std::string error;
+        if (!fromProtoSchema(request->schema(), table, error)) {
+            return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, error);
+        }
+        const CatalogStatus status = db_.createTable(std::move(table), error);
+        if (status != CatalogStatus::Ok) return catalogError(status, error);
+        if (auto created = db_.read(request->schema().table_id())) response->set_version(created->version);
+        return grpc::Status::OK;
+    }
+
+    grpc::Status DropTable(grpc::ServerContext*,
+                           const tables::DropTableRequest* request,
+                           tables::DropTableResponse*) {
+        std::string error;
+        const CatalogStatus status = db_.dropTable(request->table_id(), error);
+        // Its payloads can never be served again.
+        cache_.erase(request->table_id());
+        return status == CatalogStatus::Ok ? grpc::Status::OK : catalogError(status, error);
+    }
+
+    grpc::Status AlterSchema(grpc::ServerContext*,
+                             const tables::AlterSchemaRequest* request,
+                             tables::AlterSchemaResponse* response) {
+        std::vector<ColumnDef> columns;
+        columns.reserve(request->columns_size());
+        for (const auto& proto_column : request->columns()) {
+            auto column = fromProtoColumnDef(proto_column);
+            if (!column) {
+                return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, "Unknown type of column " + proto_column.id());
+            }
+            columns.push_back(std::move(*column));
+        }
+        std::string error;
+        const CatalogStatus status = db_.alterSchema(request->table_id(), std::move(columns), error);
+        if (status != CatalogStatus::Ok) return catalogError(status, error);
+        cache_.erase(request->table_id());
+        if (auto altered = db_.read(request->table_id())) response->set_version(altered->version);
+        return grpc::Status::OK;
+    }
+
+    DataStore& db() { return db_; }
+    Histogram& streamDataRows() { return *stream_data_rows_; }
+    Histogram& streamArrowRows() { return *stream_arrow_rows_; }
+
+private:
+    template <typename Message>
+    static bool parseRequest(const grpc::ByteBuffer& bytes, Message& message) {
+        grpc::ByteBuffer copy(bytes);  // shares the slices; deserializing consumes the buffer
+        return grpc::SerializationTraits<Message>::Deserialize(&copy, &message).ok();
+    }
+
+    // Wraps a cached payload in a one-slice buffer that keeps the payload
+    // alive until gRPC has sent it.
+    static grpc::ByteBuffer toByteBuffer(ResponseCache::Payload payload) {
+        auto* owner = new ResponseCache::Payload(std::move(payload));
+        grpc::Slice slice(const_cast<char*>((*owner)->data()), (*owner)->size(),
+                          [](void* user_data) { delete static_cast<ResponseCache::Payload*>(user_data); }, owner);
+        return grpc::ByteBuffer(&slice, 1);
+    }
+
+    static grpc::ByteBuffer toByteBuffer(std::string bytes) {
+        return toByteBuffer(std::make_shared<const std::string>(std::move(bytes)));
+    }
+
+    DataStore& db_;
+    ResponseCache& cache_;
+    Metrics& metrics_;
+    Histogram* get_data_rows_ = nullptr;
+    Histogram* get_columnar_data_rows_ = nullptr;
+    Histogram* stream_data_rows_ = nullptr;
+    Histogram* stream_arrow_rows_ = nullptr;
+    Histogram* query_rows_ = nullptr;
+    Histogram* window_rows_ = nullptr;
+    Histogram* search_rows_ = nullptr;
+};
+
+// Runs call handlers that may block off the completion-queue threads. A
+// job resumes its call through an alarm, so the workers must stop while the
+// queues still poll; jobs that have not started by then are cancelled
+// instead of run.
+class CallWorkers {
+public:
+    using Job = std::function<void(bool cancelled)>;
+
+    explicit CallWorkers(std::size_t threads) {
+        for (std::size_t i = 0; i < threads; ++i) threads_.emplace_back([this] { run(); });
+    }
+
+    // Finishes the jobs in progress and cancels the queued ones.
+    ~CallWorkers() {
+        stop_.request_stop();
+        for (std::thread& thread : threads_) thread.join();
+    }
+
+    CallWorkers(const CallWorkers&) = delete;
+    CallWorkers& operator=(const CallWorkers&) = delete;
+
+    void post(Job job) {
+        {
+            std::lock_guard lock(mutex_);
+            if (!stopped_) {
+                jobs_.push_back(std::move(job));
+                wake_.notify_one();
+                return;
+            }
+        }
+        job(true);
+    }
+
+private:
+    void run() {
+        const std::stop_token stop = stop_.get_token();
+        std::unique_lock lock(mutex_);
+        while (wake_.wait(lock, stop, [this] { return !jobs_.empty(); }) && !stop.stop_requested()) {
+            Job job = std::move(jobs_.front());
+            jobs_.pop_front();
+            lock.unlock();
+            job(false);
+            lock.lock();
+        }
+        stopped_ = true;
+        std::deque<Job> cancelled;
+        cancelled.swap(jobs_);
+        lock.unlock();
+        for (Job& job : cancelled) job(true);
+    }
+
+    std::mutex mutex_;
+    std::condition_variable_any wake_;
+    std::deque<Job> jobs_;
+    bool stopped_ = false;
+    std::stop_source stop_;
+    std::vector<std::thread> threads_;  // last member: start after everything they use
+};
+
+namespace {
+
+
+// A completion-queue tag. Each call owns one tag per kind of operation it
+// starts; the queue thread that dequeues a tag runs its handler.
+struct Tag {
+    std::function<void(bool ok)> on_complete;
+};
+
+// What a call needs to arm itself on one queue.
+struct CallContext {
+    TableAsyncService* service;
+    TableServiceImpl* handlers;
+    grpc::ServerCompletionQueue* cq;
+    CallWorkers* imports;
+    CallWorkers* writes;  // null without a write-ahead log: writes then run inline
+    std::size_t max_import_bytes;
+};
+
+template <typename Request, typename Response>
+using UnaryRequestMethod = void (TableAsyncService::*)(grpc::ServerContext*, Request*,
+                                                   grpc::ServerAsyncResponseWriter<Response>*,
+                                                   grpc::CompletionQueue*, grpc::ServerCompletionQueue*, void*);
+
+template <typename Request, typename Response>
+using UnaryHandler = grpc::Status (TableServiceImpl::*)(grpc::ServerContext*, const Request*, Response*);
+
+// One unary call: waits for a request, arms its successor, runs the handler
+// and deletes itself once the response is sent. The handler runs on the
+// queue thread, or, when it may block, on a worker that wakes the call
+// through a zero-deadline alarm so the response is sent from a queue thread.
+template <typename Request, typename Response>
+class UnaryCall {
+public:
+    static void arm(const CallContext& ctx, UnaryRequestMethod<Request, Response> request,
+                    UnaryHandler<Request, Response> handler, CallWorkers* workers) {
+        new UnaryCall(ctx, request, handler, workers);
+    }
+
+private:
+    UnaryCall(const CallContext& ctx, UnaryRequestMethod<Request, Response> request,
+              UnaryHandler<Request, Response> handler, CallWorkers* workers)
+        : ctx_(ctx),
+          request_method_(request),
+          handler_(handler),
+          workers_(workers),
+          responder_(&context_) {
+        tag_.on_complete = [this](bool ok) { proceed(ok); };
+        (ctx_.service->*request_method_)(&context_, &request_, &responder_, ctx_.cq, ctx_.cq, &tag_);
+    }
+
+    void proceed(bool ok) {
+        // !ok on the request means the server is shutting down.
+        if (!ok || finished_) {
+            delete this;
+            return;
+        }
+        if (started_) {
+            reply();  // woken by the worker
+            return;
+        }
+
+        started_ = true;
+        arm(ctx_, request_method_, handler_, workers_);
+        if (!workers_) {
+            status_ = (ctx_.handlers->*handler_)(&context_, &request_, &response_);
+            reply();
+            return;
+        }
+        // The alarm orders the worker's writes before reply() reads them.
+        alarm_.emplace();
+        workers_->post([this](bool cancelled) {
+            status_ = cancelled ? grpc::Status(grpc::StatusCode::UNAVAILABLE, "server is shutting down")
+                                : (ctx_.handlers->*handler_)(&context_, &request_, &response_);
+            alarm_->Set(ctx_.cq, std::chrono::system_clock::now(), &tag_);
+        });
+    }
+
+    void reply() {
+        finished_ = true;
+        responder_.Finish(response_, status_, &tag_);
+    }
+
+    const CallContext ctx_;
+    const UnaryRequestMethod<Request, Response> request_method_;
+    const UnaryHandler<Request, Response> handler_;
+    CallWorkers* const workers_;
+    grpc::ServerContext context_;
+    Request request_;
+    Response response_;
+    grpc::ServerAsyncResponseWriter<Response> responder_;
+    std::optional<grpc::Alarm> alarm_;  // only for handlers run by a worker
+    Tag tag_;
+    grpc::Status status_;
+    bool started_ = false;
+    bool finished_ = false;
+};
+
+// workers: where a handler that may block runs; null runs it inline.
+template <typename Request, typename Response>
+void armUnary(const CallContext& ctx, std::type_identity_t<UnaryRequestMethod<Request, Response>> request,
+              UnaryHandler<Request, Response> handler, CallWorkers* workers = nullptr) {
+    UnaryCall<Request, Response>::arm(ctx, request, handler, workers);
+}
+
+// StreamData: one batch in flight at a time. A write completes only once
+// the transport has taken the batch, so a slow reader throttles batch
+// production without holding a thread.
+class StreamCall {
+public:
+    static void arm(const CallContext& ctx) { new StreamCall(ctx); }
+
+private:
+    explicit StreamCall(const CallContext& ctx)
+        : ctx_(ctx),
+          writer_(&context_) {
+        tag_.on_complete = [this](bool ok) { proceed(ok); };
+        ctx_.service->RequestStreamData(&context_, &request_, &writer_, ctx_.cq, ctx_.cq, &tag_);
+    }
+
+    void proceed(bool ok) {
+        // A failed write means the client went away; nothing more can be
+        // sent, so there is nothing to finish.
+        if (!ok || finished_) {
+            delete this;
+            return;
+        }
+
+        if (!table_) {
+            arm(ctx_);
+            start();
+            return;
+        }
+        writeBatch();
+    }
+
+    void start() {
+        // Hold the version by reference count rather than an epoch pin: the
+        // stream can last as long as the client keeps reading.
+        table_ = ctx_.handlers->db().read(request_.table_id()).share();
+        if (!table_) {
+            finish(grpc::Status(grpc::StatusCode::NOT_FOUND, "table not found"));
+            return;
+        }
+
+        rows_ = table_->procedural ? table_->procedural->rowCount() : table_->rowCount();
+        auto start = parseCursor(request_.cursor());
+        if (!start.has_value() || *start > rows_) {
+            finish(grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, "invalid cursor"));
+            return;
+        }
+
+        slot_ = *start;
+        first_slot_ = *start;
+        max_rows_ = request_.max_rows_per_batch() ? request_.max_rows_per_batch() : kDefaultBatchRows;
+        max_rows_ = std::min(max_rows_, kMaxBatchRows);
+        max_bytes_ = request_.max_bytes_per_batch();
+        writeBatch();
+    }
+
+    void writeBatch() {
+        // The last batch, possibly empty, is written together with the status.
+        batch_.Clear();
+        batch_.set_version(table_->version);
+        // A procedural table is materialized one batch at a time.
+        const std::size_t first = slot_;
+        const std::shared_ptr<const Table> chunk =
+            table_->procedural ? table_->procedural->rows(*table_, first, std::min(rows_, first + max_rows_)) : table_;
+        const std::size_t base = table_->procedural ? first : 0;
+        std::size_t bytes = 0;
+        while (slot_ < rows_ && static_cast<std::size_t>(batch_.rows_size()) < max_rows_) {
+            auto* proto_row = batch_.add_rows();
+            fillProtoRow(*chunk, slot_++ - base, proto_row);
+            // Always send at least one row so an oversized row cannot stall the stream.
+            bytes += proto_row->ByteSizeLong();
+            if (max_bytes_ && bytes >= max_bytes_) break;
+        }
+
+        if (slot_ < rows_) {
+            batch_.set_next_cursor(std::to_string(slot_));
+            writer_.Write(batch_, &tag_);
+        } else {
+            finished_ = true;
+            ctx_.handlers->streamDataRows().observe(slot_ - first_slot_);
+            writer_.WriteAndFinish(batch_, grpc::WriteOptions(), grpc::Status::OK, &tag_);
+        }
+    }
+
+    void finish(const grpc::Status& status) {
+        finished_ = true;
+        writer_.Finish(status, &tag_);
+    }
+
+    const CallContext ctx_;
+    grpc::ServerContext context_;
+    tables::StreamDataRequest request_;
+    grpc::ServerAsyncWriter<tables::DataBatch> writer_;
+    Tag tag_;
+
+    std::shared_ptr<const Table> table_;
+    tables::DataBatch batch_;
+    std::size_t rows_ = 0;
+    std::size_t slot_ = 0;
+    std::size_t first_slot_ = 0;
+    std::size_t max_rows_ = 0;
+    std::size_t max_bytes_ = 0;
+    bool finished_ = false;
+};
+
+// StreamArrow: like StreamData, one Arrow IPC piece in flight at a time.
+class ArrowCall {
+public:
+    // Keeps a batch of a typical table well under the 4 MiB a gRPC client
+    // accepts by default.
+    static constexpr std::size_t kDefaultBatchRows = kSegmentRows;
+
+    static void arm(const CallContext& ctx) { new ArrowCall(ctx); }
+
+private:
+    explicit ArrowCall(const CallContext& ctx)
+        : ctx_(ctx),
+          writer_(&context_) {
+        tag_.on_complete = [this](bool ok) { proceed(ok); };
+        ctx_.service->RequestStreamArrow(&context_, &request_, &writer_, ctx_.cq, ctx_.cq, &tag_);
+    }
+
+    void proceed(bool ok) {
+        if (!ok || finished_) {
+            delete this;
+            return;
+        }
+
+        if (!arrow_) {
+            arm(ctx_);
+            start();
+            return;
+        }
+        writePiece();
+    }
+
+    void start() {
+        auto table = ctx_.handlers->db().read(request_.table_id()).share();
+        if (!table) {
+            finished_ = true;
+            writer_.Finish(grpc::Status(grpc::StatusCode::NOT_FOUND, "table not found"), &tag_);
+            return;
+        }
+        const std::size_t batch_rows = std::min<std::size_t>(
+            request_.max_rows_per_batch() ? request_.max_rows_per_batch() : kDefaultBatchRows, kMaxBatchRows);
+        message_.set_version(table->version);
+        arrow_.emplace(std::move(table), request_.file_format() ? ArrowFormat::File : ArrowFormat::Stream, batch_rows);
+        writePiece();
+    }
+
+    void writePiece() {
+        // The last piece is written together with the status.
+        message_.mutable_data()->clear();
+        arrow_->next(*message_.mutable_data());
+        if (!arrow_->done()) {
+            writer_.Write(message_, &tag_);
+        } else {
+            finished_ = true;
+            ctx_.handlers->streamArrowRows().observe(arrow_->rowsWritten());
+            writer_.WriteAndFinish(message_, grpc::WriteOptions(), grpc::Status::OK, &tag_);
+        }
+    }
+
+    const CallContext ctx_;
+    grpc::ServerContext context_;
+    tables::StreamArrowRequest request_;
+    grpc::ServerAsyncWriter<tables::ArrowData> writer_;
+    Tag tag_;
+
+    std::optional<ArrowWriter> arrow_;
+    tables::ArrowData message_;
+    bool finished_ = false;
+};
+
+// ImportTable: reads every request message, appending the data pieces,
+// then hands the import to the import worker, which may take seconds over a
+// large input. The worker wakes the call through a zero-deadline alarm, and
+// the one response is sent from a queue thread.
+//
+// A read also fails when the client cancels or disconnects; the data is then
+// cut short and must not be imported. The done tag tells the two apart, so
+// the call lives until both it and the last operation have completed.
+class ImportCall {
+public:
+    static void arm(const CallContext& ctx) { new ImportCall(ctx); }
+
+private:
+    explicit ImportCall(const CallContext& ctx)
+        : ctx_(ctx),
+          reader_(&context_) {
+        tag_.on_complete = [this](bool ok) { proceed(ok); };
+        done_.on_complete = [this](bool) {
+            cancelled_ = context_.IsCancelled();
+            release();
+        };
+        // Only delivered once the request has been matched.
+        context_.AsyncNotifyWhenDone(&done_);
+        ctx_.service->RequestImportTable(&context_, &reader_, ctx_.cq, ctx_.cq, &tag_);
+    }
+
+    void proceed(bool ok) {
+        switch (state_) {
+        case State::Requested:
+            if (!ok) {
+                delete this;
+                return;
+            }
+            arm(ctx_);
+            state_ = State::Reading;
+            reader_.Read(&request_, &tag_);
+            return;
+        case State::Reading:
+            if (ok) {
+                receive();
+                return;
+            }
+            if (cancelled_) {
+                fail(grpc::Status(grpc::StatusCode::CANCELLED, "the client cancelled the import"));
+                return;
+            }
+            // The client half-closed: everything has arrived.
+            finish();
+            return;
+        case State::Importing:
+            reply();
+            return;
+        case State::Finished:
+            release();
+            return;
+        }
+    }
+
+    // Deletes the call once the done tag and the last operation are back.
+    void release() {
+        if (--pending_ == 0) delete this;
+    }
+
+    void fail(const grpc::Status& status) {
+        state_ = State::Finished;
+        std::string().swap(data_);
+        reader_.FinishWithError(status, &tag_);
+    }
+
+    void receive() {
+        if (first_) {
+            first_ = false;
+            if (!request_.has_schema() || request_.schema().table_id().empty()) {
+                fail(grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, "the first message must carry the schema"));
+                return;
+            }
+            schema_ = std::move(*request_.mutable_schema());
+            format_ = request_.format();
+        }
+        if (ctx_.max_import_bytes && request_.data().size() > ctx_.max_import_bytes - data_.size()) {
+            fail(grpc::Status(grpc::StatusCode::RESOURCE_EXHAUSTED,
+                              "import data exceeds " + std::to_string(ctx_.max_import_bytes) + " bytes"));
+            return;
+        }
+        data_.append(request_.data());
+        request_.Clear();
+        reader_.Read(&request_, &tag_);
+    }
+
+    void finish() {
+        if (first_) {
+            fail(grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, "no request received"));
+            return;
+        }
+        state_ = State::Importing;
+        // The alarm orders the worker's writes before reply() reads them.
+        ctx_.imports->post([this](bool cancelled) {
+            // The client may have gone away while the import was queued.
+            if (cancelled) {
+                status_ = grpc::Status(grpc::StatusCode::UNAVAILABLE, "server is shutting down");
+            } else if (cancelled_) {
+                status_ = grpc::Status(grpc::StatusCode::CANCELLED, "the client cancelled the import");
+            } else {
+                status_ = ctx_.handlers->ImportTable(schema_, format_, data_, &response_);
+            }
+            std::string().swap(data_);
+            alarm_.Set(ctx_.cq, std::chrono::system_clock::now(), &tag_);
+        });
+    }
+
+    void reply() {
+        state_ = State::Finished;
+        if (status_.ok()) {
+            reader_.Finish(response_, status_, &tag_);
+        } else {
+            reader_.FinishWithError(status_, &tag_);
+        }
+    }
+
+    enum class State { Requested, Reading, Importing, Finished };
+
+    const CallContext ctx_;
+    grpc::ServerContext context_;
+    grpc::ServerAsyncReader<tables::ImportTableResponse, tables::ImportTableRequest> reader_;
+    grpc::Alarm alarm_;
+    Tag tag_;
+    Tag done_;
+    State state_ = State::Requested;
+    std::atomic<int> pending_{2};  // the done tag and the last operation
+    std::atomic<bool> cancelled_{false};
+
+    tables::ImportTableRequest request_;
+    bool first_ = true;
+    tables::TableSchema schema_;
+    tables::ImportFormat format_ = tables::IMPORT_FORMAT_CSV;
+    std::string data_;
+    grpc::Status status_;
+    tables::ImportTableResponse response_;
+};
+
+// WatchTable: a change-feed subscription forwarded to the client. The feed
+// wakes the call through a zero-deadline alarm so that every write is
+// started from a queue thread; the writer that published never blocks on
+// the network.
+//
+// The call may receive events concurrently (write done, alarm, done) from
+// the queue's threads and the feed, so its state lives under one mutex that
+// the feed callback shares. The callback outlives the call only as a
+// pointer that teardown clears.
+class WatchCall {
+public:
+    static void arm(const CallContext& ctx) { new WatchCall(ctx); }
+
+private:
+    struct Shared {
+        std::mutex mutex;
+        WatchCall* call = nullptr;
+    };
+
+    explicit WatchCall(const CallContext& ctx)
+        : ctx_(ctx),
+          writer_(&context_),
+          shared_(std::make_shared<Shared>()) {
+        requested_.on_complete = [this](bool ok) { onRequested(ok); };
+        written_.on_complete = [this](bool ok) { onWritten(ok); };
+        woken_.on_complete = [this](bool ok) { onWoken(ok); };
+        finished_.on_complete = [this](bool) { release(); };
+        done_.on_complete = [this](bool) { onDone(); };
+        // Only delivered once the request has been matched.
+        context_.AsyncNotifyWhenDone(&done_);
+        ctx_.service->RequestWatchTable(&context_, &request_, &writer_, ctx_.cq, ctx_.cq, &requested_);
+    }
+
+    void onRequested(bool ok) {
+        if (!ok) {
+            delete this;
+            return;
+        }
+        arm(ctx_);
+
+        DataStore& db = ctx_.handlers->db();
+        std::unique_lock lock(shared_->mutex);
+        pending_ = 1;  // the done tag
+        if (!db.read(request_.table_id())) {
+            ++pending_;
+            writer_.Finish(grpc::Status(grpc::StatusCode::NOT_FOUND, "table not found"), &finished_);
+            return;
+        }
+
+        // Subscribe before reading the baseline version so no edit can fall
+        // between the two.
+        shared_->call = this;
+        subscription_ = db.changes().subscribe(request_.table_id(), [shared = shared_] {
+            std::lock_guard lock(shared->mutex);
+            if (shared->call) shared->call->wakeLocked();
+        });
+        {
+            auto table = db.read(request_.table_id());
+            baseline_ = table ? table->version : 0;
+        }
+        message_.set_version(baseline_);
+        write();
+    }
+
+    // Called with the mutex held.
+    void wakeLocked() {
+        if (wake_pending_ || done_seen_) return;
+        wake_pending_ = true;
+        ++pending_;
+        alarm_.Set(ctx_.cq, std::chrono::system_clock::now(), &woken_);
+    }
+
+    void onWoken(bool ok) {
+        std::unique_lock lock(shared_->mutex);
+        wake_pending_ = false;
+        if (ok && !writing_ && !broken_ && !done_seen_) sendPending();
+        settle(lock);
+    }
+
+    void onWritten(bool ok) {
+        std::unique_lock lock(shared_->mutex);
+        writing_ = false;
+        if (!ok) {
+            broken_ = true;  // the done tag follows
+        } else if (!done_seen_) {
+            sendPending();
+        }
+        settle(lock);
+    }
+
+    void onDone() {
+        std::shared_ptr<Subscription> subscription;
+        {
+            std::lock_guard lock(shared_->mutex);
+            done_seen_ = true;
+            shared_->call = nullptr;
+            subscription = std::move(subscription_);
+            if (wake_pending_) alarm_.Cancel();
+        }
+        if (subscription) ctx_.handlers->db().changes().unsubscribe(subscription);
+        release();
+    }
+
+    void release() {
+        std::unique_lock lock(shared_->mutex);
+        settle(lock);
+    }
+
+    // Drops one pending event and deletes the call after the last one.
+    void settle(std::unique_lock<std::mutex>& lock) {
+        if (--pending_ != 0) return;
+        lock.unlock();
+        delete this;
+    }
+
+    // Called with the mutex held and no write in flight.
+    void sendPending() {
+        auto batch = subscription_->drain();
+        message_.Clear();
+        message_.set_version(batch.version);
+        message_.set_resync_required(batch.resync_required);
+        for (const auto& delta : batch.deltas) {
+            if (delta.version <= baseline_) continue;
+            auto* proto_delta = message_.add_deltas();
+            proto_delta->set_row_id(delta.row_id);
+            proto_delta->set_column_id(delta.column_id);
+            proto_delta->set_version(delta.version);
+            std::visit(ProtoCellVisitor{proto_delta->mutable_value()}, delta.value);
+        }
+        if (message_.deltas_size() == 0 && !batch.resync_required) return;
+        write();
+    }
+
+    void write() {
+        writing_ = true;
+        ++pending_;
+        writer_.Write(message_, &written_);
+    }
+
+    const CallContext ctx_;
+    grpc::ServerContext context_;
+    tables::WatchTableRequest request_;
+    grpc::ServerAsyncWriter<tables::TableChanges> writer_;
+    grpc::Alarm alarm_;
+    Tag requested_;
+    Tag written_;
+    Tag woken_;
+    Tag finished_;
+    Tag done_;
+
+    const std::shared_ptr<Shared> shared_;
+    std::shared_ptr<Subscription> subscription_;
+    tables::TableChanges message_;
+    std::uint64_t baseline_ = 0;
+    unsigned pending_ = 0;  // outstanding queue events
+    bool writing_ = false;
+    bool wake_pending_ = false;
+    bool broken_ = false;
+    bool done_seen_ = false;
+};
+
+void armAll(const CallContext& ctx) {
+    armUnary(ctx, &TableAsyncService::RequestListTables, &TableServiceImpl::ListTables);
+    armUnary(ctx, &TableAsyncService::RequestGetSchema, &TableServiceImpl::GetSchema);
+    armUnary(ctx, &TableAsyncService::RequestGetData, &TableServiceImpl::GetData);
+    armUnary(ctx, &TableAsyncService::RequestGetColumnarData, &TableServiceImpl::GetColumnarData);
+    // With a write-ahead log, writes wait for it to sync, and catalog
+    // changes also write a table image.
+    armUnary(ctx, &TableAsyncService::RequestUpdateCell, &TableServiceImpl::UpdateCell, ctx.writes);
+    armUnary(ctx, &TableAsyncService::RequestBatchUpdateCells, &TableServiceImpl::BatchUpdateCells, ctx.writes);
+    armUnary(ctx, &TableAsyncService::RequestGetRollups, &TableServiceImpl::GetRollups);
+    armUnary(ctx, &TableAsyncService::RequestQuery, &TableServiceImpl::Query);
+    armUnary(ctx, &TableAsyncService::RequestGetWindow, &TableServiceImpl::GetWindow);
+    armUnary(ctx, &TableAsyncService::RequestSearch, &TableServiceImpl::Search);
+    armUnary(ctx, &TableAsyncService::RequestCreateTable, &TableServiceImpl::CreateTable, ctx.writes);
+    armUnary(ctx, &TableAsyncService::RequestDropTable, &TableServiceImpl::DropTable, ctx.writes);
+    armUnary(ctx, &TableAsyncService::RequestAlterSchema, &TableServiceImpl::AlterSchema, ctx.writes);
+    StreamCall::arm(ctx);
+    ArrowCall::arm(ctx);
+    WatchCall::arm(ctx);
+    ImportCall::arm(ctx);
+}
+
+// Times every call from its arrival until its status is sent, and counts
+// the response bytes. The raw methods hand over bytes that are already
+// serialized; other responses are serialized here rather than a moment
+// later by the transport.
+class MetricsInterceptor final : public grpc::experimental::Interceptor {
+public:
+    explicit MetricsInterceptor(RequestMetrics& metrics)
+        : metrics_(metrics),
+          started_(std::chrono::steady_clock::now()) {}
+
+    void Intercept(grpc::experimental::InterceptorBatchMethods* methods) override {
+        using grpc::experimental::InterceptionHookPoints;
+        if (methods->QueryInterceptionHookPoint(InterceptionHookPoints::PRE_SEND_MESSAGE)) {
+            if (const grpc::ByteBuffer* message = methods->GetSerializedSendMessage()) bytes_ += message->Length();
+        }
+        if (methods->QueryInterceptionHookPoint(InterceptionHookPoints::PRE_SEND_STATUS)) {
+            metrics_.finish(static_cast<std::size_t>(methods->GetSendStatus().error_code()),
+                            std::chrono::steady_clock::now() - started_, bytes_);
+        }
+        methods->Proceed();
+    }
+
+private:
+    RequestMetrics& metrics_;
+    const std::chrono::steady_clock::time_point started_;
+    std::size_t bytes_ = 0;
+};
+
+class MetricsInterceptorFactory final : public grpc::experimental::ServerInterceptorFactoryInterface {
+public:
+    explicit MetricsInterceptorFactory(const Metrics& metrics)
+        : metrics_(metrics) {}
+
+    grpc::experimental::Interceptor* CreateServerInterceptor(grpc::experimental::ServerRpcInfo* info) override {
+        std::string_view method = info->method();  // "/tables.TableService/GetData"
+        method.remove_prefix(method.rfind('/') + 1);
+        RequestMetrics* metrics = metrics_.rpc(method);
+        return metrics ? new MetricsInterceptor(*metrics) : nullptr;
+    }
+
+private:
+    const Metrics& metrics_;
+};
+
+}  // namespace
+
+AsyncTableServer::AsyncTableServer(DataStore& db, ResponseCache& cache, Metrics& metrics, GrpcServerOptions options)
+    : options_(std::move(options)),
+      metrics_(metrics),
+      handlers_(std::make_unique<TableServiceImpl>(db, cache, metrics)) {
+    if (options_.completion_queues == 0) {
+        options_.completion_queues = std::max(1u, std::thread::hardware_concurrency());
+    }
+    options_.threads_per_queue = std::max<std::size_t>(options_.threads_per_queue, 1);
+}
+
+AsyncTableServer::~AsyncTableServer() {
+    shutdown();
+}
+
+bool AsyncTableServer::start() {
+    grpc::ServerBuilder builder;
+    builder.AddListeningPort(options_.address, grpc::InsecureServerCredentials());
+    if (!options_.unix_socket.empty()) {
+        builder.AddListeningPort("unix:" + options_.unix_socket, grpc::InsecureServerCredentials());
+    }
+    builder.RegisterService(&service_);
+
+    grpc::ResourceQuota quota("table_service");
+    if (options_.memory_quota_bytes > 0) quota.Resize(static_cast<std::size_t>(options_.memory_quota_bytes));
+    builder.SetResourceQuota(quota);
+
+    std::vector<std::unique_ptr<grpc::experimental::ServerInterceptorFactoryInterface>> interceptors;
+    interceptors.push_back(std::make_unique<MetricsInterceptorFactory>(metrics_));
+    builder.experimental().SetInterceptorCreators(std::move(interceptors));
+
+    for (std::size_t i = 0; i < options_.completion_queues; ++i) {
+        queues_.push_back(builder.AddCompletionQueue());
+    }
+
+    server_ = builder.BuildAndStart();
+    if (!server_) return false;
+    // One import at a time: the loader already spreads each import over
+    // every core. Writers waiting on the log share its syncs, so they get a
+    // thread each.
+    imports_ = std::make_unique<CallWorkers>(1);
+    if (handlers_->db().durable()) {
+        writes_ = std::make_unique<CallWorkers>(std::max<std::size_t>(4, std::thread::hardware_concurrency()));
+    }
+
+    const unsigned cpus = std::max(1u, std::thread::hardware_concurrency());
+    for (std::size_t q = 0; q < queues_.size(); ++q) {
+        grpc::ServerCompletionQueue* cq = queues_[q].get();
+        armAll({&service_, handlers_.get(), cq, imports_.get(), writes_.get(), options_.max_import_bytes});
+        for (std::size_t t = 0; t < options_.threads_per_queue; ++t) {
+            threads_.emplace_back([this, cq] { poll(cq); });
+            if (!options_.pin_threads) continue;
+
+            cpu_set_t cpu_set;
+            CPU_ZERO(&cpu_set);
+            CPU_SET(q % cpus, &cpu_set);
+            if (int err = pthread_setaffinity_np(threads_.back().native_handle(), sizeof(cpu_set), &cpu_set)) {
+                std::cerr << "Failed to pin gRPC queue " << q << " to CPU " << q % cpus << " (error " << err << ")" << std::endl;
+            }
+        }
+    }
+    return true;
+}
+
+void AsyncTableServer::shutdown() {
+    if (!server_) return;
+
+    // Watch streams never end on their own; the deadline cancels them.
+    server_->Shutdown(std::chrono::system_clock::now() + std::chrono::seconds(1));
+    // Before the queues shut down: the jobs in flight wake their calls
+    // through an alarm on one of them.
+    imports_.reset();
+    writes_.reset();
+    for (auto& cq : queues_) cq->Shutdown();
+    for (auto& thread : threads_) thread.join();
+    threads_.clear();
+    queues_.clear();
+    server_.reset();
+}
+
+void AsyncTableServer::poll(grpc::ServerCompletionQueue* cq) {
+    void* tag = nullptr;
+    bool ok = false;
+    while (cq->Next(&tag, &ok)) {
+        static_cast<Tag*>(tag)->on_complete(ok);
+    }
+}
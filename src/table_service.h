@@ -0,0 +1,88 @@
+#pragma once
+
+#include "data_store.h"
+#include "table.grpc.pb.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <grpcpp/grpcpp.h>
+
+struct GrpcServerOptions {
+    std::string address = "0.0.0.0:50051";
+    std::string unix_socket;            // also listen on this socket path when set
+    std::size_t completion_queues = 0;  // 0: one per hardware thread
+    std::size_t threads_per_queue = 1;
+    bool pin_threads = false;           // pin the threads of queue i to CPU i
+    std::int64_t memory_quota_bytes = 0;  // 0: unlimited
+    std::size_t max_import_bytes = std::size_t{1} << 30;  // data of one ImportTable call; 0: unlimited
+};
+
+class CallWorkers;
+class Metrics;
+class ResponseCache;
+class TableServiceImpl;
+
+// Every RPC must appear here exactly once: a method left out would be served
+// by the synchronous base class. The whole-table reads are raw so cached
+// response bytes can be sent as they are.
+using TableAsyncService =
+    tables::TableService::WithAsyncMethod_ListTables<
+    tables::TableService::WithRawMethod_GetSchema<
+    tables::TableService::WithRawMethod_GetData<
+    tables::TableService::WithRawMethod_GetColumnarData<
+    tables::TableService::WithAsyncMethod_StreamData<
+    tables::TableService::WithAsyncMethod_StreamArrow<
+    tables::TableService::WithAsyncMethod_UpdateCell<
+    tables::TableService::WithAsyncMethod_BatchUpdateCells<
+    tables::TableService::WithAsyncMethod_GetRollups<
+    tables::TableService::WithAsyncMethod_Query<
+    tables::TableService::WithAsyncMethod_GetWindow<
+    tables::TableService::WithAsyncMethod_Search<
+    tables::TableService::WithAsyncMethod_WatchTable<
+    tables::TableService::WithAsyncMethod_ImportTable<
+    tables::TableService::WithAsyncMethod_CreateTable<
+    tables::TableService::WithAsyncMethod_DropTable<
+    tables::TableService::WithAsyncMethod_AlterSchema<
+    tables::TableService::Service>>>>>>>>>>>>>>>>>;
+
+// Serves tables::TableService on the async completion-queue API. Every queue
+// is polled by its own threads, and each call is a small state machine driven
+// by queue events, so an open stream holds memory but never a thread.
+class AsyncTableServer {
+public:
+    // Registers every TableService method with metrics; calls are timed by
+    // a server interceptor.
+    AsyncTableServer(DataStore& db, ResponseCache& cache, Metrics& metrics, GrpcServerOptions options);
+    ~AsyncTableServer();
+
+    AsyncTableServer(const AsyncTableServer&) = delete;
+    AsyncTableServer& operator=(const AsyncTableServer&) = delete;
+
+    bool start();
+
+    // Cancels open calls, waits for the import and the writes in progress,
+    // then drains and joins the queue threads. The data store must no longer
+    // be written to: a publish could arm a watcher alarm on a queue that is
+    // shutting down.
+    void shutdown();
+
+    const GrpcServerOptions& options() const { return options_; }
+
+private:
+    void poll(grpc::ServerCompletionQueue* cq);
+
+    GrpcServerOptions options_;
+    Metrics& metrics_;
+    std::unique_ptr<TableServiceImpl> handlers_;
+    TableAsyncService service_;
+    std::vector<std::unique_ptr<grpc::ServerCompletionQueue>> queues_;
+    std::unique_ptr<grpc::Server> server_;
+    std::unique_ptr<CallWorkers> imports_;
+    std::unique_ptr<CallWorkers> writes_;  // only with a write-ahead log
+    std::vector<std::thread> threads_;
+};
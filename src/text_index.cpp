@@ -0,0 +1,229 @@
+#include "text_index.h"
+
+#include <algorithm>
+#include <bit>
+#include <limits>
+#include <numeric>
+#include <span>
+
+namespace {
+
+static_assert(kSegmentRows <= 65536, "local rows are stored in 16 bits");
+
+constexpr char kStart = '\x02';
+constexpr char kEnd = '\x03';
+
+char foldByte(char c) {
+    return c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+std::uint32_t gramAt(std::string_view text, std::size_t i) {
+    return std::uint32_t{static_cast<unsigned char>(text[i])} << 16 |
+           std::uint32_t{static_cast<unsigned char>(text[i + 1])} << 8 |
+           std::uint32_t{static_cast<unsigned char>(text[i + 2])};
+}
+
+bool testRow(std::span<const std::uint64_t> words, std::size_t row) {
+    return (words[row / 64] >> (row % 64)) & 1;
+}
+
+// Sorts (gram << 32 | position) keys by gram, in two stable counting passes
+// over 12 bits each.
+void sortByGram(std::vector<std::uint64_t>& keys) {
+    std::vector<std::uint64_t> sorted(keys.size());
+    for (int shift : {32, 44}) {
+        std::array<std::uint32_t, 4097> starts{};
+        for (std::uint64_t key : keys) ++starts[((key >> shift) & 0xFFF) + 1];
+        std::partial_sum(starts.begin(), starts.end(), starts.begin());
+        for (std::uint64_t key : keys) sorted[starts[(key >> shift) & 0xFFF]++] = key;
+        keys.swap(sorted);
+    }
+}
+
+template <typename Emit>
+void forEachRow(std::span<const std::uint64_t> words, Emit&& emit) {
+    for (std::size_t word = 0; word < words.size(); ++word) {
+        for (std::uint64_t bits = words[word]; bits != 0; bits &= bits - 1) {
+            emit(static_cast<std::uint32_t>(word * 64 + std::countr_zero(bits)));
+        }
+    }
+}
+
+}  // namespace
+
+std::string foldCase(std::string_view text) {
+    std::string folded(text);
+    std::transform(folded.begin(), folded.end(), folded.begin(), foldByte);
+    return folded;
+}
+
+std::shared_ptr<const TextIndex::Postings> TextIndex::index(const ColumnSegment& segment) {
+    // Repeated values share a dictionary code, so the grams are worked out
+    // once per code: code_grams[first[c] .. first[c] + count[c]) are the
+    // distinct grams of code c, later replaced by their positions in grams.
+    constexpr std::uint32_t kUnseen = std::numeric_limits<std::uint32_t>::max();
+    std::vector<std::uint32_t> first(segment.dictionarySize(), kUnseen);
+    std::vector<std::uint32_t> count(segment.dictionarySize(), 0);
+    std::vector<std::uint32_t> code_grams;
+    std::string framed;
+    for (std::size_t row = 0; row < segment.size(); ++row) {
+        if (segment.isNull(row)) continue;
+        const std::uint32_t code = segment.code(row);
+        if (first[code] != kUnseen) continue;
+
+        framed.assign(1, kStart);
+        for (char c : segment.dictionaryEntry(code)) framed.push_back(foldByte(c));
+        framed.append(2, kEnd);
+        const auto begin = static_cast<std::uint32_t>(code_grams.size());
+        for (std::size_t i = 0; i + 3 <= framed.size(); ++i) code_grams.push_back(gramAt(framed, i));
+        std::sort(code_grams.begin() + begin, code_grams.end());
+        code_grams.erase(std::unique(code_grams.begin() + begin, code_grams.end()), code_grams.end());
+        first[code] = begin;
+        count[code] = static_cast<std::uint32_t>(code_grams.size()) - begin;
+    }
+
+    auto postings = std::make_shared<Postings>();
+    auto& grams = postings->grams;
+    std::vector<std::uint64_t> keys(code_grams.size());
+    for (std::size_t i = 0; i < code_grams.size(); ++i) keys[i] = std::uint64_t{code_grams[i]} << 32 | i;
+    sortByGram(keys);
+    for (std::uint64_t key : keys) {
+        const auto gram = static_cast<std::uint32_t>(key >> 32);
+        if (grams.empty() || grams.back() != gram) grams.push_back(gram);
+        code_grams[static_cast<std::uint32_t>(key)] = static_cast<std::uint32_t>(grams.size() - 1);
+    }
+    grams.shrink_to_fit();
+
+    // Counting sort by gram; rows go in ascending order, so each list ends
+    // up sorted.
+    auto& starts = postings->starts;
+    starts.assign(grams.size() + 1, 0);
+    for (std::size_t row = 0; row < segment.size(); ++row) {
+        if (segment.isNull(row)) continue;
+        const std::uint32_t code = segment.code(row);
+        for (std::uint32_t i = first[code]; i < first[code] + count[code]; ++i) ++starts[code_grams[i] + 1];
+    }
+    std::partial_sum(starts.begin(), starts.end(), starts.begin());
+    postings->rows.resize(starts.back());
+    std::vector<std::uint32_t> fill(starts.begin(), starts.end() - 1);
+    for (std::size_t row = 0; row < segment.size(); ++row) {
+        if (segment.isNull(row)) continue;
+        const std::uint32_t code = segment.code(row);
+        for (std::uint32_t i = first[code]; i < first[code] + count[code]; ++i) {
+            postings->rows[fill[code_grams[i]]++] = static_cast<std::uint16_t>(row);
+        }
+    }
+    return postings;
+}
+
+void TextIndex::build(const Column& column) {
+    segments_.clear();
+    segments_.reserve(column.size() / kSegmentRows);
+    for (std::size_t s = 0; s < column.size() / kSegmentRows; ++s) {
+        segments_.push_back({index(column.segment(s)), nullptr, 0});
+    }
+}
+
+void TextIndex::changed(const Column& column, std::size_t slot) {
+    const std::size_t s = slot / kSegmentRows;
+    if (s >= segments_.size()) return;  // not indexed: every row is a candidate
+    Segment& segment = segments_[s];
+    const std::size_t row = slot % kSegmentRows;
+    if (segment.stale && testRow(*segment.stale, row)) return;
+
+    if (segment.stale_count == kMaxStaleRows) {
+        segment = {index(column.segment(s)), nullptr, 0};
+        return;
+    }
+    // Same ownership argument as Column::mutableSegment.
+    if (!segment.stale) {
+        segment.stale = std::make_shared<StaleRows>();
+    } else if (segment.stale.use_count() != 1) {
+        segment.stale = std::make_shared<StaleRows>(*segment.stale);
+    }
+    (*segment.stale)[row / 64] |= std::uint64_t{1} << (row % 64);
+    ++segment.stale_count;
+}
+
+void TextIndex::candidates(const Column& column, std::string_view folded_query, bool prefix,
+                           std::vector<std::uint32_t>& slots) const {
+    std::string framed;
+    if (prefix) framed.push_back(kStart);
+    framed.append(folded_query);
+
+    // A query of three bytes or more needs every one of its grams. A shorter
+    // one needs any gram that starts with it: the keys in [low, high].
+    std::vector<std::uint32_t> grams;
+    for (std::size_t i = 0; i + 3 <= framed.size(); ++i) grams.push_back(gramAt(framed, i));
+    std::sort(grams.begin(), grams.end());
+    grams.erase(std::unique(grams.begin(), grams.end()), grams.end());
+    std::uint32_t low = 0;
+    std::uint32_t high = 0;
+    if (framed.size() < 3) {
+        for (std::size_t i = 0; i < 3; ++i) {
+            low = low << 8 | (i < framed.size() ? static_cast<unsigned char>(framed[i]) : 0);
+        }
+        high = low | (0xFFFFFFu >> (8 * framed.size()));
+    }
+
+    std::vector<std::span<const std::uint16_t>> lists;
+    std::vector<std::uint16_t> rows;
+    std::vector<std::uint16_t> next;
+    StaleRows found;
+    for (std::size_t s = 0; s < segments_.size(); ++s) {
+        const Postings& postings = *segments_[s].postings;
+        auto list = [&](std::size_t i) {
+            return std::span<const std::uint16_t>(postings.rows).subspan(postings.starts[i], postings.starts[i + 1] - postings.starts[i]);
+        };
+
+        rows.clear();
+        if (!grams.empty()) {
+            lists.clear();
+            for (std::uint32_t gram : grams) {
+                auto it = std::lower_bound(postings.grams.begin(), postings.grams.end(), gram);
+                if (it == postings.grams.end() || *it != gram) break;
+                lists.push_back(list(it - postings.grams.begin()));
+            }
+            if (lists.size() == grams.size()) {
+                // Shortest list first, so every intersection is as small as it gets.
+                std::sort(lists.begin(), lists.end(), [](auto a, auto b) { return a.size() < b.size(); });
+                rows.assign(lists.front().begin(), lists.front().end());
+                for (std::size_t i = 1; i < lists.size() && !rows.empty(); ++i) {
+                    next.clear();
+                    std::set_intersection(rows.begin(), rows.end(), lists[i].begin(), lists[i].end(), std::back_inserter(next));
+                    rows.swap(next);
+                }
+            }
+        } else {
+            found.fill(0);
+            const auto begin = std::lower_bound(postings.grams.begin(), postings.grams.end(), low);
+            const auto end = std::upper_bound(begin, postings.grams.end(), high);
+            for (auto it = begin; it != end; ++it) {
+                for (std::uint16_t row : list(it - postings.grams.begin())) found[row / 64] |= std::uint64_t{1} << (row % 64);
+            }
+            forEachRow(found, [&](std::uint32_t row) { rows.push_back(static_cast<std::uint16_t>(row)); });
+        }
+
+        const auto base = static_cast<std::uint32_t>(s * kSegmentRows);
+        const StaleRows* stale = segments_[s].stale.get();
+        for (std::uint16_t row : rows) {
+            if (!stale || !testRow(*stale, row)) slots.push_back(base + row);
+        }
+        if (stale) forEachRow(*stale, [&](std::uint32_t row) { slots.push_back(base + row); });
+    }
+
+    for (std::size_t slot = segments_.size() * kSegmentRows; slot < column.size(); ++slot) {
+        slots.push_back(static_cast<std::uint32_t>(slot));
+    }
+}
+
+std::size_t TextIndex::memoryUsage() const {
+    std::size_t total = sizeof(*this) + segments_.capacity() * sizeof(Segment);
+    for (const Segment& segment : segments_) {
+        const Postings& postings = *segment.postings;
+        total += sizeof(Postings) + postings.grams.capacity() * sizeof(std::uint32_t) +
+                 postings.starts.capacity() * sizeof(std::uint32_t) + postings.rows.capacity() * sizeof(std::uint16_t);
+        if (segment.stale) total += sizeof(StaleRows);
+    }
+    return total;
+}
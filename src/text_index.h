@@ -0,0 +1,65 @@
+#pragma once
+
+#include "column_store.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// ASCII lower case; other bytes, UTF-8 included, are kept as they are.
+std::string foldCase(std::string_view text);
+
+// Trigram index of a String column, for case-insensitive substring and
+// prefix search.
+//
+// Each value is folded and framed as "\x02" value "\x03\x03": a prefix query
+// is then a substring query for "\x02" query, and every byte of the value
+// starts a trigram, which is what queries under three bytes look up.
+//
+// Every full column segment has its own posting lists, gram -> local rows;
+// a new table version shares the lists of the segments it did not touch.
+// An edited row is marked stale in its segment instead of being re-indexed,
+// and stale rows are always candidates; once a segment has kMaxStaleRows of
+// them it is indexed again. Every row of the last, partly filled segment is
+// a candidate.
+//
+// Candidates are a superset of the matches: callers check each one against
+// the current value.
+class TextIndex {
+public:
+    static constexpr std::size_t kMaxStaleRows = 64;
+
+    // Indexes every full segment of column, from scratch.
+    void build(const Column& column);
+    // Row slot of column has a new value.
+    void changed(const Column& column, std::size_t slot);
+
+    // Appends the slots that may hold folded_query: anywhere in the value,
+    // or at its start for a prefix query. The query must not be empty.
+    void candidates(const Column& column, std::string_view folded_query, bool prefix,
+                    std::vector<std::uint32_t>& slots) const;
+
+    std::size_t memoryUsage() const;
+
+private:
+    struct Postings {
+        std::vector<std::uint32_t> grams;   // sorted
+        std::vector<std::uint32_t> starts;  // rows of grams[i] are rows[starts[i] .. starts[i + 1])
+        std::vector<std::uint16_t> rows;    // sorted within each gram
+    };
+    using StaleRows = std::array<std::uint64_t, kSegmentRows / 64>;
+
+    struct Segment {
+        std::shared_ptr<const Postings> postings;
+        std::shared_ptr<StaleRows> stale;  // null while no row is stale
+        std::uint32_t stale_count = 0;
+    };
+
+    static std::shared_ptr<const Postings> index(const ColumnSegment& segment);
+
+    std::vector<Segment> segments_;
+};
@@ -0,0 +1,111 @@
+#include "text_search.h"
+
+#include <algorithm>
+#include <optional>
+#include <string_view>
+#include <tuple>
+
+namespace {
+
+bool isWordByte(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+           static_cast<unsigned char>(c) >= 0x80;
+}
+
+// The best place folded_query occurs in value, if it does.
+std::optional<SearchMatch> classify(std::string_view value, std::string_view folded_query, bool prefix) {
+    if (value.size() < folded_query.size()) return std::nullopt;
+    const std::size_t last = prefix ? 0 : value.size() - folded_query.size();
+    std::optional<SearchMatch> best;
+    for (std::size_t at = 0; at <= last; ++at) {
+        bool equal = true;
+        for (std::size_t i = 0; i < folded_query.size() && equal; ++i) {
+            char c = value[at + i];
+            if (c >= 'A' && c <= 'Z') c = static_cast<char>(c - 'A' + 'a');
+            equal = c == folded_query[i];
+        }
+        if (!equal) continue;
+        if (at == 0) return value.size() == folded_query.size() ? SearchMatch::Exact : SearchMatch::Prefix;
+        if (!isWordByte(value[at - 1])) return SearchMatch::WordStart;
+        best = SearchMatch::Substring;
+    }
+    return best;
+}
+
+struct Match {
+    std::uint32_t slot;
+    std::uint32_t ordinal;
+    SearchMatch match;
+    std::uint32_t length;
+
+    auto rank() const { return std::tie(match, length, slot); }
+};
+
+}  // namespace
+
+SearchResult runSearch(const Table& table, const SearchSpec& spec) {
+    SearchResult result;
+    const std::string query = foldCase(spec.text);
+    if (query.empty()) {
+        result.error = "Search text must not be empty";
+        return result;
+    }
+    std::vector<std::size_t> ordinals = spec.ordinals;
+    if (ordinals.empty()) {
+        for (std::size_t ordinal = 0; ordinal < table.schema.size(); ++ordinal) {
+            if (table.schema[ordinal].type == ColumnType::String) ordinals.push_back(ordinal);
+        }
+    }
+    for (std::size_t ordinal : ordinals) {
+        if (table.schema[ordinal].type != ColumnType::String) {
+            result.error = "Column " + table.schema[ordinal].id + " is not a String column";
+            return result;
+        }
+    }
+    std::sort(ordinals.begin(), ordinals.end());
+    ordinals.erase(std::unique(ordinals.begin(), ordinals.end()), ordinals.end());
+
+    std::vector<Match> matches;
+    std::vector<std::uint32_t> candidates;
+    for (std::size_t ordinal : ordinals) {
+        const Column& column = table.columns[ordinal];
+        candidates.clear();
+        table.text_indexes[ordinal].candidates(column, query, spec.prefix, candidates);
+        for (std::uint32_t slot : candidates) {
+            const ColumnSegment& segment = column.segment(slot / kSegmentRows);
+            const std::size_t row = slot % kSegmentRows;
+            if (segment.isNull(row)) continue;
+            const std::string_view value = segment.string(row);
+            if (auto match = classify(value, query, spec.prefix)) {
+                matches.push_back({slot, static_cast<std::uint32_t>(ordinal), *match, static_cast<std::uint32_t>(value.size())});
+            }
+        }
+    }
+
+    // Keep each row's best match, then rank the rows.
+    std::sort(matches.begin(), matches.end(), [](const Match& a, const Match& b) {
+        return std::tie(a.slot, a.match, a.length) < std::tie(b.slot, b.match, b.length);
+    });
+    matches.erase(std::unique(matches.begin(), matches.end(), [](const Match& a, const Match& b) { return a.slot == b.slot; }),
+                  matches.end());
+    result.match_count = matches.size();
+
+    const std::size_t limit = std::min({spec.limit == 0 ? kDefaultSearchLimit : spec.limit, kMaxSearchLimit, matches.size()});
+    std::partial_sort(matches.begin(), matches.begin() + limit, matches.end(),
+                      [](const Match& a, const Match& b) { return a.rank() < b.rank(); });
+    result.hits.reserve(limit);
+    for (std::size_t i = 0; i < limit; ++i) {
+        result.hits.push_back({matches[i].slot, matches[i].ordinal, matches[i].match});
+    }
+    return result;
+}
+
+std::vector<std::uint32_t> ancestorSlots(const Table& table, std::uint32_t slot) {
+    std::vector<std::uint32_t> ancestors;
+    const auto& parents = table.index->parent_slots;
+    for (std::uint32_t node = parents[slot]; node != kNoSlot; node = parents[node]) {
+        ancestors.push_back(node);
+    }
+    std::reverse(ancestors.begin(), ancestors.end());
+    return ancestors;
+}
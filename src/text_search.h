@@ -0,0 +1,46 @@
+#pragma once
+
+#include "data_store.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+constexpr std::size_t kDefaultSearchLimit = 50;
+constexpr std::size_t kMaxSearchLimit = 1000;
+
+// How a value matched, best first.
+enum class SearchMatch : std::uint8_t {
+    Exact,      // the whole value
+    Prefix,     // the start of the value
+    WordStart,  // the start of a word: after a byte that is not a letter or digit
+    Substring,
+};
+
+struct SearchSpec {
+    std::string text;                   // matched case-insensitively (ASCII)
+    std::vector<std::size_t> ordinals;  // String columns to search; empty searches all of them
+    bool prefix = false;                // only match the start of values
+    std::size_t limit = 0;              // 0 selects kDefaultSearchLimit; capped at kMaxSearchLimit
+};
+
+// One hit per matching row, for its best match.
+struct SearchHit {
+    std::uint32_t slot;
+    std::uint32_t ordinal;  // the column with the best match
+    SearchMatch match;
+};
+
+struct SearchResult {
+    std::vector<SearchHit> hits;  // ranked: by match, then shorter value, then row slot
+    std::size_t match_count = 0;  // matching rows, before the limit
+    std::string error;
+};
+
+// Candidates come from the columns' text indexes and are checked against
+// the current values, so the result is exact whatever the index holds.
+SearchResult runSearch(const Table& table, const SearchSpec& spec);
+
+// The ancestors of a row, root first; empty for roots and orphans.
+std::vector<std::uint32_t> ancestorSlots(const Table& table, std::uint32_t slot);
@@ -0,0 +1,142 @@
+#include "tree_window.h"
+
+#include <algorithm>
+#include <numeric>
+#include <span>
+#include <tuple>
+
+namespace {
+
+// An expanded row that is shown and has children.
+struct OpenRow {
+    std::uint32_t parent;    // kNoSlot at the top level
+    std::uint32_t position;  // in the parent's child list, or in the top level
+    std::uint32_t slot;
+    std::uint32_t depth;
+    std::uint64_t extra;       // rows shown below it
+    std::uint64_t before = 0;  // extra of the open rows before it in the same list
+};
+
+// A list being walked and the position of the current row in it.
+struct Frame {
+    std::span<const std::uint32_t> list;
+    std::size_t position;
+};
+
+}  // namespace
+
+TreeWindow treeWindow(const Table& table, std::vector<std::uint32_t> expanded, std::size_t offset, std::size_t limit) {
+    const RowIndex& index = *table.index;
+    TreeWindow window;
+
+    // Orphans are top-level rows too. Child lists are in slot order, so the
+    // top level is as well.
+    std::vector<std::uint32_t> merged;
+    std::span<const std::uint32_t> top = index.roots;
+    if (!index.orphans.empty()) {
+        merged = index.roots;
+        for (const auto& [parent_id, slots] : index.orphans) {
+            merged.insert(merged.end(), slots.begin(), slots.end());
+        }
+        std::sort(merged.begin(), merged.end());
+        top = merged;
+    }
+    auto listOf = [&](std::uint32_t parent) {
+        return parent == kNoSlot ? top : std::span<const std::uint32_t>(table.children(parent));
+    };
+
+    std::sort(expanded.begin(), expanded.end());
+    expanded.erase(std::unique(expanded.begin(), expanded.end()), expanded.end());
+    auto isOpen = [&](std::uint32_t slot) {
+        return std::binary_search(expanded.begin(), expanded.end(), slot) && !table.children(slot).empty();
+    };
+
+    std::vector<OpenRow> open;
+    for (std::uint32_t slot : expanded) {
+        if (slot >= table.rowCount() || table.children(slot).empty()) continue;
+        std::uint32_t depth = 0;
+        std::uint32_t ancestor = index.parent_slots[slot];
+        while (ancestor != kNoSlot && std::binary_search(expanded.begin(), expanded.end(), ancestor)) {
+            ancestor = index.parent_slots[ancestor];
+            ++depth;
+        }
+        if (ancestor != kNoSlot) continue;  // under a collapsed row
+
+        const std::uint32_t parent = index.parent_slots[slot];
+        const auto siblings = listOf(parent);
+        const auto position = static_cast<std::uint32_t>(std::lower_bound(siblings.begin(), siblings.end(), slot) - siblings.begin());
+        open.push_back({parent, position, slot, depth, table.children(slot).size()});
+    }
+
+    // open is in slot order, as expanded was. Walk it deepest first, so each
+    // row's extra is complete before it is added to its parent's; the parent
+    // of an open row is open itself.
+    std::vector<std::size_t> by_depth(open.size());
+    std::iota(by_depth.begin(), by_depth.end(), std::size_t{0});
+    std::sort(by_depth.begin(), by_depth.end(), [&](std::size_t a, std::size_t b) { return open[a].depth > open[b].depth; });
+    for (std::size_t i : by_depth) {
+        const OpenRow& row = open[i];
+        if (row.parent == kNoSlot) continue;
+        auto parent = std::lower_bound(open.begin(), open.end(), row.parent,
+                                       [](const OpenRow& candidate, std::uint32_t slot) { return candidate.slot < slot; });
+        parent->extra += row.extra;
+    }
+
+    // Grouped by list, in list order, with running sums: the row at position
+    // p of a list is shown p + (extra of the open rows before it) rows after
+    // the list's first row.
+    std::sort(open.begin(), open.end(), [](const OpenRow& a, const OpenRow& b) {
+        return std::tie(a.parent, a.position) < std::tie(b.parent, b.position);
+    });
+    std::uint64_t running = 0;
+    for (std::size_t i = 0; i < open.size(); ++i) {
+        if (i == 0 || open[i - 1].parent != open[i].parent) running = 0;
+        open[i].before = running;
+        running += open[i].extra;
+        if (open[i].parent == kNoSlot) window.visible_count += open[i].extra;
+    }
+    window.visible_count += top.size();
+    if (offset >= window.visible_count) return window;
+
+    // Descend to the row shown at offset, keeping the path to it.
+    std::vector<Frame> frames;
+    std::uint32_t parent = kNoSlot;
+    std::uint64_t target = offset;
+    for (;;) {
+        const auto list = listOf(parent);
+        const auto [first, last] = std::equal_range(open.begin(), open.end(), OpenRow{parent, 0, 0, 0, 0},
+                                                    [](const OpenRow& a, const OpenRow& b) { return a.parent < b.parent; });
+        // The last open row of this list that is shown at or before target.
+        const auto next = std::upper_bound(first, last, target, [](std::uint64_t value, const OpenRow& row) {
+            return value < row.position + row.before;
+        });
+        if (next != first) {
+            const OpenRow& row = *std::prev(next);
+            const std::uint64_t start = row.position + row.before;
+            if (target <= start + row.extra) {
+                frames.push_back({list, row.position});
+                if (target == start) break;
+                target -= start + 1;
+                parent = row.slot;
+                continue;
+            }
+            target -= row.before + row.extra;
+        }
+        frames.push_back({list, static_cast<std::size_t>(target)});
+        break;
+    }
+
+    while ((limit == 0 || window.slots.size() < limit) && !frames.empty()) {
+        const std::uint32_t slot = frames.back().list[frames.back().position];
+        window.slots.push_back(slot);
+        window.depths.push_back(static_cast<std::uint32_t>(frames.size() - 1));
+        if (isOpen(slot)) {
+            frames.push_back({table.children(slot), 0});
+            continue;
+        }
+        while (!frames.empty() && ++frames.back().position == frames.back().list.size()) {
+            frames.pop_back();
+        }
+    }
+    return window;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include "data_store.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// One screen of a tree grid. Rows are shown depth-first in slot order, top
+// level first (rows without a parent in the table: roots and orphans); the
+// children of a row are shown when it is expanded and so are all of its
+// ancestors.
+struct TreeWindow {
+    std::vector<std::uint32_t> slots;   // the shown rows from the requested offset on
+    std::vector<std::uint32_t> depths;  // parallel to slots; 0 for the top level
+    std::size_t visible_count = 0;      // rows shown with the whole tree scrolled through
+};
+
+// Rows [offset, offset + limit) of the shown rows; limit 0 returns every
+// shown row from offset on. Nothing proportional to the table is walked:
+// a collapsed subtree counts as one row whatever its size, the visible row
+// count and the path to the first row follow from the expanded rows alone,
+// and those are located in their parents' child lists by binary search.
+// For e expanded slots a window costs about O(e (depth + log e) + limit
+// log e), plus one pass over the top level when the table has orphans.
+// Expanded slots that are hidden or have no children are ignored.
+TreeWindow treeWindow(const Table& table, std::vector<std::uint32_t> expanded, std::size_t offset, std::size_t limit);
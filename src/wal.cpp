@@ -0,0 +1,368 @@
+#include "wal.h"
+
+#include "binary_io.h"
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <charconv>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr std::size_t kFrameHeader = 2 * sizeof(std::uint32_t);
+
+constexpr std::array<std::uint32_t, 256> makeCrcTable() {
+    std::array<std::uint32_t, 256> table{};
+    for (std::uint32_t i = 0; i < 256; ++i) {
+        std::uint32_t crc = i;
+        for (int bit = 0; bit < 8; ++bit) {
+            crc = (crc >> 1) ^ (0x82f63b78u & (0u - (crc & 1u)));  // reflected Castagnoli polynomial
+        }
+        table[i] = crc;
+    }
+    return table;
+}
+
+std::uint32_t crc32c(std::string_view bytes) {
+    static constexpr auto kTable = makeCrcTable();
+    std::uint32_t crc = ~0u;
+    for (unsigned char byte : bytes) {
+        crc = kTable[(crc ^ byte) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+std::string segmentPath(const std::string& directory, std::uint64_t segment) {
+    // Zero-padded so that file names sort in segment order.
+    char name[32];
+    std::snprintf(name, sizeof(name), "wal-%020llu.log", static_cast<unsigned long long>(segment));
+    return directory + "/" + name;
+}
+
+std::string systemError(std::string_view what, const std::string& path) {
+    return std::string(what) + " " + path + ": " + std::strerror(errno);
+}
+
+// A payload is u8 kind, string table id, u64 version, then for Edits a u32
+// count and the edits, for PutTable the image name and for AlterSchema a
+// u32 count and the column definitions.
+bool decodeRecord(std::string_view payload, LogRecord& record) {
+    BinaryReader reader(payload);
+    std::uint32_t count = 0;
+    if (!reader.read(record.kind) || !reader.readString(record.table_id) || !reader.read(record.version)) return false;
+    record.edits.clear();
+    record.image.clear();
+    record.schema.clear();
+    switch (record.kind) {
+    case LogRecord::Kind::Edits:
+        if (!reader.read(count)) return false;
+        record.edits.resize(count);
+        for (CellEdit& edit : record.edits) {
+            if (!reader.readString(edit.row_id) || !reader.readString(edit.column_id) ||
+                !reader.readCellValue(edit.value)) {
+                return false;
+            }
+        }
+        break;
+    case LogRecord::Kind::PutTable:
+        if (!reader.readString(record.image)) return false;
+        break;
+    case LogRecord::Kind::DropTable:
+        break;
+    case LogRecord::Kind::AlterSchema:
+        if (!reader.read(count)) return false;
+        record.schema.resize(count);
+        for (ColumnDef& def : record.schema) {
+            if (!reader.readColumnDef(def)) return false;
+        }
+        break;
+    default:
+        return false;
+    }
+    return reader.remaining() == 0;
+}
+
+}  // namespace
+
+WriteAheadLog::WriteAheadLog(std::string directory, SyncPolicy sync)
+    : directory_(std::move(directory)),
+      sync_(sync) {}
+
+WriteAheadLog::~WriteAheadLog() {
+    if (syncer_.joinable()) {
+        syncer_.request_stop();
+        syncer_.join();
+    }
+    std::lock_guard io(io_mutex_);
+    std::unique_lock lock(mutex_);
+    if (!failed_) flushLocked(lock);
+    if (fd_ >= 0) {
+        ::fdatasync(fd_);
+        ::close(fd_);
+    }
+}
+
+std::unique_ptr<WriteAheadLog> WriteAheadLog::open(const std::string& directory,
+                                                   std::uint64_t segment,
+                                                   SyncPolicy sync,
+                                                   std::chrono::milliseconds sync_interval,
+                                                   std::string& error) {
+    std::unique_ptr<WriteAheadLog> log(new WriteAheadLog(directory, sync));
+    {
+        std::lock_guard io(log->io_mutex_);
+        if (!log->openSegment(segment, error)) return nullptr;
+    }
+    if (sync == SyncPolicy::Interval) {
+        log->syncer_ = std::jthread([raw = log.get(), sync_interval](std::stop_token stop) {
+            raw->runSyncer(stop, sync_interval);
+        });
+    }
+    return log;
+}
+
+bool WriteAheadLog::openSegment(std::uint64_t segment, std::string& error) {
+    const std::string path = segmentPath(directory_, segment);
+    const int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        error = systemError("Cannot create", path);
+        return false;
+    }
+    // Make the new directory entry durable too.
+    const int dir = ::open(directory_.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir >= 0) {
+        ::fsync(dir);
+        ::close(dir);
+    }
+    fd_ = fd;
+    segment_ = segment;
+    return true;
+}
+
+template <typename EncodeBody>
+WriteAheadLog::Ticket WriteAheadLog::appendEncoded(LogRecord::Kind kind,
+                                                   std::string_view table_id,
+                                                   std::uint64_t version,
+                                                   EncodeBody&& encode_body) {
+    std::lock_guard lock(mutex_);
+    // Encode in place after a placeholder frame header.
+    const std::size_t frame = buffer_.size();
+    buffer_.append(kFrameHeader, '\0');
+    putPod(buffer_, kind);
+    putString(buffer_, table_id);
+    putPod(buffer_, version);
+    encode_body(buffer_);
+
+    const std::string_view payload = std::string_view(buffer_).substr(frame + kFrameHeader);
+    const auto size = static_cast<std::uint32_t>(payload.size());
+    const std::uint32_t crc = crc32c(payload);
+    std::memcpy(buffer_.data() + frame, &size, sizeof(size));
+    std::memcpy(buffer_.data() + frame + sizeof(size), &crc, sizeof(crc));
+    return ++appended_;
+}
+
+WriteAheadLog::Ticket WriteAheadLog::append(std::string_view table_id,
+                                            std::uint64_t version,
+                                            const std::vector<CellEdit>& edits) {
+    return appendEncoded(LogRecord::Kind::Edits, table_id, version, [&](std::string& out) {
+        putPod(out, static_cast<std::uint32_t>(edits.size()));
+        for (const CellEdit& edit : edits) {
+            putString(out, edit.row_id);
+            putString(out, edit.column_id);
+            putCellValue(out, edit.value);
+        }
+    });
+}
+
+WriteAheadLog::Ticket WriteAheadLog::append(const LogRecord& record) {
+    if (record.kind == LogRecord::Kind::Edits) return append(record.table_id, record.version, record.edits);
+    return appendEncoded(record.kind, record.table_id, record.version, [&](std::string& out) {
+        switch (record.kind) {
+        case LogRecord::Kind::PutTable:
+            putString(out, record.image);
+            break;
+        case LogRecord::Kind::AlterSchema:
+            putPod(out, static_cast<std::uint32_t>(record.schema.size()));
+            for (const ColumnDef& def : record.schema) {
+                putColumnDef(out, def);
+            }
+            break;
+        default:
+            break;
+        }
+    });
+}
+
+bool WriteAheadLog::waitDurable(Ticket ticket) {
+    std::unique_lock lock(mutex_);
+    while (durable_ < ticket && !failed_) {
+        if (flushing_) {
+            flushed_.wait(lock);
+            continue;
+        }
+
+        // Become the leader. io_mutex_ ranks before mutex_.
+        flushing_ = true;
+        lock.unlock();
+        {
+            std::lock_guard io(io_mutex_);
+            lock.lock();
+            flushLocked(lock);
+        }
+        flushing_ = false;
+        flushed_.notify_all();
+    }
+    return durable_ >= ticket;
+}
+
+bool WriteAheadLog::flushLocked(std::unique_lock<std::mutex>& lock) {
+    if (buffer_.empty()) return !failed_;
+
+    std::string batch;
+    batch.swap(buffer_);
+    const Ticket last = appended_;
+    lock.unlock();
+    const bool ok = writeFully(fd_, batch) && (sync_ != SyncPolicy::Always || ::fdatasync(fd_) == 0);
+    const int write_error = ok ? 0 : errno;
+    lock.lock();
+
+    if (!ok) {
+        failed_ = true;
+        std::cerr << "Write-ahead log " << segmentPath(directory_, segment_) << ": " << std::strerror(write_error)
+                  << std::endl;
+    } else {
+        durable_ = last;
+        // Hand the allocation back for the next batch.
+        if (buffer_.empty()) {
+            batch.clear();
+            buffer_.swap(batch);
+        }
+    }
+    return ok;
+}
+
+void WriteAheadLog::runSyncer(std::stop_token stop, std::chrono::milliseconds interval) {
+    std::mutex mutex;
+    std::condition_variable_any wake;
+    std::unique_lock lock(mutex);
+    while (!wake.wait_for(lock, stop, interval, [] { return false; })) {
+        if (stop.stop_requested()) return;
+        std::lock_guard io(io_mutex_);
+        if (::fdatasync(fd_) != 0) {
+            std::lock_guard state(mutex_);
+            failed_ = true;
+            flushed_.notify_all();
+            return;
+        }
+    }
+}
+
+bool WriteAheadLog::failed() const {
+    std::lock_guard lock(mutex_);
+    return failed_;
+}
+
+std::uint64_t WriteAheadLog::appended() const {
+    std::lock_guard lock(mutex_);
+    return appended_;
+}
+
+std::optional<std::uint64_t> WriteAheadLog::rotate() {
+    std::lock_guard io(io_mutex_);
+    std::unique_lock lock(mutex_);
+    if (!flushLocked(lock)) return std::nullopt;
+    flushed_.notify_all();
+    lock.unlock();
+
+    std::string error;
+    if (::fdatasync(fd_) != 0 || ::close(std::exchange(fd_, -1)) != 0 || !openSegment(segment_ + 1, error)) {
+        lock.lock();
+        failed_ = true;
+        flushed_.notify_all();
+        return std::nullopt;
+    }
+    return segment_;
+}
+
+std::vector<std::uint64_t> WriteAheadLog::listSegments(const std::string& directory) {
+    std::vector<std::uint64_t> segments;
+    std::error_code ec;
+    for (const auto& entry : std::filesystem::directory_iterator(directory, ec)) {
+        const std::string name = entry.path().filename().string();
+        if (!name.starts_with("wal-") || !name.ends_with(".log")) continue;
+        const std::string_view digits = std::string_view(name).substr(4, name.size() - 8);
+        std::uint64_t segment = 0;
+        auto [end, parse_error] = std::from_chars(digits.data(), digits.data() + digits.size(), segment);
+        if (parse_error == std::errc{} && end == digits.data() + digits.size()) segments.push_back(segment);
+    }
+    std::sort(segments.begin(), segments.end());
+    return segments;
+}
+
+bool WriteAheadLog::replay(const std::string& directory,
+                           std::uint64_t segment,
+                           const std::function<void(const LogRecord&)>& apply,
+                           std::string& error) {
+    const std::string path = segmentPath(directory, segment);
+    const int fd = ::open(path.c_str(), O_RDWR | O_CLOEXEC);
+    struct stat info{};
+    if (fd < 0 || ::fstat(fd, &info) != 0) {
+        error = systemError("Cannot open", path);
+        if (fd >= 0) ::close(fd);
+        return false;
+    }
+
+    const auto size = static_cast<std::size_t>(info.st_size);
+    void* mapped = size ? ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0) : nullptr;
+    if (mapped == MAP_FAILED) {
+        error = systemError("Cannot map", path);
+        ::close(fd);
+        return false;
+    }
+
+    const std::string_view bytes(static_cast<const char*>(mapped), size);
+    BinaryReader reader(bytes);
+    std::size_t intact = 0;  // end of the last record that checked out
+    LogRecord record;
+    for (;;) {
+        std::uint32_t payload_size = 0;
+        std::uint32_t crc = 0;
+        std::string_view payload;
+        if (!reader.read(payload_size) || !reader.read(crc) || reader.remaining() < payload_size) break;
+        payload = bytes.substr(reader.position(), payload_size);
+        reader.skip(payload_size);
+        if (crc32c(payload) != crc || !decodeRecord(payload, record)) break;
+        apply(record);
+        intact = reader.position();
+    }
+    if (mapped) ::munmap(mapped, size);
+
+    if (intact < size) {
+        // A crash mid-write leaves a partial record at the end; drop it so
+        // that nothing is ever appended after garbage.
+        std::cerr << "Write-ahead log " << path << ": discarding " << size - intact << " bytes of torn tail" << std::endl;
+        if (::ftruncate(fd, static_cast<off_t>(intact)) != 0 || ::fsync(fd) != 0) {
+            error = systemError("Cannot truncate", path);
+            ::close(fd);
+            return false;
+        }
+    }
+    ::close(fd);
+    return true;
+}
+
+void WriteAheadLog::removeSegmentsBefore(const std::string& directory, std::uint64_t segment) {
+    for (std::uint64_t existing : listSegments(directory)) {
+        if (existing < segment) ::unlink(segmentPath(directory, existing).c_str());
+    }
+}
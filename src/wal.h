@@ -0,0 +1,119 @@
+#pragma once
+
+#include "data_store.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// One published change as stored in the log: a batch of cell edits, or a
+// change to the set of tables or to a table's schema.
+struct LogRecord {
+    enum class Kind : std::uint8_t {
+        Edits,
+        PutTable,     // the table in image replaces or adds table_id
+        DropTable,
+        AlterSchema,  // Table::alterSchema(schema)
+    };
+
+    Kind kind = Kind::Edits;
+    std::string table_id;
+    std::uint64_t version = 0;    // table version the change produced; the last one for DropTable
+    std::vector<CellEdit> edits;  // Edits
+    std::string image;            // PutTable: a one-table snapshot file in the log directory
+    std::vector<ColumnDef> schema;  // AlterSchema
+};
+
+// Append-only log of published updates, split into numbered segment files
+// (wal-<number>.log) so that a snapshot can delete the segments it covers.
+// Each record is framed as [u32 payload size][u32 CRC-32C][payload]; a record
+// torn by a crash fails its checksum and recovery truncates the segment there.
+//
+// Group commit: append() only copies the encoded record into a buffer. The
+// first writer to wait on it becomes the leader and writes everything
+// buffered so far with one write() (and, under SyncPolicy::Always, one
+// fdatasync()). Writers arriving meanwhile buffer behind it and are covered
+// by the next flush, so concurrent writers share each sync.
+class WriteAheadLog {
+public:
+    using Ticket = std::uint64_t;
+
+    WriteAheadLog(const WriteAheadLog&) = delete;
+    WriteAheadLog& operator=(const WriteAheadLog&) = delete;
+    ~WriteAheadLog();
+
+    // Creates segment `segment` in directory and logs into it.
+    static std::unique_ptr<WriteAheadLog> open(const std::string& directory,
+                                               std::uint64_t segment,
+                                               SyncPolicy sync,
+                                               std::chrono::milliseconds sync_interval,
+                                               std::string& error);
+
+    // Buffers a record; records reach the file in append order.
+    Ticket append(std::string_view table_id, std::uint64_t version, const std::vector<CellEdit>& edits);
+    Ticket append(const LogRecord& record);
+
+    // Blocks until the record is as durable as the sync policy promises.
+    // Returns false once a write or sync has failed; the log then rejects
+    // every later record too.
+    bool waitDurable(Ticket ticket);
+
+    bool failed() const;
+
+    // Records appended since the log was opened.
+    std::uint64_t appended() const;
+
+    // Syncs and closes the current segment and starts the next one.
+    // Returns the new segment's number, or nullopt when the log failed.
+    std::optional<std::uint64_t> rotate();
+
+    // Segment numbers present in directory, oldest first.
+    static std::vector<std::uint64_t> listSegments(const std::string& directory);
+
+    // Calls apply for each intact record of a segment, in order. A torn or
+    // corrupt tail is cut off the file. Returns false when the segment
+    // cannot be read.
+    static bool replay(const std::string& directory,
+                       std::uint64_t segment,
+                       const std::function<void(const LogRecord&)>& apply,
+                       std::string& error);
+
+    static void removeSegmentsBefore(const std::string& directory, std::uint64_t segment);
+
+private:
+    WriteAheadLog(std::string directory, SyncPolicy sync);
+
+    template <typename EncodeBody>
+    Ticket appendEncoded(LogRecord::Kind kind, std::string_view table_id, std::uint64_t version, EncodeBody&& encode_body);
+
+    // Caller holds io_mutex_.
+    bool openSegment(std::uint64_t segment, std::string& error);
+    bool flushLocked(std::unique_lock<std::mutex>& lock);
+    void runSyncer(std::stop_token stop, std::chrono::milliseconds interval);
+
+    const std::string directory_;
+    const SyncPolicy sync_;
+
+    std::mutex io_mutex_;  // held by whoever writes, syncs or swaps the file; taken before mutex_
+    int fd_ = -1;
+    std::uint64_t segment_ = 0;
+
+    mutable std::mutex mutex_;  // guards the fields below
+    std::condition_variable flushed_;
+    std::string buffer_;        // encoded records not yet written
+    Ticket appended_ = 0;       // tickets handed out
+    Ticket durable_ = 0;        // every ticket up to this one is durable
+    bool flushing_ = false;     // a leader is writing
+    bool failed_ = false;
+
+    std::jthread syncer_;  // SyncPolicy::Interval only; last member
+};
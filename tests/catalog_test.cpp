@@ -0,0 +1,297 @@
+// Catalog changes: versions of a table created again after a drop stay above
+// those of the dropped one, AlterSchema keeps the values of kept columns and
+// rejects type changes and a removed primary key, concurrent creates, drops,
+// schema changes, reads and writes across the catalog shards (run under
+// -DSANITIZE=thread), and a durable store that gets every catalog change
+// back from its log, with and without a checkpoint in between.
+
+#include "data_store.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+std::mutex output_mutex;
+std::atomic<int> failures{0};
+
+void fail(const std::string& message) {
+    std::lock_guard lock(output_mutex);
+    if (failures < 20) std::cerr << "FAIL: " << message << std::endl;
+    ++failures;
+}
+
+const ColumnDef kIdColumn{"id", "ID", ColumnType::String, 100, true, true, false, true};
+const ColumnDef kNoteColumn{"note", "Note", ColumnType::String, 200, false, false, true, false};
+const ColumnDef kQtyColumn{"qty", "Qty", ColumnType::Number, 80, false, false, true, false};
+const ColumnDef kFlagColumn{"flag", "Flag", ColumnType::Bool, 60, false, false, true, false};
+
+Table makeTable(const std::string& id) {
+    Table table;
+    table.id = id;
+    table.name = "Table " + id;
+    table.primary_key = "id";
+    table.setSchema({kIdColumn, kNoteColumn, kQtyColumn});
+    for (int row = 0; row < 3; ++row) {
+        const std::string row_id(1, static_cast<char>('a' + row));
+        table.appendRow(row_id, std::nullopt, {{"id", row_id}, {"note", "note " + row_id}, {"qty", row}});
+    }
+    return table;
+}
+
+CellValue cell(const Table& table, const std::string& row_id, const std::string& column_id) {
+    const auto row = table.findRow(row_id);
+    const auto ordinal = table.findColumnOrdinal(column_id);
+    if (!row || !ordinal) return nullptr;
+    return table.columns[*ordinal].get(*row);
+}
+
+void testRecreatedVersions() {
+    DataStore db;
+    std::string error;
+    if (db.createTable(makeTable("t"), error) != CatalogStatus::Ok) fail("createTable: " + error);
+    for (int i = 0; i < 5; ++i) {
+        if (!db.updateCell("t", "a", "qty", i + 10, error)) fail("updateCell: " + error);
+    }
+    const auto dropped = db.read("t").share();
+    if (db.dropTable("t", error) != CatalogStatus::Ok) fail("dropTable: " + error);
+    if (db.read("t")) fail("a dropped table is still readable by id");
+    if (cell(*dropped, "a", "qty") != CellValue(14)) fail("a view of the dropped table changed");
+
+    // Writers fail once the table is dropped.
+    if (db.updateCell("t", "a", "qty", 1, error) || error != "Table not found") fail("update of a dropped table: " + error);
+    if (db.dropTable("t", error) != CatalogStatus::NotFound) fail("a table was dropped twice");
+    if (db.alterSchema("t", {kIdColumn}, error) != CatalogStatus::NotFound) fail("a dropped table was altered");
+
+    if (db.createTable(makeTable("t"), error) != CatalogStatus::Ok) fail("createTable again: " + error);
+    if (db.createTable(makeTable("u"), error) != CatalogStatus::Ok) fail("createTable: " + error);
+    for (const char* id : {"t", "u"}) {
+        TableView view = db.read(id);
+        if (!view || view->version <= dropped->version) {
+            fail(std::string(id) + ": version not above the dropped table's " + std::to_string(dropped->version));
+        }
+    }
+    if (db.createTable(makeTable("t"), error) != CatalogStatus::AlreadyExists) fail("a table was created twice");
+    if (cell(*db.read("t"), "a", "qty") != CellValue(0)) fail("the table created again has the dropped table's values");
+}
+
+void testAlterSchema() {
+    DataStore db;
+    std::string error;
+    if (db.createTable(makeTable("t"), error) != CatalogStatus::Ok) fail("createTable: " + error);
+    if (!db.updateCell("t", "b", "note", std::string("edited"), error)) fail("updateCell: " + error);
+    const std::uint64_t before = db.read("t")->version;
+
+    // Reordered, one column added and one removed.
+    if (db.alterSchema("t", {kQtyColumn, kIdColumn, kFlagColumn}, error) != CatalogStatus::Ok) {
+        fail("alterSchema: " + error);
+        return;
+    }
+    TableView view = db.read("t");
+    if (view->version != before + 1) fail("alterSchema did not publish one version");
+    if (view->schema.size() != 3 || view->schema[2].id != "flag") fail("wrong schema after alterSchema");
+    for (int row = 0; row < 3; ++row) {
+        const std::string row_id(1, static_cast<char>('a' + row));
+        if (cell(*view, row_id, "qty") != CellValue(row) || cell(*view, row_id, "id") != CellValue(row_id)) {
+            fail("row " + row_id + " lost a kept value");
+        }
+        if (cell(*view, row_id, "flag") != CellValue(nullptr)) fail("an added column is not null");
+    }
+    if (!db.updateCell("t", "a", "flag", true, error)) fail("update of an added column: " + error);
+    if (db.updateCell("t", "a", "note", std::string("x"), error)) fail("a removed column was updated");
+
+    const std::uint64_t altered = db.read("t")->version;
+    ColumnDef retyped = kQtyColumn;
+    retyped.type = ColumnType::String;
+    if (db.alterSchema("t", {retyped, kIdColumn}, error) != CatalogStatus::Invalid ||
+        error.find("cannot change its type") == std::string::npos) {
+        fail("a type change was not rejected: " + error);
+    }
+    if (db.alterSchema("t", {kQtyColumn, kFlagColumn}, error) != CatalogStatus::Invalid ||
+        error.find("primary key") == std::string::npos) {
+        fail("removing the primary key was not rejected: " + error);
+    }
+    if (db.alterSchema("t", {kIdColumn, kIdColumn}, error) != CatalogStatus::Invalid) fail("a duplicate column was accepted");
+    if (db.read("t")->version != altered) fail("a rejected alterSchema published a version");
+    if (db.alterSchema("missing", {kIdColumn}, error) != CatalogStatus::NotFound) fail("a missing table was altered");
+}
+
+// Catalog threads drop, create again and alter their own tables while
+// writers update and readers read all of them. Versions a reader sees for
+// an id never go down, and writers only ever fail because the table is gone.
+void testConcurrentCatalog() {
+    constexpr int kTables = 16;
+    constexpr int kCatalogThreads = 2;
+    constexpr int kRounds = 1500;
+    DataStore db;
+    std::string error;
+    auto tableId = [](int i) { return "t" + std::to_string(i); };
+    for (int i = 0; i < kTables; ++i) {
+        if (db.createTable(makeTable(tableId(i)), error) != CatalogStatus::Ok) fail("createTable: " + error);
+    }
+    const std::size_t tables = db.listTables().size();
+
+    std::atomic<bool> running{true};
+    std::vector<std::thread> threads;
+    for (int c = 0; c < kCatalogThreads; ++c) {
+        threads.emplace_back([&, c] {
+            std::string error;
+            for (int round = 0; round < kRounds; ++round) {
+                const std::string id = tableId(c + kCatalogThreads * (round % (kTables / kCatalogThreads)));
+                switch (round % 3) {
+                case 0:
+                    if (db.dropTable(id, error) != CatalogStatus::Ok) fail("dropTable " + id + ": " + error);
+                    if (db.createTable(makeTable(id), error) != CatalogStatus::Ok) fail("createTable " + id + ": " + error);
+                    break;
+                case 1:
+                    if (db.alterSchema(id, {kIdColumn, kNoteColumn, kQtyColumn, kFlagColumn}, error) != CatalogStatus::Ok) {
+                        fail("alterSchema " + id + ": " + error);
+                    }
+                    break;
+                default:
+                    if (db.alterSchema(id, {kIdColumn, kNoteColumn, kQtyColumn}, error) != CatalogStatus::Ok) {
+                        fail("alterSchema " + id + ": " + error);
+                    }
+                    break;
+                }
+            }
+        });
+    }
+    std::vector<std::thread> workers;
+    for (int w = 0; w < 4; ++w) {
+        workers.emplace_back([&, w] {
+            std::string error;
+            for (int i = 0; running; ++i) {
+                const std::string id = tableId((w + i) % kTables);
+                if (!db.updateCell(id, "b", "qty", i, error) && error != "Table not found") {
+                    fail("update of " + id + " failed with: " + error);
+                }
+            }
+        });
+        workers.emplace_back([&] {
+            std::map<std::string, std::uint64_t> seen;
+            while (running) {
+                for (int i = 0; i < kTables; ++i) {
+                    const std::string id = tableId(i);
+                    TableView view = db.read(id);
+                    if (!view) continue;
+                    if (view->version < seen[id]) fail(id + ": version went down");
+                    seen[id] = view->version;
+                    if (view->rowCount() != 3 || !view->findRow("c")) fail(id + ": rows missing");
+                }
+                db.listTables();
+            }
+        });
+    }
+    for (std::thread& thread : threads) thread.join();
+    running = false;
+    for (std::thread& worker : workers) worker.join();
+    if (db.listTables().size() != tables) fail("tables went missing");
+}
+
+struct Captured {
+    std::uint64_t version = 0;
+    std::vector<std::string> columns;
+    std::vector<std::vector<CellValue>> cells;
+
+    bool operator==(const Captured&) const = default;
+};
+
+std::map<std::string, Captured> capture(const DataStore& db) {
+    std::map<std::string, Captured> tables;
+    for (const auto& [id, name] : db.listTables()) {
+        TableView view = db.read(id);
+        Captured& table = tables[id];
+        table.version = view->version;
+        for (const ColumnDef& def : view->schema) table.columns.push_back(def.id);
+        for (std::size_t slot = 0; slot < view->rowCount(); ++slot) {
+            auto& row = table.cells.emplace_back();
+            for (const Column& column : view->columns) row.push_back(column.get(slot));
+        }
+    }
+    return tables;
+}
+
+std::unique_ptr<DataStore> openStore(const std::string& directory) {
+    auto db = std::make_unique<DataStore>();
+    DurabilityOptions options;
+    options.directory = directory;
+    options.snapshot_interval = std::chrono::seconds(0);
+    std::string error;
+    if (!db->openDurable(options, error)) {
+        fail("openDurable: " + error);
+        return nullptr;
+    }
+    return db;
+}
+
+// Every catalog change of one session, replayed from the log on the next
+// start; with a checkpoint half-way, the rest is replayed over the snapshot.
+void testDurableRoundTrip(bool checkpoint) {
+    const auto path = std::filesystem::temp_directory_path() /
+                      (checkpoint ? "catalog_test.checkpoint" : "catalog_test.log");
+    std::filesystem::remove_all(path);
+    const std::string directory = path.string();
+    const std::string what = checkpoint ? "with a checkpoint" : "log only";
+    std::map<std::string, Captured> expected;
+    {
+        auto db = openStore(directory);
+        if (!db) return;
+        std::string error;
+        for (int i = 0; i < 20; ++i) {
+            if (db->createTable(makeTable("t" + std::to_string(i)), error) != CatalogStatus::Ok) fail("createTable: " + error);
+        }
+        for (int i = 0; i < 20; i += 3) {
+            if (db->dropTable("t" + std::to_string(i), error) != CatalogStatus::Ok) fail("dropTable: " + error);
+        }
+        if (checkpoint && !db->checkpoint(error)) fail("checkpoint: " + error);
+        for (int i : {1, 5, 10, 14, 19}) {
+            if (db->alterSchema("t" + std::to_string(i), {kIdColumn, kFlagColumn, kQtyColumn}, error) != CatalogStatus::Ok) {
+                fail("alterSchema: " + error);
+            }
+            if (!db->updateCell("t" + std::to_string(i), "c", "flag", true, error)) fail("updateCell: " + error);
+        }
+        // Dropped before the checkpoint, created again after it.
+        if (db->createTable(makeTable("t3"), error) != CatalogStatus::Ok) fail("createTable again: " + error);
+        if (!db->updateCell("t3", "a", "note", std::string("second life"), error)) fail("updateCell: " + error);
+        if (!db->putTable(makeTable("t2"), error)) fail("putTable: " + error);
+        if (db->dropTable("t4", error) != CatalogStatus::Ok) fail("dropTable: " + error);
+        expected = capture(*db);
+    }
+    {
+        auto db = openStore(directory);
+        if (!db) return;
+        if (capture(*db) != expected) fail(what + ": the catalog differs after recovery");
+        std::string error;
+        if (db->createTable(makeTable("t4"), error) != CatalogStatus::Ok) fail(what + ": createTable after recovery");
+        if (!db->checkpoint(error)) fail("checkpoint: " + error);
+        expected = capture(*db);
+    }
+    auto db = openStore(directory);
+    if (db && capture(*db) != expected) fail(what + ": the catalog differs after the last checkpoint");
+    std::filesystem::remove_all(path);
+}
+
+}  // namespace
+
+int main() {
+    testRecreatedVersions();
+    testAlterSchema();
+    testConcurrentCatalog();
+    testDurableRoundTrip(false);
+    testDurableRoundTrip(true);
+    if (failures != 0) return 1;
+    std::cout << "OK" << std::endl;
+    return 0;
+}
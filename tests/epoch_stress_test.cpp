@@ -0,0 +1,184 @@
+// Many readers pin table versions while writers publish new ones and a
+// third party creates and drops tables, so that versions and catalog maps
+// are retired through Epoch the whole time. Every version a reader sees
+// must be complete: the two cells each batch writes together always agree,
+// the root's roll-up matches its subtree, and versions never go backwards.
+// Once the writers stop, no batch may be missing.
+
+#include "data_store.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+constexpr std::size_t kRows = 10000;  // three column segments
+constexpr std::size_t kFanout = 10;
+constexpr int kWriters = 8;
+constexpr int kBatchesPerWriter = 400;
+constexpr std::size_t kFirstRow = 5;
+constexpr std::size_t kSecondRow = 9000;  // in another segment than kFirstRow
+constexpr std::size_t kKeptVersions = 8;  // per reader, to keep retired versions alive for a while
+const std::string kTableId = "stress";
+
+std::mutex output_mutex;
+std::atomic<int> failures{0};
+
+void fail(const std::string& message) {
+    std::lock_guard lock(output_mutex);
+    if (failures < 20) std::cerr << "FAIL: " << message << std::endl;
+    ++failures;
+}
+
+// A tree under row 0 with a String and a Number column.
+Table makeTable(const std::string& id, std::size_t rows) {
+    Table table;
+    table.id = id;
+    table.name = "Stress";
+    table.primary_key = "id";
+    table.parent_key = "parent";
+    table.setSchema({
+        {"id", "ID", ColumnType::String, 100, true, true, false, true},
+        {"label", "Label", ColumnType::String, 200, false, false, true, false},
+        {"amount", "Amount", ColumnType::Number, 80, false, false, true, false},
+    });
+    for (std::size_t row = 0; row < rows; ++row) {
+        const std::string row_id = std::to_string(row);
+        const auto parent = row == 0 ? std::nullopt : std::make_optional(std::to_string((row - 1) / kFanout));
+        table.appendRow(row_id, parent, {{"id", row_id}, {"label", "initial"}, {"amount", static_cast<int>(row % 100)}});
+    }
+    return table;
+}
+
+void checkVersion(const Table& table) {
+    if (table.rowCount() != kRows) {
+        fail("wrong row count " + std::to_string(table.rowCount()));
+        return;
+    }
+    const Column& label = table.columns[1];
+    if (label.get(kFirstRow) != label.get(kSecondRow)) {
+        fail("torn version " + std::to_string(table.version));
+    }
+    double total = 0.0;
+    const Column& amount = table.columns[2];
+    for (std::size_t row = 0; row < table.rowCount(); ++row) {
+        if (!amount.isNull(row)) total += amount.segment(row / kSegmentRows).number(row % kSegmentRows);
+    }
+    const Aggregate& rollup = table.rollup(0, 2);
+    if (rollup.sum != total || rollup.count != kRows) {
+        fail("root roll-up " + std::to_string(rollup.sum) + " != " + std::to_string(total) + " in version " +
+             std::to_string(table.version));
+    }
+}
+
+}  // namespace
+
+int main() {
+    DataStore db;
+    std::string error;
+    if (!db.putTable(makeTable(kTableId, kRows), error)) {
+        std::cerr << error << std::endl;
+        return 1;
+    }
+    const std::uint64_t first_version = db.read(kTableId)->version;
+
+    std::atomic<bool> writing{true};
+    std::vector<std::thread> threads;
+
+    const int readers = static_cast<int>(std::max(8u, 2 * std::thread::hardware_concurrency()));
+    std::atomic<std::size_t> reads{0};
+    for (int r = 0; r < readers; ++r) {
+        threads.emplace_back([&, r] {
+            std::uint64_t seen = 0;
+            std::deque<std::shared_ptr<const Table>> kept;
+            std::size_t n = 0;
+            for (bool last = false; !last;) {
+                last = !writing.load();  // one more read after the writers are done
+                {
+                    TableView view = db.read(kTableId);
+                    if (!view) {
+                        fail("table vanished");
+                        return;
+                    }
+                    if (view->version < seen) fail("version went backwards");
+                    seen = view->version;
+                    // A full check is slow next to a read; do one every few reads.
+                    if (++n % 8 == static_cast<std::size_t>(r % 8)) checkVersion(*view);
+                    if (n % 64 == 0) {
+                        kept.push_back(view.share());
+                        if (kept.size() > kKeptVersions) kept.pop_front();
+                    }
+                }
+                // Scratch tables come and go; a read sees one whole or none.
+                if (TableView scratch = db.read("scratch/" + std::to_string(n % 4))) {
+                    if (scratch->rowCount() != 100) fail("partial scratch table");
+                }
+            }
+            for (const auto& table : kept) checkVersion(*table);
+            reads += n;
+        });
+    }
+
+    std::vector<std::thread> writers;
+    for (int w = 0; w < kWriters; ++w) {
+        writers.emplace_back([&, w] {
+            std::mt19937 random(static_cast<unsigned>(w));
+            const std::string first_id = std::to_string(kFirstRow);
+            const std::string second_id = std::to_string(kSecondRow);
+            std::vector<std::string> errors;
+            for (int i = 0; i < kBatchesPerWriter; ++i) {
+                const std::string value = "writer " + std::to_string(w) + " batch " + std::to_string(i);
+                const std::vector<CellEdit> edits = {
+                    {first_id, "label", value},
+                    {second_id, "label", value},
+                    {std::to_string(random() % kRows), "amount", static_cast<int>(random() % 1000)},
+                };
+                if (!db.updateCells(kTableId, edits, errors)) {
+                    fail("update failed: " + errors.front());
+                    return;
+                }
+            }
+        });
+    }
+
+    std::thread catalog([&] {
+        std::string catalog_error;
+        const Table scratch = makeTable("scratch", 100);
+        for (int i = 0; writing.load(); ++i) {
+            Table table = scratch;
+            table.id = "scratch/" + std::to_string(i % 4);
+            if (i % 8 < 4) {
+                db.createTable(std::move(table), catalog_error);
+            } else {
+                db.dropTable(table.id, catalog_error);
+            }
+        }
+    });
+
+    for (std::thread& writer : writers) writer.join();
+    writing = false;
+    catalog.join();
+    for (std::thread& thread : threads) thread.join();
+
+    TableView final_view = db.read(kTableId);
+    const std::uint64_t expected = first_version + static_cast<std::uint64_t>(kWriters) * kBatchesPerWriter;
+    if (final_view->version != expected) {
+        fail("final version " + std::to_string(final_view->version) + ", expected " + std::to_string(expected));
+    }
+    checkVersion(*final_view);
+
+    if (failures != 0) return 1;
+    std::cout << readers << " readers made " << reads.load() << " reads; OK" << std::endl;
+    return 0;
+}
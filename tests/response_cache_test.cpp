@@ -0,0 +1,178 @@
+// Serves GetData bodies through the response cache while writers update the
+// table. A body must always be the one of the version it was asked for: an
+// update is never followed by the old bytes, an older pinned version never
+// evicts the newer entry, and the cache stays within its capacity.
+
+#include "data_store.h"
+#include "proto_convert.h"
+#include "response_cache.h"
+#include "table.pb.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+constexpr std::size_t kRows = 5000;  // two column segments
+constexpr std::size_t kWatchedRow = 4500;
+constexpr int kUpdates = 500;
+constexpr int kReaders = 4;
+
+std::mutex output_mutex;
+std::atomic<int> failures{0};
+
+void fail(const std::string& message) {
+    std::lock_guard lock(output_mutex);
+    if (failures < 20) std::cerr << "FAIL: " << message << std::endl;
+    ++failures;
+}
+
+Table makeTable(const std::string& id, std::size_t rows) {
+    Table table;
+    table.id = id;
+    table.name = "Cache test";
+    table.primary_key = "id";
+    table.setSchema({
+        {"id", "ID", ColumnType::String, 100, true, true, false, true},
+        {"label", "Label", ColumnType::String, 200, false, false, true, false},
+    });
+    for (std::size_t row = 0; row < rows; ++row) {
+        const std::string row_id = std::to_string(row);
+        table.appendRow(row_id, std::nullopt, {{"id", row_id}, {"label", "initial"}});
+    }
+    return table;
+}
+
+std::string labelOf(const Table& table, std::size_t row) {
+    return std::string(table.columns[1].segment(row / kSegmentRows).string(row % kSegmentRows));
+}
+
+// The body must decode to table's version and hold its label for the row.
+void checkBody(const std::string& body, const Table& table, std::size_t row) {
+    tables::GetDataResponse response;
+    if (!response.ParseFromString(body)) {
+        fail("body does not parse");
+        return;
+    }
+    if (response.version() != table.version) {
+        fail("body of version " + std::to_string(response.version()) + " served for version " +
+             std::to_string(table.version));
+        return;
+    }
+    if (response.rows_size() != static_cast<int>(table.rowCount())) {
+        fail("body has the wrong row count");
+        return;
+    }
+    const auto& cells = response.rows(static_cast<int>(row)).cells();
+    auto it = cells.find("label");
+    if (it == cells.end() || it->second.string_value() != labelOf(table, row)) {
+        fail("stale label in the body of version " + std::to_string(table.version));
+    }
+}
+
+ResponseCache::Payload getData(ResponseCache& cache, const Table& table, int* builds = nullptr) {
+    return cache.get(table, ResponseCache::Kind::ProtoData, [&] {
+        if (builds) ++*builds;
+        return serializeDataResponse(table);
+    });
+}
+
+void testVersions() {
+    DataStore db;
+    ResponseCache cache;
+    std::string error;
+    db.putTable(makeTable("t", kRows), error);
+    int builds = 0;
+
+    auto before = db.read("t").share();
+    checkBody(*getData(cache, *before, &builds), *before, kWatchedRow);
+    checkBody(*getData(cache, *before, &builds), *before, kWatchedRow);
+    if (builds != 1) fail("the same version was built twice");
+
+    if (!db.updateCell("t", std::to_string(kWatchedRow), "label", std::string("updated"), error)) fail(error);
+    auto after = db.read("t").share();
+    checkBody(*getData(cache, *after, &builds), *after, kWatchedRow);
+    if (builds != 2) fail("an update did not rebuild the body");
+
+    // A reader still on the old version misses, but must not push out the
+    // entry of the current one.
+    checkBody(*getData(cache, *before, &builds), *before, kWatchedRow);
+    checkBody(*getData(cache, *after, &builds), *after, kWatchedRow);
+    if (builds != 3) fail("an older version replaced the current entry");
+
+    cache.erase("t");
+    checkBody(*getData(cache, *after, &builds), *after, kWatchedRow);
+    if (builds != 4) fail("erase left the entry");
+}
+
+void testConcurrentUpdates() {
+    DataStore db;
+    ResponseCache cache;
+    std::string error;
+    db.putTable(makeTable("t", kRows), error);
+
+    std::atomic<bool> writing{true};
+    std::vector<std::thread> readers;
+    for (int i = 0; i < kReaders; ++i) {
+        readers.emplace_back([&] {
+            for (bool last = false; !last;) {
+                last = !writing.load();
+                TableView view = db.read("t");
+                checkBody(*getData(cache, *view), *view, kWatchedRow);
+            }
+        });
+    }
+    for (int i = 0; i < kUpdates; ++i) {
+        if (!db.updateCell("t", std::to_string(kWatchedRow), "label", "update " + std::to_string(i), error)) {
+            fail(error);
+            break;
+        }
+    }
+    writing = false;
+    for (std::thread& reader : readers) reader.join();
+}
+
+void testCapacity() {
+    DataStore db;
+    std::string error;
+    constexpr int kTables = 20;
+    for (int i = 0; i < kTables; ++i) db.putTable(makeTable("t" + std::to_string(i), 100), error);
+    const std::size_t body = serializeDataResponse(*db.read("t0")).size();
+
+    ResponseCache cache(body * 5);
+    for (int round = 0; round < 3; ++round) {
+        for (int i = 0; i < kTables; ++i) {
+            TableView view = db.read("t" + std::to_string(i));
+            checkBody(*getData(cache, *view), *view, 50);
+            const ResponseCache::Stats stats = cache.stats();
+            if (stats.bytes > cache.capacity()) fail("cache holds more than its capacity");
+        }
+    }
+    const ResponseCache::Stats stats = cache.stats();
+    if (stats.entries == 0 || stats.entries > 5) fail("unexpected entry count " + std::to_string(stats.entries));
+    if (stats.evictions == 0) fail("nothing was evicted");
+
+    // A body larger than the whole cache is served but not kept.
+    ResponseCache tiny(body / 2);
+    TableView view = db.read("t0");
+    checkBody(*getData(tiny, *view), *view, 50);
+    if (tiny.stats().entries != 0) fail("an oversized body was cached");
+}
+
+}  // namespace
+
+int main() {
+    testVersions();
+    testConcurrentUpdates();
+    testCapacity();
+    if (failures != 0) return 1;
+    std::cout << "OK" << std::endl;
+    return 0;
+}
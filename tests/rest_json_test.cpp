@@ -0,0 +1,108 @@
+// Golden bodies of the /schema, /data and /query routes. JsonWriter replaced
+// a document tree; these pin its output byte for byte: member order,
+// escaping of control characters and quotes, UTF-8 passed through, numbers
+// stored as integers written without a fraction, shortest round-trip
+// doubles, and nulls in every column type.
+
+#include "data_store.h"
+#include "json_writer.h"
+#include "query.h"
+#include "rest_json.h"
+
+#include <cstddef>
+#include <iostream>
+#include <limits>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace {
+
+int failures = 0;
+
+void expectEqual(std::string_view what, const std::string& actual, std::string_view expected) {
+    if (actual == expected) return;
+    std::size_t at = 0;
+    while (at < actual.size() && at < expected.size() && actual[at] == expected[at]) ++at;
+    std::cerr << "FAIL: " << what << " differs at byte " << at << "\n  actual:   " << actual
+              << "\n  expected: " << expected << std::endl;
+    ++failures;
+}
+
+Table makeTable() {
+    Table table;
+    table.id = "golden";
+    table.name = "Golden \"quoted\" table";
+    table.primary_key = "id";
+    table.parent_key = "parent";
+    table.setSchema({
+        {"id", "ID", ColumnType::String, 100, true, true, false, true},
+        {"parent", "Parent", ColumnType::String, 100, false, false, false, false},
+        {"name", "Name\tTab", ColumnType::String, 200, false, false, true, false},
+        {"qty", "Qty", ColumnType::Number, 80, false, false, true, false},
+        {"price", "Price", ColumnType::Currency, 90, false, true, true, false},
+        {"ok", "OK", ColumnType::Bool, 60, false, false, true, true},
+    });
+    table.appendRow("1", std::nullopt,
+                    {{"id", "1"}, {"name", "plain"}, {"qty", 42}, {"price", 19.99}, {"ok", true}});
+    table.appendRow("2", std::make_optional<std::string>("1"),
+                    {{"id", "2"}, {"parent", "1"}, {"name", "quote \" backslash \\ slash /"}, {"qty", -7},
+                     {"price", 5}, {"ok", false}});
+    table.appendRow("3", std::make_optional<std::string>("1"),
+                    {{"id", "3"}, {"parent", "1"}, {"name", std::string("ctl \x01\x1f\b\f\n\r\t\x7f end")},
+                     {"qty", 0.1}, {"price", 1e-7}});
+    table.appendRow("4", std::nullopt,
+                    {{"id", "4"}, {"name", "Zoë 東京 🚀"}, {"qty", 1e21}, {"price", -0.5}, {"ok", true}});
+    table.appendRow("5", std::make_optional<std::string>("4"),
+                    {{"id", "5"}, {"parent", "4"}, {"qty", std::numeric_limits<double>::infinity()}});
+    return table;
+}
+
+}  // namespace
+
+int main() {
+    Table table = makeTable();
+    std::string error;
+    if (!table.buildIndexes(error)) {
+        std::cerr << error << std::endl;
+        return 1;
+    }
+    table.version = 12;
+
+    expectEqual("/schema", buildSchemaJson(table),
+                R"({"tableId":"golden","name":"Golden \"quoted\" table","primaryKey":"id","parentKey":"parent","columns":[)"
+                R"({"id":"id","title":"ID","type":"string","width":100,"isTreeColumn":true,"isPinned":true,"isEditable":false,"isPrimary":true},)"
+                R"({"id":"parent","title":"Parent","type":"string","width":100,"isTreeColumn":false,"isPinned":false,"isEditable":false,"isPrimary":false},)"
+                R"({"id":"name","title":"Name\tTab","type":"string","width":200,"isTreeColumn":false,"isPinned":false,"isEditable":true,"isPrimary":false},)"
+                R"({"id":"qty","title":"Qty","type":"number","width":80,"isTreeColumn":false,"isPinned":false,"isEditable":true,"isPrimary":false},)"
+                R"({"id":"price","title":"Price","type":"currency","width":90,"isTreeColumn":false,"isPinned":true,"isEditable":true,"isPrimary":false},)"
+                R"({"id":"ok","title":"OK","type":"bool","width":60,"isTreeColumn":false,"isPinned":false,"isEditable":false,"isPrimary":true}]})");
+
+    // DEL and UTF-8 need no escaping and are passed through.
+    const std::string row1 = R"({"id":"1","parent":null,"name":"plain","qty":42,"price":19.99,"ok":true})";
+    const std::string row2 = R"({"id":"2","parent":"1","name":"quote \" backslash \\ slash /","qty":-7,"price":5,"ok":false})";
+    const std::string row3 = R"({"id":"3","parent":"1","name":"ctl \u0001\u001f\b\f\n\r\t)" "\x7f" R"( end","qty":0.1,"price":1e-07,"ok":null})";
+    const std::string row4 = R"({"id":"4","parent":null,"name":"Zoë 東京 🚀","qty":1e+21,"price":-0.5,"ok":true})";
+    const std::string row5 = R"({"id":"5","parent":"4","name":null,"qty":null,"price":null,"ok":null})";
+    expectEqual("/data", buildRowsJson(table), "[" + row1 + "," + row2 + "," + row3 + "," + row4 + "," + row5 + "]");
+    expectEqual("/data page", buildRowsJson(table, 1, 3), "[" + row2 + "," + row3 + "]");
+    expectEqual("/data past the end", buildRowsJson(table, 7, 9), "[]");
+
+    // qty < 10, largest first: row 1 is kept as the ancestor of both matches.
+    QuerySpec spec;
+    spec.predicates.push_back({3, PredicateOp::Lt, 10});
+    spec.sort.push_back({3, true});
+    const QueryResult result = runQuery(table, spec);
+    const std::vector<std::size_t> projection{2};
+    expectEqual("/query", buildQueryJson(table, result, projection),
+                R"({"version":12,"matchCount":2,"rowCount":3,"rows":[{"id":"1","parent":null,"name":"plain"},)"
+                R"({"id":"3","parent":"1","name":"ctl \u0001\u001f\b\f\n\r\t)" "\x7f" R"( end"},)"
+                R"({"id":"2","parent":"1","name":"quote \" backslash \\ slash /"}],"matched":[false,true,true]})");
+
+    expectEqual("error", jsonError("bad \"value\"\n"), R"({"error":"bad \"value\"\n"})");
+
+    if (failures != 0) return 1;
+    std::cout << "OK" << std::endl;
+    return 0;
+}
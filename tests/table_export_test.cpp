@@ -0,0 +1,222 @@
+// Maps exported tables from several reader threads while a writer keeps
+// updating them. Every version a reader maps must be complete: the two cells
+// each batch writes together always agree, versions never go backwards, and
+// the last version matches the store cell for cell.
+
+#include "data_store.h"
+#include "table_export.h"
+#include "table_export_reader.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <iostream>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include <unistd.h>
+
+namespace {
+
+constexpr std::size_t kRows = 10000;  // three column segments
+constexpr int kUpdates = 2000;
+constexpr int kReaders = 4;
+constexpr std::size_t kFirstRow = 5;
+constexpr std::size_t kSecondRow = 9000;  // in another segment than kFirstRow
+
+std::mutex output_mutex;
+std::atomic<int> failures{0};
+
+void fail(const std::string& message) {
+    std::lock_guard lock(output_mutex);
+    std::cerr << "FAIL: " << message << std::endl;
+    ++failures;
+}
+
+// Every column type, nulls in each of them and a tree spanning segments.
+Table makeTable() {
+    Table table;
+    table.id = "export/test";  // exercises the file name escaping
+    table.name = "Export test";
+    table.primary_key = "id";
+    table.parent_key = "parent";
+    table.setSchema({
+        {"id", "ID", ColumnType::String, 100, true, true, false, true},
+        {"label", "Label", ColumnType::String, 200, false, false, true, false},
+        {"count", "Count", ColumnType::Number, 80, false, false, true, false},
+        {"price", "Price", ColumnType::Currency, 80, false, false, true, false},
+        {"flag", "Flag", ColumnType::Bool, 60, false, false, true, false},
+    });
+    for (std::size_t row = 0; row < kRows; ++row) {
+        const std::string id = std::to_string(row);
+        std::vector<std::pair<std::string, CellValue>> cells = {{"id", id}};
+        // The rows each update batch writes start out equal, like every later version.
+        if (row == kFirstRow || row == kSecondRow) {
+            cells.emplace_back("label", "initial");
+        } else if (row % 7 != 0) {
+            cells.emplace_back("label", "row " + id);
+        }
+        if (row % 11 != 0) cells.emplace_back("count", static_cast<int>(row));
+        if (row % 13 != 0) cells.emplace_back("price", row * 0.25);
+        if (row % 17 != 0) cells.emplace_back("flag", row % 3 == 0);
+        const auto parent = row < 100 ? std::nullopt : std::make_optional(std::to_string(row / 100));
+        table.appendRow(id, parent, cells);
+    }
+    return table;
+}
+
+bool sameCell(const Column& column, std::size_t row, const MappedColumn& mapped) {
+    return column.visit(row, [&](auto value) {
+        using T = decltype(value);
+        if constexpr (std::is_same_v<T, std::nullptr_t>) {
+            return mapped.isNull(row);
+        } else if constexpr (std::is_same_v<T, std::string_view>) {
+            return !mapped.isNull(row) && mapped.string(row) == value;
+        } else if constexpr (std::is_same_v<T, int>) {
+            return !mapped.isNull(row) && mapped.isInt(row) && mapped.number(row) == value;
+        } else if constexpr (std::is_same_v<T, double>) {
+            return !mapped.isNull(row) && !mapped.isInt(row) && mapped.number(row) == value;
+        } else {
+            return !mapped.isNull(row) && mapped.boolean(row) == value;
+        }
+    });
+}
+
+void compareWithStore(const Table& table, const MappedTable& mapped) {
+    if (mapped.version() != table.version || mapped.rowCount() != table.rowCount() || mapped.id() != table.id ||
+        mapped.name() != table.name || mapped.parentKey() != table.parent_key ||
+        mapped.columns().size() != table.schema.size()) {
+        fail("table header differs from the store");
+        return;
+    }
+    for (std::size_t row = 0; row < table.rowCount(); ++row) {
+        if (mapped.rowId(row) != table.rowId(row) || mapped.parentId(row) != table.parentId(row)) {
+            fail("row id or parent id differs at row " + std::to_string(row));
+            return;
+        }
+    }
+    for (std::size_t ordinal = 0; ordinal < table.schema.size(); ++ordinal) {
+        const MappedColumn& column = mapped.columns()[ordinal];
+        if (column.id() != table.schema[ordinal].id || column.type() != static_cast<ExportType>(table.schema[ordinal].type)) {
+            fail("column " + table.schema[ordinal].id + " differs");
+            continue;
+        }
+        for (std::size_t row = 0; row < table.rowCount(); ++row) {
+            if (!sameCell(table.columns[ordinal], row, column)) {
+                fail("cell " + table.schema[ordinal].id + "/" + std::to_string(row) + " differs");
+                break;
+            }
+        }
+    }
+}
+
+void readUntil(const std::string& directory, const std::string& table_id, const std::atomic<std::uint64_t>& last) {
+    std::string error;
+    auto reader = TableExportReader::open(directory, table_id, error);
+    if (!reader) {
+        fail(error);
+        return;
+    }
+    std::uint64_t seen = 0;
+    std::size_t versions = 0;
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::minutes(1);
+    for (;;) {
+        if (std::chrono::steady_clock::now() > deadline) {
+            fail("the last version was never exported");
+            return;
+        }
+        auto table = reader->current(error);
+        if (!table) {
+            fail(error);
+            return;
+        }
+        if (table->version() < seen) fail("version went backwards");
+        if (table->version() != seen) ++versions;
+        seen = table->version();
+
+        const MappedColumn* label = table->findColumn("label");
+        if (!label || table->rowCount() != kRows) {
+            fail("mapped table has the wrong shape");
+            return;
+        }
+        if (label->string(kFirstRow) != label->string(kSecondRow)) {
+            fail("torn version " + std::to_string(seen) + ": " + std::string(label->string(kFirstRow)) + " vs " +
+                 std::string(label->string(kSecondRow)));
+        }
+        if (seen == last.load()) break;
+    }
+    std::lock_guard lock(output_mutex);
+    std::cout << "reader mapped " << versions << " versions" << std::endl;
+}
+
+}  // namespace
+
+int main() {
+    const std::string directory =
+        (std::filesystem::temp_directory_path() / ("table_export_test." + std::to_string(::getpid()))).string();
+    std::filesystem::remove_all(directory);
+
+    DataStore db;
+    std::string error;
+    Table source = makeTable();
+    const std::string table_id = source.id;
+    if (!db.putTable(std::move(source), error)) {
+        std::cerr << error << std::endl;
+        return 1;
+    }
+
+    {
+        std::optional<TableExporter> exporter;
+        exporter.emplace(db, TableExportOptions{directory, std::chrono::milliseconds(1)});
+        if (!exporter->start(error)) {
+            std::cerr << error << std::endl;
+            return 1;
+        }
+
+        std::atomic<std::uint64_t> last{UINT64_MAX};
+        std::vector<std::thread> readers;
+        for (int i = 0; i < kReaders; ++i) {
+            readers.emplace_back([&] { readUntil(directory, table_id, last); });
+        }
+
+        const std::string first_id = std::to_string(kFirstRow);
+        const std::string second_id = std::to_string(kSecondRow);
+        std::vector<std::string> errors;
+        for (int i = 0; i < kUpdates; ++i) {
+            const std::string value = "update " + std::to_string(i);
+            if (!db.updateCells(table_id, {{first_id, "label", value}, {second_id, "label", value}}, errors)) {
+                fail("update failed: " + errors.front());
+                break;
+            }
+        }
+        // The thread may not have caught up with the last update yet.
+        if (!exporter->exportChanged(error)) fail(error);
+        last = db.read(table_id)->version;
+        for (std::thread& reader : readers) reader.join();
+
+        auto reader = TableExportReader::open(directory, table_id, error);
+        auto mapped = reader ? reader->current(error) : nullptr;
+        if (!mapped) {
+            fail(error);
+        } else {
+            compareWithStore(*db.read(table_id), *mapped);
+            // Once the exporter is gone its heads say so, and existing
+            // mappings stay readable.
+            exporter.reset();
+            if (reader->headVersion() != kExportClosed) fail("head not closed on shutdown");
+            compareWithStore(*db.read(table_id), *mapped);
+        }
+    }
+
+    std::filesystem::remove_all(directory);
+    if (failures != 0) return 1;
+    std::cout << "OK" << std::endl;
+    return 0;
+}
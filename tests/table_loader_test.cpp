@@ -0,0 +1,234 @@
+// Loads the same rows from CSV, from NDJSON and through appendRow, and
+// expects the same table from all three: row and parent ids, cells of the
+// same type (a Number keeps integral values as ints, a Currency never does),
+// nulls where CSV fields are empty or JSON fields missing, and the same
+// tree. The large case is several megabytes, so the loader cuts it into
+// chunks in parallel, with quoted line breaks and column segments crossing
+// the cuts.
+
+#include "data_store.h"
+#include "table_loader.h"
+
+#include <cstddef>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace {
+
+int failures = 0;
+
+void fail(const std::string& message) {
+    if (failures < 20) std::cerr << "FAIL: " << message << std::endl;
+    ++failures;
+}
+
+Table emptyTable() {
+    Table table;
+    table.id = "loaded";
+    table.name = "Loader test";
+    table.primary_key = "id";
+    table.parent_key = "parent";
+    table.setSchema({
+        {"id", "ID", ColumnType::String, 100, true, true, false, true},
+        {"name", "Name", ColumnType::String, 200, false, false, true, false},
+        {"qty", "Qty", ColumnType::Number, 80, false, false, true, false},
+        {"price", "Price", ColumnType::Currency, 90, false, false, true, false},
+        {"ok", "OK", ColumnType::Bool, 60, false, false, true, false},
+    });
+    return table;
+}
+
+struct Row {
+    std::string id;
+    std::optional<std::string> parent;
+    CellValue name;
+    CellValue qty;
+    CellValue price;
+    CellValue ok;
+};
+
+Table appendRows(const std::vector<Row>& rows) {
+    Table table = emptyTable();
+    for (const Row& row : rows) {
+        if (!table.appendRow(row.id, row.parent,
+                             {{"id", row.id}, {"name", row.name}, {"qty", row.qty}, {"price", row.price}, {"ok", row.ok}})) {
+            fail("appendRow rejected row " + row.id);
+        }
+    }
+    std::string error;
+    if (!table.buildIndexes(error)) fail(error);
+    return table;
+}
+
+std::string describe(const CellValue& value) {
+    switch (value.index()) {
+    case 0: return "string \"" + std::get<std::string>(value) + "\"";
+    case 1: return "int " + std::to_string(std::get<int>(value));
+    case 2: return "double " + std::to_string(std::get<double>(value));
+    case 3: return std::get<bool>(value) ? "true" : "false";
+    default: return "null";
+    }
+}
+
+// CellValue equality also compares the alternative, so an int-tagged 3 and
+// a double 3.0 differ.
+void expectSameTable(const Table& loaded, const Table& expected, const std::string& what) {
+    if (loaded.rowCount() != expected.rowCount()) {
+        fail(what + ": " + std::to_string(loaded.rowCount()) + " rows, expected " + std::to_string(expected.rowCount()));
+        return;
+    }
+    for (std::size_t slot = 0; slot < expected.rowCount(); ++slot) {
+        const std::string row = what + " row " + std::to_string(slot);
+        if (loaded.rowId(slot) != expected.rowId(slot)) fail(row + ": id " + std::string(loaded.rowId(slot)));
+        if (loaded.parentId(slot) != expected.parentId(slot)) fail(row + ": wrong parent");
+        for (std::size_t ordinal = 0; ordinal < expected.schema.size(); ++ordinal) {
+            const CellValue actual = loaded.columns[ordinal].get(slot);
+            const CellValue wanted = expected.columns[ordinal].get(slot);
+            if (actual != wanted) {
+                fail(row + " " + expected.schema[ordinal].id + ": " + describe(actual) + ", expected " + describe(wanted));
+            }
+        }
+    }
+    if (loaded.index->parent_slots != expected.index->parent_slots) fail(what + ": different tree");
+    for (std::size_t root : expected.index->roots) {
+        for (std::size_t ordinal : {std::size_t{2}, std::size_t{3}}) {
+            const Aggregate& actual = loaded.rollup(root, ordinal);
+            const Aggregate& wanted = expected.rollup(root, ordinal);
+            if (actual.sum != wanted.sum || actual.count != wanted.count) fail(what + ": different roll-up");
+        }
+    }
+}
+
+Table load(ImportFormat format, std::string_view data, const std::string& what) {
+    Table table = emptyTable();
+    std::string error;
+    ImportStats stats;
+    if (!loadTable(table, format, data, error, &stats)) fail(what + ": " + error);
+    if (stats.rows != table.rowCount() || stats.bytes != data.size()) fail(what + ": wrong stats");
+    return table;
+}
+
+void testSmall() {
+    const std::vector<Row> rows = {
+        {"1", std::nullopt, "plain", 42, 19.99, true},
+        {"2", "1", "quoted, with comma", 2.5, 5.0, false},
+        {"3", "1", "line\nbreak and \"quotes\" é", 1000, -0.5, nullptr},
+        {"4", std::nullopt, "", 3, nullptr, true},
+        {"5", "4", nullptr, nullptr, 0.1, false},
+        {"6", "4", "crlf", -7, 1.0, true},
+    };
+    const Table expected = appendRows(rows);
+
+    // Empty unquoted fields are null, "" is the empty string; 1e3 and 3.0
+    // are integral and kept as ints in the Number column.
+    const std::string csv =
+        "\xEF\xBB\xBF"
+        "id,parent,name,qty,price,ok\n"
+        "1,,plain,42,19.99,true\n"
+        "2,1,\"quoted, with comma\",2.5,5,false\n"
+        "\n"
+        "3,1,\"line\nbreak and \"\"quotes\"\" é\",1e3,-0.5,\n"
+        "4,,\"\",3.0,,true\n"
+        "5,4,,,0.1,false\n"
+        "6,4,crlf,-7,1,true\r\n";
+    expectSameTable(load(ImportFormat::Csv, csv, "csv"), expected, "csv");
+
+    // Missing fields and explicit nulls are null; a numeric id keeps its text.
+    const std::string ndjson =
+        "{\"id\":\"1\",\"name\":\"plain\",\"qty\":42,\"price\":19.99,\"ok\":true}\n"
+        "{\"id\":\"2\",\"parent\":\"1\",\"name\":\"quoted, with comma\",\"qty\":2.5,\"price\":5,\"ok\":false}\n"
+        "\n"
+        "{\"parent\":\"1\",\"id\":\"3\",\"name\":\"line\\nbreak and \\\"quotes\\\" \\u00e9\",\"qty\":1e3,\"price\":-0.5}\n"
+        "{\"id\":\"4\",\"parent\":null,\"name\":\"\",\"qty\":3.0,\"ok\":true}\n"
+        "{ \"id\" : \"5\", \"parent\" : \"4\", \"name\" : null, \"price\" : 0.1, \"ok\" : false }\n"
+        "{\"id\":6,\"parent\":4,\"name\":\"crlf\",\"qty\":-7,\"price\":1,\"ok\":true}\r\n";
+    expectSameTable(load(ImportFormat::NdJson, ndjson, "ndjson"), expected, "ndjson");
+}
+
+std::string csvField(const CellValue& value) {
+    switch (value.index()) {
+    case 0: {
+        const std::string& text = std::get<std::string>(value);
+        std::string quoted = "\"";
+        for (char c : text) {
+            quoted += c;
+            if (c == '"') quoted += '"';
+        }
+        return quoted + "\"";
+    }
+    case 1: return std::to_string(std::get<int>(value));
+    case 2: return std::to_string(std::get<double>(value));
+    case 3: return std::get<bool>(value) ? "true" : "false";
+    default: return "";
+    }
+}
+
+std::string jsonField(const CellValue& value) {
+    if (value.index() != 0) {
+        const std::string text = csvField(value);
+        return text.empty() ? "null" : text;
+    }
+    std::string quoted = "\"";
+    for (char c : std::get<std::string>(value)) {
+        if (c == '\n') {
+            quoted += "\\n";
+        } else {
+            if (c == '"' || c == '\\') quoted += '\\';
+            quoted += c;
+        }
+    }
+    return quoted + "\"";
+}
+
+void testChunks() {
+    // About 6 MB of CSV and 10 MB of NDJSON: at least four chunks on any
+    // machine, cut wherever a record ends, mostly inside a column segment.
+    constexpr std::size_t kRows = 100000;
+    std::vector<Row> rows;
+    rows.reserve(kRows);
+    for (std::size_t i = 0; i < kRows; ++i) {
+        Row row;
+        row.id = "row-" + std::to_string(i);
+        if (i % 5 != 0) row.parent = "row-" + std::to_string(i / 5);
+        if (i % 7 == 0) {
+            row.name = nullptr;
+        } else if (i % 11 == 0) {
+            row.name = std::string();
+        } else if (i % 3 == 0) {
+            row.name = "multi\nline, \"quoted\" name " + std::to_string(i);
+        } else {
+            row.name = "name " + std::to_string(i);
+        }
+        row.qty = i % 4 == 0 ? CellValue(static_cast<double>(i) + 0.5) : CellValue(static_cast<int>(i));
+        if (i % 13 == 0) row.qty = nullptr;
+        row.price = static_cast<double>(i % 1000) * 0.25;
+        row.ok = i % 6 == 0 ? CellValue(nullptr) : CellValue(i % 2 == 0);
+        rows.push_back(std::move(row));
+    }
+    const Table expected = appendRows(rows);
+
+    std::string csv = "id,parent,name,qty,price,ok\n";
+    std::string ndjson;
+    for (const Row& row : rows) {
+        csv += row.id + "," + row.parent.value_or("") + "," + csvField(row.name) + "," + csvField(row.qty) + "," +
+               csvField(row.price) + "," + csvField(row.ok) + "\n";
+        ndjson += "{\"id\":\"" + row.id + "\",\"parent\":" + (row.parent ? "\"" + *row.parent + "\"" : "null") +
+                  ",\"name\":" + jsonField(row.name) + ",\"qty\":" + jsonField(row.qty) + ",\"price\":" + jsonField(row.price) +
+                  ",\"ok\":" + jsonField(row.ok) + "}\n";
+    }
+    expectSameTable(load(ImportFormat::Csv, csv, "chunked csv"), expected, "chunked csv");
+    expectSameTable(load(ImportFormat::NdJson, ndjson, "chunked ndjson"), expected, "chunked ndjson");
+}
+
+}  // namespace
+
+int main() {
+    testSmall();
+    testChunks();
+    if (failures != 0) return 1;
+    std::cout << "OK" << std::endl;
+    return 0;
+}
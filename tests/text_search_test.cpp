@@ -0,0 +1,239 @@
+// Searches through the trigram indexes must find exactly what a scan of
+// every row finds (the BM_SearchScan path: a table without text indexes).
+// Covers one- and two-byte queries, which rely on the framing, ASCII case
+// folding, edited rows that are only marked stale, a segment indexed again
+// after kMaxStaleRows edits, indexes shared with an older version that must
+// keep answering for its own values, and the ranking of hits.
+
+#include "data_store.h"
+#include "text_search.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+namespace {
+
+constexpr std::size_t kRows = 3 * kSegmentRows + 100;  // three full segments and a partial one
+
+int failures = 0;
+
+void fail(const std::string& message) {
+    if (failures < 20) std::cerr << "FAIL: " << message << std::endl;
+    ++failures;
+}
+
+std::string nameOf(std::size_t row) {
+    switch (row % 7) {
+    case 0: return "Item " + std::to_string(row);
+    case 1: return "item-" + std::to_string(row) + " ALPHA beta";
+    case 2: return "Zoë " + std::to_string(row % 100);
+    case 3: return std::string(1, static_cast<char>('a' + row % 26));
+    case 4: return "ab";
+    case 5: return "";
+    default: return "sub" + std::to_string(row) + "item";
+    }
+}
+
+Table makeTable() {
+    Table table;
+    table.id = "search";
+    table.name = "Search test";
+    table.primary_key = "id";
+    table.setSchema({
+        {"id", "ID", ColumnType::String, 100, true, true, false, true},
+        {"name", "Name", ColumnType::String, 200, false, false, true, false},
+        {"note", "Note", ColumnType::String, 200, false, false, true, false},
+        {"qty", "Qty", ColumnType::Number, 80, false, false, true, false},
+    });
+    for (std::size_t row = 0; row < kRows; ++row) {
+        const std::string id = "r" + std::to_string(row);
+        std::vector<std::pair<std::string, CellValue>> cells = {
+            {"id", id}, {"name", nameOf(row)}, {"qty", static_cast<int>(row)}};
+        if (row % 3 != 0) cells.emplace_back("note", row % 2 ? "Note for ITEM " + std::to_string(row) : "x");
+        table.appendRow(id, std::nullopt, cells);
+    }
+    return table;
+}
+
+SearchResult scan(const Table& table, const SearchSpec& spec) {
+    Table unindexed = table;
+    unindexed.text_indexes.assign(table.schema.size(), TextIndex{});
+    return runSearch(unindexed, spec);
+}
+
+std::string describe(const SearchSpec& spec) {
+    return std::string(spec.prefix ? "prefix" : "search") + " \"" + spec.text + "\"";
+}
+
+// Hits must be ranked by match, then shorter value, then row slot.
+void expectRanked(const Table& table, const SearchResult& result, const std::string& what) {
+    auto rank = [&](const SearchHit& hit) {
+        const std::size_t length =
+            table.columns[hit.ordinal].segment(hit.slot / kSegmentRows).string(hit.slot % kSegmentRows).size();
+        return std::tuple(hit.match, length, hit.slot);
+    };
+    for (std::size_t i = 1; i < result.hits.size(); ++i) {
+        if (!(rank(result.hits[i - 1]) < rank(result.hits[i]))) {
+            fail(what + ": hits " + std::to_string(i - 1) + " and " + std::to_string(i) + " are out of order");
+            return;
+        }
+    }
+}
+
+// Same matches, same hits in the same order as the scan.
+void expectAsScan(const Table& table, SearchSpec spec, const std::string& what) {
+    spec.limit = kMaxSearchLimit;
+    const SearchResult indexed = runSearch(table, spec);
+    const SearchResult scanned = scan(table, spec);
+    const std::string where = what + ": " + describe(spec);
+    if (!indexed.error.empty() || !scanned.error.empty()) {
+        fail(where + ": " + indexed.error + scanned.error);
+        return;
+    }
+    if (indexed.match_count != scanned.match_count) {
+        fail(where + ": " + std::to_string(indexed.match_count) + " matches, the scan finds " +
+             std::to_string(scanned.match_count));
+        return;
+    }
+    bool same = indexed.hits.size() == scanned.hits.size();
+    for (std::size_t i = 0; same && i < indexed.hits.size(); ++i) {
+        const SearchHit& a = indexed.hits[i];
+        const SearchHit& b = scanned.hits[i];
+        same = a.slot == b.slot && a.ordinal == b.ordinal && a.match == b.match;
+    }
+    if (!same) fail(where + ": hits differ from the scan");
+    expectRanked(table, indexed, where);
+}
+
+const std::vector<std::string> kQueries = {
+    "a", "B", "3", "ë", " ", "ab", "AB", "it", "m ", "1", "zo", "Zoë", "item", "ITEM 4", "item-1", "alpha b",
+    "note for", "r12", "sub1", "99item", "ab ", "nothing here", "x",
+};
+
+void expectAllAsScan(const Table& table, const std::string& what) {
+    for (const std::string& text : kQueries) {
+        for (bool prefix : {false, true}) {
+            SearchSpec spec;
+            spec.text = text;
+            spec.prefix = prefix;
+            expectAsScan(table, spec, what);
+        }
+    }
+    SearchSpec one_column;
+    one_column.text = "item";
+    one_column.ordinals = {2};
+    expectAsScan(table, one_column, what + " (note only)");
+}
+
+// Whether slot is among the hits of text.
+bool finds(const Table& table, const std::string& text, std::uint32_t slot) {
+    SearchSpec spec;
+    spec.text = text;
+    spec.limit = kMaxSearchLimit;
+    for (const SearchHit& hit : runSearch(table, spec).hits) {
+        if (hit.slot == slot) return true;
+    }
+    return false;
+}
+
+void testEdits() {
+    DataStore db;
+    std::string error;
+    if (!db.putTable(makeTable(), error)) {
+        fail("putTable: " + error);
+        return;
+    }
+    const auto original = db.read("search").share();
+    expectAllAsScan(*original, "built");
+
+    // One edit in a full segment: the row is only marked stale.
+    const std::uint32_t edited = kSegmentRows + 7;
+    const std::string old_value = nameOf(edited);
+    if (!db.updateCell("search", "r" + std::to_string(edited), "name", std::string("Quokka renamed"), error)) fail(error);
+    auto current = db.read("search").share();
+    if (!finds(*current, "quokka", edited) || !finds(*current, "renamed", edited)) fail("the new value is not found");
+    if (finds(*current, old_value, edited)) fail("the old value is still found");
+    if (!finds(*original, old_value, edited)) fail("the older version lost its value");
+    if (finds(*original, "quokka", edited)) fail("the older version finds the new value");
+    expectAllAsScan(*current, "one stale row");
+
+    // More than kMaxStaleRows edits in the same segment index it again; the
+    // values cover short and prefix queries too.
+    for (std::size_t i = 0; i <= TextIndex::kMaxStaleRows + 10; ++i) {
+        const std::size_t row = kSegmentRows + 100 + i * 13;
+        const std::string value = i % 2 ? "Quokka " + std::to_string(i) : "ab item " + std::to_string(i);
+        if (!db.updateCell("search", "r" + std::to_string(row), "name", value, error)) fail(error);
+        if (i == TextIndex::kMaxStaleRows / 2) expectAllAsScan(*db.read("search").share(), "half stale");
+    }
+    current = db.read("search").share();
+    expectAllAsScan(*current, "indexed again");
+    if (!finds(*current, "quokka", edited)) fail("a row edited before the segment was indexed again is lost");
+
+    // A value nulled and the edited rows of the partial segment.
+    if (!db.updateCell("search", "r5", "note", nullptr, error)) fail(error);
+    if (!db.updateCell("search", "r" + std::to_string(kRows - 1), "name", std::string("Quokka tail"), error)) fail(error);
+    expectAllAsScan(*db.read("search").share(), "nulled and tail");
+
+    // The first version still answers as it was built.
+    expectAllAsScan(*original, "original after edits");
+}
+
+void testRanking() {
+    Table table;
+    table.id = "rank";
+    table.name = "Ranking";
+    table.primary_key = "id";
+    table.setSchema({
+        {"id", "ID", ColumnType::String, 100, true, true, false, true},
+        {"name", "Name", ColumnType::String, 200, false, false, true, false},
+    });
+    const std::vector<std::string> names = {"concat", "the cat", "Catalog", "cat", "Cats", "CAT", "scatter cat", "dog"};
+    for (std::size_t row = 0; row < names.size(); ++row) {
+        const std::string id = "k" + std::to_string(row);
+        table.appendRow(id, std::nullopt, {{"id", id}, {"name", names[row]}});
+    }
+    table.buildTextIndexes();
+
+    SearchSpec spec;
+    spec.text = "Cat";
+    spec.ordinals = {1};
+    const SearchResult result = runSearch(table, spec);
+    // Exact by slot, then prefixes by length, then the word starts and the
+    // substring; "dog" does not match.
+    const std::vector<std::pair<std::uint32_t, SearchMatch>> expected = {
+        {3, SearchMatch::Exact},     {5, SearchMatch::Exact},     {4, SearchMatch::Prefix},
+        {2, SearchMatch::Prefix},    {1, SearchMatch::WordStart}, {6, SearchMatch::WordStart},
+        {0, SearchMatch::Substring},
+    };
+    if (result.match_count != expected.size() || result.hits.size() != expected.size()) {
+        fail("ranking: " + std::to_string(result.match_count) + " matches");
+        return;
+    }
+    for (std::size_t i = 0; i < expected.size(); ++i) {
+        if (result.hits[i].slot != expected[i].first || result.hits[i].match != expected[i].second) {
+            fail("ranking: hit " + std::to_string(i) + " is row " + std::to_string(result.hits[i].slot));
+        }
+    }
+
+    spec.limit = 2;
+    const SearchResult limited = runSearch(table, spec);
+    if (limited.match_count != expected.size() || limited.hits.size() != 2 || limited.hits[1].slot != 5) {
+        fail("ranking: the limit does not keep the best hits");
+    }
+}
+
+}  // namespace
+
+int main() {
+    testEdits();
+    testRanking();
+    if (failures != 0) return 1;
+    std::cout << "OK" << std::endl;
+    return 0;
+}
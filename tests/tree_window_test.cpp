@@ -0,0 +1,173 @@
+// Compares treeWindow with a depth-first walk of the whole tree on random
+// trees: rows appended out of tree order, orphans whose parent id is
+// missing, expanded rows under collapsed ancestors, leaves, duplicates and
+// slots past the end in the expanded list, and windows at every kind of
+// offset and limit, including offset >= visible_count and limit 0.
+
+#include "data_store.h"
+#include "tree_window.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <optional>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+int failures = 0;
+
+void fail(const std::string& message) {
+    if (failures < 20) std::cerr << "FAIL: " << message << std::endl;
+    ++failures;
+}
+
+// Row k of the logical tree has a parent below k, none, or a missing one;
+// the rows are appended in shuffled order so slots do not follow the tree.
+Table makeTree(std::size_t rows, std::mt19937& random) {
+    Table table;
+    table.id = "tree";
+    table.name = "Tree window test";
+    table.primary_key = "id";
+    table.parent_key = "parent";
+    table.setSchema({{"id", "ID", ColumnType::String, 100, true, true, false, true}});
+
+    std::vector<std::size_t> order(rows);
+    for (std::size_t k = 0; k < rows; ++k) order[k] = k;
+    std::shuffle(order.begin(), order.end(), random);
+    for (std::size_t k : order) {
+        const std::string id = "r" + std::to_string(k);
+        std::optional<std::string> parent;
+        const unsigned kind = random() % 10;
+        if (kind == 0) {
+            parent = "missing" + std::to_string(random() % 5);
+        } else if (kind > 2 && k > 0) {
+            // Mostly recent rows, so the tree gets deep as well as wide.
+            parent = "r" + std::to_string(k - 1 - random() % std::min<std::size_t>(k, kind < 6 ? 3 : k));
+        }
+        table.appendRow(id, parent, {{"id", id}});
+    }
+    std::string error;
+    if (!table.buildIndexes(error)) fail(error);
+    return table;
+}
+
+struct Shown {
+    std::vector<std::uint32_t> slots;
+    std::vector<std::uint32_t> depths;
+};
+
+// Every shown row, from the parent slots alone.
+Shown walkTree(const Table& table, const std::vector<std::uint32_t>& expanded) {
+    const std::size_t rows = table.rowCount();
+    std::vector<std::vector<std::uint32_t>> children(rows);
+    std::vector<std::uint32_t> top;
+    for (std::uint32_t slot = 0; slot < rows; ++slot) {
+        const std::uint32_t parent = table.index->parent_slots[slot];
+        (parent == kNoSlot ? top : children[parent]).push_back(slot);
+    }
+    std::vector<bool> open(rows, false);
+    for (std::uint32_t slot : expanded) {
+        if (slot < rows) open[slot] = true;
+    }
+
+    Shown shown;
+    auto walk = [&](auto& self, std::uint32_t slot, std::uint32_t depth) -> void {
+        shown.slots.push_back(slot);
+        shown.depths.push_back(depth);
+        if (!open[slot]) return;
+        for (std::uint32_t child : children[slot]) self(self, child, depth + 1);
+    };
+    for (std::uint32_t slot : top) walk(walk, slot, 0);
+    return shown;
+}
+
+void expectWindow(const Table& table, const std::vector<std::uint32_t>& expanded, const Shown& shown,
+                  std::size_t offset, std::size_t limit, const std::string& what) {
+    const TreeWindow window = treeWindow(table, expanded, offset, limit);
+    const std::string where = what + " offset " + std::to_string(offset) + " limit " + std::to_string(limit);
+    if (window.visible_count != shown.slots.size()) {
+        fail(where + ": visible_count " + std::to_string(window.visible_count) + ", expected " +
+             std::to_string(shown.slots.size()));
+        return;
+    }
+    const std::size_t begin = std::min(offset, shown.slots.size());
+    const std::size_t end = limit == 0 ? shown.slots.size() : std::min(shown.slots.size(), begin + limit);
+    const std::vector<std::uint32_t> slots(shown.slots.begin() + begin, shown.slots.begin() + end);
+    const std::vector<std::uint32_t> depths(shown.depths.begin() + begin, shown.depths.begin() + end);
+    if (window.slots != slots) fail(where + ": wrong rows");
+    if (window.depths != depths) fail(where + ": wrong depths");
+}
+
+void testRandomTrees() {
+    std::mt19937 random(20240611);
+    bool saw_orphans = false;
+    bool saw_hidden = false;
+    for (int round = 0; round < 200; ++round) {
+        const std::size_t rows = 1 + random() % (round < 100 ? 40 : 3000);
+        const Table table = makeTree(rows, random);
+        saw_orphans = saw_orphans || !table.index->orphans.empty();
+
+        // A random share of the rows expanded, plus leaves, duplicates and
+        // slots that do not exist.
+        std::vector<std::uint32_t> expanded;
+        const unsigned share = random() % 100;
+        for (std::uint32_t slot = 0; slot < rows; ++slot) {
+            if (random() % 100 < share) expanded.push_back(slot);
+        }
+        std::shuffle(expanded.begin(), expanded.end(), random);
+        if (!expanded.empty()) expanded.push_back(expanded.front());
+        expanded.push_back(static_cast<std::uint32_t>(rows + random() % 10));
+
+        const Shown shown = walkTree(table, expanded);
+        for (std::uint32_t slot : expanded) {
+            if (slot >= rows) continue;
+            for (std::uint32_t parent = table.index->parent_slots[slot]; parent != kNoSlot;
+                 parent = table.index->parent_slots[parent]) {
+                if (std::find(expanded.begin(), expanded.end(), parent) == expanded.end()) saw_hidden = true;
+            }
+        }
+
+        const std::string what = "round " + std::to_string(round);
+        const std::size_t visible = shown.slots.size();
+        std::vector<std::size_t> offsets = {0, visible - 1, visible, visible + 7};
+        for (int i = 0; i < 8; ++i) offsets.push_back(random() % visible);
+        for (std::size_t offset : offsets) {
+            for (std::size_t limit : {std::size_t{0}, std::size_t{1}, std::size_t{1 + random() % 50}, visible + 1}) {
+                expectWindow(table, expanded, shown, offset, limit, what);
+            }
+        }
+    }
+    if (!saw_orphans) fail("no tree had orphans");
+    if (!saw_hidden) fail("no expanded row was under a collapsed one");
+}
+
+// Everything expanded and nothing expanded, on one tree.
+void testAllAndNone() {
+    std::mt19937 random(7);
+    const Table table = makeTree(2000, random);
+    std::vector<std::uint32_t> all(table.rowCount());
+    for (std::uint32_t slot = 0; slot < all.size(); ++slot) all[slot] = slot;
+
+    const Shown everything = walkTree(table, all);
+    if (everything.slots.size() != table.rowCount()) fail("expanding every row does not show every row");
+    expectWindow(table, all, everything, 0, 0, "all expanded");
+    expectWindow(table, all, everything, 1234, 100, "all expanded");
+
+    const Shown top = walkTree(table, {});
+    expectWindow(table, {}, top, 0, 0, "none expanded");
+    expectWindow(table, {}, top, top.slots.size() - 1, 10, "none expanded");
+}
+
+}  // namespace
+
+int main() {
+    testRandomTrees();
+    testAllAndNone();
+    if (failures != 0) return 1;
+    std::cout << "OK" << std::endl;
+    return 0;
+}
@@ -0,0 +1,588 @@
+// Load generator for a running grpc_server. Drives either the gRPC
+// TableService or the REST routes over localhost with a mix of whole-table
+// reads and single-cell writes, and prints one JSON object with the
+// throughput and the latency percentiles.
+//
+// Closed loop: --concurrency workers each send their next request as soon
+// as the previous one is answered.
+// Open loop: requests are scheduled at --rate per second in total, spread
+// over the workers, and latency is measured from the scheduled send time,
+// so a stalled server shows up as latency instead of as fewer requests.
+
+#include "table.grpc.pb.h"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <random>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <grpcpp/grpcpp.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+enum class Protocol { Grpc, Rest };
+enum class Mode { Closed, Open };
+enum class ReadKind { Data, Schema };
+
+struct Options {
+    Protocol protocol = Protocol::Grpc;
+    Mode mode = Mode::Closed;
+    ReadKind read = ReadKind::Data;
+    std::string grpc_address = "localhost:50051";
+    std::string http_host = "localhost";
+    std::string http_port = "8083";
+    std::string table_id = "employees";
+    std::string column_id;  // empty: the first editable column
+    std::size_t concurrency = 4;
+    double rate = 1000.0;  // open loop only, requests per second over all workers
+    double write_ratio = 0.1;
+    std::chrono::duration<double> duration{10.0};
+    std::chrono::duration<double> warmup{1.0};
+};
+
+// Log-linear latency histogram in the manner of HdrHistogram: values below
+// 2^kSubBits nanoseconds get a bucket each, and every power of two above
+// that is split into 2^(kSubBits - 1) linear buckets, so a recorded value is
+// off by less than 1/64 of itself.
+class LatencyHistogram {
+public:
+    LatencyHistogram() : counts_((66 - kSubBits) << (kSubBits - 1), 0) {}
+
+    void record(std::uint64_t nanos) {
+        ++counts_[index(nanos)];
+        ++total_;
+        max_ = std::max(max_, nanos);
+    }
+
+    void merge(const LatencyHistogram& other) {
+        for (std::size_t i = 0; i < counts_.size(); ++i) counts_[i] += other.counts_[i];
+        total_ += other.total_;
+        max_ = std::max(max_, other.max_);
+    }
+
+    std::uint64_t count() const { return total_; }
+    std::uint64_t max() const { return max_; }
+
+    // The middle of the bucket holding the value at quantile q.
+    std::uint64_t percentile(double q) const {
+        if (total_ == 0) return 0;
+        const auto rank = static_cast<std::uint64_t>(std::max(1.0, q * static_cast<double>(total_) + 0.5));
+        std::uint64_t seen = 0;
+        for (std::size_t i = 0; i < counts_.size(); ++i) {
+            seen += counts_[i];
+            if (seen >= rank) return std::min(max_, (lowest(i) + lowest(i + 1)) / 2);
+        }
+        return max_;
+    }
+
+private:
+    static constexpr int kSubBits = 7;
+    static constexpr std::uint64_t kHalf = std::uint64_t{1} << (kSubBits - 1);
+
+    static std::size_t index(std::uint64_t value) {
+        if (value < (std::uint64_t{1} << kSubBits)) return static_cast<std::size_t>(value);
+        const int shift = std::bit_width(value) - kSubBits;
+        return static_cast<std::size_t>(shift * kHalf + (value >> shift));
+    }
+
+    static std::uint64_t lowest(std::size_t i) {
+        if (i < (std::size_t{1} << kSubBits)) return i;
+        const std::size_t shift = i / kHalf - 1;
+        return (i - shift * kHalf) << shift;
+    }
+
+    std::vector<std::uint64_t> counts_;
+    std::uint64_t total_ = 0;
+    std::uint64_t max_ = 0;
+};
+
+struct WorkerStats {
+    LatencyHistogram reads;
+    LatencyHistogram writes;
+    std::uint64_t errors = 0;
+    std::string last_error;
+};
+
+// Blocking HTTP/1.1 client over one keep-alive connection. Enough for the
+// server's own responses: a status line, headers and a Content-Length body.
+class HttpConnection {
+public:
+    HttpConnection(std::string host, std::string port) : host_(std::move(host)), port_(std::move(port)) {}
+    ~HttpConnection() { close(); }
+
+    HttpConnection(const HttpConnection&) = delete;
+    HttpConnection& operator=(const HttpConnection&) = delete;
+
+    // Returns the status code, or 0 with error set when the exchange failed.
+    // A dropped connection is reopened once.
+    int request(std::string_view method, std::string_view target, std::string_view body, std::string& error) {
+        std::string message;
+        message.reserve(128 + body.size());
+        message.append(method).append(" ").append(target).append(" HTTP/1.1\r\nHost: ").append(host_);
+        if (!body.empty()) {
+            message.append("\r\nContent-Type: application/json\r\nContent-Length: ").append(std::to_string(body.size()));
+        }
+        message.append("\r\n\r\n").append(body);
+
+        for (int attempt = 0; attempt < 2; ++attempt) {
+            if (fd_ < 0 && !connect(error)) return 0;
+            int status = 0;
+            if (sendAll(message) && (status = readResponse(error)) != 0) return status;
+            close();
+            if (error.empty()) error = "connection closed";
+        }
+        return 0;
+    }
+
+private:
+    bool connect(std::string& error) {
+        addrinfo hints{};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        addrinfo* found = nullptr;
+        if (const int rc = ::getaddrinfo(host_.c_str(), port_.c_str(), &hints, &found); rc != 0) {
+            error = std::string("getaddrinfo: ") + ::gai_strerror(rc);
+            return false;
+        }
+        for (addrinfo* ai = found; ai; ai = ai->ai_next) {
+            fd_ = ::socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+            if (fd_ < 0) continue;
+            if (::connect(fd_, ai->ai_addr, ai->ai_addrlen) == 0) break;
+            close();
+        }
+        ::freeaddrinfo(found);
+        if (fd_ < 0) {
+            error = "cannot connect to " + host_ + ":" + port_ + ": " + std::strerror(errno);
+            return false;
+        }
+        const int one = 1;
+        ::setsockopt(fd_, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        buffer_.clear();
+        return true;
+    }
+
+    void close() {
+        if (fd_ >= 0) ::close(fd_);
+        fd_ = -1;
+    }
+
+    bool sendAll(std::string_view data) {
+        while (!data.empty()) {
+            const ssize_t sent = ::send(fd_, data.data(), data.size(), MSG_NOSIGNAL);
+            if (sent < 0 && errno == EINTR) continue;
+            if (sent <= 0) return false;
+            data.remove_prefix(static_cast<std::size_t>(sent));
+        }
+        return true;
+    }
+
+    bool fill() {
+        char chunk[64 << 10];
+        for (;;) {
+            const ssize_t got = ::recv(fd_, chunk, sizeof(chunk), 0);
+            if (got < 0 && errno == EINTR) continue;
+            if (got <= 0) return false;
+            buffer_.append(chunk, static_cast<std::size_t>(got));
+            return true;
+        }
+    }
+
+    int readResponse(std::string& error) {
+        std::size_t header_end;
+        while ((header_end = buffer_.find("\r\n\r\n")) == std::string::npos) {
+            if (!fill()) return 0;
+        }
+        const std::string_view head(buffer_.data(), header_end);
+        int status = 0;
+        if (head.size() < 12 || std::sscanf(buffer_.c_str() + 9, "%3d", &status) != 1) {
+            error = "malformed status line";
+            return 0;
+        }
+
+        std::size_t length = 0;
+        for (std::size_t line = head.find("\r\n"); line != std::string_view::npos;) {
+            const std::size_t next = head.find("\r\n", line + 2);
+            const std::string_view field = head.substr(line + 2, next == std::string_view::npos ? next : next - line - 2);
+            constexpr std::string_view kLength = "content-length:";
+            if (field.size() > kLength.size() &&
+                std::equal(kLength.begin(), kLength.end(), field.begin(),
+                           [](char a, char b) { return a == (b | 0x20); })) {
+                length = std::strtoull(std::string(field.substr(kLength.size())).c_str(), nullptr, 10);
+            }
+            line = next;
+        }
+
+        const std::size_t total = header_end + 4 + length;
+        while (buffer_.size() < total) {
+            if (!fill()) return 0;
+        }
+        buffer_.erase(0, total);
+        return status;
+    }
+
+    std::string host_;
+    std::string port_;
+    int fd_ = -1;
+    std::string buffer_;  // bytes received past the last response
+};
+
+// What the writes edit: the table's row ids and one editable column.
+struct Target {
+    std::vector<std::string> row_ids;
+    std::string column_id;
+    tables::ColumnType type = tables::COLUMN_TYPE_STRING;
+};
+
+std::shared_ptr<grpc::Channel> makeChannel(const std::string& address, std::size_t worker) {
+    // A distinct argument per worker keeps gRPC from sharing one connection
+    // between all of them.
+    grpc::ChannelArguments args;
+    args.SetInt("load_generator.worker", static_cast<int>(worker));
+    return grpc::CreateCustomChannel(address, grpc::InsecureChannelCredentials(), args);
+}
+
+bool discover(const Options& options, Target& target, std::string& error) {
+    auto stub = tables::TableService::NewStub(makeChannel(options.grpc_address, 0));
+
+    tables::GetSchemaRequest schema_request;
+    schema_request.set_table_id(options.table_id);
+    tables::GetSchemaResponse schema;
+    grpc::ClientContext schema_context;
+    if (auto status = stub->GetSchema(&schema_context, schema_request, &schema); !status.ok()) {
+        error = "GetSchema: " + status.error_message();
+        return false;
+    }
+    for (const auto& column : schema.schema().columns()) {
+        const bool wanted = options.column_id.empty() ? column.is_editable() && !column.is_primary()
+                                                      : column.id() == options.column_id;
+        if (wanted) {
+            target.column_id = column.id();
+            target.type = column.type();
+            break;
+        }
+    }
+    if (target.column_id.empty()) {
+        error = options.column_id.empty() ? "table has no editable column" : "column not found: " + options.column_id;
+        return false;
+    }
+
+    tables::GetDataRequest data_request;
+    data_request.set_table_id(options.table_id);
+    tables::GetDataResponse data;
+    grpc::ClientContext data_context;
+    if (auto status = stub->GetData(&data_context, data_request, &data); !status.ok()) {
+        error = "GetData: " + status.error_message();
+        return false;
+    }
+    for (const auto& row : data.rows()) target.row_ids.push_back(row.id());
+    if (target.row_ids.empty()) {
+        error = "table has no rows";
+        return false;
+    }
+    return true;
+}
+
+std::string jsonString(std::string_view text) {
+    std::string out = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char escaped[8];
+            std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            out += escaped;
+        } else {
+            out += c;
+        }
+    }
+    return out + "\"";
+}
+
+// One worker's requests; every worker has its own connection.
+class Client {
+public:
+    Client(const Options& options, const Target& target, std::size_t worker)
+        : options_(options),
+          target_(target),
+          random_(static_cast<std::uint32_t>(worker) * 7919 + 1) {
+        if (options.protocol == Protocol::Grpc) {
+            stub_ = tables::TableService::NewStub(makeChannel(options.grpc_address, worker));
+        } else {
+            http_ = std::make_unique<HttpConnection>(options.http_host, options.http_port);
+        }
+    }
+
+    bool nextIsWrite() { return std::uniform_real_distribution<double>(0.0, 1.0)(random_) < options_.write_ratio; }
+
+    bool read(std::string& error) {
+        if (http_) {
+            const std::string target = "/api/table/" + options_.table_id +
+                                       (options_.read == ReadKind::Data ? "/data" : "/schema");
+            return expectOk(http_->request("GET", target, {}, error), error);
+        }
+        grpc::ClientContext context;
+        grpc::Status status;
+        if (options_.read == ReadKind::Data) {
+            tables::GetDataRequest request;
+            request.set_table_id(options_.table_id);
+            tables::GetDataResponse response;
+            status = stub_->GetData(&context, request, &response);
+        } else {
+            tables::GetSchemaRequest request;
+            request.set_table_id(options_.table_id);
+            tables::GetSchemaResponse response;
+            status = stub_->GetSchema(&context, request, &response);
+        }
+        return expectOk(status, error);
+    }
+
+    bool write(std::string& error) {
+        const std::string& row_id = target_.row_ids[random_() % target_.row_ids.size()];
+        const std::uint32_t n = random_() % 1000;
+        if (http_) {
+            std::string value;
+            switch (target_.type) {
+            case tables::COLUMN_TYPE_NUMBER:
+                value = std::to_string(n);
+                break;
+            case tables::COLUMN_TYPE_CURRENCY:
+                value = std::to_string(n) + ".5";
+                break;
+            case tables::COLUMN_TYPE_BOOL:
+                value = n & 1 ? "true" : "false";
+                break;
+            default:
+                value = jsonString("v" + std::to_string(n));
+                break;
+            }
+            const std::string body = "{\"row_id\":" + jsonString(row_id) + ",\"column_id\":" +
+                                     jsonString(target_.column_id) + ",\"value\":" + value + "}";
+            return expectOk(http_->request("POST", "/api/table/" + options_.table_id + "/update", body, error), error);
+        }
+
+        tables::UpdateCellRequest request;
+        request.set_table_id(options_.table_id);
+        request.set_row_id(row_id);
+        request.set_column_id(target_.column_id);
+        switch (target_.type) {
+        case tables::COLUMN_TYPE_NUMBER:
+            request.mutable_value()->set_int_value(n);
+            break;
+        case tables::COLUMN_TYPE_CURRENCY:
+            request.mutable_value()->set_double_value(n + 0.5);
+            break;
+        case tables::COLUMN_TYPE_BOOL:
+            request.mutable_value()->set_bool_value(n & 1);
+            break;
+        default:
+            request.mutable_value()->set_string_value("v" + std::to_string(n));
+            break;
+        }
+        tables::UpdateCellResponse response;
+        grpc::ClientContext context;
+        const grpc::Status status = stub_->UpdateCell(&context, request, &response);
+        if (status.ok() && !response.ok()) {
+            error = response.error_message();
+            return false;
+        }
+        return expectOk(status, error);
+    }
+
+private:
+    static bool expectOk(const grpc::Status& status, std::string& error) {
+        if (!status.ok()) error = status.error_message();
+        return status.ok();
+    }
+
+    static bool expectOk(int status, std::string& error) {
+        if (status == 0) return false;
+        if (status != 200) error = "HTTP " + std::to_string(status);
+        return status == 200;
+    }
+
+    const Options& options_;
+    const Target& target_;
+    std::mt19937 random_;
+    std::unique_ptr<tables::TableService::Stub> stub_;
+    std::unique_ptr<HttpConnection> http_;
+};
+
+std::uint64_t nanosSince(Clock::time_point start, Clock::time_point end) {
+    return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+}
+
+void runWorker(const Options& options, const Target& target, std::size_t worker, Clock::time_point start,
+               WorkerStats& stats) {
+    Client client(options, target, worker);
+    const auto measured_from = start + std::chrono::duration_cast<Clock::duration>(options.warmup);
+    const auto end = measured_from + std::chrono::duration_cast<Clock::duration>(options.duration);
+
+    // Open loop: worker w sends requests w, w + N, w + 2N, ... of one
+    // schedule at the total rate.
+    const auto interval = std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(static_cast<double>(options.concurrency) / options.rate));
+    auto scheduled = start + std::chrono::duration_cast<Clock::duration>(
+                                 std::chrono::duration<double>(static_cast<double>(worker) / options.rate));
+
+    std::string error;
+    for (;;) {
+        Clock::time_point sent;
+        if (options.mode == Mode::Open) {
+            if (scheduled >= end) break;
+            std::this_thread::sleep_until(scheduled);
+            sent = scheduled;
+            scheduled += interval;
+        } else {
+            sent = Clock::now();
+            if (sent >= end) break;
+        }
+
+        const bool is_write = client.nextIsWrite();
+        error.clear();
+        const bool ok = is_write ? client.write(error) : client.read(error);
+        const auto done = Clock::now();
+        if (sent < measured_from) continue;
+        if (!ok) {
+            ++stats.errors;
+            stats.last_error = error;
+            continue;
+        }
+        (is_write ? stats.writes : stats.reads).record(nanosSince(sent, done));
+    }
+}
+
+void writeLatencies(std::ostream& out, const char* name, const LatencyHistogram& histogram) {
+    auto micros = [](std::uint64_t nanos) { return static_cast<double>(nanos) / 1000.0; };
+    out << "\"" << name << "\":{\"count\":" << histogram.count() << ",\"p50_us\":" << micros(histogram.percentile(0.5))
+        << ",\"p99_us\":" << micros(histogram.percentile(0.99))
+        << ",\"p999_us\":" << micros(histogram.percentile(0.999)) << ",\"max_us\":" << micros(histogram.max()) << "}";
+}
+
+bool parseDouble(std::string_view text, double& out) {
+    const std::string value(text);
+    char* end = nullptr;
+    out = std::strtod(value.c_str(), &end);
+    return !value.empty() && *end == '\0';
+}
+
+bool parseOptions(int argc, char** argv, Options& options) {
+    for (int i = 1; i < argc; ++i) {
+        const std::string_view arg = argv[i];
+        const std::size_t eq = arg.find('=');
+        const std::string_view name = arg.substr(0, eq);
+        const std::string_view value = eq == std::string_view::npos ? std::string_view() : arg.substr(eq + 1);
+        double number = 0.0;
+
+        if (name == "--protocol" && (value == "grpc" || value == "rest")) {
+            options.protocol = value == "grpc" ? Protocol::Grpc : Protocol::Rest;
+        } else if (name == "--mode" && (value == "closed" || value == "open")) {
+            options.mode = value == "closed" ? Mode::Closed : Mode::Open;
+        } else if (name == "--read" && (value == "data" || value == "schema")) {
+            options.read = value == "data" ? ReadKind::Data : ReadKind::Schema;
+        } else if (name == "--grpc-address" && !value.empty()) {
+            options.grpc_address = value;
+        } else if (name == "--http-address" && value.rfind(':') != std::string_view::npos) {
+            options.http_host = value.substr(0, value.rfind(':'));
+            options.http_port = value.substr(value.rfind(':') + 1);
+        } else if (name == "--table" && !value.empty()) {
+            options.table_id = value;
+        } else if (name == "--column" && !value.empty()) {
+            options.column_id = value;
+        } else if (name == "--concurrency" && parseDouble(value, number) && number >= 1) {
+            options.concurrency = static_cast<std::size_t>(number);
+        } else if (name == "--rate" && parseDouble(value, number) && number > 0) {
+            options.rate = number;
+        } else if (name == "--write-ratio" && parseDouble(value, number) && number >= 0 && number <= 1) {
+            options.write_ratio = number;
+        } else if (name == "--duration-s" && parseDouble(value, number) && number > 0) {
+            options.duration = std::chrono::duration<double>(number);
+        } else if (name == "--warmup-s" && parseDouble(value, number) && number >= 0) {
+            options.warmup = std::chrono::duration<double>(number);
+        } else {
+            std::cerr << "Usage: " << argv[0]
+                      << " [--protocol=grpc|rest] [--mode=closed|open] [--concurrency=N] [--rate=REQ_PER_S]"
+                         " [--write-ratio=0..1] [--read=data|schema] [--duration-s=N] [--warmup-s=N]"
+                         " [--table=ID] [--column=ID] [--grpc-address=HOST:PORT] [--http-address=HOST:PORT]"
+                      << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) return 2;
+
+    // Row ids and the edited column come from the gRPC service in both
+    // protocols; the server answers both from the same tables.
+    Target target;
+    std::string error;
+    if (!discover(options, target, error)) {
+        std::cerr << error << std::endl;
+        return 1;
+    }
+
+    std::vector<WorkerStats> stats(options.concurrency);
+    const auto start = Clock::now() + std::chrono::milliseconds(10);
+    {
+        std::vector<std::jthread> workers;
+        for (std::size_t w = 0; w < options.concurrency; ++w) {
+            workers.emplace_back(runWorker, std::cref(options), std::cref(target), w, start, std::ref(stats[w]));
+        }
+    }
+
+    WorkerStats total;
+    for (const auto& worker : stats) {
+        total.reads.merge(worker.reads);
+        total.writes.merge(worker.writes);
+        total.errors += worker.errors;
+        if (!worker.last_error.empty()) total.last_error = worker.last_error;
+    }
+    LatencyHistogram all = total.reads;
+    all.merge(total.writes);
+
+    const double seconds = options.duration.count();
+    std::ostringstream out;
+    out << "{\"protocol\":\"" << (options.protocol == Protocol::Grpc ? "grpc" : "rest") << "\",\"mode\":\""
+        << (options.mode == Mode::Closed ? "closed" : "open") << "\",\"table\":" << jsonString(options.table_id)
+        << ",\"read\":\"" << (options.read == ReadKind::Data ? "data" : "schema") << "\",\"concurrency\":"
+        << options.concurrency << ",\"target_rate\":" << (options.mode == Mode::Open ? options.rate : 0.0)
+        << ",\"write_ratio\":" << options.write_ratio << ",\"duration_s\":" << seconds
+        << ",\"requests\":" << all.count() << ",\"errors\":" << total.errors
+        << ",\"throughput_rps\":" << static_cast<double>(all.count()) / seconds << ",";
+    writeLatencies(out, "all", all);
+    out << ",";
+    writeLatencies(out, "reads", total.reads);
+    out << ",";
+    writeLatencies(out, "writes", total.writes);
+    if (!total.last_error.empty()) out << ",\"last_error\":" << jsonString(total.last_error);
+    out << "}";
+    std::cout << out.str() << std::endl;
+    return total.errors ? 1 : 0;
+}